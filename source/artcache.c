@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h> // For off_t
+
+#include "artcache.h"
+
+#define ARTCACHE_MIN_SLOTS 1024
+
+static void resetSlots(ArtCache *cache) {
+    free(cache->slots);
+    cache->slots = NULL;
+    cache->slotCount = 0;
+    cache->used = 0;
+    cache->thumbCount = 0;
+}
+
+// Reads art.idx into `cache`; false if it is missing or doesn't validate.
+static bool loadIndex(ArtCache *cache, const char *indexPath) {
+    FILE *f = fopen(indexPath, "rb");
+    if (!f) return false;
+
+    ArtCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == ARTCACHE_MAGIC &&
+              header.version == ARTCACHE_VERSION && header.slotCount >= ARTCACHE_MIN_SLOTS &&
+              (header.slotCount & (header.slotCount - 1)) == 0 && header.used < header.slotCount;
+    if (ok) {
+        cache->slots = (ArtCacheSlot*)malloc((size_t)header.slotCount * sizeof(ArtCacheSlot));
+        ok = cache->slots &&
+             fread(cache->slots, sizeof(ArtCacheSlot), header.slotCount, f) == header.slotCount;
+    }
+    fclose(f);
+    if (!ok) {
+        resetSlots(cache);
+        return false;
+    }
+    cache->slotCount = header.slotCount;
+    cache->used = header.used;
+    cache->thumbCount = header.thumbCount;
+    return true;
+}
+
+bool artCacheOpen(ArtCache *cache, const char *indexPath, const char *thumbPath) {
+    memset(cache, 0, sizeof(*cache));
+    snprintf(cache->indexPath, sizeof(cache->indexPath), "%s", indexPath);
+
+    bool haveIndex = loadIndex(cache, indexPath);
+    cache->thumbs = haveIndex ? fopen(thumbPath, "r+b") : NULL;
+    if (cache->thumbs) {
+        // Thumbnails appended after the last flush have no slots; write over them
+        fseeko(cache->thumbs, 0, SEEK_END);
+        off_t size = ftello(cache->thumbs);
+        if (size < 0 || (uint64_t)size < (uint64_t)cache->thumbCount * ART_THUMB_BYTES) {
+            fclose(cache->thumbs);
+            cache->thumbs = NULL;
+        }
+    }
+    if (!cache->thumbs) {
+        // Start over: no slot may refer to a thumbnail that isn't there
+        resetSlots(cache);
+        cache->thumbs = fopen(thumbPath, "w+b");
+        if (!cache->thumbs) {
+            perror("fopen failed for art cache");
+            return false;
+        }
+        cache->dirty = true;
+    }
+    if (!cache->slots) {
+        cache->slots = (ArtCacheSlot*)calloc(ARTCACHE_MIN_SLOTS, sizeof(ArtCacheSlot));
+        if (!cache->slots) {
+            perror("calloc failed for art cache");
+            fclose(cache->thumbs);
+            cache->thumbs = NULL;
+            return false;
+        }
+        cache->slotCount = ARTCACHE_MIN_SLOTS;
+    }
+    return true;
+}
+
+void artCacheClose(ArtCache *cache) {
+    artCacheFlush(cache);
+    if (cache->thumbs) fclose(cache->thumbs);
+    free(cache->slots);
+    free(cache->sessionSlots);
+    memset(cache, 0, sizeof(*cache));
+}
+
+bool artCacheFlush(ArtCache *cache) {
+    if (!cache->dirty || !cache->slots) return true;
+    // Slots must never point past what art.bin holds on disk
+    if (cache->thumbs) fflush(cache->thumbs);
+
+    char tmpPath[PATH_MAX + 4];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", cache->indexPath);
+    FILE *f = fopen(tmpPath, "wb");
+    if (!f) {
+        perror("fopen failed for art cache index");
+        return false;
+    }
+    ArtCacheHeader header = { ARTCACHE_MAGIC, ARTCACHE_VERSION, cache->slotCount, cache->used,
+                              cache->thumbCount, 0 };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(cache->slots, sizeof(ArtCacheSlot), cache->slotCount, f) == cache->slotCount;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) {
+        remove(tmpPath);
+        return false;
+    }
+    // sdmc rename() does not overwrite an existing file
+    remove(cache->indexPath);
+    if (rename(tmpPath, cache->indexPath) != 0) return false;
+    cache->dirty = false;
+    return true;
+}
+
+uint64_t artCacheKey(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash ? hash : 1;
+}
+
+// Slot holding `key`, or the empty slot where it would go.
+static ArtCacheSlot* probe(ArtCacheSlot *slots, uint32_t slotCount, uint64_t key) {
+    uint32_t mask = slotCount - 1;
+    uint32_t i = (uint32_t)(key ^ (key >> 32)) & mask;
+    while (slots[i].key != 0 && slots[i].key != key) i = (i + 1) & mask;
+    return &slots[i];
+}
+
+bool artCacheLookup(const ArtCache *cache, uint64_t key, uint32_t *thumb) {
+    const ArtCacheSlot *slot = probe(cache->slots, cache->slotCount, key);
+    if (slot->key == 0 && cache->sessionSlots) slot = probe(cache->sessionSlots, cache->sessionSlotCount, key);
+    if (slot->key == 0) return false;
+    *thumb = slot->thumb;
+    return true;
+}
+
+// Doubles a table, or allocates it at the minimum size if it has none yet.
+static bool grow(ArtCacheSlot **slots, uint32_t *slotCount) {
+    uint32_t newCount = *slots ? *slotCount * 2 : ARTCACHE_MIN_SLOTS;
+    ArtCacheSlot *grown = (ArtCacheSlot*)calloc(newCount, sizeof(ArtCacheSlot));
+    if (!grown) {
+        perror("calloc failed for art cache");
+        return false;
+    }
+    for (uint32_t i = 0; *slots && i < *slotCount; ++i) {
+        if ((*slots)[i].key != 0) *probe(grown, newCount, (*slots)[i].key) = (*slots)[i];
+    }
+    free(*slots);
+    *slots = grown;
+    *slotCount = newCount;
+    return true;
+}
+
+static bool setSlot(ArtCacheSlot **slots, uint32_t *slotCount, uint32_t *used, uint64_t key, uint32_t thumb) {
+    if (!*slots && !grow(slots, slotCount)) return false;
+    ArtCacheSlot *slot = probe(*slots, *slotCount, key);
+    if (slot->key == 0) {
+        // Keep the load under 3/4 so probe runs stay short
+        if ((*used + 1) * 4 > *slotCount * 3) {
+            if (!grow(slots, slotCount)) return false;
+            slot = probe(*slots, *slotCount, key);
+        }
+        slot->key = key;
+        (*used)++;
+    }
+    slot->thumb = thumb;
+    return true;
+}
+
+bool artCacheSet(ArtCache *cache, uint64_t key, uint32_t thumb) {
+    if (!setSlot(&cache->slots, &cache->slotCount, &cache->used, key, thumb)) return false;
+    cache->dirty = true;
+    return true;
+}
+
+bool artCacheSetSession(ArtCache *cache, uint64_t key, uint32_t thumb) {
+    return setSlot(&cache->sessionSlots, &cache->sessionSlotCount, &cache->sessionUsed, key, thumb);
+}
+
+uint32_t artCacheAddThumb(ArtCache *cache, const uint16_t pixels[ART_THUMB_PIXELS]) {
+    uint32_t thumb = cache->thumbCount;
+    if (thumb == ART_THUMB_NONE || !cache->thumbs ||
+        fseeko(cache->thumbs, (off_t)thumb * ART_THUMB_BYTES, SEEK_SET) != 0 ||
+        fwrite(pixels, 1, ART_THUMB_BYTES, cache->thumbs) != ART_THUMB_BYTES) {
+        return ART_THUMB_NONE;
+    }
+    cache->thumbCount++;
+    cache->dirty = true;
+    return thumb;
+}
+
+bool artCacheReadThumb(ArtCache *cache, uint32_t thumb, uint16_t pixels[ART_THUMB_PIXELS]) {
+    if (thumb >= cache->thumbCount || !cache->thumbs) return false;
+    return fseeko(cache->thumbs, (off_t)thumb * ART_THUMB_BYTES, SEEK_SET) == 0 &&
+           fread(pixels, 1, ART_THUMB_BYTES, cache->thumbs) == ART_THUMB_BYTES;
+}
@@ -0,0 +1,83 @@
+#ifndef ARTCACHE_H
+#define ARTCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
+
+// --- Cover Art Cache ---
+// Thumbnails are decoded once and kept on disk in two files:
+//   art.bin  A flat array of ART_THUMB_BYTES thumbnails, only ever appended
+//            to, so thumbnail n is at n * ART_THUMB_BYTES.
+//   art.idx  ArtCacheHeader | ArtCacheSlot[slotCount]: an open-addressed
+//            hash table from 64-bit keys (a track, a folder, or a picture's
+//            content) to thumbnail numbers, loaded whole at start.
+// A lookup is a probe in memory; a hit costs one 2 KiB read, and the bytes
+// are already the GPU's tiled RGB565 layout, ready to copy into a texture.
+//
+// Answers that can go stale while a file keeps its bytes (a track with no
+// picture of its own, which takes the folder's or has none) are recorded
+// under the track's path for the run only, in a second table that is never
+// saved. The files can't change under the running app, and the next run
+// looks at them again.
+
+#define ART_THUMB_SIZE   32
+#define ART_THUMB_PIXELS (ART_THUMB_SIZE * ART_THUMB_SIZE)
+#define ART_THUMB_BYTES  (ART_THUMB_PIXELS * 2)
+
+#define ARTCACHE_MAGIC   0x54524150u // "PART"
+#define ARTCACHE_VERSION 2u // 1 saved path and folder answers for good
+#define ART_THUMB_NONE   0xFFFFFFFFu // Key was looked at and has no usable art
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;  // Power of two
+    uint32_t used;
+    uint32_t thumbCount; // Thumbnails in art.bin the slots may refer to
+    uint32_t reserved;
+} ArtCacheHeader;
+
+typedef struct {
+    uint64_t key;   // 0 = empty
+    uint32_t thumb; // Index into art.bin, or ART_THUMB_NONE
+    uint32_t reserved;
+} ArtCacheSlot;
+
+typedef struct {
+    ArtCacheSlot *slots;
+    uint32_t slotCount;
+    uint32_t used;
+    ArtCacheSlot *sessionSlots; // Keys recorded for this run only (NULL until the first)
+    uint32_t sessionSlotCount;
+    uint32_t sessionUsed;
+    uint32_t thumbCount;
+    FILE *thumbs;        // art.bin, open for reading and appending
+    bool dirty;          // Slots changed since the last flush
+    char indexPath[PATH_MAX];
+} ArtCache;
+
+// Loads art.idx and opens art.bin, starting empty if either is missing or
+// doesn't match. Returns false only if art.bin can't be opened or created.
+bool artCacheOpen(ArtCache *cache, const char *indexPath, const char *thumbPath);
+// Flushes and releases everything.
+void artCacheClose(ArtCache *cache);
+// Writes art.idx if slots changed (to a temp file, then renamed over it).
+bool artCacheFlush(ArtCache *cache);
+
+// FNV-1a over `data`, starting from `seed`; never returns 0.
+uint64_t artCacheKey(const void *data, size_t len, uint64_t seed);
+// O(1): false if the key has never been recorded, or only in an earlier run.
+bool artCacheLookup(const ArtCache *cache, uint64_t key, uint32_t *thumb);
+// Records or replaces `key`. Returns false if out of memory.
+bool artCacheSet(ArtCache *cache, uint64_t key, uint32_t thumb);
+// Records `key` for this run only; it is never written to art.idx.
+bool artCacheSetSession(ArtCache *cache, uint64_t key, uint32_t thumb);
+
+// Appends a tiled thumbnail; returns its number, or ART_THUMB_NONE on a write error.
+uint32_t artCacheAddThumb(ArtCache *cache, const uint16_t pixels[ART_THUMB_PIXELS]);
+bool artCacheReadThumb(ArtCache *cache, uint32_t thumb, uint16_t pixels[ART_THUMB_PIXELS]);
+
+#endif
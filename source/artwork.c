@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include "artwork.h"
+#include "catalog.h"
+#include "metadata.h"
+#include "contenthash.h"
+
+// Key spaces, so a track, a folder and a picture never share a key
+#define ART_SEED_TRACK   0xCBF29CE484222325ull // FNV-1a offset basis
+#define ART_SEED_FOLDER  0x84222325CBF29CE4ull
+#define ART_SEED_PICTURE 0x9E3779B97F4A7C15ull
+#define ART_SEED_CONTENT 0xC2B2AE3D27D4EB4Full
+
+#define ART_PNG_MAX_PIXELS (2048u * 2048u) // PNGs are decoded whole; bigger ones are skipped
+
+static const char *const s_folderPictures[] = { "folder.jpg", "cover.jpg", "folder.png", "cover.png" };
+
+// --- Downscaling ---
+// Source rows are fed top to bottom and summed into the thumbnail pixels they
+// cover, so only the sums are held, never the decoded picture.
+
+typedef struct {
+    uint32_t sum[ART_THUMB_PIXELS][3];
+    uint32_t count[ART_THUMB_PIXELS];
+    uint32_t cropX, cropY, side; // Centred square of the source that is kept
+} Downscaler;
+
+static void downscaleInit(Downscaler *d, uint32_t width, uint32_t height) {
+    memset(d, 0, sizeof(*d));
+    d->side = width < height ? width : height;
+    d->cropX = (width - d->side) / 2;
+    d->cropY = (height - d->side) / 2;
+}
+
+// Thumbnail rows or columns [*first, *last] that source position `pos` (in the crop) covers.
+static void coverage(uint32_t pos, uint32_t side, uint32_t *first, uint32_t *last) {
+    *first = pos * ART_THUMB_SIZE / side;
+    *last = ((pos + 1) * ART_THUMB_SIZE - 1) / side; // Beyond `first` only when upscaling
+}
+
+static void downscaleRow(Downscaler *d, uint32_t y, const uint8_t *rgb) {
+    if (y < d->cropY || y >= d->cropY + d->side) return;
+    uint32_t ty0, ty1;
+    coverage(y - d->cropY, d->side, &ty0, &ty1);
+    for (uint32_t x = 0; x < d->side; ++x) {
+        const uint8_t *p = rgb + (d->cropX + x) * 3;
+        uint32_t tx0, tx1;
+        coverage(x, d->side, &tx0, &tx1);
+        for (uint32_t ty = ty0; ty <= ty1; ++ty) {
+            for (uint32_t tx = tx0; tx <= tx1; ++tx) {
+                uint32_t i = ty * ART_THUMB_SIZE + tx;
+                d->sum[i][0] += p[0];
+                d->sum[i][1] += p[1];
+                d->sum[i][2] += p[2];
+                d->count[i]++;
+            }
+        }
+    }
+}
+
+// Averages each pixel and stores it as RGB565 at its tiled position.
+static void downscaleFinish(const Downscaler *d, uint16_t thumb[ART_THUMB_PIXELS]) {
+    for (uint32_t y = 0; y < ART_THUMB_SIZE; ++y) {
+        for (uint32_t x = 0; x < ART_THUMB_SIZE; ++x) {
+            uint32_t i = y * ART_THUMB_SIZE + x;
+            uint32_t n = d->count[i] ? d->count[i] : 1;
+            uint32_t r = d->sum[i][0] / n, g = d->sum[i][1] / n, b = d->sum[i][2] / n;
+            thumb[artworkTileIndex(x, y, ART_THUMB_SIZE)] = (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        }
+    }
+}
+
+// --- Decoding ---
+
+typedef struct {
+    struct jpeg_error_mgr base;
+    jmp_buf escape;
+} JpegError;
+
+static void jpegFail(j_common_ptr cinfo) {
+    longjmp(((JpegError*)cinfo->err)->escape, 1); // The default handler would exit()
+}
+
+static void jpegQuiet(j_common_ptr cinfo, int level) {
+    (void)cinfo;
+    (void)level; // Corrupt-data warnings from odd encoders are not worth printing
+}
+
+static bool decodeJpeg(const uint8_t *data, uint32_t len, Downscaler *d) {
+    struct jpeg_decompress_struct cinfo;
+    JpegError error;
+    uint8_t *volatile row = NULL;
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpegFail;
+    error.base.emit_message = jpegQuiet;
+    if (setjmp(error.escape)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(row);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)data, len);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    // Let the IDCT scale down by up to 8x: far less work than decoding at full size
+    uint32_t shortSide = cinfo.image_width < cinfo.image_height ? cinfo.image_width : cinfo.image_height;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    while (cinfo.scale_denom < 8 && shortSide / (cinfo.scale_denom * 2) >= ART_THUMB_SIZE) cinfo.scale_denom *= 2;
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_decompress(&cinfo);
+
+    row = (uint8_t*)malloc((size_t)cinfo.output_width * 3);
+    if (!row) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    downscaleInit(d, cinfo.output_width, cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        uint32_t y = cinfo.output_scanline;
+        JSAMPROW rows[1] = { row };
+        jpeg_read_scanlines(&cinfo, rows, 1);
+        downscaleRow(d, y, row);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    free(row);
+    return true;
+}
+
+static bool decodePng(const uint8_t *data, uint32_t len, Downscaler *d) {
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&image, data, len)) return false;
+    if ((uint64_t)image.width * image.height > ART_PNG_MAX_PIXELS) {
+        png_image_free(&image);
+        return false;
+    }
+    image.format = PNG_FORMAT_RGB; // Palette, grey and 16-bit are converted
+
+    uint8_t *pixels = (uint8_t*)malloc(PNG_IMAGE_SIZE(image));
+    if (!pixels) {
+        png_image_free(&image);
+        return false;
+    }
+    png_color black = { 0, 0, 0 }; // Without one, alpha is blended with whatever the buffer held
+    bool ok = png_image_finish_read(&image, &black, pixels, 0, NULL) != 0;
+    if (ok) {
+        downscaleInit(d, image.width, image.height);
+        for (uint32_t y = 0; y < image.height; ++y) downscaleRow(d, y, pixels + (size_t)y * image.width * 3);
+    }
+    free(pixels);
+    return ok;
+}
+
+bool artworkDecodeThumb(const uint8_t *data, uint32_t len, uint16_t thumb[ART_THUMB_PIXELS]) {
+    Downscaler *d = (Downscaler*)malloc(sizeof(Downscaler)); // 16 KiB: too much for a thread's stack
+    if (!d) return false;
+    bool ok = false;
+    if (len >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) {
+        ok = decodeJpeg(data, len, d);
+    } else if (len >= 8 && memcmp(data, "\x89PNG\r\n\x1A\n", 8) == 0) {
+        ok = decodePng(data, len, d);
+    }
+    if (ok && d->side > 0) downscaleFinish(d, thumb);
+    else ok = false;
+    free(d);
+    return ok;
+}
+
+// --- Picture Sources ---
+
+// Reads the embedded cover of `path` into a malloc'd buffer; NULL if there is none.
+static uint8_t* loadEmbedded(const char *path, uint32_t *len) {
+    struct stat st;
+    if (stat(path, &st) != 0) return NULL;
+
+    MetaReader reader;
+    if (!metaReaderOpen(&reader, path, (uint64_t)st.st_size)) return NULL;
+    TrackFormat format = metadataSniff(&reader, trackFormatFromExtension(path));
+    MetaSpan picture;
+    bool found = false;
+    switch (format) {
+        case TRACK_FORMAT_MP3:  found = id3FindPicture(&reader, &picture); break;
+        case TRACK_FORMAT_FLAC: found = flacFindPicture(&reader, &picture); break;
+        case TRACK_FORMAT_M4A:  found = mp4FindPicture(&reader, &picture); break;
+        default:                break; // Ogg keeps art base64-encoded in a comment; not read
+    }
+
+    uint8_t *data = NULL;
+    if (found && picture.len > 0 && picture.len <= ART_PICTURE_MAX) {
+        data = (uint8_t*)malloc(picture.len);
+        if (data && !metaReaderRead(&reader, picture.offset, data, picture.len)) {
+            free(data);
+            data = NULL;
+        }
+        *len = picture.len;
+    }
+    metaReaderClose(&reader);
+    return data;
+}
+
+static uint8_t* loadFile(const char *path, uint32_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    uint8_t *data = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        if (size > 0 && (uint64_t)size <= ART_PICTURE_MAX && fseek(f, 0, SEEK_SET) == 0) {
+            data = (uint8_t*)malloc((size_t)size);
+            if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+                free(data);
+                data = NULL;
+            }
+            *len = (uint32_t)size;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+// Length of the folder part of `relPath`, without the trailing slash.
+static size_t folderLength(const char *relPath) {
+    const char *slash = strrchr(relPath, '/');
+    return slash ? (size_t)(slash - relPath) : 0;
+}
+
+#define ART_FOLDER_PICTURES (sizeof(s_folderPictures) / sizeof(s_folderPictures[0]))
+
+// Path of folder picture `i` beside `relPath`.
+static void folderPicturePath(char *path, const char *musicDir, const char *relPath, size_t i) {
+    int folderLen = (int)folderLength(relPath);
+    if (folderLen > 0) snprintf(path, PATH_MAX, "%s/%.*s/%s", musicDir, folderLen, relPath, s_folderPictures[i]);
+    else snprintf(path, PATH_MAX, "%s/%s", musicDir, s_folderPictures[i]);
+}
+
+// Reads the first folder picture found beside `relPath`.
+static uint8_t* loadFolderPicture(const char *musicDir, const char *relPath, uint32_t *len) {
+    for (size_t i = 0; i < ART_FOLDER_PICTURES; ++i) {
+        char path[PATH_MAX];
+        folderPicturePath(path, musicDir, relPath, i);
+        uint8_t *data = loadFile(path, len);
+        if (data) return data;
+    }
+    return NULL;
+}
+
+// Which folder picture loadFolderPicture() would read, with its size and
+// mtime; 0 if there is none. Adding, replacing or removing one changes it.
+static uint64_t folderPictureStamp(const char *musicDir, const char *relPath) {
+    for (size_t i = 0; i < ART_FOLDER_PICTURES; ++i) {
+        char path[PATH_MAX];
+        struct stat st;
+        folderPicturePath(path, musicDir, relPath, i);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        uint64_t stamp[3] = { i + 1, (uint64_t)st.st_size, (uint64_t)st.st_mtime };
+        return artCacheKey(stamp, sizeof(stamp), ART_SEED_FOLDER);
+    }
+    return 0;
+}
+
+// --- Building ---
+
+uint64_t artworkTrackKey(const char *relPath, uint64_t contentHash) {
+    if (contentHash != CONTENT_HASH_NONE) return artCacheKey(&contentHash, sizeof(contentHash), ART_SEED_CONTENT);
+    return artCacheKey(relPath, strlen(relPath), ART_SEED_TRACK);
+}
+
+// Thumbnail for picture bytes, decoding them only if no track has used them yet.
+static uint32_t pictureThumb(ArtCache *cache, const uint8_t *data, uint32_t len, ArtworkStats *stats) {
+    uint64_t key = artCacheKey(data, len, ART_SEED_PICTURE);
+    uint32_t thumb;
+    if (artCacheLookup(cache, key, &thumb)) {
+        if (thumb != ART_THUMB_NONE && stats) stats->shared++;
+        return thumb;
+    }
+    uint16_t pixels[ART_THUMB_PIXELS];
+    thumb = ART_THUMB_NONE;
+    if (artworkDecodeThumb(data, len, pixels)) {
+        thumb = artCacheAddThumb(cache, pixels);
+        if (thumb != ART_THUMB_NONE && stats) stats->decoded++;
+    }
+    artCacheSet(cache, key, thumb); // A picture that won't decode is not tried again
+    return thumb;
+}
+
+// The folder's picture, looked for once per folder and picture: the key
+// covers the picture's stamp, so a new or replaced one is read again.
+static uint32_t folderThumb(ArtCache *cache, const char *musicDir, const char *relPath, ArtworkStats *stats) {
+    uint64_t stamp = folderPictureStamp(musicDir, relPath);
+    uint64_t key = artCacheKey(&stamp, sizeof(stamp), artCacheKey(relPath, folderLength(relPath), ART_SEED_FOLDER));
+    uint32_t thumb;
+    if (artCacheLookup(cache, key, &thumb)) {
+        if (thumb != ART_THUMB_NONE && stats) stats->shared++;
+        return thumb;
+    }
+    uint32_t len = 0;
+    uint8_t *data = loadFolderPicture(musicDir, relPath, &len);
+    thumb = ART_THUMB_NONE;
+    if (data) {
+        if (stats) stats->bytesRead += len;
+        thumb = pictureThumb(cache, data, len, stats);
+        free(data);
+    }
+    artCacheSet(cache, key, thumb);
+    return thumb;
+}
+
+bool artworkLookup(const ArtCache *cache, const char *relPath, uint64_t contentHash, uint32_t *thumb) {
+    if (contentHash != CONTENT_HASH_NONE && artCacheLookup(cache, artworkTrackKey(relPath, contentHash), thumb)) {
+        return true;
+    }
+    return artCacheLookup(cache, artworkTrackKey(relPath, CONTENT_HASH_NONE), thumb);
+}
+
+uint32_t artworkBuild(ArtCache *cache, const char *musicDir, const char *relPath, uint64_t contentHash,
+                      ArtworkStats *stats) {
+    uint32_t thumb;
+    if (artworkLookup(cache, relPath, contentHash, &thumb)) return thumb;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", musicDir, relPath);
+    uint32_t len = 0;
+    uint8_t *data = loadEmbedded(path, &len);
+    thumb = ART_THUMB_NONE;
+    if (data) {
+        if (stats) stats->bytesRead += len;
+        thumb = pictureThumb(cache, data, len, stats);
+        free(data);
+    }
+    // Only a picture in the file itself follows its content hash: copies of
+    // one file in two folders can have different folder pictures. Anything
+    // else is kept under the path for this run and looked at again next run
+    if (thumb != ART_THUMB_NONE && contentHash != CONTENT_HASH_NONE) {
+        artCacheSet(cache, artworkTrackKey(relPath, contentHash), thumb);
+        return thumb;
+    }
+    if (thumb == ART_THUMB_NONE) thumb = folderThumb(cache, musicDir, relPath, stats);
+    if (thumb == ART_THUMB_NONE && stats) stats->missing++;
+    artCacheSetSession(cache, artworkTrackKey(relPath, CONTENT_HASH_NONE), thumb);
+    return thumb;
+}
+
+bool artworkLoadThumb(const char *musicDir, const char *relPath, uint16_t thumb[ART_THUMB_PIXELS]) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", musicDir, relPath);
+    uint32_t len = 0;
+    uint8_t *data = loadEmbedded(path, &len);
+    bool ok = data && artworkDecodeThumb(data, len, thumb);
+    free(data);
+    if (ok) return true;
+    data = loadFolderPicture(musicDir, relPath, &len);
+    ok = data && artworkDecodeThumb(data, len, thumb);
+    free(data);
+    return ok;
+}
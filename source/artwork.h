@@ -0,0 +1,56 @@
+#ifndef ARTWORK_H
+#define ARTWORK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "artcache.h"
+
+// --- Cover Art ---
+// A track's cover is its embedded picture (ID3 APIC, FLAC PICTURE, MP4
+// covr), or else folder.jpg / cover.jpg / folder.png / cover.png beside it.
+// The JPEG or PNG is decoded once, centre-cropped to a square, box-filtered
+// to 32x32 and stored tiled (see artcache.h). Pictures are keyed by their
+// bytes, so an album's tracks that all embed one cover share one thumbnail
+// and it is decoded only for the first of them.
+
+#define ART_PICTURE_MAX (8u * 1024 * 1024) // Larger pictures are not read
+
+typedef struct {
+    uint32_t decoded;   // Pictures turned into new thumbnails
+    uint32_t shared;    // Tracks given a thumbnail made for an earlier track
+    uint32_t missing;   // Tracks with no usable art
+    uint64_t bytesRead; // Picture bytes read
+} ArtworkStats;
+
+// Cache key of a track: from its content hash once it has one (see
+// contenthash.h), so the key follows the file when it is moved or renamed;
+// until then from its path relative to the music folder.
+uint64_t artworkTrackKey(const char *relPath, uint64_t contentHash);
+
+// The track's thumbnail number as recorded in `cache`: under its content
+// hash if its own picture was saved there, else under its path this run.
+// False if neither has been recorded yet.
+bool artworkLookup(const ArtCache *cache, const char *relPath, uint64_t contentHash, uint32_t *thumb);
+
+// The track's thumbnail number, built and recorded in `cache` on first use;
+// ART_THUMB_NONE if it has no art. Only a hashed track's embedded picture is
+// saved, under its content hash; the folder's picture or no art at all is
+// kept under its path for the run (see artcache.h). `stats` may be NULL.
+uint32_t artworkBuild(ArtCache *cache, const char *musicDir, const char *relPath, uint64_t contentHash,
+                      ArtworkStats *stats);
+
+// Builds the thumbnail straight from the track's files, bypassing the cache.
+bool artworkLoadThumb(const char *musicDir, const char *relPath, uint16_t thumb[ART_THUMB_PIXELS]);
+
+// Decodes a JPEG or PNG (told apart by their signatures) into a thumbnail.
+bool artworkDecodeThumb(const uint8_t *data, uint32_t len, uint16_t thumb[ART_THUMB_PIXELS]);
+
+// Index of pixel (x, y) in a tiled texture `width` pixels wide: 8x8 tiles
+// left to right, top to bottom, Morton (Z) order within each tile.
+static inline uint32_t artworkTileIndex(uint32_t x, uint32_t y, uint32_t width) {
+    uint32_t morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) | ((y & 4) << 3);
+    return ((y >> 3) * (width >> 3) + (x >> 3)) * 64 + morton;
+}
+
+#endif
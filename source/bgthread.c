@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <stdio.h>
+#ifdef __3DS__
+#include <3ds.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "bgthread.h"
+
+#define BGTHREAD_STACK_SIZE (64 * 1024)
+
+struct BgThread {
+#ifdef __3DS__
+    Thread handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+#ifndef __3DS__
+typedef struct {
+    BgThreadFunc entry;
+    void *arg;
+} HostStart;
+
+static void* hostEntry(void *p) {
+    HostStart start = *(HostStart*)p;
+    free(p);
+    start.entry(start.arg);
+    return NULL;
+}
+#endif
+
+BgThread* bgThreadStart(BgThreadFunc entry, void *arg, bool lowPriority) {
+    return bgThreadStartOn(entry, arg, lowPriority, 0);
+}
+
+BgThread* bgThreadStartOn(BgThreadFunc entry, void *arg, bool lowPriority, int core) {
+    BgThread *thread = (BgThread*)malloc(sizeof(BgThread));
+    if (!thread) return NULL;
+
+#ifdef __3DS__
+    // Higher number = lower priority; stay just below the main thread so
+    // it only runs while the render thread waits on vblank/GPU.
+    s32 prio = 0x30;
+    svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+    if (lowPriority && prio < 0x3F) prio++;
+    // -2 is the app's own core; New 3DS lends applications core 2 as well
+    int coreId = (core > 0) ? 2 : -2;
+    thread->handle = threadCreate(entry, arg, BGTHREAD_STACK_SIZE, prio, coreId, false);
+    if (!thread->handle) {
+        free(thread);
+        return NULL;
+    }
+#else
+    (void)lowPriority; // The host scheduler is preemptive; nothing to tune
+    (void)core;
+    HostStart *start = (HostStart*)malloc(sizeof(HostStart));
+    if (!start) {
+        free(thread);
+        return NULL;
+    }
+    start->entry = entry;
+    start->arg = arg;
+    if (pthread_create(&thread->handle, NULL, hostEntry, start) != 0) {
+        free(start);
+        free(thread);
+        return NULL;
+    }
+#endif
+    return thread;
+}
+
+void bgThreadJoin(BgThread *thread) {
+    if (!thread) return;
+#ifdef __3DS__
+    threadJoin(thread->handle, U64_MAX);
+    threadFree(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+}
+
+void bgThreadSleepUs(uint32_t us) {
+#ifdef __3DS__
+    svcSleepThread((s64)us * 1000);
+#else
+    struct timespec ts = { (time_t)(us / 1000000u), (long)(us % 1000000u) * 1000 };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+int bgThreadCores(void) {
+#ifdef __3DS__
+    bool isNew3ds = false;
+    APT_CheckNew3DS(&isNew3ds);
+    return isNew3ds ? 2 : 1;
+#else
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 1 ? (int)online : 1;
+#endif
+}
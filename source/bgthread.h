@@ -0,0 +1,26 @@
+#ifndef BGTHREAD_H
+#define BGTHREAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// --- Background Threads ---
+// Thin wrapper so worker code is shared between the 3DS build (libctru
+// threadCreate) and host tools (pthreads).
+
+typedef struct BgThread BgThread;
+typedef void (*BgThreadFunc)(void *arg);
+
+// Low-priority threads yield to the render thread on device.
+BgThread* bgThreadStart(BgThreadFunc entry, void *arg, bool lowPriority);
+// Same, on core `core` (0 .. bgThreadCores() - 1). Core 0 is the app core
+// the render thread runs on. The host scheduler places threads itself.
+BgThread* bgThreadStartOn(BgThreadFunc entry, void *arg, bool lowPriority, int core);
+// Cores a worker pool can spread over: the online CPUs on the host; on
+// device the app core, plus core 2 on New 3DS.
+int bgThreadCores(void);
+// Waits for the thread to exit and releases it.
+void bgThreadJoin(BgThread *thread);
+void bgThreadSleepUs(uint32_t us);
+
+#endif
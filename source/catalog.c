@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strcasecmp
+
+#include "catalog.h"
+
+void catalogInit(Catalog *catalog) {
+    memset(catalog, 0, sizeof(*catalog));
+    strArenaInit(&catalog->strings);
+}
+
+static void freeChunks(Catalog *catalog) {
+    for (uint32_t c = 0; c < catalog->numChunks; ++c) {
+        free(catalog->chunks[c]);
+    }
+    free(catalog->chunks);
+    catalog->chunks = NULL;
+    catalog->numChunks = 0;
+    catalog->chunkCapacity = 0;
+    catalog->count = 0;
+}
+
+void catalogClear(Catalog *catalog) {
+    freeChunks(catalog);
+    strArenaReset(&catalog->strings);
+}
+
+void catalogFree(Catalog *catalog) {
+    freeChunks(catalog);
+    strArenaFree(&catalog->strings);
+}
+
+bool catalogAppend(Catalog *catalog, const CatalogEntry *entry) {
+    uint32_t chunk = catalog->count >> CATALOG_CHUNK_SHIFT;
+
+    if (chunk == catalog->numChunks) {
+        // Current chunk is full (or none yet): add one more
+        if (catalog->numChunks == catalog->chunkCapacity) {
+            uint32_t newCapacity = catalog->chunkCapacity ? catalog->chunkCapacity * 2 : 16;
+            CatalogChunk **grown = (CatalogChunk**)realloc(catalog->chunks, newCapacity * sizeof(CatalogChunk*));
+            if (!grown) return false;
+            catalog->chunks = grown;
+            catalog->chunkCapacity = newCapacity;
+        }
+        CatalogChunk *block = (CatalogChunk*)malloc(sizeof(CatalogChunk));
+        if (!block) return false;
+        catalog->chunks[catalog->numChunks++] = block;
+    }
+
+    uint32_t i = catalog->count;
+    CATALOG_FIELD(catalog, contentHash, i) = entry->contentHash;
+    CATALOG_FIELD(catalog, filename, i) = entry->filename;
+    CATALOG_FIELD(catalog, title, i) = entry->title;
+    CATALOG_FIELD(catalog, artist, i) = entry->artist;
+    CATALOG_FIELD(catalog, album, i) = entry->album;
+    CATALOG_FIELD(catalog, durationMs, i) = entry->durationMs;
+    CATALOG_FIELD(catalog, startFrame, i) = entry->startFrame;
+    CATALOG_FIELD(catalog, endFrame, i) = entry->endFrame;
+    CATALOG_FIELD(catalog, gain, i) = entry->gain;
+    CATALOG_FIELD(catalog, trackNumber, i) = entry->trackNumber;
+    CATALOG_FIELD(catalog, format, i) = entry->format;
+    CATALOG_FIELD(catalog, flags, i) = entry->flags;
+    catalog->count++;
+    return true;
+}
+
+uint32_t catalogMemoryUsed(const Catalog *catalog) {
+    return catalog->numChunks * (uint32_t)sizeof(CatalogChunk)
+         + catalog->chunkCapacity * (uint32_t)sizeof(CatalogChunk*);
+}
+
+TrackFormat trackFormatFromExtension(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    if (!dot || dot == filename) return TRACK_FORMAT_NONE;
+    if (strcasecmp(dot, ".mp3") == 0) return TRACK_FORMAT_MP3;
+    if (strcasecmp(dot, ".ogg") == 0) return TRACK_FORMAT_OGG;
+    if (strcasecmp(dot, ".wav") == 0) return TRACK_FORMAT_WAV;
+    if (strcasecmp(dot, ".flac") == 0) return TRACK_FORMAT_FLAC;
+    if (strcasecmp(dot, ".m4a") == 0) return TRACK_FORMAT_M4A;
+    return TRACK_FORMAT_NONE;
+}
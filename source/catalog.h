@@ -0,0 +1,113 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "replaygain.h"
+#include "strarena.h"
+
+// --- Track Catalog ---
+// Column-oriented track storage. Each column is a parallel array, cut into
+// fixed-size chunks that are never moved, so appending never copies rows and
+// lookup is O(1): chunk = index >> CATALOG_CHUNK_SHIFT, slot = index & mask.
+// Strings are 32-bit refs into the catalog's own StrArena, so sorting or
+// filtering touches only the columns it needs, not scattered heap strings.
+//
+// Memory per track: 48 bytes of columns (content hash, four refs, duration,
+// cue frames, ReplayGain, track number, format, flags) + one directory pointer per chunk
+// (4 / 256 bytes) + string bytes.
+
+#define CATALOG_CHUNK_SHIFT 8
+#define CATALOG_CHUNK_SIZE  (1u << CATALOG_CHUNK_SHIFT)
+#define CATALOG_CHUNK_MASK  (CATALOG_CHUNK_SIZE - 1)
+
+typedef enum {
+    TRACK_FORMAT_NONE = 0, // Not a music file
+    TRACK_FORMAT_MP3,
+    TRACK_FORMAT_OGG,
+    TRACK_FORMAT_WAV,
+    TRACK_FORMAT_FLAC,
+    TRACK_FORMAT_M4A
+} TrackFormat;
+
+#define CATALOG_FLAG_MESSAGE     0x01 // Error/info row, not a playable track
+#define CATALOG_FLAG_PENDING     0x02 // Tags not read yet; read when the row nears the screen
+#define CATALOG_FLAG_LATE        0x04 // Tags read after the scan, not yet saved to the library index
+#define CATALOG_FLAG_TAG_GLYPHS  0x08 // Tags have characters the system font lacks
+#define CATALOG_FLAG_NAME_GLYPHS 0x10 // So has the filename
+#define CATALOG_FLAG_CUE         0x20 // A cue sheet track: frames [startFrame, endFrame) of its file
+#define CATALOG_FLAG_MEASURED    0x40 // Untagged; the loudness analyser has been over it (see loudnessjob.h)
+
+typedef struct {
+    uint64_t contentHash[CATALOG_CHUNK_SIZE]; // contenthash.h; CONTENT_HASH_NONE until hashed
+    uint32_t filename[CATALOG_CHUNK_SIZE]; // StrArena refs (STRARENA_NONE if absent)
+    uint32_t title[CATALOG_CHUNK_SIZE];
+    uint32_t artist[CATALOG_CHUNK_SIZE];
+    uint32_t album[CATALOG_CHUNK_SIZE];
+    uint32_t durationMs[CATALOG_CHUNK_SIZE]; // 0 if unknown
+    uint32_t startFrame[CATALOG_CHUNK_SIZE]; // PCM frames into the file (CATALOG_FLAG_CUE rows; else 0)
+    uint32_t endFrame[CATALOG_CHUNK_SIZE];
+    ReplayGain gain[CATALOG_CHUNK_SIZE];     // Loudness tags, for the output path's gain stage
+    uint16_t trackNumber[CATALOG_CHUNK_SIZE]; // Within its album; 0 if unknown
+    uint8_t  format[CATALOG_CHUNK_SIZE];     // TrackFormat
+    uint8_t  flags[CATALOG_CHUNK_SIZE];      // CATALOG_FLAG_*
+} CatalogChunk;
+
+// One row, as produced by the scanner and appended to the catalog.
+typedef struct {
+    uint64_t contentHash;
+    uint32_t filename;
+    uint32_t title;
+    uint32_t artist;
+    uint32_t album;
+    uint32_t durationMs;
+    uint32_t startFrame;
+    uint32_t endFrame;
+    ReplayGain gain;
+    uint16_t trackNumber;
+    uint8_t  format;
+    uint8_t  flags;
+} CatalogEntry;
+
+typedef struct {
+    StrArena strings;      // Backs every string ref in the columns
+    CatalogChunk **chunks; // Chunk directory
+    uint32_t numChunks;
+    uint32_t chunkCapacity;
+    uint32_t count;        // Rows stored
+} Catalog;
+
+// Column access by row index, usable for reads and writes. `i` must be < count.
+#define CATALOG_FIELD(cat, column, i) \
+    ((cat)->chunks[(uint32_t)(i) >> CATALOG_CHUNK_SHIFT]->column[(uint32_t)(i) & CATALOG_CHUNK_MASK])
+
+void catalogInit(Catalog *catalog);
+// Drops every row and releases all strings with one arena reset.
+void catalogClear(Catalog *catalog);
+void catalogFree(Catalog *catalog);
+// Returns false if out of memory.
+bool catalogAppend(Catalog *catalog, const CatalogEntry *entry);
+// Bytes held by the columns and directory (strings are in catalog->strings.stats).
+uint32_t catalogMemoryUsed(const Catalog *catalog);
+
+TrackFormat trackFormatFromExtension(const char *filename);
+
+// A tag's track number as the column keeps it: numbers past its range are
+// not real track numbers and read as unknown.
+static inline uint16_t catalogTrackNumber(uint32_t number) {
+    return number <= UINT16_MAX ? (uint16_t)number : 0;
+}
+
+static inline const char* catalogString(const Catalog *catalog, uint32_t ref) {
+    return strArenaGet(&catalog->strings, ref);
+}
+
+// The filename column holds paths relative to the music folder; this is the last component.
+static inline const char* catalogBaseName(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+#endif
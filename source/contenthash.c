@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "contenthash.h"
+
+// --- Mixing ---
+
+static inline uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t mixWord(uint32_t k) {
+    k *= 0xCC9E2D51u;
+    k = rotl32(k, 15);
+    return k * 0x1B873593u;
+}
+
+static inline uint32_t finalMix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    return h ^ (h >> 16);
+}
+
+uint64_t contentHashBytes(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *p = (const uint8_t*)data;
+    uint32_t h1 = (uint32_t)seed;
+    uint32_t h2 = (uint32_t)(seed >> 32);
+    uint32_t k1, k2;
+    // Words are read in native order, like the rest of the library index
+    for (size_t pairs = len / 8; pairs > 0; --pairs, p += 8) {
+        memcpy(&k1, p, 4);
+        memcpy(&k2, p + 4, 4);
+        h1 = rotl32(h1 ^ mixWord(k1), 13) * 5 + 0xE6546B64u;
+        h2 = rotl32(h2 ^ mixWord(k2), 17) * 5 + 0x561CCD1Bu;
+    }
+    if (len & 7) {
+        uint8_t tail[8] = { 0 };
+        memcpy(tail, p, len & 7);
+        memcpy(&k1, tail, 4);
+        memcpy(&k2, tail + 4, 4);
+        h1 ^= mixWord(k1);
+        h2 ^= mixWord(k2);
+    }
+
+    h1 ^= (uint32_t)len;
+    h2 ^= (uint32_t)((uint64_t)len >> 32);
+    h1 += h2;
+    h2 += h1;
+    h1 = finalMix(h1);
+    h2 = finalMix(h2);
+    h1 += h2;
+    h2 += h1;
+    uint64_t hash = ((uint64_t)h2 << 32) | h1;
+    return hash != CONTENT_HASH_NONE ? hash : 1;
+}
+
+// --- Files ---
+
+static bool readSpan(FILE *f, uint64_t offset, uint8_t *buffer, uint32_t len, MetaIoStats *io) {
+    if (!metaSeek(f, offset)) return false;
+    size_t got = fread(buffer, 1, len, f);
+    if (io) {
+        io->reads++;
+        io->bytesRead += got;
+    }
+    return got == len;
+}
+
+bool contentHashFile(const char *path, uint64_t fileSize, uint8_t *buffer, uint64_t *hash, MetaIoStats *io) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    setvbuf(f, NULL, _IONBF, 0); // Straight into `buffer`: one FS request per span
+
+    uint32_t headLen = fileSize < CONTENT_HASH_SPAN ? (uint32_t)fileSize : CONTENT_HASH_SPAN;
+    uint64_t rest = fileSize - headLen;
+    uint32_t tailLen = rest < CONTENT_HASH_SPAN ? (uint32_t)rest : CONTENT_HASH_SPAN;
+
+    uint64_t h = contentHashBytes(&fileSize, sizeof(fileSize), 0);
+    bool ok = readSpan(f, 0, buffer, headLen, io);
+    if (ok) h = contentHashBytes(buffer, headLen, h);
+    if (ok && tailLen > 0) {
+        ok = readSpan(f, fileSize - tailLen, buffer, tailLen, io);
+        if (ok) h = contentHashBytes(buffer, tailLen, h);
+    }
+    fclose(f);
+    if (ok) *hash = h;
+    return ok;
+}
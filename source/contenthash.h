@@ -0,0 +1,34 @@
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "metaio.h"
+
+// --- Content Hash ---
+// Identifies a file by what it holds rather than where it is, so a track
+// that was moved or renamed can take over its old index record (tags,
+// duration, measured gain) and its cover art. The hash covers the file
+// size and its first and last CONTENT_HASH_SPAN bytes: the tags, the
+// stream headers and enough audio at either end that two rips of one song
+// differ. Editing tags changes the head, so an edited file is read again.
+//
+// The mixing runs over 32-bit words in two MurmurHash3-style lanes; ARM11
+// has no 64-bit multiply, and byte-wise FNV-1a is several times slower
+// there. Either way the two 64 KiB reads cost far more than the mixing.
+
+#define CONTENT_HASH_SPAN (64u * 1024) // Bytes hashed at each end of the file
+#define CONTENT_HASH_NONE 0u           // Not hashed yet; no file hashes to it
+
+// Hashes `len` bytes, carrying on from `seed`. Never returns CONTENT_HASH_NONE.
+uint64_t contentHashBytes(const void *data, size_t len, uint64_t seed);
+
+// Hashes the file at `path`, `fileSize` bytes long as stat'ed, through
+// `buffer` (CONTENT_HASH_SPAN bytes): one read for a file no longer than
+// the span, else one at each end. `io` (may be NULL) gets the reads counted.
+// Returns false if the file can't be read or is shorter than `fileSize`.
+bool contentHashFile(const char *path, uint64_t fileSize, uint8_t *buffer, uint64_t *hash, MetaIoStats *io);
+
+#endif
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strcasecmp
+
+#include "cue.h"
+
+#define CUE_NO_START UINT64_MAX
+
+bool cueIsSheetName(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot && dot != name && strcasecmp(dot, ".cue") == 0;
+}
+
+// --- Text Sheets ---
+
+// Next word, or "quoted string" (quotes dropped), between `*p` and `end`.
+// Returns false at the end of the line.
+static bool nextToken(const char **p, const char *end, const char **token, size_t *len) {
+    const char *s = *p;
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+    if (s >= end) return false;
+    if (*s == '"') {
+        const char *close = memchr(s + 1, '"', (size_t)(end - s - 1));
+        if (!close) close = end; // Unterminated: the rest of the line
+        *token = s + 1;
+        *len = (size_t)(close - s - 1);
+        *p = close < end ? close + 1 : end;
+        return true;
+    }
+    const char *e = s;
+    while (e < end && *e != ' ' && *e != '\t' && *e != '\r') e++;
+    *token = s;
+    *len = (size_t)(e - s);
+    *p = e;
+    return true;
+}
+
+// The value of TITLE / PERFORMER: a quoted string, or else the rest of the line.
+static bool lineValue(const char **p, const char *end, const char **value, size_t *len) {
+    const char *s = *p;
+    while (s < end && (*s == ' ' || *s == '\t')) s++;
+    if (s < end && *s == '"') return nextToken(p, end, value, len);
+    const char *e = end;
+    while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) e--;
+    *value = s;
+    *len = (size_t)(e - s);
+    *p = end;
+    return e > s;
+}
+
+static bool isCommand(const char *token, size_t len, const char *command) {
+    return strlen(command) == len && strncasecmp(token, command, len) == 0;
+}
+
+static uint32_t parseNumber(const char *s, size_t len) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < len && s[i] >= '0' && s[i] <= '9'; ++i) {
+        if (value > 100000000u) break;
+        value = value * 10 + (uint32_t)(s[i] - '0');
+    }
+    return value;
+}
+
+// "mm:ss:ff" in CD frames; false if malformed.
+static bool parseTime(const char *s, size_t len, uint64_t *sectors) {
+    uint32_t parts[3] = { 0, 0, 0 };
+    int part = 0;
+    bool digit = false;
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] >= '0' && s[i] <= '9') {
+            if (parts[part] > 100000u) return false;
+            parts[part] = parts[part] * 10 + (uint32_t)(s[i] - '0');
+            digit = true;
+        } else if (s[i] == ':' && digit && part < 2) {
+            part++;
+            digit = false;
+        } else {
+            return false;
+        }
+    }
+    if (part != 2 || !digit || parts[1] >= 60 || parts[2] >= CUE_SECTOR_RATE) return false;
+    *sectors = ((uint64_t)parts[0] * 60 + parts[1]) * CUE_SECTOR_RATE + parts[2];
+    return true;
+}
+
+static uint32_t storeText(StrArena *strings, MetaTextEncoding encoding, const char *s, size_t len,
+                          uint8_t *flags) {
+    return textConvert(strings, encoding, (const uint8_t*)s, (uint32_t)len, flags);
+}
+
+// Drops tracks that aren't audio or have no INDEX, and checks the order.
+static bool finishSheet(CueSheet *sheet, const bool *audio) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < sheet->count; ++i) {
+        if (!audio[i] || sheet->tracks[i].start == CUE_NO_START) continue;
+        if (kept > 0 && sheet->tracks[i].start <= sheet->tracks[kept - 1].start) return false;
+        sheet->tracks[kept++] = sheet->tracks[i];
+    }
+    sheet->count = kept;
+    return kept > 0;
+}
+
+bool cueParse(const char *text, size_t len, StrArena *strings, CueSheet *sheet) {
+    memset(sheet, 0, sizeof(*sheet));
+    replayGainInit(&sheet->gain);
+    sheet->rate = CUE_SECTOR_RATE;
+    bool audio[CUE_MAX_TRACKS];
+    bool haveFile = false;
+    CueTrack *track = NULL; // Track being read; NULL before the first
+
+    const char *p = text;
+    const char *end = text + len;
+    if (len >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3; // UTF-8 byte order mark
+    // Rippers write either UTF-8 or the Windows code page, for the whole sheet
+    MetaTextEncoding encoding = textIsUtf8(p, (size_t)(end - p)) ? META_TEXT_UTF8 : META_TEXT_LATIN1;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        const char *line = p;
+        p = eol < end ? eol + 1 : end;
+
+        const char *command, *arg;
+        size_t commandLen, argLen;
+        if (!nextToken(&line, eol, &command, &commandLen)) continue;
+
+        if (isCommand(command, commandLen, "FILE")) {
+            if (haveFile) return false; // One file per track (or several images): nothing to split
+            if (!nextToken(&line, eol, &arg, &argLen) || argLen == 0 || argLen >= CUE_MAX_NAME) return false;
+            memcpy(sheet->file, arg, argLen);
+            sheet->file[argLen] = '\0';
+            haveFile = true;
+        } else if (isCommand(command, commandLen, "TRACK")) {
+            if (!haveFile || sheet->count == CUE_MAX_TRACKS) return false;
+            if (!nextToken(&line, eol, &arg, &argLen)) return false;
+            track = &sheet->tracks[sheet->count];
+            memset(track, 0, sizeof(*track));
+            replayGainInit(&track->gain);
+            track->number = parseNumber(arg, argLen);
+            track->start = CUE_NO_START;
+            audio[sheet->count] = nextToken(&line, eol, &arg, &argLen) && isCommand(arg, argLen, "AUDIO");
+            sheet->count++;
+        } else if (isCommand(command, commandLen, "INDEX")) {
+            const char *time;
+            size_t timeLen;
+            uint64_t sectors;
+            if (!track || !nextToken(&line, eol, &arg, &argLen) || !nextToken(&line, eol, &time, &timeLen)) continue;
+            if (!parseTime(time, timeLen, &sectors)) return false;
+            // INDEX 01, or the first one if there is none
+            if (parseNumber(arg, argLen) == 1 || track->start == CUE_NO_START) track->start = sectors;
+        } else if (isCommand(command, commandLen, "TITLE") || isCommand(command, commandLen, "PERFORMER")) {
+            if (!lineValue(&line, eol, &arg, &argLen)) continue;
+            bool title = isCommand(command, commandLen, "TITLE");
+            uint8_t *flags = track ? &track->textFlags : &sheet->textFlags;
+            uint32_t ref = storeText(strings, encoding, arg, argLen, flags);
+            if (track) *(title ? &track->title : &track->performer) = ref;
+            else *(title ? &sheet->title : &sheet->performer) = ref;
+        } else if (isCommand(command, commandLen, "REM")) {
+            // "REM REPLAYGAIN_ALBUM_GAIN -7.89 dB"; other REMs (GENRE, DATE...) aren't shown
+            const char *value;
+            size_t valueLen;
+            if (!nextToken(&line, eol, &arg, &argLen) || !lineValue(&line, eol, &value, &valueLen)) continue;
+            replayGainTag(track ? &track->gain : &sheet->gain, (const uint8_t*)arg, (uint32_t)argLen,
+                          (const uint8_t*)value, (uint32_t)valueLen);
+        }
+        // CATALOG, FLAGS, ISRC, PREGAP... change nothing a track list shows
+    }
+    return finishSheet(sheet, audio);
+}
+
+bool cueLoad(const char *path, StrArena *strings, CueSheet *sheet, MetaIoStats *io) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    char *text = (char*)malloc(CUE_MAX_BYTES);
+    if (!text) {
+        fclose(f);
+        return false;
+    }
+    size_t len = fread(text, 1, CUE_MAX_BYTES, f);
+    bool whole = len < CUE_MAX_BYTES || fgetc(f) == EOF;
+    fclose(f);
+    if (io) {
+        io->bytesRead += len;
+        io->reads++;
+    }
+    bool ok = whole && cueParse(text, len, strings, sheet);
+    free(text);
+    return ok;
+}
+
+// --- FLAC CUESHEET Blocks ---
+// Media catalog number (128), lead-in samples (8), CD flag and reserved
+// bytes (259), track count (1); then per track its offset in samples (8),
+// number (1), ISRC (12), type and reserved bytes (14), index count (1), each
+// index an offset from the track's (8), number (1) and reserved bytes (3).
+
+#define FLAC_BLOCK_CUESHEET   5
+#define FLAC_CUE_HEADER_SIZE  396
+#define FLAC_CUE_TRACK_SIZE   36
+#define FLAC_CUE_INDEX_SIZE   12
+#define FLAC_CUE_LEAD_OUT_CD  170
+#define FLAC_CUE_LEAD_OUT     255
+
+static uint64_t be64(const uint8_t *p) {
+    return ((uint64_t)metaBe32(p) << 32) | metaBe32(p + 4);
+}
+
+bool cueReadFlac(MetaReader *reader, CueSheet *sheet) {
+    memset(sheet, 0, sizeof(*sheet));
+    replayGainInit(&sheet->gain);
+    bool audio[CUE_MAX_TRACKS];
+    MetaSpan block;
+    if (!flacFindBlock(reader, FLAC_BLOCK_CUESHEET, &block) || block.len < FLAC_CUE_HEADER_SIZE) return false;
+    const uint8_t *header = metaReaderPeek(reader, block.offset, FLAC_CUE_HEADER_SIZE);
+    if (!header) return false;
+    uint32_t numTracks = header[FLAC_CUE_HEADER_SIZE - 1];
+
+    uint64_t pos = block.offset + FLAC_CUE_HEADER_SIZE;
+    uint64_t end = block.offset + block.len;
+    for (uint32_t t = 0; t < numTracks; ++t) {
+        if (pos + FLAC_CUE_TRACK_SIZE > end) return false;
+        const uint8_t *p = metaReaderPeek(reader, pos, FLAC_CUE_TRACK_SIZE);
+        if (!p) return false;
+        uint64_t offset = be64(p);
+        uint32_t number = p[8];
+        bool isAudio = (p[21] & 0x80) == 0;
+        uint32_t numIndexes = p[35];
+        pos += FLAC_CUE_TRACK_SIZE;
+
+        if (number == FLAC_CUE_LEAD_OUT_CD || number == FLAC_CUE_LEAD_OUT) {
+            sheet->end = offset;
+            break;
+        }
+        if (sheet->count == CUE_MAX_TRACKS) return false;
+        CueTrack *track = &sheet->tracks[sheet->count];
+        memset(track, 0, sizeof(*track));
+        replayGainInit(&track->gain);
+        track->number = number;
+        track->start = CUE_NO_START;
+        audio[sheet->count++] = isAudio;
+        for (uint32_t i = 0; i < numIndexes; ++i) {
+            if (pos + FLAC_CUE_INDEX_SIZE > end || !(p = metaReaderPeek(reader, pos, FLAC_CUE_INDEX_SIZE))) {
+                return false;
+            }
+            pos += FLAC_CUE_INDEX_SIZE;
+            // INDEX 01, or the first one if there is none
+            if (p[8] == 1 || track->start == CUE_NO_START) track->start = offset + be64(p);
+        }
+    }
+    return finishSheet(sheet, audio);
+}
+
+// --- Lookup ---
+
+// Length of `name` without its extension.
+static size_t stemLength(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return (dot && dot != name) ? (size_t)(dot - name) : strlen(name);
+}
+
+bool cueNamesFile(const CueSheet *sheet, const char *name, bool anyExtension) {
+    // FILE may carry a folder, with either kind of slash
+    const char *file = sheet->file;
+    for (const char *s = sheet->file; *s; ++s) {
+        if (*s == '/' || *s == '\\') file = s + 1;
+    }
+    if (!anyExtension) return strcasecmp(file, name) == 0;
+    size_t len = stemLength(file);
+    return len > 0 && len == stemLength(name) && strncasecmp(file, name, len) == 0;
+}
+
+static uint64_t toFrames(const CueSheet *sheet, uint64_t units, uint32_t sampleRate) {
+    return sheet->rate ? units * sampleRate / sheet->rate : units;
+}
+
+uint64_t cueTrackStart(const CueSheet *sheet, uint32_t i, uint32_t sampleRate) {
+    return toFrames(sheet, sheet->tracks[i].start, sampleRate);
+}
+
+uint64_t cueTrackEnd(const CueSheet *sheet, uint32_t i, uint32_t sampleRate, uint64_t frameCount) {
+    uint64_t end = frameCount;
+    if (i + 1 < sheet->count) end = cueTrackStart(sheet, i + 1, sampleRate);
+    else if (sheet->end) end = toFrames(sheet, sheet->end, sampleRate);
+    return end < frameCount ? end : frameCount;
+}
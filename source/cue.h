@@ -0,0 +1,73 @@
+#ifndef CUE_H
+#define CUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "metadata.h"
+
+// --- Cue Sheets ---
+// A single-file album rip (one FLAC or WAV "image") comes with a cue sheet
+// that splits it into tracks: a .cue text file beside it, or a CUESHEET
+// block inside the FLAC. The scanner expands the image into one catalog row
+// per track, each carrying the track's first and end PCM frame, so a player
+// seeks straight to it instead of decoding from the start of the image.
+//
+// Only what a track list needs is read: the album and track titles and
+// performers, and each track's INDEX 01 (the start a player jumps to;
+// pregaps stay with the track before), plus the REM REPLAYGAIN_* lines
+// rippers write. Sheets that spread their tracks over
+// several FILEs are per-track rips already and are left alone.
+
+#define CUE_MAX_TRACKS  99          // The Red Book limit
+#define CUE_MAX_BYTES   (64 * 1024) // Larger .cue files are not real cue sheets
+#define CUE_MAX_NAME    768         // FILE name bytes, terminator included
+#define CUE_SECTOR_RATE 75          // CD frames per second: the unit of .cue INDEX times
+
+typedef struct {
+    uint32_t number;    // TRACK number as written
+    uint64_t start;     // INDEX 01, in the sheet's units (see CueSheet.rate)
+    uint32_t title;     // StrArena refs (STRARENA_NONE if absent)
+    uint32_t performer;
+    uint8_t textFlags;  // TEXT_FLAG_* of the two strings
+    ReplayGain gain;    // From REMs inside the TRACK
+} CueTrack;
+
+typedef struct {
+    char file[CUE_MAX_NAME]; // The image, as FILE names it ("" for a FLAC's own cuesheet)
+    uint32_t rate;           // Units of the track starts per second; 0 = already PCM frames
+    uint64_t end;            // End of the last track in the same units (FLAC lead-out); 0 = end of file
+    uint32_t title;          // Album title and performer
+    uint32_t performer;
+    uint8_t textFlags;
+    ReplayGain gain;         // From REMs before the first TRACK: the album's
+    CueTrack tracks[CUE_MAX_TRACKS];
+    uint32_t count;          // Audio tracks, in ascending start order
+} CueSheet;
+
+// True for a ".cue" filename.
+bool cueIsSheetName(const char *name);
+
+// Parses .cue text. Titles and performers are read as UTF-8 if the whole
+// sheet is valid UTF-8, else as Latin-1 (what Windows rippers write), and
+// interned into `strings`. Returns false unless it lists at least one audio
+// track, all in a single FILE.
+bool cueParse(const char *text, size_t len, StrArena *strings, CueSheet *sheet);
+// Reads and parses a .cue file (up to CUE_MAX_BYTES), adding its I/O to `io`
+// (may be NULL).
+bool cueLoad(const char *path, StrArena *strings, CueSheet *sheet, MetaIoStats *io);
+// Reads a FLAC's own CUESHEET block. Track starts come out in PCM frames.
+bool cueReadFlac(MetaReader *reader, CueSheet *sheet);
+
+// True if the sheet's FILE is `name` (a basename), ignoring case. With
+// `anyExtension` only the stems need to match: rippers often write the cue
+// for a .wav that is later encoded to .flac.
+bool cueNamesFile(const CueSheet *sheet, const char *name, bool anyExtension);
+
+// Track `i`'s first PCM frame, and the frame after its last, at
+// `sampleRate`; the last track ends at the sheet's end, or `frameCount`.
+uint64_t cueTrackStart(const CueSheet *sheet, uint32_t i, uint32_t sampleRate);
+uint64_t cueTrackEnd(const CueSheet *sheet, uint32_t i, uint32_t sampleRate, uint64_t frameCount);
+
+#endif
@@ -0,0 +1,9 @@
+// Implementations of the vendored dr_libs decoders. The loudness analyser
+// decodes through them on the device; pearscan also measures the tag
+// readers against a full dr_flac open.
+#define DR_FLAC_IMPLEMENTATION
+#include "dr_flac.h"
+#define DR_MP3_IMPLEMENTATION
+#include "dr_mp3.h"
+#define DR_WAV_IMPLEMENTATION
+#include "dr_wav.h"
@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "metadata.h"
+
+// --- FLAC Metadata Blocks ---
+// Walks the metadata block headers after "fLaC" and stops at the block
+// flagged last, so no audio frame is touched. STREAMINFO gives the sample
+// rate and length; VORBIS_COMMENT the tags. PICTURE, PADDING, SEEKTABLE and
+// the rest are skipped by offset without reading their payload.
+
+#define FLAC_BLOCK_STREAMINFO     0
+#define FLAC_BLOCK_VORBIS_COMMENT 4
+#define FLAC_BLOCK_PICTURE        6
+#define FLAC_PICTURE_FRONT        3
+#define FLAC_STREAMINFO_SIZE      34
+#define FLAC_MAX_BLOCKS           64 // Real files have a handful; stop runaway walks
+
+static void readStreamInfo(const uint8_t *info, TrackMetadata *meta) {
+    // 20-bit sample rate, 3-bit channels, 5-bit depth, 36-bit total samples
+    uint32_t sampleRate = ((uint32_t)info[10] << 12) | ((uint32_t)info[11] << 4) | (info[12] >> 4);
+    uint64_t totalSamples = ((uint64_t)(info[13] & 0x0F) << 32) | metaBe32(info + 14);
+    meta->sampleRate = sampleRate;
+    meta->frameCount = totalSamples;
+    if (sampleRate > 0 && totalSamples > 0) {
+        meta->durationMs = (uint32_t)(totalSamples * 1000 / sampleRate);
+    }
+}
+
+void flacRead(MetaReader *reader, StrArena *strings, TrackMetadata *meta) {
+    uint64_t pos = id3PrefixSize(reader);
+    const uint8_t *marker = metaReaderPeek(reader, pos, 4);
+    if (!marker || memcmp(marker, "fLaC", 4) != 0) return;
+    pos += 4;
+
+    for (int n = 0; n < FLAC_MAX_BLOCKS; ++n) {
+        const uint8_t *header = metaReaderPeek(reader, pos, 4);
+        if (!header) return;
+        bool last = (header[0] & 0x80) != 0;
+        uint8_t type = header[0] & 0x7F;
+        uint32_t length = metaBe24(header + 1);
+        uint64_t body = pos + 4;
+
+        if (type == FLAC_BLOCK_STREAMINFO && length >= FLAC_STREAMINFO_SIZE) {
+            const uint8_t *info = metaReaderPeek(reader, body, FLAC_STREAMINFO_SIZE);
+            if (info) readStreamInfo(info, meta);
+        } else if (type == FLAC_BLOCK_VORBIS_COMMENT) {
+            MetaSpan block = { body, length };
+            vorbisCommentRead(reader, &block, 1, 0, strings, meta);
+        }
+
+        if (last) return;
+        pos = body + length;
+    }
+}
+
+bool flacFindBlock(MetaReader *reader, uint8_t type, MetaSpan *block) {
+    uint64_t pos = id3PrefixSize(reader);
+    const uint8_t *marker = metaReaderPeek(reader, pos, 4);
+    if (!marker || memcmp(marker, "fLaC", 4) != 0) return false;
+    pos += 4;
+
+    for (int n = 0; n < FLAC_MAX_BLOCKS; ++n) {
+        const uint8_t *header = metaReaderPeek(reader, pos, 4);
+        if (!header) return false;
+        bool last = (header[0] & 0x80) != 0;
+        uint32_t length = metaBe24(header + 1);
+        if ((header[0] & 0x7F) == type) {
+            block->offset = pos + 4;
+            block->len = length;
+            return true;
+        }
+        if (last) return false;
+        pos += 4 + (uint64_t)length;
+    }
+    return false;
+}
+
+// Reads a PICTURE block's header fields and locates its image data.
+static bool readPictureBlock(MetaReader *reader, uint64_t body, uint32_t length, uint32_t *pictureType,
+                             MetaSpan *picture) {
+    uint64_t end = body + length;
+    const uint8_t *p = metaReaderPeek(reader, body, 8);
+    if (!p || length < 32) return false;
+    *pictureType = metaBe32(p);
+    uint64_t pos = body + 8 + (uint64_t)metaBe32(p + 4); // MIME type
+    if (pos + 4 > end || !(p = metaReaderPeek(reader, pos, 4))) return false;
+    pos += 4 + (uint64_t)metaBe32(p) + 16; // Description, then width, height, depth, colours
+    if (pos + 4 > end || !(p = metaReaderPeek(reader, pos, 4))) return false;
+    uint32_t dataLen = metaBe32(p);
+    if (dataLen > end - (pos + 4)) return false;
+    picture->offset = pos + 4;
+    picture->len = dataLen;
+    return true;
+}
+
+bool flacFindPicture(MetaReader *reader, MetaSpan *picture) {
+    uint64_t pos = id3PrefixSize(reader);
+    const uint8_t *marker = metaReaderPeek(reader, pos, 4);
+    if (!marker || memcmp(marker, "fLaC", 4) != 0) return false;
+    pos += 4;
+
+    bool found = false;
+    for (int n = 0; n < FLAC_MAX_BLOCKS; ++n) {
+        const uint8_t *header = metaReaderPeek(reader, pos, 4);
+        if (!header) break;
+        bool last = (header[0] & 0x80) != 0;
+        uint8_t type = header[0] & 0x7F;
+        uint32_t length = metaBe24(header + 1);
+        uint64_t body = pos + 4;
+
+        MetaSpan candidate;
+        uint32_t pictureType;
+        if (type == FLAC_BLOCK_PICTURE && readPictureBlock(reader, body, length, &pictureType, &candidate)) {
+            // The first picture, unless a front cover follows it
+            if (!found || pictureType == FLAC_PICTURE_FRONT) *picture = candidate;
+            found = true;
+            if (pictureType == FLAC_PICTURE_FRONT) break;
+        }
+
+        if (last) break;
+        pos = body + length;
+    }
+    return found;
+}
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "groupindex.h"
+#include "sortindex.h"
+
+typedef struct {
+    uint64_t artistKey;  // Collation keys (sortCollationKey())
+    uint64_t albumKey;
+    const char *artist;  // NULL if absent
+    const char *album;
+    uint32_t track;      // Track number; UINT32_MAX if unknown, so those follow the numbered ones
+    uint32_t order;      // Then the caller's track order
+    uint32_t row;        // Catalog row
+} GroupRecord;
+
+// Interned strings: the same pointer is the same name, with no compare
+static int compareArtists(const GroupRecord *a, const GroupRecord *b) {
+    return a->artist == b->artist ? 0 : sortCompareStrings(a->artistKey, a->artist, b->artistKey, b->artist);
+}
+
+static int compareAlbums(const GroupRecord *a, const GroupRecord *b) {
+    return a->album == b->album ? 0 : sortCompareStrings(a->albumKey, a->album, b->albumKey, b->album);
+}
+
+static int compareRecords(const void *a, const void *b) {
+    const GroupRecord *ra = (const GroupRecord*)a;
+    const GroupRecord *rb = (const GroupRecord*)b;
+    int cmp = compareArtists(ra, rb);
+    if (cmp == 0) cmp = compareAlbums(ra, rb);
+    if (cmp == 0) cmp = ra->track < rb->track ? -1 : (ra->track > rb->track ? 1 : 0);
+    if (cmp == 0) cmp = ra->order < rb->order ? -1 : (ra->order > rb->order ? 1 : 0);
+    return cmp;
+}
+
+void groupIndexInit(GroupIndex *index) {
+    memset(index, 0, sizeof(*index));
+}
+
+void groupIndexFree(GroupIndex *index) {
+    free(index->tracks);
+    free(index->albumOf);
+    free(index->albums);
+    free(index->artists);
+    free(index->albumRows);
+    groupIndexInit(index);
+}
+
+uint32_t groupIndexMemoryUsed(const GroupIndex *index) {
+    if (!index->tracks) return 0;
+    uint32_t tracks = index->albums[index->albumCount].firstTrack;
+    return (tracks + index->count) * (uint32_t)sizeof(uint32_t)
+         + (index->albumCount + 1) * (uint32_t)(sizeof(GroupAlbum) + sizeof(uint32_t))
+         + (index->artistCount + 1) * (uint32_t)sizeof(GroupArtist);
+}
+
+bool groupIndexBuild(GroupIndex *index, const Catalog *catalog, const uint32_t *rank) {
+    groupIndexFree(index);
+    uint32_t count = catalog->count;
+    if (count == 0) return true;
+
+    GroupRecord *records = (GroupRecord*)malloc(count * sizeof(GroupRecord));
+    if (!records) return false;
+    uint32_t n = 0;
+    for (uint32_t row = 0; row < count; ++row) {
+        if (CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_MESSAGE) continue;
+        GroupRecord *rec = &records[n++];
+        rec->artist = catalogString(catalog, CATALOG_FIELD(catalog, artist, row));
+        rec->album = catalogString(catalog, CATALOG_FIELD(catalog, album, row));
+        rec->artistKey = sortCollationKey(rec->artist);
+        rec->albumKey = sortCollationKey(rec->album);
+        uint16_t track = CATALOG_FIELD(catalog, trackNumber, row);
+        rec->track = track ? track : UINT32_MAX;
+        rec->order = rank ? rank[row] : row;
+        rec->row = row;
+    }
+    if (n == 0) {
+        free(records);
+        return true;
+    }
+    qsort(records, n, sizeof(GroupRecord), compareRecords);
+
+    // Count the groups, then fill exactly sized arrays
+    uint32_t artistCount = 0, albumCount = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        bool newArtist = i == 0 || compareArtists(&records[i - 1], &records[i]) != 0;
+        if (newArtist) artistCount++;
+        if (newArtist || compareAlbums(&records[i - 1], &records[i]) != 0) albumCount++;
+    }
+    index->tracks = (uint32_t*)malloc(n * sizeof(uint32_t));
+    index->albumOf = (uint32_t*)malloc(count * sizeof(uint32_t));
+    index->albums = (GroupAlbum*)malloc((albumCount + 1) * sizeof(GroupAlbum));
+    index->artists = (GroupArtist*)malloc((artistCount + 1) * sizeof(GroupArtist));
+    index->albumRows = (uint32_t*)malloc((albumCount + 1) * sizeof(uint32_t));
+    if (!index->tracks || !index->albumOf || !index->albums || !index->artists || !index->albumRows) {
+        free(records);
+        groupIndexFree(index);
+        return false;
+    }
+    memset(index->albumOf, 0xFF, count * sizeof(uint32_t)); // Message rows belong to no album
+
+    uint32_t artist = UINT32_MAX, album = UINT32_MAX;
+    for (uint32_t i = 0; i < n; ++i) {
+        const GroupRecord *rec = &records[i];
+        bool newArtist = i == 0 || compareArtists(&records[i - 1], rec) != 0;
+        if (newArtist) {
+            GroupArtist *a = &index->artists[++artist];
+            a->name = CATALOG_FIELD(catalog, artist, rec->row);
+            a->firstAlbum = album + 1;
+        }
+        if (newArtist || compareAlbums(&records[i - 1], rec) != 0) {
+            GroupAlbum *a = &index->albums[++album];
+            a->name = CATALOG_FIELD(catalog, album, rec->row);
+            a->artist = artist;
+            a->firstTrack = i;
+            a->row = rec->row;
+            index->albumRows[album] = rec->row;
+        }
+        index->tracks[i] = rec->row;
+        index->albumOf[rec->row] = album;
+    }
+    free(records);
+
+    // Sentinels close the last slices
+    index->artists[artistCount] = (GroupArtist){ STRARENA_NONE, albumCount };
+    index->albums[albumCount] = (GroupAlbum){ STRARENA_NONE, artistCount, n, UINT32_MAX };
+    index->albumRows[albumCount] = UINT32_MAX;
+    index->artistCount = artistCount;
+    index->albumCount = albumCount;
+    index->count = count;
+    return true;
+}
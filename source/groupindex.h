@@ -0,0 +1,71 @@
+#ifndef GROUPINDEX_H
+#define GROUPINDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "catalog.h"
+
+// --- Artist / Album Grouping ---
+// Artist -> albums -> tracks, built once after a scan with a single sort of
+// the catalog rows by (artist, album, track number, track order). Each
+// level is a slice of the level below it, CSR style: an artist's albums are
+// albums[firstAlbum .. next artist's firstAlbum), an album's tracks are
+// tracks[firstTrack .. next album's firstTrack). Opening either is O(1) and
+// listing it O(k), with no pass over the library.
+//
+// Names compare like the sort index (collation key, then case-insensitive),
+// so "The Beatles" and "the beatles" are one artist. Catalog strings are
+// interned, so rows with the same artist share a pointer and most compares
+// end there. Untagged tracks group under a NULL artist / album, last.
+// An album is per artist: a compilation is listed under each of its artists
+// with their own tracks.
+//
+// Memory: 8 bytes per track (tracks, albumOf) + 20 per album + 8 per artist.
+
+typedef struct {
+    uint32_t name;       // Album title ref (STRARENA_NONE for untagged tracks)
+    uint32_t artist;     // Index into GroupIndex.artists
+    uint32_t firstTrack; // Index into GroupIndex.tracks
+    uint32_t row;        // Catalog row of its first track, standing for the album in lists
+} GroupAlbum;
+
+typedef struct {
+    uint32_t name;       // Artist ref (STRARENA_NONE for untagged tracks)
+    uint32_t firstAlbum; // Index into GroupIndex.albums
+} GroupArtist;
+
+typedef struct {
+    uint32_t *tracks;     // Catalog rows by artist, album, then track order
+    uint32_t *albumOf;    // Catalog row -> album index
+    GroupAlbum *albums;   // albumCount + 1: the last only ends the final album
+    GroupArtist *artists; // artistCount + 1, likewise
+    uint32_t *albumRows;  // GroupAlbum.row of every album, so a list can show them in place
+    uint32_t albumCount;
+    uint32_t artistCount;
+    uint32_t count;       // Catalog rows covered
+} GroupIndex;
+
+void groupIndexInit(GroupIndex *index);
+// Groups the catalog's rows. Within an album tracks follow their track
+// numbers, unnumbered ones last; equal numbers follow `rank` (e.g. a
+// SortIndex rank array, by filename), or scan order if it is NULL. Returns
+// false if out of memory; the index is left empty.
+bool groupIndexBuild(GroupIndex *index, const Catalog *catalog, const uint32_t *rank);
+void groupIndexFree(GroupIndex *index);
+// Bytes held by the index.
+uint32_t groupIndexMemoryUsed(const GroupIndex *index);
+
+// An album's catalog rows; returns how many.
+static inline uint32_t groupAlbumTracks(const GroupIndex *index, uint32_t album, const uint32_t **rows) {
+    *rows = index->tracks + index->albums[album].firstTrack;
+    return index->albums[album + 1].firstTrack - index->albums[album].firstTrack;
+}
+
+// An artist's first album index; returns how many albums it has.
+static inline uint32_t groupArtistAlbums(const GroupIndex *index, uint32_t artist, uint32_t *firstAlbum) {
+    *firstAlbum = index->artists[artist].firstAlbum;
+    return index->artists[artist + 1].firstAlbum - index->artists[artist].firstAlbum;
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "hashjob.h"
+#include "libindex.h"
+#include "scanner.h"
+
+void hashJobInit(HashJob *job, const char *musicDir, StrArena *strings) {
+    memset(job, 0, sizeof(*job));
+    atomic_init(&job->slot.state, HASH_SLOT_FREE);
+    job->musicDir = musicDir;
+    job->strings = strings;
+    atomic_init(&job->stop, false);
+}
+
+// --- Worker ---
+
+// Hashes the queued file. The stat comes first so the hash is saved only
+// over a record of the file as it was hashed.
+static bool hashSlotFile(HashJob *job, HashSlot *slot) {
+    const char *relPath = strArenaGet(job->strings, slot->filename);
+    char path[PATH_MAX];
+    int n = relPath ? snprintf(path, sizeof(path), "%s/%s", job->musicDir, relPath) : -1;
+    if (n < 0 || (size_t)n >= sizeof(path)) return false;
+    struct stat st;
+    if (!scanStatPath(path, &st, &slot->mtime)) return false;
+    slot->size = (uint64_t)st.st_size;
+    return contentHashFile(path, slot->size, job->buffer, &slot->contentHash, &slot->io);
+}
+
+static void hashJobMain(void *arg) {
+    HashJob *job = (HashJob*)arg;
+    HashSlot *slot = &job->slot;
+    while (!atomic_load(&job->stop)) {
+        if (atomic_load(&slot->state) != HASH_SLOT_QUEUED) {
+            bgThreadSleepUs(HASH_JOB_IDLE_US);
+            continue;
+        }
+        atomic_store(&slot->state, HASH_SLOT_BUSY);
+
+        uint64_t startUs = scanNowUs();
+        memset(&slot->io, 0, sizeof(slot->io));
+        slot->hashed = hashSlotFile(job, slot);
+        slot->busyUs = scanNowUs() - startUs;
+        atomic_store(&slot->state, HASH_SLOT_DONE);
+    }
+}
+
+bool hashJobStart(HashJob *job) {
+    job->buffer = (uint8_t*)malloc(CONTENT_HASH_SPAN);
+    if (!job->buffer) {
+        perror("out of memory for hash buffer");
+        return false;
+    }
+    atomic_store(&job->stop, false);
+    job->thread = bgThreadStartOn(hashJobMain, job, true, bgThreadCores() - 1);
+    if (!job->thread) {
+        perror("failed to start hash thread");
+        free(job->buffer);
+        job->buffer = NULL;
+        return false;
+    }
+    return true;
+}
+
+void hashJobStop(HashJob *job) {
+    if (!job->thread) return;
+    atomic_store(&job->stop, true);
+    bgThreadJoin(job->thread);
+    job->thread = NULL;
+    free(job->buffer);
+    job->buffer = NULL;
+    atomic_store(&job->slot.state, HASH_SLOT_FREE);
+}
+
+// --- Render Thread ---
+
+static void applySlot(HashJob *job, Catalog *catalog) {
+    HashSlot *slot = &job->slot;
+    job->stats.busyUs += slot->busyUs;
+    job->stats.bytesRead += slot->io.bytesRead;
+    job->stats.reads += slot->io.reads;
+    if (!slot->hashed) {
+        job->stats.failed++; // Tried again on a later sweep, if there is one
+        return;
+    }
+    job->stats.hashed++;
+    if (slot->row >= catalog->count || CATALOG_FIELD(catalog, filename, slot->row) != slot->filename) return;
+    CATALOG_FIELD(catalog, contentHash, slot->row) = slot->contentHash;
+
+    if (job->unsavedCount == job->unsavedCapacity) {
+        uint32_t capacity = job->unsavedCapacity ? job->unsavedCapacity * 2 : 64;
+        HashJobUnsaved *grown = (HashJobUnsaved*)realloc(job->unsaved, capacity * sizeof(HashJobUnsaved));
+        if (!grown) return; // Not saved: hashed again after the next scan
+        job->unsaved = grown;
+        job->unsavedCapacity = capacity;
+    }
+    HashJobUnsaved *unsaved = &job->unsaved[job->unsavedCount++];
+    unsaved->row = slot->row;
+    unsaved->size = slot->size;
+    unsaved->mtime = slot->mtime;
+}
+
+// True if the row is a whole file that hasn't been hashed.
+static bool needsHashing(const Catalog *catalog, uint32_t row) {
+    return !(CATALOG_FIELD(catalog, flags, row) & (CATALOG_FLAG_MESSAGE | CATALOG_FLAG_CUE)) &&
+           CATALOG_FIELD(catalog, contentHash, row) == CONTENT_HASH_NONE;
+}
+
+uint32_t hashJobUpdate(HashJob *job, Catalog *catalog) {
+    HashSlot *slot = &job->slot;
+    uint32_t state = atomic_load(&slot->state);
+    uint32_t filled = 0;
+    if (state == HASH_SLOT_DONE) {
+        applySlot(job, catalog);
+        atomic_store(&slot->state, HASH_SLOT_FREE);
+        filled = slot->hashed ? 1 : 0;
+    } else if (state != HASH_SLOT_FREE) {
+        return 0;
+    }
+    if (job->restUpdates > 0) {
+        job->restUpdates--;
+        return filled;
+    }
+
+    for (uint32_t looked = 0; looked < HASH_JOB_ROWS; ++looked) {
+        if (job->nextRow >= catalog->count) {
+            // Round again once the tag loader may have read the rows passed
+            // over; a sweep that passed none leaves nothing for later
+            job->nextRow = 0;
+            job->restUpdates = job->passedPending ? HASH_JOB_RESWEEP : UINT32_MAX;
+            job->passedPending = false;
+            return filled;
+        }
+        uint32_t row = job->nextRow++;
+        if (CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_PENDING) {
+            job->passedPending = true;
+            continue;
+        }
+        if (!needsHashing(catalog, row)) continue;
+        slot->row = row;
+        slot->filename = CATALOG_FIELD(catalog, filename, row);
+        atomic_store(&slot->state, HASH_SLOT_QUEUED);
+        break;
+    }
+    return filled;
+}
+
+bool hashJobCollect(HashJob *job, const Catalog *catalog, LibIndexUpdate *update) {
+    bool ok = true;
+    if (job->unsavedCount > 0) {
+        LibIndexHash *hashes = (LibIndexHash*)malloc(job->unsavedCount * sizeof(LibIndexHash));
+        if (hashes) {
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < job->unsavedCount; ++i) {
+                const HashJobUnsaved *unsaved = &job->unsaved[i];
+                uint32_t row = unsaved->row;
+                const char *name = (row < catalog->count) ? catalogString(catalog, CATALOG_FIELD(catalog, filename, row))
+                                                          : NULL;
+                if (!name) continue;
+                hashes[n].name = name;
+                hashes[n].size = unsaved->size;
+                hashes[n].mtime = unsaved->mtime;
+                hashes[n].contentHash = CATALOG_FIELD(catalog, contentHash, row);
+                n++;
+            }
+            update->hashes = hashes;
+            update->hashCount = n;
+        } else {
+            perror("out of memory for content hashes");
+            ok = false;
+        }
+    }
+    free(job->unsaved);
+    job->unsaved = NULL;
+    job->unsavedCount = 0;
+    job->unsavedCapacity = 0;
+    return ok;
+}
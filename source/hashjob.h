@@ -0,0 +1,97 @@
+#ifndef HASHJOB_H
+#define HASHJOB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "catalog.h"
+#include "contenthash.h"
+#include "libindex.h"
+#include "bgthread.h"
+
+// --- Background Content Hashing ---
+// Hashes every track's file once (see contenthash.h) on a low-priority
+// thread after the scan, so the next scan can recognise it if it has been
+// moved or renamed by then. It works like the loudness job: the render
+// thread picks the next unhashed row and hands it over in a single slot,
+// then writes the hash into the catalog's contentHash column, which also
+// keys the row's cover art from then on. Hashes are saved to the library
+// index when the job stops.
+//
+// Rows with pending tags are passed over until the tag loader has read
+// them, since only records with tags are worth finding again; cue sheet
+// tracks are left out, as a moved image is split again anyway.
+
+#define HASH_JOB_ROWS     512   // Catalog rows looked at per update
+#define HASH_JOB_IDLE_US  20000 // Worker sleep while nothing is queued
+#define HASH_JOB_RESWEEP  600   // Updates to wait before looking at passed-over rows again
+
+typedef enum {
+    HASH_SLOT_FREE = 0,
+    HASH_SLOT_QUEUED, // Filled by the render thread
+    HASH_SLOT_BUSY,   // Being hashed
+    HASH_SLOT_DONE    // Result ready for the render thread
+} HashSlotState;
+
+typedef struct {
+    _Atomic uint32_t state; // HashSlotState
+    uint32_t row;           // Catalog row
+    uint32_t filename;      // Copied so the worker never reads the columns
+    bool hashed;            // Written by the worker: false if the file couldn't be read
+    uint64_t contentHash;
+    uint64_t size;          // The file as stat'ed just before hashing
+    int64_t mtime;
+    uint64_t busyUs;
+    MetaIoStats io;
+} HashSlot;
+
+typedef struct {
+    uint32_t hashed;     // Files hashed
+    uint32_t failed;     // Files that couldn't be read
+    uint64_t busyUs;     // Worker time spent on it
+    uint64_t bytesRead;
+    uint32_t reads;
+} HashJobStats;
+
+// One hash waiting to be saved.
+typedef struct {
+    uint32_t row;
+    uint64_t size;
+    int64_t mtime;
+} HashJobUnsaved;
+
+typedef struct {
+    HashSlot slot;
+    const char *musicDir;
+    StrArena *strings;    // The catalog's arena; the worker only reads filenames from it
+    uint8_t *buffer;      // CONTENT_HASH_SPAN bytes, the worker's
+    BgThread *thread;
+    atomic_bool stop;
+    uint32_t nextRow;     // Where the search for work carries on
+    bool passedPending;   // This sweep passed rows whose tags are still pending
+    uint32_t restUpdates; // Updates left before the next sweep
+    HashJobUnsaved *unsaved; // Rows hashed since the last save
+    uint32_t unsavedCount;
+    uint32_t unsavedCapacity;
+    HashJobStats stats;
+} HashJob;
+
+void hashJobInit(HashJob *job, const char *musicDir, StrArena *strings);
+// Starts the worker at low priority on the last core bgThreadCores() offers.
+// Start it after the scan is drained and stop it before the catalog is cleared.
+bool hashJobStart(HashJob *job);
+// Stops and joins the worker; a file being hashed is dropped.
+void hashJobStop(HashJob *job);
+
+// Render thread, once per frame: writes a finished hash into the catalog
+// and queues the next row that needs one. Returns the number of rows
+// written (0 or 1).
+uint32_t hashJobUpdate(HashJob *job, Catalog *catalog);
+
+// Hands the hashes taken since the last call to `update`, to be saved into
+// the library index. The list is dropped either way; the catalog keeps the
+// values. Returns false if out of memory.
+bool hashJobCollect(HashJob *job, const Catalog *catalog, LibIndexUpdate *update);
+
+#endif
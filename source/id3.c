@@ -0,0 +1,384 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "metadata.h"
+
+// --- ID3v2.2 / 2.3 / 2.4 and ID3v1 ---
+// Walks the frame headers of the tag at the start of the file. Frames we
+// display are read (a few hundred bytes at most); everything else, APIC
+// artwork included, is skipped by moving the offset past it. ID3v1 is read
+// only when the v2 tag is missing a field, with one 128-byte read at the end.
+// ReplayGain TXXX frames are picked up on the way; once the fields we show
+// are in, the walk goes on only as far as the reads so far reach.
+
+#define ID3_HEADER_SIZE  10
+#define ID3V1_SIZE       128
+#define ID3_TEXT_MAX     1024        // Longest text frame payload we read
+#define ID3_UNSYNC_MAX   (64 * 1024) // Tag prefix buffered when the whole tag is unsynchronised
+
+typedef enum {
+    ID3_FIELD_NONE,
+    ID3_FIELD_TITLE,
+    ID3_FIELD_ARTIST,
+    ID3_FIELD_ALBUM_ARTIST,
+    ID3_FIELD_ALBUM,
+    ID3_FIELD_TRACK,
+    ID3_FIELD_LENGTH,
+    ID3_FIELD_USER_TEXT // TXXX: a description, then its value
+} Id3Field;
+
+// Tag bytes come from the file, or from memory once a whole-tag
+// unsynchronisation has been undone. Offsets are from the start of the file.
+typedef struct {
+    MetaReader *reader;
+    uint8_t *mem;     // Tag body (after the header) when buffered, else NULL
+    uint32_t memLen;
+} Id3Source;
+
+static const uint8_t* sourceBytes(Id3Source *src, uint32_t offset, uint32_t len) {
+    if (!src->mem) return metaReaderPeek(src->reader, offset, len);
+    if (offset < ID3_HEADER_SIZE || offset - ID3_HEADER_SIZE + len > src->memLen) return NULL;
+    return src->mem + (offset - ID3_HEADER_SIZE);
+}
+
+static uint32_t syncsafe32(const uint8_t *p) {
+    return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) |
+           ((uint32_t)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+// Removes the 0x00 inserted after every 0xFF; returns the new length.
+static uint32_t undoUnsync(uint8_t *data, uint32_t len) {
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        data[out++] = data[i];
+        if (data[i] == 0xFF && i + 1 < len && data[i + 1] == 0x00) i++;
+    }
+    return out;
+}
+
+static Id3Field fieldForId(const uint8_t *id, bool shortIds) {
+    if (shortIds) {
+        if (memcmp(id, "TT2", 3) == 0) return ID3_FIELD_TITLE;
+        if (memcmp(id, "TP1", 3) == 0) return ID3_FIELD_ARTIST;
+        if (memcmp(id, "TP2", 3) == 0) return ID3_FIELD_ALBUM_ARTIST;
+        if (memcmp(id, "TAL", 3) == 0) return ID3_FIELD_ALBUM;
+        if (memcmp(id, "TRK", 3) == 0) return ID3_FIELD_TRACK;
+        if (memcmp(id, "TLE", 3) == 0) return ID3_FIELD_LENGTH;
+        if (memcmp(id, "TXX", 3) == 0) return ID3_FIELD_USER_TEXT;
+        return ID3_FIELD_NONE;
+    }
+    if (id[0] != 'T') return ID3_FIELD_NONE; // Every frame we want is a text frame
+    if (memcmp(id, "TIT2", 4) == 0) return ID3_FIELD_TITLE;
+    if (memcmp(id, "TPE1", 4) == 0) return ID3_FIELD_ARTIST;
+    if (memcmp(id, "TPE2", 4) == 0) return ID3_FIELD_ALBUM_ARTIST;
+    if (memcmp(id, "TALB", 4) == 0) return ID3_FIELD_ALBUM;
+    if (memcmp(id, "TRCK", 4) == 0) return ID3_FIELD_TRACK;
+    if (memcmp(id, "TLEN", 4) == 0) return ID3_FIELD_LENGTH;
+    if (memcmp(id, "TXXX", 4) == 0) return ID3_FIELD_USER_TEXT;
+    return ID3_FIELD_NONE;
+}
+
+// Narrows ASCII text in any ID3 encoding: UTF-16 drops its zero high bytes
+// and byte order mark. Stops at the first terminator; returns the bytes
+// consumed, terminator included.
+static uint32_t narrowText(MetaTextEncoding encoding, const uint8_t *data, uint32_t len, char *out,
+                           uint32_t outSize, uint32_t *outLen) {
+    bool wide = encoding == META_TEXT_UTF16 || encoding == META_TEXT_UTF16BE;
+    uint32_t step = wide ? 2 : 1;
+    uint32_t i = 0, n = 0;
+    for (; i + step <= len; i += step) {
+        uint8_t c = (wide && data[i] == 0) ? data[i + 1] : data[i]; // UTF-16 in either byte order
+        if (c == 0) {
+            i += step;
+            break;
+        }
+        if (wide && (c == 0xFE || c == 0xFF)) continue;
+        if (n < outSize) out[n++] = (char)c;
+    }
+    *outLen = n;
+    return i;
+}
+
+// Stores one text frame (encoding byte + text) into `meta`.
+static void storeText(Id3Field field, const uint8_t *data, uint32_t len, StrArena *strings,
+                      TrackMetadata *meta, uint32_t *albumArtist) {
+    if (len < 2) return;
+    MetaTextEncoding encoding = (MetaTextEncoding)data[0];
+    data++;
+    len--;
+    uint8_t *flags = &meta->textFlags;
+
+    switch (field) {
+        case ID3_FIELD_TITLE:        meta->title = textConvert(strings, encoding, data, len, flags); break;
+        case ID3_FIELD_ARTIST:       meta->artist = textConvert(strings, encoding, data, len, flags); break;
+        case ID3_FIELD_ALBUM_ARTIST: *albumArtist = textConvert(strings, encoding, data, len, flags); break;
+        case ID3_FIELD_ALBUM:        meta->album = textConvert(strings, encoding, data, len, flags); break;
+        case ID3_FIELD_TRACK:
+        case ID3_FIELD_LENGTH: {
+            // Numeric frames: only digits matter, so a narrow copy is enough
+            char digits[16];
+            uint32_t n;
+            narrowText(encoding, data, len, digits, sizeof(digits), &n);
+            uint32_t value = metadataNumber((const uint8_t*)digits, n);
+            if (field == ID3_FIELD_TRACK) meta->trackNumber = value;
+            else meta->durationMs = value;
+            break;
+        }
+        case ID3_FIELD_USER_TEXT: {
+            // Only ReplayGain's are kept, and both parts of those are ASCII
+            char key[32], value[32];
+            uint32_t keyLen, valueLen;
+            uint32_t used = narrowText(encoding, data, len, key, sizeof(key), &keyLen);
+            narrowText(encoding, data + used, len - used, value, sizeof(value), &valueLen);
+            replayGainTag(&meta->gain, (const uint8_t*)key, keyLen, (const uint8_t*)value, valueLen);
+            break;
+        }
+        default: break;
+    }
+}
+
+static bool haveAllFields(const TrackMetadata *meta) {
+    return meta->title != STRARENA_NONE && meta->artist != STRARENA_NONE && meta->album != STRARENA_NONE &&
+           meta->trackNumber != 0 && meta->durationMs != 0;
+}
+
+// True if reading `len` bytes at `offset` costs no file read.
+static bool alreadyRead(const Id3Source *src, uint32_t offset, uint32_t len) {
+    if (src->mem) return true;
+    const MetaReader *reader = src->reader;
+    return offset >= reader->windowStart && offset + len <= reader->windowStart + reader->windowLen;
+}
+
+// Returns where the audio starts: the end of the tag, or 0 if there is none.
+static uint32_t readId3v2(MetaReader *reader, StrArena *strings, TrackMetadata *meta) {
+    const uint8_t *header = metaReaderPeek(reader, 0, ID3_HEADER_SIZE);
+    if (!header || memcmp(header, "ID3", 3) != 0) return 0;
+
+    uint8_t version = header[3];
+    uint8_t flags = header[5];
+    if (version < 2 || version > 4 || (header[6] | header[7] | header[8] | header[9]) & 0x80) return 0;
+
+    uint32_t tagSize = syncsafe32(header + 6);
+    if ((uint64_t)ID3_HEADER_SIZE + tagSize > reader->fileSize)
+        tagSize = (uint32_t)(reader->fileSize - ID3_HEADER_SIZE);
+    uint32_t audioStart = ID3_HEADER_SIZE + tagSize;
+    if (version == 4 && (flags & 0x10)) audioStart += ID3_HEADER_SIZE; // Footer
+    if (version == 2 && (flags & 0x40)) return audioStart; // v2.2 "compressed tag": no defined scheme
+
+    Id3Source src = { reader, NULL, 0 };
+    uint32_t end = ID3_HEADER_SIZE + tagSize;
+    bool tagUnsync = (flags & 0x80) != 0;
+    if (tagUnsync && version < 4) {
+        // v2.2/2.3 unsynchronise frame headers too, so buffer and undo it up front
+        uint32_t len = tagSize < ID3_UNSYNC_MAX ? tagSize : ID3_UNSYNC_MAX;
+        src.mem = (uint8_t*)malloc(len ? len : 1);
+        if (!src.mem || !metaReaderRead(reader, ID3_HEADER_SIZE, src.mem, len)) {
+            free(src.mem);
+            return audioStart;
+        }
+        src.memLen = undoUnsync(src.mem, len);
+        end = ID3_HEADER_SIZE + src.memLen;
+    }
+
+    uint32_t pos = ID3_HEADER_SIZE;
+    if (version >= 3 && (flags & 0x40)) {
+        const uint8_t *ext = sourceBytes(&src, pos, 4);
+        if (!ext) {
+            free(src.mem);
+            return audioStart;
+        }
+        // v2.3 counts the size field separately; v2.4 includes it (and makes it syncsafe)
+        uint32_t extSize = version == 3 ? metaBe32(ext) + 4 : syncsafe32(ext);
+        if (extSize > end - pos) {
+            free(src.mem);
+            return audioStart;
+        }
+        pos += extSize;
+    }
+
+    bool shortIds = version == 2;
+    uint32_t frameHeaderSize = shortIds ? 6 : 10;
+    uint32_t albumArtist = STRARENA_NONE;
+    while (pos + frameHeaderSize <= end) {
+        // ReplayGain frames aren't worth a read of their own
+        if (haveAllFields(meta) &&
+            (replayGainComplete(&meta->gain) || !alreadyRead(&src, pos, frameHeaderSize))) {
+            break;
+        }
+        const uint8_t *frame = sourceBytes(&src, pos, frameHeaderSize);
+        if (!frame || frame[0] == 0) break; // Padding
+
+        uint32_t size;
+        uint8_t formatFlags = 0;
+        if (shortIds) size = metaBe24(frame + 3);
+        else if (version == 4) size = syncsafe32(frame + 4);
+        else size = metaBe32(frame + 4);
+        if (!shortIds) formatFlags = frame[9];
+
+        uint32_t body = pos + frameHeaderSize;
+        if (size > end - body) break;
+        Id3Field field = fieldForId(frame, shortIds);
+        pos = body + size;
+        if (field == ID3_FIELD_NONE) continue; // Skipped without reading its payload
+
+        // Frame-level prefixes and transforms
+        uint32_t skip = 0;
+        bool frameUnsync = false;
+        if (version == 4) {
+            if (formatFlags & 0x0C) continue;  // Compressed or encrypted
+            if (formatFlags & 0x40) skip += 1; // Group id
+            if (formatFlags & 0x01) skip += 4; // Data length indicator
+            frameUnsync = (formatFlags & 0x02) || tagUnsync;
+        } else if (version == 3) {
+            if (formatFlags & 0xC0) continue;  // Compressed or encrypted
+            if (formatFlags & 0x20) skip += 1; // Group id
+        }
+        if (skip >= size) continue;
+
+        uint32_t len = size - skip < ID3_TEXT_MAX ? size - skip : ID3_TEXT_MAX;
+        const uint8_t *data = sourceBytes(&src, body + skip, len);
+        if (!data) break;
+        if (frameUnsync) {
+            uint8_t copy[ID3_TEXT_MAX];
+            memcpy(copy, data, len);
+            len = undoUnsync(copy, len);
+            storeText(field, copy, len, strings, meta, &albumArtist);
+        } else {
+            storeText(field, data, len, strings, meta, &albumArtist);
+        }
+    }
+    if (meta->artist == STRARENA_NONE) meta->artist = albumArtist;
+    free(src.mem);
+    return audioStart;
+}
+
+// Copies an ID3v1 field if `*ref` is still empty.
+static void storeV1(StrArena *strings, TrackMetadata *meta, uint32_t *ref, const uint8_t *data, uint32_t len) {
+    if (*ref == STRARENA_NONE) *ref = textConvert(strings, META_TEXT_LATIN1, data, len, &meta->textFlags);
+}
+
+static void readId3v1(MetaReader *reader, StrArena *strings, TrackMetadata *meta) {
+    if (reader->fileSize < ID3V1_SIZE) return;
+    const uint8_t *tag = metaReaderPeek(reader, reader->fileSize - ID3V1_SIZE, ID3V1_SIZE);
+    if (!tag || memcmp(tag, "TAG", 3) != 0) return;
+
+    storeV1(strings, meta, &meta->title, tag + 3, 30);
+    storeV1(strings, meta, &meta->artist, tag + 33, 30);
+    storeV1(strings, meta, &meta->album, tag + 63, 30);
+    // ID3v1.1: a zero byte before the last comment byte marks a track number
+    if (meta->trackNumber == 0 && tag[125] == 0 && tag[126] != 0) meta->trackNumber = tag[126];
+}
+
+uint32_t id3PrefixSize(MetaReader *reader) {
+    const uint8_t *header = metaReaderPeek(reader, 0, ID3_HEADER_SIZE);
+    if (!header || memcmp(header, "ID3", 3) != 0) return 0;
+    uint32_t size = ID3_HEADER_SIZE + syncsafe32(header + 6);
+    if (header[5] & 0x10) size += ID3_HEADER_SIZE; // v2.4 footer
+    return size;
+}
+
+// --- Embedded Pictures ---
+
+#define ID3_PICTURE_HEADER_MAX 512 // Encoding, MIME type, picture type and description
+#define ID3_PICTURE_FRONT      3
+
+// Finds where the image starts in an APIC (v2.2: PIC) body. Returns false if
+// the header is malformed or longer than we look at.
+static bool pictureHeader(const uint8_t *body, uint32_t len, bool shortIds, uint32_t *dataStart,
+                          uint8_t *pictureType) {
+    uint32_t pos = 1; // Text encoding
+    if (shortIds) {
+        pos += 3; // Image format, e.g. "JPG"
+    } else {
+        const uint8_t *end = memchr(body + pos, 0, len - pos);
+        if (!end) return false;
+        pos = (uint32_t)(end - body) + 1;
+    }
+    if (pos >= len) return false;
+    *pictureType = body[pos++];
+
+    // Description, terminated by one zero byte, or two aligned ones in UTF-16
+    bool wide = body[0] == META_TEXT_UTF16 || body[0] == META_TEXT_UTF16BE;
+    for (;;) {
+        if (pos + (wide ? 2 : 1) > len) return false;
+        if (!wide && body[pos] == 0) {
+            pos += 1;
+            break;
+        }
+        if (wide && body[pos] == 0 && body[pos + 1] == 0) {
+            pos += 2;
+            break;
+        }
+        pos += wide ? 2 : 1;
+    }
+    *dataStart = pos;
+    return true;
+}
+
+bool id3FindPicture(MetaReader *reader, MetaSpan *picture) {
+    const uint8_t *header = metaReaderPeek(reader, 0, ID3_HEADER_SIZE);
+    if (!header || memcmp(header, "ID3", 3) != 0) return false;
+    uint8_t version = header[3];
+    uint8_t flags = header[5];
+    // An unsynchronised tag would need its image bytes rewritten; not worth it for art
+    if (version < 2 || version > 4 || (flags & 0x80)) return false;
+
+    uint32_t end = ID3_HEADER_SIZE + syncsafe32(header + 6);
+    if (end > reader->fileSize) end = (uint32_t)reader->fileSize;
+    uint32_t pos = ID3_HEADER_SIZE;
+    if (version >= 3 && (flags & 0x40)) {
+        const uint8_t *ext = metaReaderPeek(reader, pos, 4);
+        if (!ext) return false;
+        uint32_t extSize = version == 3 ? metaBe32(ext) + 4 : syncsafe32(ext);
+        if (extSize > end - pos) return false;
+        pos += extSize;
+    }
+
+    bool shortIds = version == 2;
+    uint32_t frameHeaderSize = shortIds ? 6 : 10;
+    bool found = false;
+    while (pos + frameHeaderSize <= end) {
+        const uint8_t *frame = metaReaderPeek(reader, pos, frameHeaderSize);
+        if (!frame || frame[0] == 0) break;
+        uint32_t size;
+        if (shortIds) size = metaBe24(frame + 3);
+        else if (version == 4) size = syncsafe32(frame + 4);
+        else size = metaBe32(frame + 4);
+        uint32_t body = pos + frameHeaderSize;
+        if (size > end - body) break;
+        pos = body + size;
+        if (memcmp(frame, shortIds ? "PIC" : "APIC", shortIds ? 3 : 4) != 0) continue;
+
+        uint32_t skip = 0;
+        if (version == 4) {
+            if (frame[9] & 0x0E) continue; // Compressed, encrypted or unsynchronised
+            if (frame[9] & 0x40) skip += 1;
+            if (frame[9] & 0x01) skip += 4;
+        } else if (version == 3) {
+            if (frame[9] & 0xC0) continue;
+            if (frame[9] & 0x20) skip += 1;
+        }
+        if (skip >= size) continue;
+
+        uint32_t len = size - skip < ID3_PICTURE_HEADER_MAX ? size - skip : ID3_PICTURE_HEADER_MAX;
+        const uint8_t *data = metaReaderPeek(reader, body + skip, len);
+        uint32_t dataStart;
+        uint8_t pictureType;
+        if (!data || !pictureHeader(data, len, shortIds, &dataStart, &pictureType)) continue;
+        if (found && pictureType != ID3_PICTURE_FRONT) continue;
+        picture->offset = body + skip + dataStart;
+        picture->len = size - skip - dataStart;
+        found = true;
+        if (pictureType == ID3_PICTURE_FRONT) break;
+    }
+    return found;
+}
+
+void id3Read(MetaReader *reader, StrArena *strings, TrackMetadata *meta) {
+    uint32_t audioStart = readId3v2(reader, strings, meta);
+    if (meta->title == STRARENA_NONE || meta->artist == STRARENA_NONE || meta->album == STRARENA_NONE) {
+        readId3v1(reader, strings, meta);
+    }
+    // Timed from the audio itself; TLEN stays only if that fails, as taggers often get it wrong
+    mpegDurationRead(reader, audioStart, meta);
+}
@@ -0,0 +1,481 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "libindex.h"
+#include "contenthash.h"
+
+// --- Hashing ---
+
+uint32_t libIndexHashName(const char *name) {
+    // FNV-1a, 32-bit
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)name; *p; ++p) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Builds an open-addressed table (load factor <= 0.5) over `count` hashes
+// spaced `stride` bytes apart. Returns NULL if out of memory.
+static uint32_t* buildBuckets(const uint8_t *firstHash, size_t stride, uint32_t count, uint32_t *mask) {
+    uint32_t numBuckets = 16;
+    while (numBuckets < count * 2u) numBuckets <<= 1;
+    uint32_t *buckets = (uint32_t*)malloc(numBuckets * sizeof(uint32_t));
+    if (!buckets) return NULL;
+    memset(buckets, 0xFF, numBuckets * sizeof(uint32_t)); // All LIBINDEX_NONE
+
+    *mask = numBuckets - 1;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t hash;
+        memcpy(&hash, firstHash + i * stride, sizeof(hash));
+        uint32_t slot = hash & *mask;
+        while (buckets[slot] != LIBINDEX_NONE) slot = (slot + 1) & *mask;
+        buckets[slot] = i;
+    }
+    return buckets;
+}
+
+// Bucket for a file size in the size table.
+static uint32_t sizeSlot(uint64_t size, uint32_t mask) {
+    uint32_t hash = (uint32_t)(size ^ (size >> 32)) * 0x9E3779B1u;
+    return (hash ^ (hash >> 16)) & mask;
+}
+
+// A record a moved file can take over: hashed, tags read, not a cue track.
+static bool movableRecord(const LibIndexRecord *rec) {
+    return rec->contentHash != CONTENT_HASH_NONE && !(rec->flags & (LIBINDEX_RECORD_PENDING | LIBINDEX_RECORD_CUE));
+}
+
+// Builds the size table over the movable records; no table if there are
+// none. Returns false if out of memory.
+static bool buildSizeBuckets(LibIndex *index) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < index->count; ++i) count += movableRecord(&index->records[i]);
+    if (count == 0) return true;
+
+    uint32_t numBuckets = 16;
+    while (numBuckets < count * 2u) numBuckets <<= 1;
+    index->sizeBuckets = (uint32_t*)malloc(numBuckets * sizeof(uint32_t));
+    if (!index->sizeBuckets) return false;
+    memset(index->sizeBuckets, 0xFF, numBuckets * sizeof(uint32_t));
+
+    index->sizeBucketMask = numBuckets - 1;
+    for (uint32_t i = 0; i < index->count; ++i) {
+        if (!movableRecord(&index->records[i])) continue;
+        uint32_t slot = sizeSlot(index->records[i].size, index->sizeBucketMask);
+        while (index->sizeBuckets[slot] != LIBINDEX_NONE) slot = (slot + 1) & index->sizeBucketMask;
+        index->sizeBuckets[slot] = i;
+    }
+    return true;
+}
+
+// --- Loading ---
+
+static void clearIndex(LibIndex *index) {
+    memset(index, 0, sizeof(*index));
+}
+
+// The writer numbers folders in visit order, so a child always comes after
+// its parent and a sibling list runs backwards. Checking that, and that no
+// folder is listed twice, guarantees walking the journal terminates.
+static bool validateJournal(const LibIndex *index) {
+    uint8_t *listed = (uint8_t*)calloc(index->dirCount ? index->dirCount : 1, 1);
+    if (!listed) return false;
+
+    bool ok = true;
+    for (uint32_t d = 0; d < index->dirCount && ok; ++d) {
+        const LibIndexDir *dir = &index->dirs[d];
+        if ((uint64_t)dir->firstRecord + dir->recordCount > index->count) ok = false;
+
+        uint32_t prev = index->dirCount;
+        for (uint32_t c = dir->firstChild; c != LIBINDEX_NONE && ok; c = index->dirs[c].nextSibling) {
+            if (c <= d || c >= prev || listed[c]) {
+                ok = false;
+                break;
+            }
+            listed[c] = 1;
+            prev = c;
+        }
+    }
+    free(listed);
+    return ok;
+}
+
+bool libIndexLoad(LibIndex *index, const char *path) {
+    clearIndex(index);
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return false; // No index yet (first boot) is not an error
+
+    fseek(f, 0, SEEK_END);
+    long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (fileSize < (long)sizeof(LibIndexHeader)) {
+        fclose(f);
+        return false;
+    }
+
+    uint8_t *data = (uint8_t*)malloc((size_t)fileSize);
+    if (!data) {
+        perror("malloc failed for library index");
+        fclose(f);
+        return false;
+    }
+    size_t got = fread(data, 1, (size_t)fileSize, f);
+    fclose(f);
+    if (got != (size_t)fileSize) {
+        free(data);
+        return false;
+    }
+
+    // Validate header and sizes before trusting any offsets
+    LibIndexHeader header;
+    memcpy(&header, data, sizeof(header));
+    uint64_t expected = (uint64_t)sizeof(LibIndexHeader)
+                      + (uint64_t)header.count * sizeof(LibIndexRecord)
+                      + (uint64_t)header.dirCount * sizeof(LibIndexDir)
+                      + header.stringBytes;
+    if (header.magic != LIBINDEX_MAGIC || header.version != LIBINDEX_VERSION ||
+        expected != (uint64_t)fileSize ||
+        (header.stringBytes > 0 && data[fileSize - 1] != '\0')) {
+        free(data);
+        return false;
+    }
+
+    index->data = data;
+    index->records = (const LibIndexRecord*)(data + sizeof(LibIndexHeader));
+    index->dirs = (const LibIndexDir*)(index->records + header.count);
+    index->strings = (const char*)(index->dirs + header.dirCount);
+    index->count = header.count;
+    index->dirCount = header.dirCount;
+    index->stringBytes = header.stringBytes;
+
+    if (!validateJournal(index)) {
+        libIndexFree(index);
+        return false;
+    }
+
+    index->buckets = buildBuckets((const uint8_t*)&index->records[0].nameHash, sizeof(LibIndexRecord),
+                                  header.count, &index->bucketMask);
+    index->dirBuckets = buildBuckets((const uint8_t*)&index->dirs[0].pathHash, sizeof(LibIndexDir),
+                                     header.dirCount, &index->dirBucketMask);
+    if (!index->buckets || !index->dirBuckets || !buildSizeBuckets(index)) {
+        perror("malloc failed for library index buckets");
+        libIndexFree(index);
+        return false;
+    }
+    return true;
+}
+
+void libIndexFree(LibIndex *index) {
+    free(index->buckets);
+    free(index->dirBuckets);
+    free(index->sizeBuckets);
+    free(index->data);
+    clearIndex(index);
+}
+
+const char* libIndexString(const LibIndex *index, uint32_t offset) {
+    if (offset == LIBINDEX_NONE || offset >= index->stringBytes) return NULL;
+    return index->strings + offset;
+}
+
+// Record number for `name`, or LIBINDEX_NONE.
+static uint32_t findRecord(const LibIndex *index, const char *name) {
+    if (!index->buckets) return LIBINDEX_NONE;
+
+    uint32_t hash = libIndexHashName(name);
+    uint32_t slot = hash & index->bucketMask;
+    while (index->buckets[slot] != LIBINDEX_NONE) {
+        const LibIndexRecord *rec = &index->records[index->buckets[slot]];
+        if (rec->nameHash == hash && !(rec->flags & LIBINDEX_RECORD_CUE)) {
+            const char *recName = libIndexString(index, rec->nameOff);
+            if (recName && strcmp(recName, name) == 0) return index->buckets[slot];
+        }
+        slot = (slot + 1) & index->bucketMask;
+    }
+    return LIBINDEX_NONE;
+}
+
+const LibIndexRecord* libIndexFind(const LibIndex *index, const char *name, uint64_t size, int64_t mtime) {
+    uint32_t i = findRecord(index, name);
+    if (i == LIBINDEX_NONE) return NULL;
+    // Same file name, but only reuse it if it hasn't changed on disk
+    const LibIndexRecord *rec = &index->records[i];
+    return (rec->size == size && rec->mtime == mtime) ? rec : NULL;
+}
+
+bool libIndexHasSize(const LibIndex *index, uint64_t size) {
+    if (!index->sizeBuckets) return false;
+    uint32_t slot = sizeSlot(size, index->sizeBucketMask);
+    while (index->sizeBuckets[slot] != LIBINDEX_NONE) {
+        if (index->records[index->sizeBuckets[slot]].size == size) return true;
+        slot = (slot + 1) & index->sizeBucketMask;
+    }
+    return false;
+}
+
+const LibIndexRecord* libIndexFindContent(const LibIndex *index, uint64_t size, uint64_t contentHash) {
+    if (!index->sizeBuckets || contentHash == CONTENT_HASH_NONE) return NULL;
+    uint32_t slot = sizeSlot(size, index->sizeBucketMask);
+    while (index->sizeBuckets[slot] != LIBINDEX_NONE) {
+        const LibIndexRecord *rec = &index->records[index->sizeBuckets[slot]];
+        if (rec->size == size && rec->contentHash == contentHash) return rec;
+        slot = (slot + 1) & index->sizeBucketMask;
+    }
+    return NULL;
+}
+
+const LibIndexDir* libIndexFindDir(const LibIndex *index, const char *path) {
+    if (!index->dirBuckets) return NULL;
+
+    uint32_t hash = libIndexHashName(path);
+    uint32_t slot = hash & index->dirBucketMask;
+    while (index->dirBuckets[slot] != LIBINDEX_NONE) {
+        const LibIndexDir *dir = &index->dirs[index->dirBuckets[slot]];
+        if (dir->pathHash == hash) {
+            const char *dirPath = libIndexString(index, dir->pathOff);
+            if (dirPath && strcmp(dirPath, path) == 0) return dir;
+        }
+        slot = (slot + 1) & index->dirBucketMask;
+    }
+    return NULL;
+}
+
+// --- Writing ---
+
+void libIndexWriterInit(LibIndexWriter *writer) {
+    memset(writer, 0, sizeof(*writer));
+    writer->currentDir = LIBINDEX_NONE;
+}
+
+void libIndexWriterFree(LibIndexWriter *writer) {
+    free(writer->records);
+    free(writer->dirs);
+    free(writer->strings);
+    libIndexWriterInit(writer);
+}
+
+static uint32_t writerAddString(LibIndexWriter *writer, const char *s) {
+    if (!s || writer->failed) return LIBINDEX_NONE;
+
+    size_t len = strlen(s) + 1;
+    if (writer->stringBytes + len > writer->stringCapacity) {
+        uint32_t newCapacity = writer->stringCapacity ? writer->stringCapacity : 4096;
+        while (newCapacity < writer->stringBytes + len) newCapacity *= 2;
+        char *grown = (char*)realloc(writer->strings, newCapacity);
+        if (!grown) {
+            writer->failed = true;
+            return LIBINDEX_NONE;
+        }
+        writer->strings = grown;
+        writer->stringCapacity = newCapacity;
+    }
+    uint32_t offset = writer->stringBytes;
+    memcpy(writer->strings + offset, s, len);
+    writer->stringBytes += (uint32_t)len;
+    return offset;
+}
+
+// Ends the open folder, if any, keeping whatever entry stamp it already has.
+static void closeCurrentDir(LibIndexWriter *writer) {
+    if (writer->currentDir == LIBINDEX_NONE) return;
+    LibIndexDir *dir = &writer->dirs[writer->currentDir];
+    dir->recordCount = writer->count - dir->firstRecord;
+    writer->currentDir = LIBINDEX_NONE;
+}
+
+uint32_t libIndexWriterBeginDir(LibIndexWriter *writer, const char *path, int64_t mtime, uint64_t size,
+                                uint32_t parent) {
+    closeCurrentDir(writer);
+    if (writer->failed) return LIBINDEX_NONE;
+
+    if (writer->dirCount == writer->dirCapacity) {
+        uint32_t newCapacity = writer->dirCapacity ? writer->dirCapacity * 2 : 64;
+        LibIndexDir *grown = (LibIndexDir*)realloc(writer->dirs, newCapacity * sizeof(LibIndexDir));
+        if (!grown) {
+            writer->failed = true;
+            return LIBINDEX_NONE;
+        }
+        writer->dirs = grown;
+        writer->dirCapacity = newCapacity;
+    }
+
+    uint32_t id = writer->dirCount;
+    LibIndexDir *dir = &writer->dirs[id];
+    memset(dir, 0, sizeof(*dir));
+    dir->mtime = mtime;
+    dir->size = size;
+    dir->pathHash = libIndexHashName(path);
+    dir->pathOff = writerAddString(writer, path);
+    dir->firstRecord = writer->count;
+    dir->firstChild = LIBINDEX_NONE;
+    dir->nextSibling = LIBINDEX_NONE;
+    if (writer->failed) return LIBINDEX_NONE;
+
+    if (parent != LIBINDEX_NONE && parent < id) {
+        dir->nextSibling = writer->dirs[parent].firstChild;
+        writer->dirs[parent].firstChild = id;
+    }
+    writer->dirCount++;
+    writer->currentDir = id;
+    return id;
+}
+
+void libIndexWriterEndDir(LibIndexWriter *writer, uint32_t entryCount, uint32_t entryHash) {
+    if (writer->currentDir == LIBINDEX_NONE) return;
+    LibIndexDir *dir = &writer->dirs[writer->currentDir];
+    dir->entryCount = entryCount;
+    dir->entryHash = entryHash;
+    closeCurrentDir(writer);
+}
+
+void libIndexWriterAdd(LibIndexWriter *writer, const char *name, uint64_t size, int64_t mtime,
+                       uint64_t contentHash, const char *title, const char *artist, const char *album,
+                       uint32_t durationMs, uint32_t trackNumber, const ReplayGain *gain, uint32_t format,
+                       uint32_t flags, uint32_t startFrame, uint32_t endFrame) {
+    if (writer->failed) return;
+
+    if (writer->count == writer->capacity) {
+        uint32_t newCapacity = writer->capacity ? writer->capacity * 2 : 256;
+        LibIndexRecord *grown = (LibIndexRecord*)realloc(writer->records, newCapacity * sizeof(LibIndexRecord));
+        if (!grown) {
+            writer->failed = true;
+            return;
+        }
+        writer->records = grown;
+        writer->capacity = newCapacity;
+    }
+
+    LibIndexRecord *rec = &writer->records[writer->count];
+    rec->size = size;
+    rec->mtime = mtime;
+    rec->contentHash = contentHash;
+    rec->nameHash = libIndexHashName(name);
+    rec->nameOff = writerAddString(writer, name);
+    rec->titleOff = writerAddString(writer, title);
+    rec->artistOff = writerAddString(writer, artist);
+    rec->albumOff = writerAddString(writer, album);
+    rec->durationMs = durationMs;
+    rec->trackNumber = trackNumber;
+    if (gain) rec->gain = *gain;
+    else replayGainInit(&rec->gain);
+    rec->flags = flags;
+    rec->format = format;
+    rec->startFrame = startFrame;
+    rec->endFrame = endFrame;
+    if (!writer->failed) writer->count++;
+}
+
+// Writes an index file to "<path>.tmp" and renames it over `path`. The string
+// blob may come in two pieces (`extra` follows `strings`).
+static bool writeIndexFile(const char *path, const LibIndexRecord *records, uint32_t count,
+                           const LibIndexDir *dirs, uint32_t dirCount, const char *strings,
+                           uint32_t stringBytes, const char *extra, uint32_t extraBytes) {
+    char tmpPath[PATH_MAX];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    FILE *f = fopen(tmpPath, "wb");
+    if (!f) {
+        perror("fopen failed for library index");
+        return false;
+    }
+
+    LibIndexHeader header = { LIBINDEX_MAGIC, LIBINDEX_VERSION, count, dirCount, stringBytes + extraBytes, 0 };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (ok && count > 0)
+        ok = fwrite(records, sizeof(LibIndexRecord), count, f) == count;
+    if (ok && dirCount > 0)
+        ok = fwrite(dirs, sizeof(LibIndexDir), dirCount, f) == dirCount;
+    if (ok && stringBytes > 0)
+        ok = fwrite(strings, 1, stringBytes, f) == stringBytes;
+    if (ok && extraBytes > 0)
+        ok = fwrite(extra, 1, extraBytes, f) == extraBytes;
+    if (fclose(f) != 0) ok = false;
+
+    if (!ok) {
+        remove(tmpPath);
+        return false;
+    }
+    // sdmc rename() does not overwrite an existing file
+    remove(path);
+    return rename(tmpPath, path) == 0;
+}
+
+bool libIndexWriterCommit(LibIndexWriter *writer, const char *path) {
+    closeCurrentDir(writer);
+    if (writer->failed) return false;
+    return writeIndexFile(path, writer->records, writer->count, writer->dirs, writer->dirCount,
+                          writer->strings, writer->stringBytes, NULL, 0);
+}
+
+// --- Updating ---
+
+void libIndexUpdateInit(LibIndexUpdate *update) {
+    memset(update, 0, sizeof(*update));
+}
+
+void libIndexUpdateFree(LibIndexUpdate *update) {
+    free(update->tags);
+    free(update->gains);
+    free(update->hashes);
+    libIndexUpdateInit(update);
+}
+
+bool libIndexUpdate(const char *path, const LibIndexUpdate *update) {
+    if (update->tagCount == 0 && update->gainCount == 0 && update->hashCount == 0) return true;
+    LibIndex index;
+    if (!libIndexLoad(&index, path)) return false;
+
+    // The loaded file is one mutable allocation; patch its records in place
+    // and collect the new strings in a writer's blob, placed after the old one
+    LibIndexRecord *records = (LibIndexRecord*)(index.data + sizeof(LibIndexHeader));
+    LibIndexWriter extra;
+    libIndexWriterInit(&extra);
+    uint32_t base = index.stringBytes;
+    uint32_t updated = 0;
+    for (uint32_t i = 0; i < update->tagCount; ++i) {
+        const LibIndexTags *tags = &update->tags[i];
+        uint32_t r = findRecord(&index, tags->name);
+        if (r == LIBINDEX_NONE) continue;
+        uint32_t title = writerAddString(&extra, tags->title);
+        uint32_t artist = writerAddString(&extra, tags->artist);
+        uint32_t album = writerAddString(&extra, tags->album);
+        if (extra.failed) break;
+        records[r].titleOff = (title == LIBINDEX_NONE) ? LIBINDEX_NONE : base + title;
+        records[r].artistOff = (artist == LIBINDEX_NONE) ? LIBINDEX_NONE : base + artist;
+        records[r].albumOff = (album == LIBINDEX_NONE) ? LIBINDEX_NONE : base + album;
+        records[r].durationMs = tags->durationMs;
+        records[r].trackNumber = tags->trackNumber;
+        records[r].gain = tags->gain;
+        records[r].format = tags->format;
+        records[r].flags = (records[r].flags & ~(LIBINDEX_RECORD_PENDING | LIBINDEX_RECORD_NO_GLYPHS)) | tags->flags;
+        updated++;
+    }
+    for (uint32_t i = 0; i < update->gainCount; ++i) {
+        uint32_t r = findRecord(&index, update->gains[i].name);
+        if (r == LIBINDEX_NONE) continue;
+        records[r].gain = update->gains[i].gain;
+        records[r].flags |= LIBINDEX_RECORD_MEASURED;
+        updated++;
+    }
+    for (uint32_t i = 0; i < update->hashCount; ++i) {
+        const LibIndexHash *hash = &update->hashes[i];
+        uint32_t r = findRecord(&index, hash->name);
+        if (r == LIBINDEX_NONE || records[r].size != hash->size || records[r].mtime != hash->mtime) continue;
+        records[r].contentHash = hash->contentHash;
+        updated++;
+    }
+
+    bool ok = !extra.failed;
+    if (ok && updated > 0) {
+        ok = writeIndexFile(path, records, index.count, index.dirs, index.dirCount, index.strings,
+                            index.stringBytes, extra.strings, extra.stringBytes);
+    }
+    libIndexWriterFree(&extra);
+    libIndexFree(&index);
+    return ok;
+}
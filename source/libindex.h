@@ -0,0 +1,188 @@
+#ifndef LIBINDEX_H
+#define LIBINDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "replaygain.h"
+
+// --- On-disk Library Index ---
+// Compact binary snapshot of the previous scan. Track records are keyed on
+// path + size + mtime; a directory journal records each folder's stamp so
+// a rescan can skip reading folders that have not changed. Records whose
+// file has been hashed (contenthash.h) can also be found by size + content
+// hash, so a file that moved keeps what was read from it.
+// File layout (native little-endian):
+//   LibIndexHeader | LibIndexRecord[count] | LibIndexDir[dirCount] | string blob
+// The whole file is loaded with a single read; records reference strings by
+// byte offset into the blob, so nothing is copied or strdup'd on load.
+// Paths are relative to the music directory; the root folder's path is "".
+
+#define LIBINDEX_MAGIC   0x58444950u // "PIDX"
+#define LIBINDEX_VERSION 11u
+#define LIBINDEX_NONE    0xFFFFFFFFu // String offset / record index meaning "absent"
+
+#define LIBINDEX_RECORD_PENDING   0x01u // Tags not read yet (see tagloader.h)
+#define LIBINDEX_RECORD_NO_GLYPHS 0x02u // Tags the system font can't draw (TEXT_FLAG_NO_GLYPHS)
+#define LIBINDEX_RECORD_CUE       0x04u // One track of a cue sheet; the file has a record per track
+#define LIBINDEX_RECORD_MEASURED  0x08u // Gain measured by the loudness analyser, not tagged (see loudness.h)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;       // Number of track records
+    uint32_t dirCount;    // Number of directory journal entries
+    uint32_t stringBytes; // Size of the string blob that follows the directories
+    uint32_t reserved;
+} LibIndexHeader;
+
+typedef struct {
+    uint64_t size;      // File size in bytes when it was probed
+    int64_t  mtime;     // Modification time (seconds) when it was probed
+    uint64_t contentHash; // contentHashFile() of the file; CONTENT_HASH_NONE until hashed
+    uint32_t nameHash;  // libIndexHashName() of the relative path
+    uint32_t nameOff;   // Offsets into the string blob (LIBINDEX_NONE if absent)
+    uint32_t titleOff;
+    uint32_t artistOff;
+    uint32_t albumOff;
+    uint32_t durationMs; // 0 if unknown
+    uint32_t trackNumber; // 0 if unknown
+    uint32_t flags;      // LIBINDEX_RECORD_*
+    uint32_t format;     // TrackFormat found in the file's first bytes (0 = not read yet)
+    uint32_t startFrame; // LIBINDEX_RECORD_CUE: the track's frames in the file; else 0
+    uint32_t endFrame;
+    ReplayGain gain;     // Loudness tags (absent until the tags are read)
+} LibIndexRecord;
+
+// Journal entry for one folder. Its tracks are the contiguous records
+// [firstRecord, firstRecord + recordCount); its sub-folders form a list
+// through firstChild / nextSibling.
+typedef struct {
+    int64_t  mtime;       // Folder stamp: modification time...
+    uint64_t size;        // ...and size as reported by stat
+    uint32_t pathHash;
+    uint32_t pathOff;
+    uint32_t firstRecord;
+    uint32_t recordCount;
+    uint32_t firstChild;  // LIBINDEX_NONE if no sub-folders
+    uint32_t nextSibling;
+    uint32_t entryCount;  // Directory entries seen when it was last read...
+    uint32_t entryHash;   // ...and the sum of libIndexHashName() over their names
+} LibIndexDir;
+
+// Loaded, read-only index.
+typedef struct {
+    uint8_t *data;                 // Entire file contents (single allocation)
+    const LibIndexRecord *records;
+    const LibIndexDir *dirs;
+    const char *strings;
+    uint32_t count;
+    uint32_t dirCount;
+    uint32_t stringBytes;
+    uint32_t *buckets;             // Open-addressed table of record indices
+    uint32_t bucketMask;
+    uint32_t *dirBuckets;          // Open-addressed table of directory indices
+    uint32_t dirBucketMask;
+    uint32_t *sizeBuckets;         // Record indices by file size: hashed records only (NULL if none)
+    uint32_t sizeBucketMask;
+} LibIndex;
+
+// Accumulates records during a scan, then writes them out in one go.
+typedef struct {
+    LibIndexRecord *records;
+    uint32_t count;
+    uint32_t capacity;
+    LibIndexDir *dirs;
+    uint32_t dirCount;
+    uint32_t dirCapacity;
+    uint32_t currentDir;           // Directory receiving records (LIBINDEX_NONE if none)
+    char *strings;
+    uint32_t stringBytes;
+    uint32_t stringCapacity;
+    bool failed;                   // Set on allocation failure; commit is skipped
+} LibIndexWriter;
+
+uint32_t libIndexHashName(const char *name);
+
+// Returns false (with an empty index) if the file is missing or malformed.
+bool libIndexLoad(LibIndex *index, const char *path);
+void libIndexFree(LibIndex *index);
+
+// Finds the record for `name`, but only if its size and mtime still match.
+// Cue sheet tracks are never returned: they are replayed with their folder.
+const LibIndexRecord* libIndexFind(const LibIndex *index, const char *name, uint64_t size, int64_t mtime);
+// True if a hashed record with read tags has this file size. A file the
+// index doesn't know by name is only worth hashing if so.
+bool libIndexHasSize(const LibIndex *index, uint64_t size);
+// Finds a hashed record with read tags for this size and content, whatever
+// its path; NULL if none. Cue sheet tracks are never returned.
+const LibIndexRecord* libIndexFindContent(const LibIndex *index, uint64_t size, uint64_t contentHash);
+// Finds the journal entry for a folder path; NULL if it was not in the last scan.
+const LibIndexDir* libIndexFindDir(const LibIndex *index, const char *path);
+// Resolves a string offset; returns NULL for LIBINDEX_NONE or out-of-range offsets.
+const char* libIndexString(const LibIndex *index, uint32_t offset);
+
+void libIndexWriterInit(LibIndexWriter *writer);
+// Starts a folder; records added until libIndexWriterEndDir() belong to it.
+// Returns its journal index, to be passed as `parent` for its sub-folders.
+uint32_t libIndexWriterBeginDir(LibIndexWriter *writer, const char *path, int64_t mtime, uint64_t size,
+                                uint32_t parent);
+void libIndexWriterEndDir(LibIndexWriter *writer, uint32_t entryCount, uint32_t entryHash);
+void libIndexWriterAdd(LibIndexWriter *writer, const char *name, uint64_t size, int64_t mtime,
+                       uint64_t contentHash, const char *title, const char *artist, const char *album,
+                       uint32_t durationMs, uint32_t trackNumber, const ReplayGain *gain, uint32_t format,
+                       uint32_t flags, uint32_t startFrame, uint32_t endFrame);
+// Writes to "<path>.tmp" and renames over `path`. Returns false on any failure.
+bool libIndexWriterCommit(LibIndexWriter *writer, const char *path);
+void libIndexWriterFree(LibIndexWriter *writer);
+
+// Tags read for a track after its scan.
+typedef struct {
+    const char *name; // Relative path, as recorded
+    const char *title;
+    const char *artist;
+    const char *album;
+    uint32_t durationMs;
+    uint32_t trackNumber;
+    ReplayGain gain;
+    uint32_t format;  // TrackFormat
+    uint32_t flags;   // LIBINDEX_RECORD_NO_GLYPHS or 0
+} LibIndexTags;
+
+// A track gain measured after the scan.
+typedef struct {
+    const char *name; // Relative path, as recorded
+    ReplayGain gain;  // Track gain and peak; both absent if the file couldn't be measured
+} LibIndexGain;
+
+// A content hash taken after the scan.
+typedef struct {
+    const char *name;     // Relative path, as recorded
+    uint64_t size;        // The file as it was hashed
+    int64_t mtime;
+    uint64_t contentHash;
+} LibIndexHash;
+
+// Everything learnt about the tracks after the scan, saved in one rewrite.
+// Each list is malloc'd by whoever fills it (tagLoaderCollect(),
+// loudnessJobCollect(), hashJobCollect()) and may be empty; the names and
+// strings point into the catalog, which must outlive the update.
+typedef struct {
+    LibIndexTags *tags;   // Filled into the records, clearing their pending flag and setting their other flags
+    uint32_t tagCount;
+    LibIndexGain *gains;  // Marked LIBINDEX_RECORD_MEASURED so the next scan doesn't measure them again
+    uint32_t gainCount;
+    LibIndexHash *hashes; // Skipped if the record's size or mtime differs: the file changed after the scan
+    uint32_t hashCount;
+} LibIndexUpdate;
+
+void libIndexUpdateInit(LibIndexUpdate *update);
+void libIndexUpdateFree(LibIndexUpdate *update);
+
+// Loads the index at `path` once, applies the tags, then the gains, then the
+// hashes, and writes it once. Tracks no longer in the index are skipped; new
+// strings are appended to the blob and everything else is copied as is.
+// Does nothing if the update is empty.
+bool libIndexUpdate(const char *path, const LibIndexUpdate *update);
+
+#endif
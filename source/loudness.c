@@ -0,0 +1,454 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h> // For off_t
+
+#include "loudness.h"
+#include "dr_flac.h"
+#include "dr_mp3.h"
+#include "dr_wav.h"
+
+#define LOUDNESS_OFFSET       (-0.691) // BS.1770: K-weighting's gain at 1 kHz, taken back off
+#define LOUDNESS_RELATIVE     (-10.0)  // LU under the mean of the blocks over the absolute gate
+#define LOUDNESS_BINS_PER_LU  10
+#define LOUDNESS_KAISER_BETA  6.0
+#define LOUDNESS_KAISER_WIDTH 6.5      // Taps either side of the output where the window reaches 0
+#define LOUDNESS_PEAK_BLOCK   64       // Frames interpolated, or skipped, together
+
+// --- Filters ---
+
+// Both stages of the K-weighting filter at any rate, from the analogue
+// prototypes that BS.1770's 48 kHz coefficients come from.
+static void kWeighting(LoudnessMeter *meter) {
+    double k = tan(M_PI * 1681.974450955533 / meter->sampleRate);
+    double q = 0.7071752369554196;
+    double vh = pow(10.0, 3.999843853973347 / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    meter->shelf.b0 = (float)((vh + vb * k / q + k * k) / a0);
+    meter->shelf.b1 = (float)(2.0 * (k * k - vh) / a0);
+    meter->shelf.b2 = (float)((vh - vb * k / q + k * k) / a0);
+    meter->shelf.a1 = (float)(2.0 * (k * k - 1.0) / a0);
+    meter->shelf.a2 = (float)((1.0 - k / q + k * k) / a0);
+
+    k = tan(M_PI * 38.13547087602444 / meter->sampleRate);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+    meter->highPass.b0 = 1.0f;
+    meter->highPass.b1 = -2.0f;
+    meter->highPass.b2 = 1.0f;
+    meter->highPass.a1 = (float)(2.0 * (k * k - 1.0) / a0);
+    meter->highPass.a2 = (float)((1.0 - k / q + k * k) / a0);
+}
+
+// Modified Bessel function I0, for the Kaiser window.
+static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc taps for the points a quarter, half and three
+// quarters of the way between the two middle samples of a window. At 96 kHz
+// and over only the half-way point is needed. Each phase is scaled to unity
+// gain at DC so a constant signal reads its own level.
+static void interpolator(LoudnessMeter *meter) {
+    meter->phaseCount = 0;
+    meter->tapGain = 0.0f;
+    for (int p = 1; p < 4; ++p) {
+        if (meter->sampleRate >= 96000 && p != 2) continue;
+        float *taps = meter->phase[meter->phaseCount++];
+        double offset = p / 4.0, sum = 0.0;
+        double tap[LOUDNESS_TAPS];
+        for (int k = 0; k < LOUDNESS_TAPS; ++k) {
+            double x = k - (LOUDNESS_TAPS / 2 - 1) - offset; // Samples from the output point
+            double r = x / LOUDNESS_KAISER_WIDTH;
+            double window = besselI0(LOUDNESS_KAISER_BETA * sqrt(1.0 - r * r)) / besselI0(LOUDNESS_KAISER_BETA);
+            tap[k] = sin(M_PI * x) / (M_PI * x) * window;
+            sum += tap[k];
+        }
+        float gain = 0.0f;
+        for (int k = 0; k < LOUDNESS_TAPS; ++k) {
+            taps[k] = (float)(tap[k] / sum);
+            gain += fabsf(taps[k]);
+        }
+        if (gain > meter->tapGain) meter->tapGain = gain;
+    }
+}
+
+// --- Meter ---
+
+bool loudnessMeterInit(LoudnessMeter *meter, uint32_t sampleRate, uint32_t channels) {
+    if (channels == 0 || channels > LOUDNESS_MAX_CHANNELS || sampleRate < 8000 || sampleRate > 384000) return false;
+    memset(meter, 0, sizeof(*meter));
+    meter->channels = channels;
+    meter->sampleRate = sampleRate;
+    kWeighting(meter);
+    interpolator(meter);
+    // 5.1 in the usual L R C LFE Ls Rs order: the LFE is left out and the
+    // surrounds count 1.5 dB more; anything else weighs every channel alike
+    for (uint32_t c = 0; c < channels; ++c) {
+        meter->weight[c] = 1.0f;
+        if (channels == 6 && c == 3) meter->weight[c] = 0.0f;
+        if (channels == 6 && c >= 4) meter->weight[c] = 1.41f;
+    }
+    meter->stepFrames = (sampleRate + 5) / 10;
+    return true;
+}
+
+static const double s_gateEnergy = 1.1724653045822963e-7; // 10^((-70 + 0.691) / 10)
+
+// Closes a 100 ms step; from the fourth on, each one ends a gating block.
+static void finishStep(LoudnessMeter *meter) {
+    meter->steps[meter->stepCount++ & 3] = meter->stepSum;
+    meter->stepSum = 0.0f;
+    meter->stepFill = 0;
+    if (meter->stepCount < 4) return;
+
+    double energy = ((double)meter->steps[0] + meter->steps[1] + meter->steps[2] + meter->steps[3]) /
+                    (4.0 * meter->stepFrames);
+    if (energy <= s_gateEnergy) return;
+    double lufs = LOUDNESS_OFFSET + 10.0 * log10(energy);
+    int bin = (int)((lufs - LOUDNESS_GATE) * LOUDNESS_BINS_PER_LU);
+    if (bin < 0) bin = 0;
+    if (bin >= LOUDNESS_BINS) bin = LOUDNESS_BINS - 1;
+    meter->binCount[bin]++;
+    meter->binEnergy[bin] += energy;
+}
+
+// Sample and true peaks of one channel's `frames` frames. A block whose
+// windows (it and the LOUDNESS_TAPS - 1 samples before it) hold nothing
+// that the taps could lift over the peak so far is only added to the
+// history: once a track's loudest passage has been seen, most are.
+static void meterPeaks(LoudnessMeter *meter, uint32_t c, const float *samples, uint32_t frames) {
+    float *history = meter->history[c];
+    uint32_t pos = meter->historyPos;
+    uint32_t stride = meter->channels, phases = meter->phaseCount;
+    float peak = meter->truePeak, samplePeak = meter->samplePeak, recent = meter->recentMax[c];
+
+    for (uint32_t start = 0; start < frames; start += LOUDNESS_PEAK_BLOCK) {
+        uint32_t end = start + LOUDNESS_PEAK_BLOCK < frames ? start + LOUDNESS_PEAK_BLOCK : frames;
+        float blockMax = 0.0f;
+        for (uint32_t i = start; i < end; ++i) {
+            float magnitude = fabsf(samples[i * stride]);
+            if (magnitude > blockMax) blockMax = magnitude;
+        }
+        if (blockMax > samplePeak) samplePeak = blockMax;
+        bool interpolate = (blockMax > recent ? blockMax : recent) * meter->tapGain > peak;
+
+        for (uint32_t i = start; i < end; ++i) {
+            float x = samples[i * stride];
+            history[pos] = x;
+            history[pos + LOUDNESS_TAPS] = x;
+            if (++pos == LOUDNESS_TAPS) pos = 0;
+            if (!interpolate) continue;
+            const float *window = history + pos; // Oldest first
+            for (uint32_t p = 0; p < phases; ++p) {
+                const float *taps = meter->phase[p];
+                float v = 0.0f;
+                for (int k = 0; k < LOUDNESS_TAPS; ++k) v += taps[k] * window[k];
+                float magnitude = fabsf(v);
+                if (magnitude > peak) peak = magnitude;
+            }
+        }
+        // A short block leaves older samples in the next block's windows
+        if (end - start >= LOUDNESS_TAPS - 1) recent = blockMax;
+        else if (blockMax > recent) recent = blockMax;
+    }
+    meter->truePeak = peak;
+    meter->samplePeak = samplePeak;
+    meter->recentMax[c] = recent;
+}
+
+// K-weighted squares of one channel's `frames` frames, times its weight.
+static float meterChannel(LoudnessMeter *meter, uint32_t c, const float *samples, uint32_t frames) {
+    const LoudnessBiquad s = meter->shelf, h = meter->highPass;
+    float s1 = meter->filter[c][0], s2 = meter->filter[c][1];
+    float h1 = meter->filter[c][2], h2 = meter->filter[c][3];
+    uint32_t stride = meter->channels;
+    float sum = 0.0f;
+
+    for (uint32_t i = 0; i < frames; ++i) {
+        float x = samples[i * stride];
+        float y = s.b0 * x + s1;
+        s1 = s.b1 * x - s.a1 * y + s2;
+        s2 = s.b2 * x - s.a2 * y;
+        float z = h.b0 * y + h1;
+        h1 = h.b1 * y - h.a1 * z + h2;
+        h2 = h.b2 * y - h.a2 * z;
+        sum += z * z;
+    }
+    meter->filter[c][0] = s1;
+    meter->filter[c][1] = s2;
+    meter->filter[c][2] = h1;
+    meter->filter[c][3] = h2;
+    meterPeaks(meter, c, samples, frames);
+    return sum * meter->weight[c];
+}
+
+void loudnessMeterAdd(LoudnessMeter *meter, const float *samples, uint32_t frames) {
+    while (frames > 0) {
+        // Channel by channel up to the end of the current step
+        uint32_t run = meter->stepFrames - meter->stepFill;
+        if (run > frames) run = frames;
+        float sum = 0.0f;
+        for (uint32_t c = 0; c < meter->channels; ++c) sum += meterChannel(meter, c, samples + c, run);
+        meter->historyPos = (meter->historyPos + run) % LOUDNESS_TAPS;
+        meter->stepSum += sum;
+        meter->stepFill += run;
+        meter->frames += run;
+        if (meter->stepFill == meter->stepFrames) finishStep(meter);
+        samples += (size_t)run * meter->channels;
+        frames -= run;
+    }
+}
+
+static float energyToLufs(double energy) {
+    return (float)(LOUDNESS_OFFSET + 10.0 * log10(energy));
+}
+
+void loudnessMeterResult(const LoudnessMeter *meter, LoudnessResult *result) {
+    result->integrated = LOUDNESS_GATE;
+    result->truePeak = meter->truePeak > meter->samplePeak ? meter->truePeak : meter->samplePeak;
+    result->samplePeak = meter->samplePeak;
+    result->blocks = 0;
+    result->frames = meter->frames;
+    result->sampleRate = meter->sampleRate;
+
+    double energy = 0.0;
+    uint64_t count = 0;
+    for (int b = 0; b < LOUDNESS_BINS; ++b) {
+        energy += meter->binEnergy[b];
+        count += meter->binCount[b];
+    }
+    if (count == 0) return;
+
+    // The bin the relative gate falls in is kept if its blocks' mean clears it
+    double gate = energyToLufs(energy / count) + LOUDNESS_RELATIVE;
+    int first = (int)((gate - LOUDNESS_GATE) * LOUDNESS_BINS_PER_LU);
+    if (first < 0) first = 0;
+    if (first < LOUDNESS_BINS && meter->binCount[first] > 0 &&
+        energyToLufs(meter->binEnergy[first] / meter->binCount[first]) < gate) {
+        first++;
+    }
+    energy = 0.0;
+    count = 0;
+    for (int b = first; b < LOUDNESS_BINS; ++b) {
+        energy += meter->binEnergy[b];
+        count += meter->binCount[b];
+    }
+    if (count == 0) return;
+    result->integrated = energyToLufs(energy / count);
+    result->blocks = (uint32_t)count;
+}
+
+bool loudnessToReplayGain(const LoudnessResult *result, ReplayGain *gain) {
+    if (result->blocks == 0) return false;
+    long db = lrintf((LOUDNESS_REFERENCE - result->integrated) * 100.0f);
+    if (db > INT16_MAX) db = INT16_MAX;
+    if (db < -INT16_MAX) db = -INT16_MAX; // INT16_MIN is REPLAYGAIN_NONE
+    long peak = lrintf(result->truePeak * REPLAYGAIN_UNITY);
+    if (peak < 1) peak = 1;
+    if (peak > UINT16_MAX) peak = UINT16_MAX;
+    gain->trackGain = (int16_t)db;
+    gain->trackPeak = (uint16_t)peak;
+    return true;
+}
+
+// --- File Source ---
+// The decoders pull through one large buffer; reads past it go to the file
+// in buffer-sized requests.
+
+#define LOUDNESS_READ_SIZE (64 * 1024)
+
+typedef struct {
+    FILE *file;
+    uint64_t size;
+    uint64_t start; // File offset of buffer[0]
+    uint32_t len;   // Valid bytes in the buffer
+    uint32_t pos;   // Next byte to hand out
+    MetaIoStats stats;
+    uint8_t *buffer;
+} DecodeSource;
+
+static size_t sourceRead(void *user, void *out, size_t bytes) {
+    DecodeSource *source = (DecodeSource*)user;
+    uint8_t *dst = (uint8_t*)out;
+    size_t done = 0;
+    while (done < bytes) {
+        if (source->pos == source->len) {
+            source->start += source->len;
+            source->pos = 0;
+            source->len = (uint32_t)fread(source->buffer, 1, LOUDNESS_READ_SIZE, source->file);
+            source->stats.bytesRead += source->len;
+            source->stats.reads++;
+            if (source->len == 0) break;
+        }
+        size_t take = source->len - source->pos;
+        if (take > bytes - done) take = bytes - done;
+        memcpy(dst + done, source->buffer + source->pos, take);
+        source->pos += (uint32_t)take;
+        done += take;
+    }
+    return done;
+}
+
+// `whence` is SEEK_SET, SEEK_CUR or SEEK_END. Seeks inside the buffer cost nothing.
+static bool sourceSeek(DecodeSource *source, int64_t offset, int whence) {
+    int64_t target = offset;
+    if (whence == SEEK_CUR) target += (int64_t)(source->start + source->pos);
+    if (whence == SEEK_END) target += (int64_t)source->size;
+    if (target < 0 || (uint64_t)target > source->size) return false;
+    if ((uint64_t)target >= source->start && (uint64_t)target <= source->start + source->len) {
+        source->pos = (uint32_t)((uint64_t)target - source->start);
+        return true;
+    }
+    if (!metaSeek(source->file, (uint64_t)target)) return false;
+    source->start = (uint64_t)target;
+    source->len = 0;
+    source->pos = 0;
+    return true;
+}
+
+static drflac_bool32 flacSeek(void *user, int offset, drflac_seek_origin origin) {
+    return sourceSeek((DecodeSource*)user, offset, origin == drflac_seek_origin_current ? SEEK_CUR : SEEK_SET);
+}
+
+static drmp3_bool32 mp3Seek(void *user, int offset, drmp3_seek_origin origin) {
+    int whence = origin == drmp3_seek_origin_current ? SEEK_CUR : origin == drmp3_seek_origin_end ? SEEK_END : SEEK_SET;
+    return sourceSeek((DecodeSource*)user, offset, whence);
+}
+
+static drmp3_bool32 mp3Tell(void *user, drmp3_int64 *cursor) {
+    DecodeSource *source = (DecodeSource*)user;
+    *cursor = (drmp3_int64)(source->start + source->pos);
+    return DRMP3_TRUE;
+}
+
+static drwav_bool32 wavSeek(void *user, int offset, drwav_seek_origin origin) {
+    return sourceSeek((DecodeSource*)user, offset, origin == drwav_seek_origin_current ? SEEK_CUR : SEEK_SET);
+}
+
+// --- File Analysis ---
+
+// One open decoder of any of the three kinds.
+typedef struct {
+    TrackFormat format;
+    drflac *flac;
+    drmp3 *mp3;
+    drwav *wav;
+    uint32_t channels;
+    uint32_t sampleRate;
+} Decoder;
+
+static bool decoderOpen(Decoder *decoder, TrackFormat format, DecodeSource *source) {
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->format = format;
+    if (format == TRACK_FORMAT_FLAC) {
+        decoder->flac = drflac_open(sourceRead, flacSeek, source, NULL);
+        if (!decoder->flac) return false;
+        decoder->channels = decoder->flac->channels;
+        decoder->sampleRate = decoder->flac->sampleRate;
+    } else if (format == TRACK_FORMAT_MP3) {
+        // drmp3 holds a frame of PCM; too big for a worker's stack
+        decoder->mp3 = (drmp3*)malloc(sizeof(drmp3));
+        if (!decoder->mp3) return false;
+        if (!drmp3_init(decoder->mp3, sourceRead, mp3Seek, mp3Tell, NULL, source, NULL)) {
+            free(decoder->mp3);
+            decoder->mp3 = NULL;
+            return false;
+        }
+        decoder->channels = decoder->mp3->channels;
+        decoder->sampleRate = decoder->mp3->sampleRate;
+    } else if (format == TRACK_FORMAT_WAV) {
+        decoder->wav = (drwav*)malloc(sizeof(drwav));
+        if (!decoder->wav) return false;
+        if (!drwav_init(decoder->wav, sourceRead, wavSeek, source, NULL)) {
+            free(decoder->wav);
+            decoder->wav = NULL;
+            return false;
+        }
+        decoder->channels = decoder->wav->channels;
+        decoder->sampleRate = decoder->wav->sampleRate;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static uint32_t decoderRead(Decoder *decoder, float *out, uint32_t frames) {
+    if (decoder->flac) return (uint32_t)drflac_read_pcm_frames_f32(decoder->flac, frames, out);
+    if (decoder->mp3) return (uint32_t)drmp3_read_pcm_frames_f32(decoder->mp3, frames, out);
+    if (decoder->wav) return (uint32_t)drwav_read_pcm_frames_f32(decoder->wav, frames, out);
+    return 0;
+}
+
+static void decoderClose(Decoder *decoder) {
+    if (decoder->flac) drflac_close(decoder->flac);
+    if (decoder->mp3) {
+        drmp3_uninit(decoder->mp3);
+        free(decoder->mp3);
+    }
+    if (decoder->wav) {
+        drwav_uninit(decoder->wav);
+        free(decoder->wav);
+    }
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+bool loudnessCanDecode(TrackFormat format) {
+    return format == TRACK_FORMAT_MP3 || format == TRACK_FORMAT_FLAC || format == TRACK_FORMAT_WAV;
+}
+
+// Decodes the whole of `source` through `meter`. Returns false if it can't
+// be decoded or `stop` was raised.
+static bool meterSource(DecodeSource *source, TrackFormat format, const atomic_bool *stop, LoudnessMeter *meter,
+                        float *pcm, LoudnessResult *result) {
+    Decoder decoder;
+    if (!decoderOpen(&decoder, format, source)) return false;
+    bool ok = loudnessMeterInit(meter, decoder.sampleRate, decoder.channels);
+    while (ok) {
+        if (stop && atomic_load(stop)) {
+            ok = false;
+            break;
+        }
+        uint32_t frames = decoderRead(&decoder, pcm, LOUDNESS_CHUNK_FRAMES);
+        if (frames == 0) break;
+        loudnessMeterAdd(meter, pcm, frames);
+    }
+    decoderClose(&decoder);
+    if (!ok || meter->frames == 0) return false;
+    loudnessMeterResult(meter, result);
+    return true;
+}
+
+bool loudnessAnalyseFile(const char *path, TrackFormat format, const atomic_bool *stop, LoudnessResult *result,
+                         MetaIoStats *io) {
+    if (!loudnessCanDecode(format)) return false;
+    DecodeSource source;
+    memset(&source, 0, sizeof(source));
+    source.file = fopen(path, "rb");
+    if (!source.file) return false;
+    setvbuf(source.file, NULL, _IONBF, 0); // The source buffer is the only one
+    off_t size = (fseeko(source.file, 0, SEEK_END) == 0) ? ftello(source.file) : -1;
+    source.size = size > 0 ? (uint64_t)size : 0;
+
+    source.buffer = (uint8_t*)malloc(LOUDNESS_READ_SIZE);
+    LoudnessMeter *meter = (LoudnessMeter*)malloc(sizeof(LoudnessMeter));
+    float *pcm = (float*)malloc(LOUDNESS_CHUNK_FRAMES * LOUDNESS_MAX_CHANNELS * sizeof(float));
+    bool ok = size > 0 && metaSeek(source.file, 0) && source.buffer && meter && pcm &&
+              meterSource(&source, format, stop, meter, pcm, result);
+    if (io) {
+        io->bytesRead += source.stats.bytesRead;
+        io->reads += source.stats.reads;
+    }
+    fclose(source.file);
+    free(source.buffer);
+    free(meter);
+    free(pcm);
+    return ok;
+}
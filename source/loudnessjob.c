@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "loudnessjob.h"
+#include "libindex.h"
+#include "scanner.h"
+
+void loudnessJobInit(LoudnessJob *job, const char *musicDir, StrArena *strings) {
+    memset(job, 0, sizeof(*job));
+    atomic_init(&job->slot.state, LOUDNESS_SLOT_FREE);
+    job->musicDir = musicDir;
+    job->strings = strings;
+    atomic_init(&job->stop, false);
+}
+
+// --- Worker ---
+
+static void loudnessJobMain(void *arg) {
+    LoudnessJob *job = (LoudnessJob*)arg;
+    LoudnessSlot *slot = &job->slot;
+    while (!atomic_load(&job->stop)) {
+        if (atomic_load(&slot->state) != LOUDNESS_SLOT_QUEUED) {
+            bgThreadSleepUs(LOUDNESS_JOB_IDLE_US);
+            continue;
+        }
+        atomic_store(&slot->state, LOUDNESS_SLOT_BUSY);
+
+        uint64_t startUs = scanNowUs();
+        memset(&slot->io, 0, sizeof(slot->io));
+        const char *relPath = strArenaGet(job->strings, slot->filename);
+        char path[PATH_MAX];
+        int n = relPath ? snprintf(path, sizeof(path), "%s/%s", job->musicDir, relPath) : -1;
+        slot->measured = n >= 0 && (size_t)n < sizeof(path) &&
+                         loudnessAnalyseFile(path, (TrackFormat)slot->format, &job->stop, &slot->result, &slot->io);
+        slot->busyUs = scanNowUs() - startUs;
+        if (atomic_load(&job->stop)) break; // Cut short, not undecodable
+        atomic_store(&slot->state, LOUDNESS_SLOT_DONE);
+    }
+}
+
+bool loudnessJobStart(LoudnessJob *job) {
+    atomic_store(&job->stop, false);
+    job->thread = bgThreadStartOn(loudnessJobMain, job, true, bgThreadCores() - 1);
+    if (!job->thread) {
+        perror("failed to start loudness thread");
+        return false;
+    }
+    return true;
+}
+
+void loudnessJobStop(LoudnessJob *job) {
+    if (!job->thread) return;
+    atomic_store(&job->stop, true);
+    bgThreadJoin(job->thread);
+    job->thread = NULL;
+    atomic_store(&job->slot.state, LOUDNESS_SLOT_FREE);
+}
+
+// --- Render Thread ---
+
+static void applySlot(LoudnessJob *job, Catalog *catalog) {
+    LoudnessSlot *slot = &job->slot;
+    job->stats.busyUs += slot->busyUs;
+    job->stats.bytesRead += slot->io.bytesRead;
+    job->stats.reads += slot->io.reads;
+    if (slot->row >= catalog->count || CATALOG_FIELD(catalog, filename, slot->row) != slot->filename) return;
+
+    if (slot->measured) {
+        loudnessToReplayGain(&slot->result, &CATALOG_FIELD(catalog, gain, slot->row)); // Silence stays untagged
+        job->stats.measured++;
+        job->stats.audioSeconds += (double)slot->result.frames / slot->result.sampleRate;
+    } else {
+        job->stats.failed++;
+    }
+    CATALOG_FIELD(catalog, flags, slot->row) |= CATALOG_FLAG_MEASURED;
+
+    if (job->unsavedCount == job->unsavedCapacity) {
+        uint32_t capacity = job->unsavedCapacity ? job->unsavedCapacity * 2 : 64;
+        uint32_t *grown = (uint32_t*)realloc(job->unsaved, capacity * sizeof(uint32_t));
+        if (!grown) return; // Not saved: measured again after the next scan
+        job->unsaved = grown;
+        job->unsavedCapacity = capacity;
+    }
+    job->unsaved[job->unsavedCount++] = slot->row;
+}
+
+// True if the row is untagged and decodable, and hasn't been measured.
+static bool needsMeasuring(const Catalog *catalog, uint32_t row) {
+    if (CATALOG_FIELD(catalog, flags, row) & (CATALOG_FLAG_MESSAGE | CATALOG_FLAG_CUE | CATALOG_FLAG_MEASURED)) {
+        return false;
+    }
+    const ReplayGain *gain = &CATALOG_FIELD(catalog, gain, row);
+    return gain->trackGain == REPLAYGAIN_NONE && gain->albumGain == REPLAYGAIN_NONE &&
+           loudnessCanDecode((TrackFormat)CATALOG_FIELD(catalog, format, row));
+}
+
+uint32_t loudnessJobUpdate(LoudnessJob *job, Catalog *catalog) {
+    LoudnessSlot *slot = &job->slot;
+    uint32_t state = atomic_load(&slot->state);
+    uint32_t filled = 0;
+    if (state == LOUDNESS_SLOT_DONE) {
+        applySlot(job, catalog);
+        atomic_store(&slot->state, LOUDNESS_SLOT_FREE);
+        filled = 1;
+    } else if (state != LOUDNESS_SLOT_FREE) {
+        return 0;
+    }
+    if (job->restUpdates > 0) {
+        job->restUpdates--;
+        return filled;
+    }
+
+    for (uint32_t looked = 0; looked < LOUDNESS_JOB_ROWS; ++looked) {
+        if (job->nextRow >= catalog->count) {
+            // Round again once the tag loader may have read the rows passed
+            // over; a sweep that passed none leaves nothing for later
+            job->nextRow = 0;
+            job->restUpdates = job->passedPending ? LOUDNESS_JOB_RESWEEP : UINT32_MAX;
+            job->passedPending = false;
+            return filled;
+        }
+        uint32_t row = job->nextRow++;
+        if (CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_PENDING) {
+            job->passedPending = true;
+            continue;
+        }
+        if (!needsMeasuring(catalog, row)) continue;
+        slot->row = row;
+        slot->filename = CATALOG_FIELD(catalog, filename, row);
+        slot->format = CATALOG_FIELD(catalog, format, row);
+        atomic_store(&slot->state, LOUDNESS_SLOT_QUEUED);
+        break;
+    }
+    return filled;
+}
+
+bool loudnessJobCollect(LoudnessJob *job, const Catalog *catalog, LibIndexUpdate *update) {
+    bool ok = true;
+    if (job->unsavedCount > 0) {
+        LibIndexGain *gains = (LibIndexGain*)malloc(job->unsavedCount * sizeof(LibIndexGain));
+        if (gains) {
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < job->unsavedCount; ++i) {
+                uint32_t row = job->unsaved[i];
+                const char *name = (row < catalog->count) ? catalogString(catalog, CATALOG_FIELD(catalog, filename, row))
+                                                          : NULL;
+                if (!name) continue;
+                gains[n].name = name;
+                gains[n].gain = CATALOG_FIELD(catalog, gain, row);
+                n++;
+            }
+            update->gains = gains;
+            update->gainCount = n;
+        } else {
+            perror("out of memory for measured gains");
+            ok = false;
+        }
+    }
+    free(job->unsaved);
+    job->unsaved = NULL;
+    job->unsavedCount = 0;
+    job->unsavedCapacity = 0;
+    return ok;
+}
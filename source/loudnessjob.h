@@ -0,0 +1,91 @@
+#ifndef LOUDNESSJOB_H
+#define LOUDNESSJOB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "catalog.h"
+#include "loudness.h"
+#include "libindex.h"
+#include "bgthread.h"
+
+// --- Background Loudness Analysis ---
+// Measures the tracks that came without ReplayGain tags (see loudness.h),
+// one file at a time on a low-priority thread, so the gain stage has a
+// track gain for every file that can be decoded. The render thread looks
+// through a few hundred catalog rows per frame for the next one and hands
+// it over in a single slot; the result comes back through the same slot and
+// is written into the catalog on the render thread, with
+// CATALOG_FLAG_MEASURED, so the catalog's columns have one writer. Files
+// that fail to decode are marked too, and never retried. Measured gains are
+// saved to the library index when the job stops, so each file is measured
+// once.
+//
+// Rows with pending tags are passed over until the tag loader has read them;
+// cue sheet tracks are left out, as each would decode its image.
+
+#define LOUDNESS_JOB_ROWS     512  // Catalog rows looked at per update
+#define LOUDNESS_JOB_IDLE_US  20000 // Worker sleep while nothing is queued
+#define LOUDNESS_JOB_RESWEEP  600  // Updates to wait before looking at passed-over rows again
+
+typedef enum {
+    LOUDNESS_SLOT_FREE = 0,
+    LOUDNESS_SLOT_QUEUED, // Filled by the render thread
+    LOUDNESS_SLOT_BUSY,   // Being measured
+    LOUDNESS_SLOT_DONE    // Result ready for the render thread
+} LoudnessSlotState;
+
+typedef struct {
+    _Atomic uint32_t state; // LoudnessSlotState
+    uint32_t row;           // Catalog row
+    uint32_t filename;      // Copied so the worker never reads the columns
+    uint8_t format;
+    bool measured;          // Written by the worker: false if it couldn't be decoded
+    LoudnessResult result;
+    uint64_t busyUs;
+    MetaIoStats io;
+} LoudnessSlot;
+
+typedef struct {
+    uint32_t measured;   // Files measured
+    uint32_t failed;     // Files that couldn't be decoded
+    double audioSeconds; // Audio measured
+    uint64_t busyUs;     // Worker time spent on it
+    uint64_t bytesRead;
+    uint32_t reads;
+} LoudnessJobStats;
+
+typedef struct {
+    LoudnessSlot slot;
+    const char *musicDir;
+    StrArena *strings;    // The catalog's arena; the worker only reads filenames from it
+    BgThread *thread;
+    atomic_bool stop;
+    uint32_t nextRow;     // Where the search for work carries on
+    bool passedPending;   // This sweep passed rows whose tags are still pending
+    uint32_t restUpdates; // Updates left before the next sweep
+    uint32_t *unsaved;    // Rows measured since the last save
+    uint32_t unsavedCount;
+    uint32_t unsavedCapacity;
+    LoudnessJobStats stats;
+} LoudnessJob;
+
+void loudnessJobInit(LoudnessJob *job, const char *musicDir, StrArena *strings);
+// Starts the worker at low priority on the last core bgThreadCores() offers.
+// Start it after the scan is drained and stop it before the catalog is cleared.
+bool loudnessJobStart(LoudnessJob *job);
+// Stops and joins the worker; a file being measured is dropped.
+void loudnessJobStop(LoudnessJob *job);
+
+// Render thread, once per frame: writes a finished measurement into the
+// catalog and queues the next row that needs one. Returns the number of
+// rows written (0 or 1).
+uint32_t loudnessJobUpdate(LoudnessJob *job, Catalog *catalog);
+
+// Hands the gains measured since the last call to `update`, to be saved into
+// the library index. The list is dropped either way; the catalog keeps the
+// values. Returns false if out of memory.
+bool loudnessJobCollect(LoudnessJob *job, const Catalog *catalog, LibIndexUpdate *update);
+
+#endif
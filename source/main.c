@@ -9,6 +9,16 @@
 #include <limits.h>
 #include <dirent.h>  // For directory operations
 #include <strings.h> // For strcasecmp
+#include <sys/stat.h> // For mkdir
+
+#include "scanner.h"
+#include "sortindex.h"
+#include "search.h"
+#include "groupindex.h"
+#include "artwork.h"
+#include "tagloader.h"
+#include "loudnessjob.h"
+#include "hashjob.h"
 
 // --- Screen Dimensions ---
 #define TOP_SCREEN_WIDTH  400
@@ -17,8 +27,14 @@
 #define BOTTOM_SCREEN_HEIGHT 240
 
 // --- List Configuration ---
-#define MAX_LIST_ITEMS 1024
 #define MUSIC_DIR "/music"
+#define APP_DATA_DIR "/3ds/3DS-Pear-Player"
+#define LIBRARY_INDEX_PATH APP_DATA_DIR "/library.idx" // Cached scan results (see libindex.h)
+#define SCAN_DRAIN_PER_FRAME SCAN_RING_CAPACITY // Finished items moved into the list per frame at most
+#define ART_INDEX_PATH APP_DATA_DIR "/art.idx"  // Cover-art cache (see artcache.h)
+#define ART_THUMBS_PATH APP_DATA_DIR "/art.bin"
+#define ART_TEXTURE_SLOTS 16 // Thumbnails kept on the GPU; a screen shows at most 6 rows
+#define ART_FLUSH_EVERY 32   // New thumbnails between art.idx writes
 
 // --- List Item Layout Constants ---
 #define LIST_ITEM_HEIGHT 48.0f
@@ -39,212 +55,563 @@
 // Removed SELECTION_BORDER_COLOR as we are removing the explicit borders for a cleaner look
 
 
-// --- Data Structure for List Items ---
-typedef struct {
-    char *filename; // Always store the original filename
-    char *title;    // Title from metadata (NULL if none)
-    char *artist;   // Artist from metadata (NULL if none)
-    // Add other fields if needed (album, duration, etc.)
-} MusicListItem;
-
 // --- Static Text Data ---
 C2D_TextBuf g_staticBuf;
 C2D_Text g_pearPlayerText;
+C2D_Text g_sortLabelText[SORT_KEY_COUNT]; // "Sorted by ..." for each sort key
+C2D_TextBuf g_searchBuf;          // Re-parsed only when the query changes
+C2D_Text g_searchLabelText;
+C2D_TextBuf g_browseBuf;          // Re-parsed only when the browse level changes
+C2D_Text g_browseLabelText;
 
 // --- Dynamic Text Data (for list items) ---
 C2D_TextBuf g_dynamicBuf; // Increase size slightly for potentially more text
 #define DYNAMIC_BUF_SIZE 12288
 
 // --- List Data & State ---
-MusicListItem* g_listItems[MAX_LIST_ITEMS]; // Array of POINTERS to list items
-int g_actualNumListItems = 0;
+Catalog g_catalog;                  // Column-oriented track list (see catalog.h)
+int g_actualNumListItems = 0;       // Rows in the current view (catalog or search results)
+SortIndex g_sortIndex;              // Permutations built once per scan
+SortKey g_sortKey = SORT_BY_TITLE;  // Active sort order (L/R to change)
+SearchIndex g_searchIndex;          // Word-prefix index built once per scan
+SearchResult g_search;              // Active search; empty query shows everything
+const uint32_t* g_viewRows = NULL;  // List row -> catalog row; NULL shows catalog order
+GroupIndex g_groupIndex;            // Artist -> albums -> tracks, built once per scan
+
+// What the list shows: the library, or a slice of the group index
+typedef enum {
+    BROWSE_LIBRARY = 0, // Every track, sorted or searched
+    BROWSE_ARTIST,      // One artist's albums, each shown by its first track's row
+    BROWSE_ALBUM        // One album's tracks
+} BrowseLevel;
+
+BrowseLevel g_browseLevel = BROWSE_LIBRARY;
+uint32_t g_browseArtist = 0;        // Artist whose albums are listed (BROWSE_ARTIST and below)
+uint32_t g_browseAlbum = 0;         // Album whose tracks are listed (BROWSE_ALBUM)
+uint32_t g_browseReturnRow = UINT32_MAX; // Catalog row to select again on going back to the library
 float g_scrollPixelOffset = 0.0f;   // Current scroll position in pixels
 float g_maxScrollPixelOffset = 0.0f; // Maximum scrollable distance
 float g_totalListHeight = 0.0f;     // Total height of all items combined
 int g_selectedIndex = -1;           // Index of the currently selected item
+ScanWorker g_scanWorker;            // Background scan feeding g_catalog
+bool g_scanActive = false;
+TagLoader g_tagLoader;              // Reads the tags the scan deferred, near the screen first
+bool g_tagLoaderActive = false;
+LoudnessJob g_loudnessJob;          // Measures untagged tracks for the gain stage
+bool g_loudnessJobActive = false;
+HashJob g_hashJob;                  // Hashes tracks so a moved file keeps its record and art
+bool g_hashJobActive = false;
+PrefetchWindow g_prefetch;          // Rows worth reading tags and art for this frame
+bool g_viewStale = false;           // Tags arrived since the sort and search indexes were built
+
+// --- Cover Art ---
+typedef struct {
+    C3D_Tex tex;        // 32x32 RGB565, filled straight from art.bin
+    uint64_t key;       // Track key of the thumbnail held; 0 = none
+    uint32_t lastFrame; // Frame it was last drawn in, for eviction
+    bool ready;         // Texture was allocated
+} ArtTexture;
+
+ArtCache g_artCache;
+bool g_artCacheOpen = false;
+ArtTexture g_artTextures[ART_TEXTURE_SLOTS];
+uint32_t g_frameCount = 0;
+uint32_t g_artBuildsSinceFlush = 0;
+// art.bin rows are stored top row first, so v runs downwards
+static const Tex3DS_SubTexture s_artSubTex = { ART_THUMB_SIZE, ART_THUMB_SIZE, 0.0f, 0.0f, 1.0f, 1.0f };
 
 // --- Function Declarations ---
 static void setupListItems(void);
+static void updateListScan(void);
+static bool appendListItem(const CatalogEntry *entry, void *user);
+static void addMessageItem(const char *message);
+static void freeListItems(void);
+static void updateListMetrics(void);
+static uint32_t listRowToCatalog(int row);
+static void applySortKey(SortKey key);
+static void finishListScan(void);
+static void buildViewIndexes(void);
+static void stopTagLoader(LibIndexUpdate *update);
+static void stopLoudnessJob(LibIndexUpdate *update);
+static void stopHashJob(LibIndexUpdate *update);
+static void updateLazyLoads(void);
+static void refreshStaleIndexes(void);
+static void refreshView(void);
+static void selectCatalogRow(uint32_t row);
+static void applySearch(const char *query);
+static void openArtist(uint32_t catalogRow);
+static void openAlbum(uint32_t album);
+static void browseBack(void);
+static void updateBrowseLabel(void);
+static void promptSearch(void);
+static void artInit(void);
+static void artExit(void);
+static C3D_Tex* artTexture(uint32_t catalogRow);
+static void updateArtwork(void);
+static void updateSearchLabel(void);
 static void sceneInit(void);
 static void sceneRenderTop(void);
 static void sceneRenderBottom(void);
 static void sceneExit(void);
 static void handleInput(void);
 // Removed: static void updateScrollPhysics(void);
-static bool hasMusicExtension(const char *filename);
 static void ensureSelectionIsVisible(void);
-// --- Placeholder Function (Replace with real metadata reader) ---
-static void readMusicMetadata(const char* filepath, char** title, char** artist);
 
 // --- Function Implementations ---
 
-static bool hasMusicExtension(const char *filename) {
-    const char *dot = strrchr(filename, '.');
-    if (!dot || dot == filename) return false;
-    if (strcasecmp(dot, ".mp3") == 0) return true;
-    if (strcasecmp(dot, ".ogg") == 0) return true;
-    if (strcasecmp(dot, ".wav") == 0) return true;
-    if (strcasecmp(dot, ".flac") == 0) return true;
-    if (strcasecmp(dot, ".m4a") == 0) return true;
-    return false;
-}
-
-// --- !!! IMPORTANT PLACEHOLDER !!! ---
-// Replace this function with actual metadata reading using a library.
-static void readMusicMetadata(const char* filepath, char** title, char** artist) {
-    // Default to NULL
-    *title = NULL;
-    *artist = NULL;
-
-    // ---=== Placeholder Logic (Simulates reading) ===---
-    // Construct full path (necessary if metadata library needs it)
-    // char fullpath[PATH_MAX];
-    // snprintf(fullpath, sizeof(fullpath), "%s/%s", MUSIC_DIR, filename_only); // Be careful with buffer sizes
-
-    // Example: Simulate based on filename containing keywords
-    if (strstr(filepath, "_TA_") != NULL) { // e.g., "Some Artist_TA_Some Title.mp3"
-        *title = strdup("Simulated Title");
-        *artist = strdup("Simulated Artist");
-    } else if (strstr(filepath, "_T_") != NULL) { // e.g., "Some Title Only_T_.mp3"
-         *title = strdup("Simulated Title Only");
-    } else if (strstr(filepath, "Error") != NULL) { // Handle error messages passed in filename slot
-         *title = NULL; // No metadata for errors
-         *artist = NULL;
-    }
-     // else: title and artist remain NULL, filename will be used.
-
-    // ---=== End Placeholder Logic ===---
-
-    // In a real implementation using e.g., TagLib:
-    // TagLib::FileRef f(fullpath);
-    // if (!f.isNull() && f.tag()) {
-    //     TagLib::Tag *tag = f.tag();
-    //     if (!tag->title().isEmpty()) {
-    //         *title = strdup(tag->title().toCString(true)); // true for UTF-8
-    //     }
-    //     if (!tag->artist().isEmpty()) {
-    //         *artist = strdup(tag->artist().toCString(true));
-    //     }
-    // }
-    // Remember to handle memory allocation failures (strdup returns NULL).
-}
-// --- !!! END PLACEHOLDER !!! ---
+static void freeListItems(void) {
+    // Stop everything that writes the arena before it is reset, and save
+    // what they found in one rewrite of the index rather than one each
+    LibIndexUpdate update;
+    libIndexUpdateInit(&update);
+    stopTagLoader(&update);
+    stopLoudnessJob(&update);
+    stopHashJob(&update);
+    if (!libIndexUpdate(LIBRARY_INDEX_PATH, &update)) perror("failed to update library index");
+    libIndexUpdateFree(&update);
+    g_viewRows = NULL;
+    g_browseLevel = BROWSE_LIBRARY;
+    groupIndexFree(&g_groupIndex);
+    sortIndexFree(&g_sortIndex);
+    searchIndexFree(&g_searchIndex);
+    searchResultFree(&g_search);
+    catalogClear(&g_catalog); // One arena reset instead of a free per string
+    g_actualNumListItems = 0;
+}
+
+// Recomputes scroll limits after the list length changes.
+// Offsets stay whole pixels, which float represents exactly up to ~349k rows.
+static void updateListMetrics(void) {
+    g_totalListHeight = (float)g_actualNumListItems * LIST_ITEM_HEIGHT;
+    g_maxScrollPixelOffset = fmaxf(0.0f, g_totalListHeight - BOTTOM_SCREEN_HEIGHT);
+}
 
+// Maps a visible list row to the catalog row it shows under the active sort.
+static uint32_t listRowToCatalog(int row) {
+    return g_viewRows ? g_viewRows[row] : (uint32_t)row;
+}
 
-static void setupListItems(void) {
-    DIR *dir;
-    struct dirent *entry;
+// Points the list at the active view: an artist's albums or an album's
+// tracks, search results, or the whole catalog in the active sort order (scan
+// order until the sort index exists). Group slices are used in place.
+static void refreshView(void) {
+    if (g_browseLevel == BROWSE_ALBUM) {
+        g_actualNumListItems = (int)groupAlbumTracks(&g_groupIndex, g_browseAlbum, &g_viewRows);
+    } else if (g_browseLevel == BROWSE_ARTIST) {
+        uint32_t firstAlbum;
+        g_actualNumListItems = (int)groupArtistAlbums(&g_groupIndex, g_browseArtist, &firstAlbum);
+        g_viewRows = g_groupIndex.albumRows + firstAlbum;
+    } else if (g_search.query[0] != '\0') {
+        g_viewRows = g_search.rows;
+        g_actualNumListItems = (int)g_search.count;
+    } else {
+        bool sorted = g_sortIndex.count > 0 && g_sortIndex.count == g_catalog.count;
+        g_viewRows = sorted ? g_sortIndex.order[g_sortKey] : NULL;
+        g_actualNumListItems = (int)g_catalog.count;
+    }
+    updateListMetrics();
+}
 
-    // Free any previously allocated items
-    for (int i = 0; i < g_actualNumListItems; ++i) {
-        if (g_listItems[i] != NULL) {
-            free(g_listItems[i]->filename);
-            free(g_listItems[i]->title);
-            free(g_listItems[i]->artist);
-            free(g_listItems[i]);
-            g_listItems[i] = NULL;
+// Moves the selection to the list row showing catalog row `row`, or to the
+// top if it is not in the view.
+static void selectCatalogRow(uint32_t row) {
+    g_selectedIndex = (g_actualNumListItems > 0) ? 0 : -1;
+    if (row < g_catalog.count) {
+        if (g_search.query[0] == '\0' && g_viewRows) {
+            g_selectedIndex = (int)g_sortIndex.rank[g_sortKey][row]; // O(1)
+        } else if (!g_viewRows) {
+            g_selectedIndex = (int)row;
+        } else {
+            for (int i = 0; i < g_actualNumListItems; ++i) {
+                if (g_viewRows[i] == row) {
+                    g_selectedIndex = i;
+                    break;
+                }
+            }
         }
     }
-    g_actualNumListItems = 0;
+    if (g_selectedIndex <= 0) g_scrollPixelOffset = 0.0f;
+    ensureSelectionIsVisible();
+}
 
-    dir = opendir(MUSIC_DIR);
-    if (dir == NULL) {
-        perror("opendir failed");
-        // Create a dummy item for the error message
-        MusicListItem* errorItem = (MusicListItem*)malloc(sizeof(MusicListItem));
-        if (errorItem) {
-            errorItem->filename = strdup("Error: /music not found");
-            errorItem->title = NULL;
-            errorItem->artist = NULL;
-             if (!errorItem->filename) { // strdup failed
-                 free(errorItem);
-             } else {
-                g_listItems[0] = errorItem;
-                g_actualNumListItems = 1;
-             }
+// Switches the visible order. The permutations are prebuilt, so without a
+// search this is O(1); search results are re-sorted in O(k log k).
+static void applySortKey(SortKey key) {
+    uint32_t selectedRow = (g_selectedIndex >= 0) ? listRowToCatalog(g_selectedIndex) : UINT32_MAX;
+    g_sortKey = key;
+    if (g_search.query[0] != '\0') searchReorder(&g_search, g_sortIndex.rank[key]);
+    refreshView();
+    selectCatalogRow(selectedRow);
+}
+
+// Filters the list. Typing more of the same query refines the previous results.
+static void applySearch(const char *query) {
+    const uint32_t *rank = (g_sortIndex.count > 0) ? g_sortIndex.rank[g_sortKey] : NULL;
+    if (!searchRun(&g_search, &g_searchIndex, &g_catalog, query, rank)) {
+        perror("out of memory for search results");
+    }
+    refreshView();
+    g_scrollPixelOffset = 0.0f;
+    g_selectedIndex = (g_actualNumListItems > 0) ? 0 : -1;
+    updateSearchLabel();
+}
+
+// Opens the software keyboard, starting from the current query.
+static void promptSearch(void) {
+    SwkbdState swkbd;
+    char query[SEARCH_MAX_QUERY];
+    swkbdInit(&swkbd, SWKBD_TYPE_NORMAL, 2, SEARCH_MAX_QUERY - 1);
+    swkbdSetHintText(&swkbd, "Title, artist, album or file");
+    swkbdSetInitialText(&swkbd, g_search.query);
+    if (swkbdInputText(&swkbd, query, sizeof(query)) == SWKBD_BUTTON_CONFIRM) {
+        applySearch(query);
+    }
+}
+
+static void updateSearchLabel(void) {
+    char label[SEARCH_MAX_QUERY + 32];
+    C2D_TextBufClear(g_searchBuf);
+    if (g_search.query[0] == '\0') return;
+    snprintf(label, sizeof(label), "Search: %s (%lu)", g_search.query, (unsigned long)g_search.count);
+    C2D_TextParse(&g_searchLabelText, g_searchBuf, label);
+    C2D_TextOptimize(&g_searchLabelText);
+}
+
+// --- Browsing ---
+
+// Lists the albums of the artist of `catalogRow`, selecting its album. O(k)
+// for k albums: the group index holds them as one slice.
+static void openArtist(uint32_t catalogRow) {
+    if (g_groupIndex.count != g_catalog.count || catalogRow >= g_catalog.count) return;
+    uint32_t album = g_groupIndex.albumOf[catalogRow];
+    if (album >= g_groupIndex.albumCount) return; // A message row
+    if (g_browseLevel == BROWSE_LIBRARY) g_browseReturnRow = catalogRow;
+    g_browseArtist = g_groupIndex.albums[album].artist;
+    g_browseLevel = BROWSE_ARTIST;
+    refreshView();
+    g_selectedIndex = (int)(album - g_groupIndex.artists[g_browseArtist].firstAlbum);
+    g_scrollPixelOffset = 0.0f;
+    ensureSelectionIsVisible();
+    updateBrowseLabel();
+}
+
+static void openAlbum(uint32_t album) {
+    g_browseAlbum = album;
+    g_browseLevel = BROWSE_ALBUM;
+    refreshView();
+    g_selectedIndex = (g_actualNumListItems > 0) ? 0 : -1;
+    g_scrollPixelOffset = 0.0f;
+    updateBrowseLabel();
+}
+
+// Goes up a level: album -> its artist's albums -> the library.
+static void browseBack(void) {
+    if (g_browseLevel == BROWSE_ALBUM) {
+        g_browseLevel = BROWSE_ARTIST;
+        refreshView();
+        g_selectedIndex = (int)(g_browseAlbum - g_groupIndex.artists[g_browseArtist].firstAlbum);
+        g_scrollPixelOffset = 0.0f;
+        ensureSelectionIsVisible();
+    } else if (g_browseLevel == BROWSE_ARTIST) {
+        g_browseLevel = BROWSE_LIBRARY;
+        refreshView();
+        selectCatalogRow(g_browseReturnRow);
+    }
+    updateBrowseLabel();
+}
+
+static void updateBrowseLabel(void) {
+    char label[160];
+    C2D_TextBufClear(g_browseBuf);
+    if (g_browseLevel == BROWSE_LIBRARY) return;
+    const char *artist = catalogString(&g_catalog, g_groupIndex.artists[g_browseArtist].name);
+    if (g_browseLevel == BROWSE_ALBUM) {
+        const char *album = catalogString(&g_catalog, g_groupIndex.albums[g_browseAlbum].name);
+        snprintf(label, sizeof(label), "%s - %s", artist ? artist : "Unknown artist", album ? album : "Unknown album");
+    } else {
+        snprintf(label, sizeof(label), "%s (%d albums)", artist ? artist : "Unknown artist", g_actualNumListItems);
+    }
+    C2D_TextParse(&g_browseLabelText, g_browseBuf, label);
+    C2D_TextOptimize(&g_browseLabelText);
+}
+
+// Adds a filename-only row used for errors and empty-library messages.
+static void addMessageItem(const char *message) {
+    CatalogEntry messageItem;
+    memset(&messageItem, 0, sizeof(messageItem));
+    replayGainInit(&messageItem.gain);
+    messageItem.filename = strArenaAdd(&g_catalog.strings, message, strlen(message));
+    messageItem.flags = CATALOG_FLAG_MESSAGE;
+    if (messageItem.filename != STRARENA_NONE && catalogAppend(&g_catalog, &messageItem)) {
+        g_actualNumListItems = (int)g_catalog.count;
+    }
+    g_selectedIndex = -1;
+}
+
+// Scanner callback: items appear in the list as soon as they are read.
+static bool appendListItem(const CatalogEntry *entry, void *user) {
+    (void)user;
+    if (!catalogAppend(&g_catalog, entry)) {
+        perror("out of memory for list items");
+        return false; // Stop the scan
+    }
+    g_actualNumListItems = (int)g_catalog.count;
+    if (g_selectedIndex < 0) g_selectedIndex = 0; // Select first item by default
+    return true;
+}
+
+// Starts a background scan of MUSIC_DIR and its sub-folders; the list fills in over the next frames.
+static void setupListItems(void) {
+    // Free any previously allocated items
+    if (g_scanActive) scanWorkerStop(&g_scanWorker);
+    freeListItems();
+    g_selectedIndex = -1;
+
+    // Tags are deferred, so the scan needs no tag pool; the loader spreads
+    // them over the cores instead
+    g_scanActive = scanWorkerStart(&g_scanWorker, MUSIC_DIR, APP_DATA_DIR, LIBRARY_INDEX_PATH, &g_catalog.strings,
+                                   true, NULL);
+    if (!g_scanActive) {
+        addMessageItem("Error: could not start scan");
+    }
+}
+
+// Moves rows finished by the scan thread into the catalog. Only copies small rows,
+// so the cost per frame stays flat however much I/O the scanner is doing.
+static void updateListScan(void) {
+    if (!g_scanActive) return;
+
+    bool done = scanWorkerDrain(&g_scanWorker, appendListItem, NULL, SCAN_DRAIN_PER_FRAME);
+    if (done) {
+        g_scanActive = false;
+        if (g_scanWorker.scanner.openFailed) {
+            addMessageItem("Error: /music not found");
+        } else if (g_actualNumListItems == 0) {
+            addMessageItem("No music files found");
+        } else {
+            finishListScan();
         }
-        g_selectedIndex = -1;
-        return;
     }
+    updateListMetrics();
+}
 
-    while ((entry = readdir(dir)) != NULL && g_actualNumListItems < MAX_LIST_ITEMS) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+// Builds the sort and search indexes once the catalog is complete, then
+// starts reading the tags the scan deferred.
+static void finishListScan(void) {
+    if (!g_artCacheOpen) {
+        mkdir(APP_DATA_DIR, 0777); // May already exist
+        g_artCacheOpen = artCacheOpen(&g_artCache, ART_INDEX_PATH, ART_THUMBS_PATH);
+    }
+    buildViewIndexes();
 
-        if (hasMusicExtension(entry->d_name)) {
-            MusicListItem* newItem = (MusicListItem*)malloc(sizeof(MusicListItem));
-            if (!newItem) {
-                perror("malloc failed for MusicListItem");
-                break; // Stop adding items if memory runs out
-            }
+    // The list went up with filenames only; tags come in as rows near the screen
+    if (g_scanWorker.scanner.stats.itemsDeferred > 0) {
+        tagLoaderInit(&g_tagLoader, MUSIC_DIR, &g_catalog.strings);
+        g_tagLoaderActive = tagLoaderStart(&g_tagLoader, bgThreadCores());
+    }
+    loudnessJobInit(&g_loudnessJob, MUSIC_DIR, &g_catalog.strings);
+    g_loudnessJobActive = loudnessJobStart(&g_loudnessJob);
+    hashJobInit(&g_hashJob, MUSIC_DIR, &g_catalog.strings);
+    g_hashJobActive = hashJobStart(&g_hashJob);
+}
 
-            // Initialize pointers
-            newItem->filename = NULL;
-            newItem->title = NULL;
-            newItem->artist = NULL;
-
-            // Store filename
-            newItem->filename = strdup(entry->d_name);
-            if (!newItem->filename) {
-                perror("strdup failed for filename");
-                free(newItem); // Clean up allocated struct
-                continue; // Skip this file
-            }
+// Builds the sort permutations, search index and artist/album groups,
+// keeping the track the user had selected.
+static void buildViewIndexes(void) {
+    g_viewStale = false;
+    if (!searchIndexBuild(&g_searchIndex, &g_catalog)) {
+        perror("out of memory for search index"); // Search stays unavailable
+    }
+    if (!sortIndexBuild(&g_sortIndex, &g_catalog)) {
+        perror("out of memory for sort index");
+        return; // List stays in scan order
+    }
+    // Tracks within an album in filename order, which rippers number
+    if (!groupIndexBuild(&g_groupIndex, &g_catalog, g_sortIndex.rank[SORT_BY_FILENAME])) {
+        perror("out of memory for group index"); // Browsing stays unavailable
+    }
+    applySortKey(g_sortKey);
+}
+
+// --- Lazy Tags ---
+
+// Stops the tag loader and hands what it read to `update`, so the next scan has it.
+static void stopTagLoader(LibIndexUpdate *update) {
+    if (!g_tagLoaderActive) return;
+    tagLoaderStop(&g_tagLoader);
+    g_tagLoaderActive = false;
+    if (!tagLoaderCollect(&g_catalog, update)) perror("failed to save tags to library index");
+}
+
+// Moves the prefetch window to this frame's scroll position and lets the tag
+// loader fill in, drop and queue rows around it. The loudness and hash jobs
+// hand in their latest results; neither changes the order, so the view stays.
+static void updateLazyLoads(void) {
+    prefetchUpdate(&g_prefetch, g_scrollPixelOffset, LIST_ITEM_HEIGHT, BOTTOM_SCREEN_HEIGHT, g_actualNumListItems);
+    if (g_tagLoaderActive && tagLoaderUpdate(&g_tagLoader, &g_catalog, &g_prefetch, g_viewRows) > 0) {
+        g_viewStale = true;
+    }
+    if (g_loudnessJobActive) loudnessJobUpdate(&g_loudnessJob, &g_catalog);
+    if (g_hashJobActive) hashJobUpdate(&g_hashJob, &g_catalog);
+}
+
+// --- Loudness ---
+
+// Stops the loudness job and hands what it measured to `update`, so no file is measured twice.
+static void stopLoudnessJob(LibIndexUpdate *update) {
+    if (!g_loudnessJobActive) return;
+    loudnessJobStop(&g_loudnessJob);
+    g_loudnessJobActive = false;
+    if (!loudnessJobCollect(&g_loudnessJob, &g_catalog, update)) {
+        perror("failed to save measured gains to library index");
+    }
+}
+
+// --- Content Hashes ---
+
+// Stops the hash job and hands what it hashed to `update`, so a later move is recognised.
+static void stopHashJob(LibIndexUpdate *update) {
+    if (!g_hashJobActive) return;
+    hashJobStop(&g_hashJob);
+    g_hashJobActive = false;
+    if (!hashJobCollect(&g_hashJob, &g_catalog, update)) perror("failed to save content hashes to library index");
+}
+
+// Rebuilds the sort and search indexes if tags arrived since they were built.
+// Called only before the user changes the order or searches, so the list
+// never reshuffles while it is being scrolled.
+static void refreshStaleIndexes(void) {
+    if (!g_viewStale) return;
+    char query[SEARCH_MAX_QUERY];
+    snprintf(query, sizeof(query), "%s", g_search.query);
+    uint32_t selectedRow = (g_selectedIndex >= 0) ? listRowToCatalog(g_selectedIndex) : UINT32_MAX;
+
+    buildViewIndexes();
+    if (query[0] != '\0') {
+        searchResultFree(&g_search); // Old results would only be refined, missing new matches
+        searchResultInit(&g_search);
+        applySearch(query);
+        selectCatalogRow(selectedRow);
+    }
+}
+
+// --- Cover Art ---
 
-            // --- Call Metadata Reader (Placeholder) ---
-            // Construct full path (example, adjust as needed by real reader)
-             char fullpath[PATH_MAX]; // Ensure PATH_MAX is defined (limits.h or define it)
-             snprintf(fullpath, sizeof(fullpath)-1, "%s/%s", MUSIC_DIR, newItem->filename);
-             fullpath[sizeof(fullpath)-1] = '\0'; // Ensure null termination
+static void artInit(void) {
+    for (int i = 0; i < ART_TEXTURE_SLOTS; ++i) {
+        ArtTexture *slot = &g_artTextures[i];
+        slot->key = 0;
+        slot->lastFrame = 0;
+        slot->ready = C3D_TexInit(&slot->tex, ART_THUMB_SIZE, ART_THUMB_SIZE, GPU_RGB565);
+    }
+}
 
-            readMusicMetadata(fullpath, &newItem->title, &newItem->artist);
-            // Note: readMusicMetadata allocates title/artist via strdup if found
+static void artExit(void) {
+    for (int i = 0; i < ART_TEXTURE_SLOTS; ++i) {
+        if (g_artTextures[i].ready) C3D_TexDelete(&g_artTextures[i].tex);
+        g_artTextures[i].ready = false;
+    }
+    if (g_artCacheOpen) artCacheClose(&g_artCache);
+    g_artCacheOpen = false;
+}
 
-            // Add the new item to the list
-            g_listItems[g_actualNumListItems] = newItem;
-            g_actualNumListItems++;
+// The row's thumbnail as a texture, or NULL to draw the placeholder. A miss
+// on the GPU costs one 2 KiB read from art.bin; rows the cache has never seen
+// are left to updateArtwork().
+static C3D_Tex* artTexture(uint32_t catalogRow) {
+    if (!g_artCacheOpen || (CATALOG_FIELD(&g_catalog, flags, catalogRow) & CATALOG_FLAG_MESSAGE)) return NULL;
+    const char *relPath = catalogString(&g_catalog, CATALOG_FIELD(&g_catalog, filename, catalogRow));
+    if (!relPath) return NULL;
+
+    uint64_t key = artworkTrackKey(relPath, CONTENT_HASH_NONE); // Copies of one file may show different art
+    ArtTexture *victim = NULL;
+    for (int i = 0; i < ART_TEXTURE_SLOTS; ++i) {
+        ArtTexture *slot = &g_artTextures[i];
+        if (!slot->ready) continue;
+        if (slot->key == key) {
+            slot->lastFrame = g_frameCount;
+            return &slot->tex;
         }
+        // Never replace a texture already drawn this frame
+        if (slot->lastFrame != g_frameCount && (!victim || slot->lastFrame < victim->lastFrame)) victim = slot;
     }
-    closedir(dir);
-
-    if (g_actualNumListItems == 0) {
-        // Create a dummy item for the "not found" message
-         MusicListItem* notFoundItem = (MusicListItem*)malloc(sizeof(MusicListItem));
-        if (notFoundItem) {
-            notFoundItem->filename = strdup("No music files found");
-            notFoundItem->title = NULL;
-            notFoundItem->artist = NULL;
-             if (!notFoundItem->filename) { // strdup failed
-                 free(notFoundItem);
-             } else {
-                g_listItems[0] = notFoundItem;
-                g_actualNumListItems = 1;
-             }
+
+    uint32_t thumb;
+    uint64_t contentHash = CATALOG_FIELD(&g_catalog, contentHash, catalogRow);
+    if (!artworkLookup(&g_artCache, relPath, contentHash, &thumb) || thumb == ART_THUMB_NONE || !victim) return NULL;
+    if (!artCacheReadThumb(&g_artCache, thumb, (uint16_t*)victim->tex.data)) {
+        victim->key = 0;
+        return NULL;
+    }
+    C3D_TexFlush(&victim->tex);
+    victim->key = key;
+    victim->lastFrame = g_frameCount;
+    return &victim->tex;
+}
+
+// Builds at most one missing thumbnail per frame, once the scan is done so the
+// two don't compete for the SD card: the best-ranked row of the prefetch
+// window the cache has never seen.
+static void updateArtwork(void) {
+    g_frameCount++;
+    if (!g_artCacheOpen || g_scanActive) return;
+
+    int rows[PREFETCH_MAX_ROWS];
+    int n = prefetchOrder(&g_prefetch, rows, PREFETCH_MAX_ROWS);
+    const char *relPath = NULL;
+    uint64_t contentHash = CONTENT_HASH_NONE;
+    for (int i = 0; i < n && !relPath; ++i) {
+        uint32_t catalogRow = listRowToCatalog(rows[i]);
+        if (CATALOG_FIELD(&g_catalog, flags, catalogRow) & CATALOG_FLAG_MESSAGE) continue;
+        const char *candidate = catalogString(&g_catalog, CATALOG_FIELD(&g_catalog, filename, catalogRow));
+        uint64_t candidateHash = CATALOG_FIELD(&g_catalog, contentHash, catalogRow);
+        uint32_t thumb;
+        if (candidate && !artworkLookup(&g_artCache, candidate, candidateHash, &thumb)) {
+            relPath = candidate;
+            contentHash = candidateHash;
         }
-        g_selectedIndex = -1;
-    } else {
-        g_selectedIndex = 0; // Select first item by default
-        // Optional: Sort list here (would need a custom comparison function for the struct)
+    }
+    if (!relPath) return;
+    artworkBuild(&g_artCache, MUSIC_DIR, relPath, contentHash, NULL);
+    if (++g_artBuildsSinceFlush >= ART_FLUSH_EVERY) {
+        artCacheFlush(&g_artCache);
+        g_artBuildsSinceFlush = 0;
     }
 }
 
 static void sceneInit(void)
 {
-    g_staticBuf  = C2D_TextBufNew(100);
+    catalogInit(&g_catalog);
+
+    sortIndexInit(&g_sortIndex);
+    searchIndexInit(&g_searchIndex);
+    searchResultInit(&g_search);
+    groupIndexInit(&g_groupIndex);
+
+    g_staticBuf  = C2D_TextBufNew(256);
+    g_searchBuf  = C2D_TextBufNew(SEARCH_MAX_QUERY + 32);
+    g_browseBuf  = C2D_TextBufNew(160);
     g_dynamicBuf = C2D_TextBufNew(DYNAMIC_BUF_SIZE); // Use larger buffer
 
     C2D_TextParse(&g_pearPlayerText, g_staticBuf, "Pear Player");
     C2D_TextOptimize(&g_pearPlayerText);
 
-    setupListItems(); // Populates the list with MusicListItem structs
+    for (int k = 0; k < SORT_KEY_COUNT; ++k) {
+        char label[32];
+        snprintf(label, sizeof(label), "Sorted by %s", sortKeyName((SortKey)k));
+        C2D_TextParse(&g_sortLabelText[k], g_staticBuf, label);
+        C2D_TextOptimize(&g_sortLabelText[k]);
+    }
+
+    artInit();
+    prefetchInit(&g_prefetch);
+    setupListItems(); // Starts the scan; updateListScan() fills the list each frame
 
     g_scrollPixelOffset = 0.0f;
     // Removed: g_scrollVelocity = 0.0f;
     // Removed: g_isTouching = false;
 
-    g_totalListHeight = (float)g_actualNumListItems * LIST_ITEM_HEIGHT;
-    g_maxScrollPixelOffset = fmaxf(0.0f, g_totalListHeight - BOTTOM_SCREEN_HEIGHT);
-
-    ensureSelectionIsVisible();
+    updateListMetrics();
 }
 
 static void sceneRenderTop(void)
@@ -258,6 +625,22 @@ static void sceneRenderTop(void)
     C2D_DrawText(&g_pearPlayerText, C2D_AlignCenter | C2D_WithColor,
                  TOP_SCREEN_WIDTH / 2.0f, TOP_SCREEN_HEIGHT / 2.0f - 8.0f, 0.5f,
                  1.0f, 1.0f, C2D_Color32(0xFF, 0xFF, 0xFF, 0xFF));
+    // Render the artist or album being browsed, or else the active sort order
+    if (g_browseLevel != BROWSE_LIBRARY) {
+        C2D_DrawText(&g_browseLabelText, C2D_AlignCenter | C2D_WithColor,
+                     TOP_SCREEN_WIDTH / 2.0f, TOP_SCREEN_HEIGHT / 2.0f + 24.0f, 0.5f,
+                     0.5f, 0.5f, C2D_Color32(0xCC, 0xCC, 0xCC, 0xFF));
+        return;
+    }
+    C2D_DrawText(&g_sortLabelText[g_sortKey], C2D_AlignCenter | C2D_WithColor,
+                 TOP_SCREEN_WIDTH / 2.0f, TOP_SCREEN_HEIGHT / 2.0f + 24.0f, 0.5f,
+                 0.5f, 0.5f, C2D_Color32(0xCC, 0xCC, 0xCC, 0xFF));
+    // Render active search, if any
+    if (g_search.query[0] != '\0') {
+        C2D_DrawText(&g_searchLabelText, C2D_AlignCenter | C2D_WithColor,
+                     TOP_SCREEN_WIDTH / 2.0f, TOP_SCREEN_HEIGHT / 2.0f + 44.0f, 0.5f,
+                     0.5f, 0.5f, C2D_Color32(0xCC, 0xCC, 0xCC, 0xFF));
+    }
 }
 
 static void sceneRenderBottom(void)
@@ -276,9 +659,30 @@ static void sceneRenderBottom(void)
         if (rowBottomY <= 0) continue;             // Skip if entirely above screen
         if (currentItemIndex < 0 || currentItemIndex >= g_actualNumListItems) continue; // Skip invalid indices
 
-        // Get pointer to the current item's data
-        MusicListItem* currentItem = g_listItems[currentItemIndex];
-        if (!currentItem) continue; // Should not happen, but safety check
+        // Resolve the row's string columns through the active sort order
+        uint32_t catalogRow = listRowToCatalog(currentItemIndex);
+        const char* itemTitle = catalogString(&g_catalog, CATALOG_FIELD(&g_catalog, title, catalogRow));
+        const char* itemArtist = catalogString(&g_catalog, CATALOG_FIELD(&g_catalog, artist, catalogRow));
+        const char* itemFilename = catalogString(&g_catalog, CATALOG_FIELD(&g_catalog, filename, catalogRow));
+        if (itemFilename) itemFilename = catalogBaseName(itemFilename); // Stored relative to MUSIC_DIR
+        // Tags the font can't draw would show as boxes; the filename is better, unless it has the same problem
+        uint8_t rowFlags = CATALOG_FIELD(&g_catalog, flags, catalogRow);
+        if ((rowFlags & (CATALOG_FLAG_TAG_GLYPHS | CATALOG_FLAG_NAME_GLYPHS)) == CATALOG_FLAG_TAG_GLYPHS) {
+            itemTitle = NULL;
+            itemArtist = NULL;
+        }
+        // An artist's album list shows each album by its first track: name and track count
+        char albumTracks[24];
+        if (g_browseLevel == BROWSE_ARTIST) {
+            uint32_t album = g_groupIndex.albumOf[catalogRow];
+            const uint32_t *albumRows;
+            uint32_t trackCount = groupAlbumTracks(&g_groupIndex, album, &albumRows);
+            snprintf(albumTracks, sizeof(albumTracks), "%lu track%s", (unsigned long)trackCount,
+                     trackCount == 1 ? "" : "s");
+            itemTitle = catalogString(&g_catalog, g_groupIndex.albums[album].name);
+            if (!itemTitle) itemTitle = "Unknown album";
+            itemArtist = albumTracks;
+        }
 
         // --- Draw Selection Highlight ---
         if (currentItemIndex == g_selectedIndex) {
@@ -295,19 +699,25 @@ static void sceneRenderBottom(void)
             // C2D_DrawRectSolid(0.0f, rowBottomY - 1.0f, 0.35f, BOTTOM_SCREEN_WIDTH, 1.0f, SELECTION_BORDER_COLOR); // Bottom border REMOVED
         }
 
-        // --- Draw Placeholder ---
+        // --- Draw Cover Art, or a Placeholder ---
         float placeholderX = ITEM_PADDING_X;
         float placeholderY = rowTopY + ITEM_PADDING_Y;
-        C2D_DrawRectSolid(placeholderX, placeholderY, 0.4f,
-                          PLACEHOLDER_SIZE, PLACEHOLDER_SIZE,
-                          C2D_Color32(0x40, 0x40, 0x40, 0xFF));
+        C3D_Tex* artTex = artTexture(catalogRow);
+        if (artTex) {
+            C2D_Image image = { artTex, &s_artSubTex };
+            C2D_DrawImageAt(image, placeholderX, placeholderY, 0.4f, NULL, 1.0f, 1.0f);
+        } else {
+            C2D_DrawRectSolid(placeholderX, placeholderY, 0.4f,
+                              PLACEHOLDER_SIZE, PLACEHOLDER_SIZE,
+                              C2D_Color32(0x40, 0x40, 0x40, 0xFF));
+        }
 
         // --- Draw Text based on available metadata ---
         C2D_Text dynTextTitle, dynTextArtist, dynTextFilename;
         float textX = TEXT_AREA_LEFT; // Use defined constant
 
         // Case 1: Title and Artist available
-        if (currentItem->title && currentItem->artist) {
+        if (itemTitle && itemArtist) {
             // Calculate Y positions for two lines (approximate vertical centering)
             float titleBaseY = rowTopY + LIST_ITEM_HEIGHT * 0.33f;
             float artistBaseY = rowTopY + LIST_ITEM_HEIGHT * 0.66f;
@@ -316,14 +726,14 @@ static void sceneRenderBottom(void)
             float artistY = artistBaseY - (TEXT_SCALE_ARTIST * 16.0f / 2.0f);
 
             // Draw Title
-            C2D_TextParse(&dynTextTitle, g_dynamicBuf, currentItem->title);
+            C2D_TextParse(&dynTextTitle, g_dynamicBuf, itemTitle);
             C2D_TextOptimize(&dynTextTitle);
             C2D_DrawText(&dynTextTitle, C2D_WithColor | C2D_AlignLeft,
                          textX, titleY, 0.5f, TEXT_SCALE_TITLE, TEXT_SCALE_TITLE,
                          C2D_Color32(0xFF, 0xFF, 0xFF, 0xFF));
 
             // Draw Artist (slightly smaller/dimmer?)
-            C2D_TextParse(&dynTextArtist, g_dynamicBuf, currentItem->artist);
+            C2D_TextParse(&dynTextArtist, g_dynamicBuf, itemArtist);
             C2D_TextOptimize(&dynTextArtist);
             C2D_DrawText(&dynTextArtist, C2D_WithColor | C2D_AlignLeft,
                          textX, artistY, 0.5f, TEXT_SCALE_ARTIST, TEXT_SCALE_ARTIST,
@@ -331,24 +741,24 @@ static void sceneRenderBottom(void)
 
         }
         // Case 2: Only Title available
-        else if (currentItem->title) {
+        else if (itemTitle) {
              // Calculate Y position for single centered line
             float centeredY = rowTopY + (LIST_ITEM_HEIGHT / 2.0f) - (TEXT_SCALE_TITLE * 16.0f / 2.0f);
 
             // Draw Title centered
-            C2D_TextParse(&dynTextTitle, g_dynamicBuf, currentItem->title);
+            C2D_TextParse(&dynTextTitle, g_dynamicBuf, itemTitle);
             C2D_TextOptimize(&dynTextTitle);
             C2D_DrawText(&dynTextTitle, C2D_WithColor | C2D_AlignLeft,
                          textX, centeredY, 0.5f, TEXT_SCALE_TITLE, TEXT_SCALE_TITLE,
                          C2D_Color32(0xFF, 0xFF, 0xFF, 0xFF));
         }
         // Case 3: No metadata (or error message), display filename
-        else if (currentItem->filename) { // Should always have filename unless allocation failed badly
+        else if (itemFilename) { // Should always have filename unless allocation failed badly
             // Calculate Y position for single centered line
             float centeredY = rowTopY + (LIST_ITEM_HEIGHT / 2.0f) - (TEXT_SCALE_TITLE * 16.0f / 2.0f);
 
             // Draw Filename centered
-            C2D_TextParse(&dynTextFilename, g_dynamicBuf, currentItem->filename);
+            C2D_TextParse(&dynTextFilename, g_dynamicBuf, itemFilename);
             C2D_TextOptimize(&dynTextFilename);
             C2D_DrawText(&dynTextFilename, C2D_WithColor | C2D_AlignLeft,
                          textX, centeredY, 0.5f, TEXT_SCALE_TITLE, TEXT_SCALE_TITLE,
@@ -360,20 +770,17 @@ static void sceneRenderBottom(void)
 static void sceneExit(void)
 {
     C2D_TextBufDelete(g_dynamicBuf);
+    C2D_TextBufDelete(g_searchBuf);
+    C2D_TextBufDelete(g_browseBuf);
     C2D_TextBufDelete(g_staticBuf);
 
-    // Free the allocated list items and their contents
-    for (int i = 0; i < g_actualNumListItems; ++i) {
-        if (g_listItems[i] != NULL) {
-            free(g_listItems[i]->filename); // Free the duplicated filename
-            free(g_listItems[i]->title);    // Free the duplicated title (if any)
-            free(g_listItems[i]->artist);   // Free the duplicated artist (if any)
-            free(g_listItems[i]);           // Free the struct itself
-            g_listItems[i] = NULL;
-        }
-    }
-    g_actualNumListItems = 0;
+    // Stop an unfinished scan, then free the allocated list items and their contents
+    if (g_scanActive) scanWorkerStop(&g_scanWorker);
+    g_scanActive = false;
+    freeListItems();
+    catalogFree(&g_catalog);
     g_selectedIndex = -1;
+    artExit(); // Writes any thumbnails built since the last flush into art.idx
 }
 
 // Ensures the currently selected item is visible on screen, adjusting scroll if needed.
@@ -409,7 +816,8 @@ static void ensureSelectionIsVisible(void) {
 }
 
 
-// Handles only D-Pad input for selection and scrolling.
+// Handles D-Pad input for selection and scrolling, L/R to change sort order,
+// Y/B to search and clear the search, and X/A/B to browse by artist and album.
 static void handleInput(void)
 {
     hidScanInput();
@@ -419,6 +827,32 @@ static void handleInput(void)
 
     // Removed touch input handling section entirely
 
+    // --- Browsing (X: the selected track's artist, A: open an album, B: back) ---
+    if (!g_scanActive && g_groupIndex.count > 0) {
+        if ((kDown & KEY_X) && g_selectedIndex >= 0 && g_browseLevel != BROWSE_ARTIST) {
+            if (g_browseLevel == BROWSE_LIBRARY) refreshStaleIndexes(); // Groups from the latest tags
+            if (g_selectedIndex < g_actualNumListItems) openArtist(listRowToCatalog(g_selectedIndex));
+            kDown &= ~KEY_X;
+        } else if ((kDown & KEY_A) && g_browseLevel == BROWSE_ARTIST && g_selectedIndex >= 0) {
+            openAlbum(g_groupIndex.artists[g_browseArtist].firstAlbum + (uint32_t)g_selectedIndex);
+        } else if ((kDown & KEY_B) && g_browseLevel != BROWSE_LIBRARY) {
+            browseBack();
+            kDown &= ~KEY_B;
+        }
+    }
+
+    // --- Search (available once the scan has built the index, outside browsing) ---
+    if (!g_scanActive && g_searchIndex.offsets && g_browseLevel == BROWSE_LIBRARY) {
+        if (kDown & (KEY_Y | KEY_B | KEY_L | KEY_R)) refreshStaleIndexes(); // Before the old order is used
+        if (kDown & KEY_Y) {
+            promptSearch();
+        } else if ((kDown & KEY_B) && g_search.query[0] != '\0') {
+            uint32_t selectedRow = (g_selectedIndex >= 0) ? listRowToCatalog(g_selectedIndex) : UINT32_MAX;
+            applySearch("");
+            selectCatalogRow(selectedRow); // Keep the track found by the search
+        }
+    }
+
     // --- D-Pad Handling ---
     if (g_actualNumListItems > 0) {
         bool selectionChanged = false; // Flag to check if we need to ensure visibility
@@ -466,6 +900,17 @@ static void handleInput(void)
              selectionChanged = true; // Might need to adjust view
         }
 
+        // L/R cycle the sort order once the scan has built the permutations
+        if (!g_scanActive && g_sortIndex.count > 0 && g_browseLevel == BROWSE_LIBRARY) {
+            if (kDown & KEY_R) {
+                applySortKey((SortKey)((g_sortKey + 1) % SORT_KEY_COUNT));
+                selectionChanged = true;
+            } else if (kDown & KEY_L) {
+                applySortKey((SortKey)((g_sortKey + SORT_KEY_COUNT - 1) % SORT_KEY_COUNT));
+                selectionChanged = true;
+            }
+        }
+
         // Ensure the selected item is visible after any D-Pad action that might change it
         if (selectionChanged) {
             ensureSelectionIsVisible();
@@ -500,7 +945,7 @@ int main()
     C3D_RenderTarget* bottom = C2D_CreateScreenTarget(GFX_BOTTOM, GFX_LEFT);
 
     // --- Initialize Scene Data ---
-    sceneInit(); // Sets up text, list data (incl. metadata placeholders)
+    sceneInit(); // Sets up text and starts the incremental list scan
 
     // --- Main Loop ---
     while (aptMainLoop())
@@ -511,6 +956,10 @@ int main()
 
         // Removed: updateScrollPhysics(); // Physics are no longer calculated
 
+        updateListScan(); // Grows the list while the UI stays interactive
+        updateLazyLoads(); // Fills in tags near the screen and queues more
+        updateArtwork();  // Builds one missing cover thumbnail near the screen
+
         // --- Rendering ---
         C3D_FrameBegin(C3D_FRAME_SYNCDRAW);
 
@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "metadata.h"
+
+// --- Numbers ---
+
+uint32_t metadataNumber(const uint8_t *data, uint32_t len) {
+    uint32_t i = 0;
+    while (i < len && data[i] == ' ') i++;
+    uint32_t value = 0;
+    for (; i < len && data[i] >= '0' && data[i] <= '9'; ++i) {
+        if (value > 100000000u) break; // Nothing sensible is this large
+        value = value * 10 + (data[i] - '0');
+    }
+    return value;
+}
+
+// --- Vorbis Comments ---
+
+// Case-insensitive match of "KEY=" at the start of a comment; returns the value offset or 0.
+static uint32_t matchKey(const uint8_t *comment, uint32_t len, const char *key) {
+    uint32_t i = 0;
+    for (; key[i]; ++i) {
+        if (i >= len) return 0;
+        uint8_t c = comment[i];
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (c != (uint8_t)key[i]) return 0;
+    }
+    return (i < len && comment[i] == '=') ? i + 1 : 0;
+}
+
+#define VORBIS_COMMENT_MAX 1024 // Bytes of a comment read; the rest is skipped
+
+// Copies `len` bytes at `pos` within the spans' concatenation. Returns false if out of range.
+static bool spanRead(MetaReader *reader, const MetaSpan *spans, uint32_t numSpans, uint64_t pos,
+                     uint8_t *dst, uint32_t len) {
+    for (uint32_t i = 0; i < numSpans && len > 0; ++i) {
+        if (pos >= spans[i].len) {
+            pos -= spans[i].len;
+            continue;
+        }
+        uint32_t take = spans[i].len - (uint32_t)pos < len ? spans[i].len - (uint32_t)pos : len;
+        if (!metaReaderRead(reader, spans[i].offset + pos, dst, take)) return false;
+        dst += take;
+        len -= take;
+        pos = 0;
+    }
+    return len == 0;
+}
+
+// Stores one "KEY=value" comment if it is a field we show or a loudness
+// tag, and we don't have it yet.
+static void storeComment(const uint8_t *comment, uint32_t len, StrArena *strings, TrackMetadata *meta,
+                         uint32_t *albumArtist) {
+    uint32_t v;
+    if (len > 0 && (comment[0] | 0x20) == 'r') { // REPLAYGAIN_* or R128_*
+        const uint8_t *eq = memchr(comment, '=', len);
+        if (eq && replayGainTag(&meta->gain, comment, (uint32_t)(eq - comment), eq + 1,
+                                len - (uint32_t)(eq - comment) - 1)) {
+            return;
+        }
+    }
+    if (meta->title == STRARENA_NONE && (v = matchKey(comment, len, "TITLE")) != 0) {
+        meta->title = textConvert(strings, META_TEXT_UTF8, comment + v, len - v, &meta->textFlags);
+    } else if (meta->artist == STRARENA_NONE && (v = matchKey(comment, len, "ARTIST")) != 0) {
+        meta->artist = textConvert(strings, META_TEXT_UTF8, comment + v, len - v, &meta->textFlags);
+    } else if (meta->album == STRARENA_NONE && (v = matchKey(comment, len, "ALBUM")) != 0) {
+        meta->album = textConvert(strings, META_TEXT_UTF8, comment + v, len - v, &meta->textFlags);
+    } else if (*albumArtist == STRARENA_NONE && (v = matchKey(comment, len, "ALBUMARTIST")) != 0) {
+        *albumArtist = textConvert(strings, META_TEXT_UTF8, comment + v, len - v, &meta->textFlags);
+    } else if (meta->trackNumber == 0 && (v = matchKey(comment, len, "TRACKNUMBER")) != 0) {
+        meta->trackNumber = metadataNumber(comment + v, len - v);
+    }
+}
+
+void vorbisCommentRead(MetaReader *reader, const MetaSpan *spans, uint32_t numSpans, uint32_t skip,
+                       StrArena *strings, TrackMetadata *meta) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < numSpans; ++i) total += spans[i].len;
+
+    uint8_t field[4];
+    uint64_t pos = skip;
+    if (!spanRead(reader, spans, numSpans, pos, field, 4)) return;
+    pos += 4 + (uint64_t)metaLe32(field); // Vendor string
+    if (!spanRead(reader, spans, numSpans, pos, field, 4)) return;
+    uint32_t count = metaLe32(field);
+    pos += 4;
+
+    uint8_t comment[VORBIS_COMMENT_MAX];
+    uint32_t albumArtist = STRARENA_NONE;
+    for (uint32_t n = 0; n < count; ++n) {
+        if (!spanRead(reader, spans, numSpans, pos, field, 4)) break;
+        uint32_t len = metaLe32(field);
+        uint32_t take = len < VORBIS_COMMENT_MAX ? len : VORBIS_COMMENT_MAX;
+        // A comment cut short by the end of the data still yields its prefix
+        if (take > total - (pos + 4)) take = (uint32_t)(total - (pos + 4));
+        if (!spanRead(reader, spans, numSpans, pos + 4, comment, take)) break;
+        storeComment(comment, take, strings, meta, &albumArtist);
+        pos += 4 + (uint64_t)len;
+
+        if (meta->title != STRARENA_NONE && meta->artist != STRARENA_NONE && meta->album != STRARENA_NONE &&
+            meta->trackNumber != 0 && replayGainComplete(&meta->gain)) {
+            break;
+        }
+    }
+    if (meta->artist == STRARENA_NONE) meta->artist = albumArtist;
+}
+
+// --- Dispatch ---
+
+#define SNIFF_BYTES 12 // Enough for RIFF....WAVE and ....ftyp
+
+TrackFormat metadataSniff(MetaReader *reader, TrackFormat guess) {
+    uint32_t len = reader->fileSize < SNIFF_BYTES ? (uint32_t)reader->fileSize : SNIFF_BYTES;
+    const uint8_t *head = metaReaderPeek(reader, 0, len);
+    if (!head || len < 4) return guess;
+
+    if (memcmp(head, "ID3", 3) == 0) {
+        // Whatever follows the tag decides, if the first read reached it
+        uint32_t tagSize = id3PrefixSize(reader);
+        if (reader->windowStart == 0 && (uint64_t)tagSize + 4 <= reader->windowLen) {
+            return memcmp(reader->window + tagSize, "fLaC", 4) == 0 ? TRACK_FORMAT_FLAC : TRACK_FORMAT_MP3;
+        }
+        return guess == TRACK_FORMAT_FLAC ? TRACK_FORMAT_FLAC : TRACK_FORMAT_MP3;
+    }
+    if (memcmp(head, "fLaC", 4) == 0) return TRACK_FORMAT_FLAC;
+    if (memcmp(head, "OggS", 4) == 0) return TRACK_FORMAT_OGG;
+    if (len >= 12 && memcmp(head, "RIFF", 4) == 0 && memcmp(head + 8, "WAVE", 4) == 0) return TRACK_FORMAT_WAV;
+    if (len >= 8 && memcmp(head + 4, "ftyp", 4) == 0) return TRACK_FORMAT_M4A;
+    if (mpegFrameHeader(head)) return TRACK_FORMAT_MP3;
+    return guess; // Junk before the first frame, say; the guessed reader copes or finds nothing
+}
+
+void metadataParse(MetaReader *reader, TrackFormat format, StrArena *strings, TrackMetadata *meta) {
+    memset(meta, 0, sizeof(*meta));
+    replayGainInit(&meta->gain);
+    meta->format = format;
+    switch (format) {
+        case TRACK_FORMAT_MP3:  id3Read(reader, strings, meta); break;
+        case TRACK_FORMAT_FLAC: flacRead(reader, strings, meta); break;
+        case TRACK_FORMAT_OGG:  oggRead(reader, strings, meta); break;
+        case TRACK_FORMAT_M4A:  mp4Read(reader, strings, meta); break;
+        case TRACK_FORMAT_WAV:  wavRead(reader, strings, meta); break;
+        default:                break; // No reader for this container yet
+    }
+}
+
+bool metadataRead(const char *path, TrackFormat format, uint64_t fileSize, StrArena *strings,
+                  TrackMetadata *meta, MetaIoStats *io) {
+    memset(meta, 0, sizeof(*meta));
+    replayGainInit(&meta->gain);
+    meta->format = format;
+
+    MetaReader reader;
+    if (!metaReaderOpen(&reader, path, fileSize)) return false;
+    metadataParse(&reader, metadataSniff(&reader, format), strings, meta);
+
+    if (io) {
+        io->bytesRead += reader.stats.bytesRead;
+        io->reads += reader.stats.reads;
+    }
+    metaReaderClose(&reader);
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "catalog.h"
+#include "metaio.h"
+#include "replaygain.h"
+#include "strarena.h"
+#include "textconv.h"
+
+// --- Track Metadata ---
+// Reads tags and duration from a file's headers only; audio is never decoded. Strings are
+// normalised to UTF-8 (textConvert()) and interned into the caller's arena.
+
+typedef struct {
+    uint32_t title;       // StrArena refs (STRARENA_NONE if absent)
+    uint32_t artist;
+    uint32_t album;
+    uint32_t trackNumber; // 0 if unknown
+    uint32_t sampleRate;  // Hz, 0 if unknown
+    uint32_t durationMs;  // 0 if unknown
+    uint64_t frameCount;  // PCM frames, where the header states them exactly (FLAC, WAV); else 0
+    ReplayGain gain;      // Loudness tags; absent values as replayGainInit() leaves them
+    TrackFormat format;   // Container found in the first bytes; the caller's guess if none was
+    uint8_t textFlags;    // TEXT_FLAG_* of every string stored
+} TrackMetadata;
+
+// Reads what it can; fields stay empty if the file has no usable tags.
+// `format` is a guess from the extension: the first read, which the parser
+// then works from, decides which reader runs (see metadataSniff()).
+// Returns false only if the file could not be opened. `io` may be NULL.
+bool metadataRead(const char *path, TrackFormat format, uint64_t fileSize, StrArena *strings,
+                  TrackMetadata *meta, MetaIoStats *io);
+// Runs `format`'s reader on an open reader, as is; no sniffing.
+void metadataParse(MetaReader *reader, TrackFormat format, StrArena *strings, TrackMetadata *meta);
+
+// Recognises a container from the file's first bytes: an ID3v2 tag or MPEG
+// audio frame header, "fLaC", "OggS", RIFF/WAVE or an MP4 "ftyp" box. Costs
+// one read, which fills the reader's window from offset 0 for the parser to
+// reuse. Some FLAC files start with an ID3v2 tag; when the tag runs past
+// that first read, `guess` settles it. Returns `guess` if nothing matches.
+TrackFormat metadataSniff(MetaReader *reader, TrackFormat guess);
+
+// Leading decimal number of a tag value such as "3/12"; 0 if none.
+uint32_t metadataNumber(const uint8_t *data, uint32_t len);
+
+// A run of file bytes. A packet split across Ogg pages is a list of these.
+typedef struct {
+    uint64_t offset;
+    uint32_t len;
+} MetaSpan;
+
+// Reads a Vorbis comment block (FLAC VORBIS_COMMENT, Ogg Vorbis / Opus comment
+// packet) stored in `spans`, starting `skip` bytes in. Each comment is read
+// only as far as its value is useful; long ones, such as embedded pictures,
+// are stepped over.
+void vorbisCommentRead(MetaReader *reader, const MetaSpan *spans, uint32_t numSpans, uint32_t skip,
+                       StrArena *strings, TrackMetadata *meta);
+
+// Per-format readers, called by metadataRead() with an open reader.
+void id3Read(MetaReader *reader, StrArena *strings, TrackMetadata *meta);
+void flacRead(MetaReader *reader, StrArena *strings, TrackMetadata *meta);
+void oggRead(MetaReader *reader, StrArena *strings, TrackMetadata *meta);
+void mp4Read(MetaReader *reader, StrArena *strings, TrackMetadata *meta);
+void wavRead(MetaReader *reader, StrArena *strings, TrackMetadata *meta);
+
+// Locate the embedded cover (the front cover if marked, else the first
+// picture) without reading it. Return false if the file has none.
+bool id3FindPicture(MetaReader *reader, MetaSpan *picture);
+bool flacFindPicture(MetaReader *reader, MetaSpan *picture);
+bool mp4FindPicture(MetaReader *reader, MetaSpan *picture);
+// Locates the first FLAC metadata block of `type` (e.g. 5, CUESHEET).
+bool flacFindBlock(MetaReader *reader, uint8_t type, MetaSpan *block);
+
+// Sets durationMs (and sampleRate) from the MPEG audio frames starting at or
+// after `audioStart`, leaving it untouched if no frame is found.
+void mpegDurationRead(MetaReader *reader, uint64_t audioStart, TrackMetadata *meta);
+// True if `p` (4 bytes) is a usable MPEG audio frame header.
+bool mpegFrameHeader(const uint8_t *p);
+
+// Size of an ID3v2 tag at the start of the file, header included; 0 if none.
+// Some FLAC files carry one before the "fLaC" marker.
+uint32_t id3PrefixSize(MetaReader *reader);
+
+#endif
@@ -0,0 +1,64 @@
+#include <string.h>
+#include <sys/types.h> // For off_t
+
+#include "metaio.h"
+
+bool metaReaderOpen(MetaReader *reader, const char *path, uint64_t fileSize) {
+    reader->file = fopen(path, "rb");
+    reader->fileSize = fileSize;
+    reader->windowStart = 0;
+    reader->windowLen = 0;
+    memset(&reader->stats, 0, sizeof(reader->stats));
+    if (!reader->file) return false;
+    // The window is the only buffer; stdio's would double every read
+    setvbuf(reader->file, NULL, _IONBF, 0);
+    return true;
+}
+
+void metaReaderClose(MetaReader *reader) {
+    if (reader->file) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+bool metaSeek(FILE *file, uint64_t offset) {
+    off_t pos = (off_t)offset;
+    if (pos < 0 || (uint64_t)pos != offset) return false;
+    return fseeko(file, pos, SEEK_SET) == 0;
+}
+
+// Reads up to `len` bytes at `offset`; returns the number read.
+static uint32_t readAt(MetaReader *reader, uint64_t offset, void *dst, uint32_t len) {
+    if (!metaSeek(reader->file, offset)) return 0;
+    size_t got = fread(dst, 1, len, reader->file);
+    reader->stats.bytesRead += got;
+    reader->stats.reads++;
+    return (uint32_t)got;
+}
+
+const uint8_t* metaReaderPeek(MetaReader *reader, uint64_t offset, uint32_t len) {
+    if (len > META_WINDOW_SIZE || offset + len > reader->fileSize) return NULL;
+
+    if (offset < reader->windowStart || offset + len > reader->windowStart + reader->windowLen) {
+        // Refill starting at the requested offset; parsers mostly walk forwards
+        uint64_t remaining = reader->fileSize - offset;
+        uint32_t want = remaining < META_WINDOW_SIZE ? (uint32_t)remaining : META_WINDOW_SIZE;
+        reader->windowStart = offset;
+        reader->windowLen = readAt(reader, offset, reader->window, want);
+        if (reader->windowLen < len) return NULL;
+    }
+    return reader->window + (offset - reader->windowStart);
+}
+
+bool metaReaderRead(MetaReader *reader, uint64_t offset, void *dst, uint32_t len) {
+    if (offset + len > reader->fileSize) return false;
+    // Small reads go through the window so neighbouring fields share one read
+    if (len <= META_WINDOW_SIZE) {
+        const uint8_t *bytes = metaReaderPeek(reader, offset, len);
+        if (!bytes) return false;
+        memcpy(dst, bytes, len);
+        return true;
+    }
+    return readAt(reader, offset, dst, len) == len;
+}
@@ -0,0 +1,64 @@
+#ifndef METAIO_H
+#define METAIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// --- Bounded Metadata I/O ---
+// Tag parsers read files through a single window buffer instead of stdio's
+// own buffering. A read is made only when a parser asks for bytes outside
+// the window, and skipping a frame just moves the offset it asks for next,
+// so picture and audio payloads are never read. Every read is counted.
+
+#define META_WINDOW_SIZE 4096
+
+typedef struct {
+    uint64_t bytesRead; // Bytes actually read from the file
+    uint32_t reads;     // Read calls (each one is an FS request on the 3DS)
+} MetaIoStats;
+
+typedef struct {
+    FILE *file;
+    uint64_t fileSize;
+    uint64_t windowStart;   // File offset of window[0]
+    uint32_t windowLen;     // Valid bytes in the window
+    MetaIoStats stats;
+    uint8_t window[META_WINDOW_SIZE];
+} MetaReader;
+
+// `fileSize` is the size the caller already stat'ed. Returns false if the file can't be opened.
+bool metaReaderOpen(MetaReader *reader, const char *path, uint64_t fileSize);
+void metaReaderClose(MetaReader *reader);
+
+// Returns `len` bytes at `offset` (len <= META_WINDOW_SIZE), reading only if
+// they are not already in the window. NULL if the range runs past the end of
+// the file. The pointer is valid until the next call.
+const uint8_t* metaReaderPeek(MetaReader *reader, uint64_t offset, uint32_t len);
+// Copies `len` bytes at `offset` into `dst`, through the window when they fit
+// in it. Returns false on a short read.
+bool metaReaderRead(MetaReader *reader, uint64_t offset, void *dst, uint32_t len);
+
+// Seeks `file` to `offset` from its start with fseeko(), so offsets past
+// 2 GiB work where long is 32 bits. False if off_t can't hold `offset`.
+bool metaSeek(FILE *file, uint64_t offset);
+
+// Big-endian / little-endian field decoding.
+static inline uint32_t metaBe32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint32_t metaBe24(const uint8_t *p) {
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static inline uint32_t metaLe16(const uint8_t *p) {
+    return ((uint32_t)p[1] << 8) | p[0];
+}
+
+static inline uint32_t metaLe32(const uint8_t *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+#endif
@@ -0,0 +1,246 @@
+#include <string.h>
+
+#include "metadata.h"
+
+// --- MP4 / M4A Atoms ---
+// Walks the atom tree by header alone: every atom is an 8-byte size + type
+// (16 with a 64-bit size), and anything not on the path to the fields we
+// want is skipped by offset. That includes mdat, whether the encoder put
+// moov before it (faststart) or after it, and the sample tables and cover
+// art inside moov. Tags come from moov/udta/meta/ilst; duration from the
+// sound track's mdhd, or mvhd if there is none. ReplayGain comes from
+// iTunes-style "----" items (mean, name and data atoms).
+
+#define MP4_TYPE(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+#define MP4_MAX_DEPTH  8   // moov/udta/meta/ilst/<item>/data is six deep
+#define MP4_MAX_ATOMS  512 // Per file; stops runaway walks over corrupt sizes
+#define MP4_TEXT_MAX   1024 // Bytes of a text value read
+
+// ilst item data types
+#define MP4_DATA_UTF8    1
+#define MP4_DATA_UTF16BE 2
+
+typedef struct {
+    MetaReader *reader;
+    StrArena *strings;
+    TrackMetadata *meta;
+    uint32_t atomsLeft;
+    uint32_t albumArtist;
+    uint64_t movieDurationMs; // From mvhd
+    // The track being walked
+    uint32_t handler;
+    uint32_t trackTimescale;
+    uint64_t trackDuration;
+    uint32_t trackSampleRate;
+    MetaSpan *cover;          // Set when only the cover art is wanted
+    bool haveCover;
+} Mp4Walk;
+
+// Reads the mvhd / mdhd timescale and duration (version 0: 32-bit times, version 1: 64-bit).
+static bool readTimes(Mp4Walk *walk, uint64_t body, uint64_t size, uint32_t *timescale, uint64_t *duration) {
+    const uint8_t *box = metaReaderPeek(walk->reader, body, size < 32 ? (uint32_t)size : 32);
+    if (!box || size < 20) return false;
+    if (box[0] == 1) {
+        if (size < 32) return false;
+        *timescale = metaBe32(box + 20);
+        *duration = ((uint64_t)metaBe32(box + 24) << 32) | metaBe32(box + 28);
+    } else {
+        *timescale = metaBe32(box + 12);
+        *duration = metaBe32(box + 16);
+    }
+    return *timescale != 0;
+}
+
+// An ilst item holds one or more "data" atoms: type, locale, then the value.
+static void readItem(Mp4Walk *walk, uint32_t type, uint64_t body, uint64_t size) {
+    const uint8_t *header = metaReaderPeek(walk->reader, body, 16);
+    if (!header || size < 16 || metaBe32(header + 4) != MP4_TYPE('d', 'a', 't', 'a')) return;
+    uint64_t dataSize = metaBe32(header);
+    if (dataSize < 16 || dataSize > size) return;
+    uint32_t dataType = metaBe32(header + 8) & 0x00FFFFFF;
+    uint64_t valueLen = dataSize - 16;
+    if (walk->cover) {
+        // The image is left unread; the first covr entry is the one players show
+        if (type == MP4_TYPE('c', 'o', 'v', 'r') && !walk->haveCover) {
+            walk->cover->offset = body + 16;
+            walk->cover->len = (uint32_t)valueLen;
+            walk->haveCover = true;
+        }
+        return;
+    }
+    uint32_t take = valueLen < MP4_TEXT_MAX ? (uint32_t)valueLen : MP4_TEXT_MAX;
+    const uint8_t *value = metaReaderPeek(walk->reader, body + 16, take);
+    if (!value) return;
+
+    TrackMetadata *meta = walk->meta;
+    if (type == MP4_TYPE('t', 'r', 'k', 'n')) {
+        // Binary: 2 bytes padding, 16-bit track, 16-bit total
+        if (take >= 4 && meta->trackNumber == 0) meta->trackNumber = ((uint32_t)value[2] << 8) | value[3];
+        return;
+    }
+
+    uint32_t *field = NULL;
+    if (type == MP4_TYPE(0xA9, 'n', 'a', 'm')) field = &meta->title;
+    else if (type == MP4_TYPE(0xA9, 'A', 'R', 'T')) field = &meta->artist;
+    else if (type == MP4_TYPE(0xA9, 'a', 'l', 'b')) field = &meta->album;
+    else if (type == MP4_TYPE('a', 'A', 'R', 'T')) field = &walk->albumArtist;
+    if (!field || *field != STRARENA_NONE) return;
+
+    if (dataType == MP4_DATA_UTF8) {
+        *field = textConvert(walk->strings, META_TEXT_UTF8, value, take, &walk->meta->textFlags);
+    } else if (dataType == MP4_DATA_UTF16BE) {
+        *field = textConvert(walk->strings, META_TEXT_UTF16BE, value, take, &walk->meta->textFlags);
+    }
+}
+
+// A "----" item: "mean" and "name" atoms (version/flags, then the text)
+// name it, a "data" atom holds the value. Only ReplayGain's are read.
+static void readFreeform(Mp4Walk *walk, uint64_t pos, uint64_t end) {
+    char name[32];
+    uint32_t nameLen = 0;
+    while (pos + 12 <= end) {
+        const uint8_t *header = metaReaderPeek(walk->reader, pos, 12);
+        if (!header) return;
+        uint64_t size = metaBe32(header);
+        uint32_t type = metaBe32(header + 4);
+        if (size < 12 || size > end - pos) return;
+        uint32_t len = (uint32_t)size - 12;
+        if (type == MP4_TYPE('n', 'a', 'm', 'e')) {
+            const uint8_t *text = metaReaderPeek(walk->reader, pos + 12, len < sizeof(name) ? len : sizeof(name));
+            if (!text) return;
+            nameLen = len < sizeof(name) ? len : sizeof(name);
+            memcpy(name, text, nameLen);
+        } else if (type == MP4_TYPE('d', 'a', 't', 'a') && nameLen > 0 && len >= 4) {
+            // Type and locale, then the text
+            uint32_t take = len - 4 < 32 ? len - 4 : 32;
+            const uint8_t *value = metaReaderPeek(walk->reader, pos + 16, take);
+            if (value) replayGainTag(&walk->meta->gain, (const uint8_t*)name, nameLen, value, take);
+            return;
+        }
+        pos += size;
+    }
+}
+
+static bool isContainer(uint32_t type) {
+    switch (type) {
+        case MP4_TYPE('m', 'o', 'o', 'v'):
+        case MP4_TYPE('t', 'r', 'a', 'k'):
+        case MP4_TYPE('m', 'd', 'i', 'a'):
+        case MP4_TYPE('m', 'i', 'n', 'f'):
+        case MP4_TYPE('s', 't', 'b', 'l'):
+        case MP4_TYPE('u', 'd', 't', 'a'):
+        case MP4_TYPE('i', 'l', 's', 't'):
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void walkAtoms(Mp4Walk *walk, uint64_t pos, uint64_t end, uint32_t parent, int depth);
+
+static void enterTrack(Mp4Walk *walk, uint64_t body, uint64_t end, int depth) {
+    walk->handler = 0;
+    walk->trackTimescale = 0;
+    walk->trackDuration = 0;
+    walk->trackSampleRate = 0;
+    walkAtoms(walk, body, end, MP4_TYPE('t', 'r', 'a', 'k'), depth + 1);
+
+    TrackMetadata *meta = walk->meta;
+    if (walk->handler != MP4_TYPE('s', 'o', 'u', 'n') || meta->durationMs != 0) return;
+    if (walk->trackTimescale != 0 && walk->trackDuration != 0) {
+        meta->durationMs = (uint32_t)(walk->trackDuration * 1000 / walk->trackTimescale);
+    }
+    // The sample entry's rate, or else the media timescale, which encoders set to it
+    meta->sampleRate = walk->trackSampleRate ? walk->trackSampleRate : walk->trackTimescale;
+}
+
+// Visits the atoms in [pos, end). `parent` is the enclosing atom's type.
+static void walkAtoms(Mp4Walk *walk, uint64_t pos, uint64_t end, uint32_t parent, int depth) {
+    if (depth >= MP4_MAX_DEPTH) return;
+    while (pos + 8 <= end && walk->atomsLeft > 0) {
+        walk->atomsLeft--;
+        const uint8_t *header = metaReaderPeek(walk->reader, pos, 8);
+        if (!header) return;
+        uint64_t size = metaBe32(header);
+        uint32_t type = metaBe32(header + 4);
+        uint64_t body = pos + 8;
+        if (size == 1) {
+            // 64-bit size follows the type; mdat of a large file uses it
+            const uint8_t *large = metaReaderPeek(walk->reader, pos + 8, 8);
+            if (!large) return;
+            size = ((uint64_t)metaBe32(large) << 32) | metaBe32(large + 4);
+            body = pos + 16;
+        } else if (size == 0) {
+            size = end - pos; // Runs to the end of its container
+        }
+        if (size < body - pos || size > end - pos) return;
+        uint64_t next = pos + size;
+
+        if (type == MP4_TYPE('t', 'r', 'a', 'k')) {
+            enterTrack(walk, body, next, depth);
+        } else if (isContainer(type)) {
+            walkAtoms(walk, body, next, type, depth + 1);
+            if (type == MP4_TYPE('m', 'o', 'o', 'v')) return; // Nothing we read lives outside it
+        } else if (type == MP4_TYPE('m', 'e', 't', 'a')) {
+            // A full box (4 bytes version/flags) in iTunes files, a plain one in QuickTime's
+            const uint8_t *peek = metaReaderPeek(walk->reader, body, 8);
+            if (peek && metaBe32(peek + 4) != MP4_TYPE('h', 'd', 'l', 'r')) body += 4;
+            walkAtoms(walk, body, next, type, depth + 1);
+        } else if (type == MP4_TYPE('m', 'v', 'h', 'd')) {
+            uint32_t timescale;
+            uint64_t duration;
+            if (readTimes(walk, body, next - body, &timescale, &duration)) {
+                walk->movieDurationMs = duration * 1000 / timescale;
+            }
+        } else if (type == MP4_TYPE('m', 'd', 'h', 'd')) {
+            readTimes(walk, body, next - body, &walk->trackTimescale, &walk->trackDuration);
+        } else if (type == MP4_TYPE('h', 'd', 'l', 'r') && parent == MP4_TYPE('m', 'd', 'i', 'a')) {
+            const uint8_t *hdlr = metaReaderPeek(walk->reader, body, 12);
+            if (hdlr) walk->handler = metaBe32(hdlr + 8);
+        } else if (type == MP4_TYPE('s', 't', 's', 'd') && walk->handler == MP4_TYPE('s', 'o', 'u', 'n') &&
+                   next - body >= 8 + 8 + 28) {
+            // Version/flags, entry count, then the first sample entry; an audio
+            // entry has its 16.16 rate 24 bytes into the entry body
+            const uint8_t *stsd = metaReaderPeek(walk->reader, body, 8 + 8 + 28);
+            if (stsd) walk->trackSampleRate = metaBe32(stsd + 8 + 8 + 24) >> 16;
+        } else if (type == MP4_TYPE('-', '-', '-', '-') && parent == MP4_TYPE('i', 'l', 's', 't')) {
+            if (!walk->cover) readFreeform(walk, body, next);
+        } else if (parent == MP4_TYPE('i', 'l', 's', 't')) {
+            readItem(walk, type, body, next - body);
+        }
+        // Everything else, mdat included, is stepped over without reading it
+        pos = next;
+    }
+}
+
+static bool beginWalk(Mp4Walk *walk, MetaReader *reader, StrArena *strings, TrackMetadata *meta) {
+    const uint8_t *ftyp = metaReaderPeek(reader, 0, 8);
+    if (!ftyp || metaBe32(ftyp + 4) != MP4_TYPE('f', 't', 'y', 'p')) return false;
+    memset(walk, 0, sizeof(*walk));
+    walk->reader = reader;
+    walk->strings = strings;
+    walk->meta = meta;
+    walk->atomsLeft = MP4_MAX_ATOMS;
+    walk->albumArtist = STRARENA_NONE;
+    return true;
+}
+
+void mp4Read(MetaReader *reader, StrArena *strings, TrackMetadata *meta) {
+    Mp4Walk walk;
+    if (!beginWalk(&walk, reader, strings, meta)) return;
+    walkAtoms(&walk, 0, reader->fileSize, 0, 0);
+
+    if (meta->artist == STRARENA_NONE) meta->artist = walk.albumArtist;
+    if (meta->durationMs == 0) meta->durationMs = (uint32_t)walk.movieDurationMs;
+}
+
+bool mp4FindPicture(MetaReader *reader, MetaSpan *picture) {
+    Mp4Walk walk;
+    TrackMetadata scratch; // Durations found on the way are not wanted
+    memset(&scratch, 0, sizeof(scratch));
+    if (!beginWalk(&walk, reader, NULL, &scratch)) return false;
+    walk.cover = picture;
+    walkAtoms(&walk, 0, reader->fileSize, 0, 0);
+    return walk.haveCover;
+}
@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "metadata.h"
+
+// --- MPEG Audio Duration ---
+// Times an MP3 from its first frame instead of decoding it. A VBR encoder
+// leaves a Xing/Info or VBRI header there with the frame count, and LAME's
+// extension of it the encoder delay and padding to trim. Without one, a
+// stream whose first frames share a bitrate is CBR and is timed from its
+// size. Only a stream with neither is walked frame header to frame header,
+// for a bounded stretch whose average is extrapolated to the rest.
+
+#define MPEG_HEADER_SIZE  4
+#define MPEG_SYNC_SEARCH  (64 * 1024)  // Junk tolerated between the tag and the first frame
+#define MPEG_CBR_FRAMES   8            // Frames that must agree before a stream is called CBR
+#define MPEG_WALK_BYTES   (256 * 1024) // Stretch of a headerless VBR stream walked frame by frame
+
+// Xing flags
+#define XING_FRAMES  0x01
+#define XING_BYTES   0x02
+#define XING_TOC     0x04
+#define XING_QUALITY 0x08
+
+typedef struct {
+    uint32_t bitrate;         // Bits per second
+    uint32_t sampleRate;
+    uint32_t samplesPerFrame;
+    uint32_t frameLen;        // Bytes, header included
+    uint32_t sideInfoLen;     // Layer III side info, where the Xing header follows
+    uint8_t  version;         // Header bits: 3 = MPEG-1, 2 = MPEG-2, 0 = MPEG-2.5
+    uint8_t  layer;           // 1..3
+} MpegFrame;
+
+// kbps by [MPEG-1 ? 0 : 1][layer - 1][index]
+static const uint16_t s_bitrates[2][3][15] = {
+    { { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+      { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+      { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 } },
+    { { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 } },
+};
+
+static const uint32_t s_sampleRates[3] = { 44100, 48000, 32000 }; // MPEG-1; halved for 2, quartered for 2.5
+
+// Decodes a frame header. Free-format streams (bitrate index 0) are not timed.
+static bool parseHeader(const uint8_t *p, MpegFrame *frame) {
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return false;
+    uint8_t version = (p[1] >> 3) & 0x03;
+    uint8_t layerBits = (p[1] >> 1) & 0x03;
+    uint8_t bitrateIndex = p[2] >> 4;
+    uint8_t rateIndex = (p[2] >> 2) & 0x03;
+    if (version == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) return false;
+
+    bool mpeg1 = version == 3;
+    bool mono = (p[3] >> 6) == 3;
+    uint32_t padding = (p[2] >> 1) & 0x01;
+    frame->version = version;
+    frame->layer = (uint8_t)(4 - layerBits);
+    frame->bitrate = s_bitrates[mpeg1 ? 0 : 1][frame->layer - 1][bitrateIndex] * 1000u;
+    frame->sampleRate = s_sampleRates[rateIndex] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+
+    if (frame->layer == 1) {
+        frame->samplesPerFrame = 384;
+        frame->frameLen = (12 * frame->bitrate / frame->sampleRate + padding) * 4;
+    } else {
+        bool halfFrame = frame->layer == 3 && !mpeg1; // MPEG-2/2.5 Layer III: 576 samples
+        frame->samplesPerFrame = halfFrame ? 576 : 1152;
+        frame->frameLen = (halfFrame ? 72 : 144) * frame->bitrate / frame->sampleRate + padding;
+    }
+    frame->sideInfoLen = mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+    return frame->frameLen > MPEG_HEADER_SIZE;
+}
+
+bool mpegFrameHeader(const uint8_t *p) {
+    MpegFrame frame;
+    return parseHeader(p, &frame);
+}
+
+static bool readFrame(MetaReader *reader, uint64_t pos, MpegFrame *frame) {
+    const uint8_t *p = metaReaderPeek(reader, pos, MPEG_HEADER_SIZE);
+    return p && parseHeader(p, frame);
+}
+
+// Finds the first frame at or after `pos`, confirmed by a matching header
+// where the next frame should start, so a stray 0xFF in junk isn't taken.
+static bool findFirstFrame(MetaReader *reader, uint64_t *pos, MpegFrame *frame) {
+    uint64_t end = *pos + MPEG_SYNC_SEARCH;
+    for (uint64_t at = *pos; at < end && at + MPEG_HEADER_SIZE <= reader->fileSize; ++at) {
+        if (!readFrame(reader, at, frame)) continue;
+        MpegFrame next;
+        if (!readFrame(reader, at + frame->frameLen, &next)) continue;
+        if (next.version == frame->version && next.layer == frame->layer && next.sampleRate == frame->sampleRate) {
+            *pos = at;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t samplesToMs(uint64_t samples, uint32_t sampleRate) {
+    return (uint32_t)(samples * 1000 / sampleRate);
+}
+
+// Xing/Info (LAME and most VBR encoders) after the side info, or VBRI (Fraunhofer)
+// 32 bytes in. Returns false if the frame carries neither.
+static bool readVbrHeader(MetaReader *reader, uint64_t pos, const MpegFrame *frame, TrackMetadata *meta) {
+    if (frame->layer != 3) return false;
+
+    uint64_t xing = pos + MPEG_HEADER_SIZE + frame->sideInfoLen;
+    const uint8_t *p = metaReaderPeek(reader, xing, 12);
+    if (p && (memcmp(p, "Xing", 4) == 0 || memcmp(p, "Info", 4) == 0)) {
+        uint32_t flags = metaBe32(p + 4);
+        if (!(flags & XING_FRAMES)) return false;
+        uint64_t samples = (uint64_t)metaBe32(p + 8) * frame->samplesPerFrame;
+
+        // The LAME extension follows the optional fields
+        uint64_t lame = xing + 12 + ((flags & XING_BYTES) ? 4 : 0) + ((flags & XING_TOC) ? 100 : 0) +
+                        ((flags & XING_QUALITY) ? 4 : 0);
+        const uint8_t *ext = metaReaderPeek(reader, lame, 24);
+        if (ext && (memcmp(ext, "LAME", 4) == 0 || memcmp(ext, "Lavc", 4) == 0 || memcmp(ext, "Lavf", 4) == 0)) {
+            // 12-bit encoder delay and 12-bit padding, in samples
+            uint32_t delay = ((uint32_t)ext[21] << 4) | (ext[22] >> 4);
+            uint32_t padding = ((uint32_t)(ext[22] & 0x0F) << 8) | ext[23];
+            if (samples > delay + padding) samples -= delay + padding;
+        }
+        meta->durationMs = samplesToMs(samples, frame->sampleRate);
+        return true;
+    }
+
+    p = metaReaderPeek(reader, pos + MPEG_HEADER_SIZE + 32, 18);
+    if (p && memcmp(p, "VBRI", 4) == 0) {
+        uint64_t samples = (uint64_t)metaBe32(p + 14) * frame->samplesPerFrame;
+        meta->durationMs = samplesToMs(samples, frame->sampleRate);
+        return true;
+    }
+    return false;
+}
+
+void mpegDurationRead(MetaReader *reader, uint64_t audioStart, TrackMetadata *meta) {
+    uint64_t pos = audioStart;
+    MpegFrame first;
+    if (!findFirstFrame(reader, &pos, &first)) return;
+    meta->sampleRate = first.sampleRate;
+    if (readVbrHeader(reader, pos, &first, meta)) return;
+
+    // Walk frames until the bitrate changes, or for good once it has
+    uint64_t audioBytes = reader->fileSize - pos;
+    uint64_t at = pos;
+    uint64_t samples = 0;
+    uint32_t frames = 0;
+    bool constant = true;
+    MpegFrame frame;
+    while (at - pos < MPEG_WALK_BYTES && readFrame(reader, at, &frame)) {
+        if (frame.sampleRate != first.sampleRate) break;
+        if (frame.bitrate != first.bitrate) constant = false;
+        samples += frame.samplesPerFrame;
+        at += frame.frameLen;
+        frames++;
+        if (constant && frames == MPEG_CBR_FRAMES) {
+            meta->durationMs = (uint32_t)(audioBytes * 8000 / first.bitrate);
+            return;
+        }
+    }
+    if (frames == 0) return;
+    if (at - pos >= MPEG_WALK_BYTES) {
+        samples = samples * audioBytes / (at - pos); // Extrapolate the walked stretch
+    }
+    meta->durationMs = samplesToMs(samples, first.sampleRate);
+}
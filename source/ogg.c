@@ -0,0 +1,128 @@
+#include <string.h>
+
+#include "metadata.h"
+
+// --- Ogg Vorbis / Opus Headers ---
+// Follows the page segment tables of the first logical stream just far
+// enough to find its first two packets: the identification header (a few
+// bytes of which are kept) and the comment header, which is recorded as
+// the file spans it occupies and read comment by comment from there. No
+// codec state or decode tables are built. The length is the granule
+// position of the stream's last page, found with a read at the end.
+
+#define OGG_PAGE_HEADER_SIZE 27
+#define OGG_MAX_PAGES        64 // Comment packets with embedded art span many pages
+#define OGG_IDENT_MAX        32 // Bytes of the identification packet we look at
+#define OGG_TAIL_WINDOWS     16 // Windows searched back from the end; a page is at most ~64 KiB
+#define OPUS_RATE            48000
+
+typedef struct {
+    uint8_t ident[OGG_IDENT_MAX];
+    uint32_t identLen;
+    MetaSpan comment[OGG_MAX_PAGES]; // Where the comment packet lies, one span per page
+    uint32_t commentSpans;
+    uint32_t packet;                 // Packets completed so far
+    uint32_t serial;                 // The logical stream they belong to
+} OggHeaders;
+
+// Records `len` bytes at `offset` as part of the current packet.
+static bool collect(MetaReader *reader, OggHeaders *h, uint64_t offset, uint32_t len) {
+    if (h->packet == 0) {
+        uint32_t take = OGG_IDENT_MAX - h->identLen < len ? OGG_IDENT_MAX - h->identLen : len;
+        if (take > 0 && !metaReaderRead(reader, offset, h->ident + h->identLen, take)) return false;
+        h->identLen += take;
+        return true;
+    }
+    // Segments within a page are contiguous, so each page adds at most one span
+    MetaSpan *last = h->commentSpans ? &h->comment[h->commentSpans - 1] : NULL;
+    if (last && last->offset + last->len == offset) {
+        last->len += len;
+    } else if (h->commentSpans < OGG_MAX_PAGES) {
+        h->comment[h->commentSpans].offset = offset;
+        h->comment[h->commentSpans].len = len;
+        h->commentSpans++;
+    }
+    return true;
+}
+
+// Locates the first two packets. Returns false if the stream ends first.
+static bool findHeaderPackets(MetaReader *reader, OggHeaders *h) {
+    uint64_t pos = 0;
+    for (int page = 0; page < OGG_MAX_PAGES; ++page) {
+        const uint8_t *header = metaReaderPeek(reader, pos, OGG_PAGE_HEADER_SIZE);
+        if (!header || memcmp(header, "OggS", 4) != 0 || header[4] != 0) return false;
+        uint32_t pageSerial = metaLe32(header + 14);
+        uint32_t numSegments = header[26];
+        if (page == 0) h->serial = pageSerial;
+
+        uint8_t lacing[255];
+        if (!metaReaderRead(reader, pos + OGG_PAGE_HEADER_SIZE, lacing, numSegments)) return false;
+        uint64_t data = pos + OGG_PAGE_HEADER_SIZE + numSegments;
+
+        for (uint32_t s = 0; s < numSegments; ++s) {
+            // Pages of other multiplexed streams are stepped over
+            if (pageSerial == h->serial) {
+                if (!collect(reader, h, data, lacing[s])) return false;
+                if (lacing[s] < 255 && ++h->packet == 2) return true;
+            }
+            data += lacing[s];
+        }
+        pos = data;
+    }
+    return false;
+}
+
+// Granule position of the last page of `serial` that ends a packet, searched
+// backwards from the end of the file one window at a time. Usually one read.
+static bool lastGranule(MetaReader *reader, uint32_t serial, uint64_t *granule) {
+    uint64_t end = reader->fileSize;
+    for (int n = 0; n < OGG_TAIL_WINDOWS && end >= OGG_PAGE_HEADER_SIZE; ++n) {
+        uint64_t start = end > META_WINDOW_SIZE ? end - META_WINDOW_SIZE : 0;
+        const uint8_t *tail = metaReaderPeek(reader, start, (uint32_t)(end - start));
+        if (!tail) return false;
+        for (uint32_t i = (uint32_t)(end - start) - OGG_PAGE_HEADER_SIZE + 1; i-- > 0;) {
+            const uint8_t *page = tail + i;
+            if (memcmp(page, "OggS", 4) != 0 || page[4] != 0 || metaLe32(page + 14) != serial) continue;
+            uint64_t position = ((uint64_t)metaLe32(page + 10) << 32) | metaLe32(page + 6);
+            if (position == UINT64_MAX) continue; // No packet ends on this page
+            *granule = position;
+            return true;
+        }
+        if (start == 0) break;
+        end = start + OGG_PAGE_HEADER_SIZE - 1; // Overlap so a header across the boundary is seen
+    }
+    return false;
+}
+
+void oggRead(MetaReader *reader, StrArena *strings, TrackMetadata *meta) {
+    OggHeaders h;
+    h.identLen = h.commentSpans = h.packet = 0;
+    // A comment packet that runs past the pages we follow still yields the tags before that
+    if (!findHeaderPackets(reader, &h) && h.packet < 1) return;
+
+    uint8_t magic[8];
+    bool haveMagic = h.commentSpans > 0 && h.comment[0].len >= sizeof(magic) &&
+                     metaReaderRead(reader, h.comment[0].offset, magic, sizeof(magic));
+
+    uint64_t granule = 0;
+    if (h.identLen >= 16 && h.ident[0] == 0x01 && memcmp(h.ident + 1, "vorbis", 6) == 0) {
+        meta->sampleRate = metaLe32(h.ident + 12);
+        if (haveMagic && magic[0] == 0x03 && memcmp(magic + 1, "vorbis", 6) == 0) {
+            vorbisCommentRead(reader, h.comment, h.commentSpans, 7, strings, meta);
+        }
+        // Vorbis granules count samples at the stream's rate
+        if (meta->sampleRate > 0 && lastGranule(reader, h.serial, &granule)) {
+            meta->durationMs = (uint32_t)(granule * 1000 / meta->sampleRate);
+        }
+    } else if (h.identLen >= 16 && memcmp(h.ident, "OpusHead", 8) == 0) {
+        meta->sampleRate = metaLe32(h.ident + 12); // Original input rate; Opus always decodes at 48 kHz
+        if (haveMagic && memcmp(magic, "OpusTags", 8) == 0) {
+            vorbisCommentRead(reader, h.comment, h.commentSpans, 8, strings, meta);
+        }
+        // Opus granules are 48 kHz samples, counting the pre-skip the decoder drops
+        uint32_t preSkip = metaLe16(h.ident + 10);
+        if (lastGranule(reader, h.serial, &granule) && granule > preSkip) {
+            meta->durationMs = (uint32_t)((granule - preSkip) * 1000 / OPUS_RATE);
+        }
+    }
+}
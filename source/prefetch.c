@@ -0,0 +1,88 @@
+#include <math.h>
+
+#include "prefetch.h"
+
+void prefetchInit(PrefetchWindow *window) {
+    window->first = 0;
+    window->last = -1;
+    window->count = 0;
+    window->direction = 1; // Lists start at the top, so the only way is down
+    window->lastOffset = 0.0f;
+}
+
+void prefetchUpdate(PrefetchWindow *window, float scrollOffset, float rowHeight, float viewHeight, int count) {
+    if (scrollOffset > window->lastOffset) window->direction = 1;
+    else if (scrollOffset < window->lastOffset) window->direction = -1;
+    window->lastOffset = scrollOffset;
+
+    window->count = count;
+    window->first = (int)floorf(scrollOffset / rowHeight);
+    window->last = (int)ceilf((scrollOffset + viewHeight) / rowHeight) - 1;
+    if (window->first < 0) window->first = 0;
+    if (window->last >= count) window->last = count - 1;
+}
+
+// Distance past the leading (+) or trailing edge, in rows; 0 on screen.
+static int edgeDistance(const PrefetchWindow *window, int row, bool *ahead) {
+    int below = row - window->last;
+    int above = window->first - row;
+    *ahead = (window->direction > 0) ? below > 0 : above > 0;
+    if (below > 0) return below;
+    if (above > 0) return above;
+    return 0;
+}
+
+uint32_t prefetchRank(const PrefetchWindow *window, int row) {
+    if (row < 0 || row >= window->count || window->last < window->first) return PREFETCH_RANK_FAR;
+    bool ahead;
+    int distance = edgeDistance(window, row, &ahead);
+    if (distance == 0) return (uint32_t)(row - window->first);
+
+    uint32_t onScreen = (uint32_t)(window->last - window->first + 1);
+    if (ahead) {
+        if (distance > PREFETCH_AHEAD_ROWS) return PREFETCH_RANK_FAR;
+        return onScreen + (uint32_t)distance - 1;
+    }
+    if (distance > PREFETCH_BEHIND_ROWS) return PREFETCH_RANK_FAR;
+    return onScreen + (uint32_t)distance * PREFETCH_BEHIND_COST - 1;
+}
+
+bool prefetchTooFar(const PrefetchWindow *window, int row) {
+    bool ahead;
+    int distance = edgeDistance(window, row, &ahead);
+    return distance > (ahead ? PREFETCH_AHEAD_ROWS : PREFETCH_BEHIND_ROWS) + PREFETCH_CANCEL_ROWS;
+}
+
+int prefetchOrder(const PrefetchWindow *window, int *rows, int max) {
+    if (window->last < window->first) return 0;
+    int before = (window->direction > 0) ? PREFETCH_BEHIND_ROWS : PREFETCH_AHEAD_ROWS;
+    int after = (window->direction > 0) ? PREFETCH_AHEAD_ROWS : PREFETCH_BEHIND_ROWS;
+    int start = window->first - before;
+    int end = window->last + after;
+    if (start < 0) start = 0;
+    if (end >= window->count) end = window->count - 1;
+
+    // A window is a few dozen rows, so an insertion sort by rank is plenty
+    int limit = (max < PREFETCH_MAX_ROWS) ? max : PREFETCH_MAX_ROWS;
+    int n = 0;
+    uint32_t ranks[PREFETCH_MAX_ROWS];
+    for (int row = start; row <= end; ++row) {
+        uint32_t rank = prefetchRank(window, row);
+        int pos;
+        if (n < limit) {
+            pos = n++;
+        } else if (n > 0 && rank < ranks[n - 1]) {
+            pos = n - 1; // Push out the worst row kept so far
+        } else {
+            continue;
+        }
+        while (pos > 0 && ranks[pos - 1] > rank) {
+            ranks[pos] = ranks[pos - 1];
+            rows[pos] = rows[pos - 1];
+            pos--;
+        }
+        ranks[pos] = rank;
+        rows[pos] = row;
+    }
+    return n;
+}
@@ -0,0 +1,41 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// --- Viewport Prefetch ---
+// Decides which list rows are worth reading tags or art for, and in what
+// order: the rows on screen first, then a window past each edge. The window
+// reaches further in the direction the list last scrolled, and rows behind
+// that direction rank as if they were further away. Work queued for a row
+// that has since left the window by more than PREFETCH_CANCEL_ROWS is dropped.
+
+#define PREFETCH_AHEAD_ROWS   12 // Past the edge the list is moving towards
+#define PREFETCH_BEHIND_ROWS  3  // Past the other edge
+#define PREFETCH_BEHIND_COST  3  // A row behind ranks like one this many times as far ahead
+#define PREFETCH_CANCEL_ROWS  6  // Slack beyond the window before queued work is dropped
+#define PREFETCH_MAX_ROWS     32 // Upper bound on rows in a window
+#define PREFETCH_RANK_FAR     UINT32_MAX
+
+typedef struct {
+    int first;        // First list row at least partly on screen
+    int last;         // Last one (inclusive); last < first when the list is empty
+    int count;        // Rows in the list
+    int direction;    // +1 if the list last scrolled down, -1 if up
+    float lastOffset; // Scroll offset at the previous update
+} PrefetchWindow;
+
+void prefetchInit(PrefetchWindow *window);
+// Moves the window to the current scroll position, once per frame.
+void prefetchUpdate(PrefetchWindow *window, float scrollOffset, float rowHeight, float viewHeight, int count);
+
+// 0 for the top row on screen, growing with distance from it; PREFETCH_RANK_FAR
+// outside the window.
+uint32_t prefetchRank(const PrefetchWindow *window, int row);
+// True if work queued for `row` should be dropped.
+bool prefetchTooFar(const PrefetchWindow *window, int row);
+// Writes the window's rows to `rows`, best first. Returns how many (at most `max`).
+int prefetchOrder(const PrefetchWindow *window, int *rows, int max);
+
+#endif
@@ -0,0 +1,156 @@
+#include <math.h>
+#include <string.h>
+
+#include "replaygain.h"
+
+void replayGainInit(ReplayGain *gain) {
+    gain->trackGain = REPLAYGAIN_NONE;
+    gain->albumGain = REPLAYGAIN_NONE;
+    gain->trackPeak = 0;
+    gain->albumPeak = 0;
+}
+
+// --- Tag Values ---
+
+#define REPLAYGAIN_GAIN_LIMIT 32767 // Hundredths of a dB; REPLAYGAIN_NONE is one below -limit
+#define REPLAYGAIN_PEAK_LIMIT 65535
+#define R128_GAIN_OFFSET      500   // -23 LUFS to -18 LUFS, in hundredths of a dB
+
+static bool isDigit(uint8_t c) {
+    return c >= '0' && c <= '9';
+}
+
+// A decimal such as "-6.54 dB" or "0.988525", times `scale` and rounded, up
+// to `limit` either side of zero. Whatever follows the number (the unit) is
+// ignored. Returns false if there are no digits.
+static bool parseScaled(const uint8_t *s, uint32_t len, uint32_t scale, uint32_t limit, int32_t *out) {
+    uint32_t i = 0;
+    while (i < len && (s[i] == ' ' || s[i] == '\t')) i++;
+    bool negative = false;
+    if (i < len && (s[i] == '+' || s[i] == '-')) negative = s[i++] == '-';
+
+    uint64_t whole = 0, frac = 0, den = 1;
+    bool digits = false;
+    for (; i < len && isDigit(s[i]); ++i) {
+        if (whole < 1000000) whole = whole * 10 + (s[i] - '0'); // Past the limit either way
+        digits = true;
+    }
+    // Some taggers write the locale's decimal comma
+    if (i < len && (s[i] == '.' || s[i] == ',')) {
+        for (++i; i < len && isDigit(s[i]); ++i) {
+            if (den < 1000000000) {
+                frac = frac * 10 + (s[i] - '0');
+                den *= 10;
+            }
+            digits = true;
+        }
+    }
+    if (!digits) return false;
+    uint64_t value = whole * scale + (frac * scale + den / 2) / den;
+    if (value > limit) value = limit;
+    *out = negative ? -(int32_t)value : (int32_t)value;
+    return true;
+}
+
+typedef enum {
+    TAG_TRACK_GAIN,
+    TAG_ALBUM_GAIN,
+    TAG_TRACK_PEAK,
+    TAG_ALBUM_PEAK,
+    TAG_R128_TRACK_GAIN,
+    TAG_R128_ALBUM_GAIN
+} ReplayGainTagKind;
+
+static const struct {
+    const char *key;
+    ReplayGainTagKind kind;
+} s_tags[] = {
+    { "REPLAYGAIN_TRACK_GAIN", TAG_TRACK_GAIN },
+    { "REPLAYGAIN_ALBUM_GAIN", TAG_ALBUM_GAIN },
+    { "REPLAYGAIN_TRACK_PEAK", TAG_TRACK_PEAK },
+    { "REPLAYGAIN_ALBUM_PEAK", TAG_ALBUM_PEAK },
+    { "R128_TRACK_GAIN",       TAG_R128_TRACK_GAIN },
+    { "R128_ALBUM_GAIN",       TAG_R128_ALBUM_GAIN },
+};
+
+static bool keyIs(const uint8_t *key, uint32_t keyLen, const char *name) {
+    uint32_t i = 0;
+    for (; i < keyLen && name[i]; ++i) {
+        uint8_t c = key[i];
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (c != (uint8_t)name[i]) return false;
+    }
+    return i == keyLen && name[i] == '\0';
+}
+
+// Q7.8 dB against -23 LUFS, to hundredths of a dB against -18 LUFS.
+static int32_t fromR128(int32_t q78) {
+    int32_t centi = (q78 * 100 + (q78 >= 0 ? 128 : -128)) / 256 + R128_GAIN_OFFSET;
+    if (centi > REPLAYGAIN_GAIN_LIMIT) return REPLAYGAIN_GAIN_LIMIT;
+    return centi < -REPLAYGAIN_GAIN_LIMIT ? -REPLAYGAIN_GAIN_LIMIT : centi;
+}
+
+bool replayGainTag(ReplayGain *gain, const uint8_t *key, uint32_t keyLen, const uint8_t *value, uint32_t valueLen) {
+    size_t t = 0;
+    while (t < sizeof(s_tags) / sizeof(s_tags[0]) && !keyIs(key, keyLen, s_tags[t].key)) t++;
+    if (t == sizeof(s_tags) / sizeof(s_tags[0])) return false;
+
+    ReplayGainTagKind kind = s_tags[t].kind;
+    bool album = kind == TAG_ALBUM_GAIN || kind == TAG_ALBUM_PEAK || kind == TAG_R128_ALBUM_GAIN;
+    int32_t parsed;
+    if (kind == TAG_TRACK_PEAK || kind == TAG_ALBUM_PEAK) {
+        uint16_t *peak = album ? &gain->albumPeak : &gain->trackPeak;
+        if (*peak == 0 && parseScaled(value, valueLen, REPLAYGAIN_UNITY, REPLAYGAIN_PEAK_LIMIT, &parsed) &&
+            parsed > 0) {
+            *peak = (uint16_t)parsed;
+        }
+        return true;
+    }
+    // The first gain tag found wins; a file shouldn't carry both kinds
+    int16_t *db = album ? &gain->albumGain : &gain->trackGain;
+    if (*db != REPLAYGAIN_NONE) return true;
+    if (kind == TAG_R128_TRACK_GAIN || kind == TAG_R128_ALBUM_GAIN) {
+        if (parseScaled(value, valueLen, 1, INT16_MAX, &parsed)) *db = (int16_t)fromR128(parsed);
+    } else if (parseScaled(value, valueLen, 100, REPLAYGAIN_GAIN_LIMIT, &parsed)) {
+        *db = (int16_t)parsed;
+    }
+    return true;
+}
+
+// --- Gain Stage ---
+
+int32_t replayGainMultiplier(const ReplayGain *gain, ReplayGainMode mode, int16_t preamp, bool preventClipping) {
+    if (mode == REPLAYGAIN_OFF) return REPLAYGAIN_UNITY;
+    bool album = mode == REPLAYGAIN_ALBUM;
+    int32_t db = album ? gain->albumGain : gain->trackGain;
+    if (db == REPLAYGAIN_NONE) {
+        album = !album;
+        db = album ? gain->albumGain : gain->trackGain;
+        if (db == REPLAYGAIN_NONE) return REPLAYGAIN_UNITY;
+    }
+    // The album peak bounds every track's, so it stands in for a missing track peak
+    uint32_t peak = album ? gain->albumPeak : gain->trackPeak;
+    if (peak == 0) peak = album ? gain->trackPeak : gain->albumPeak;
+
+    // 10^(dB / 20), once per track
+    double scale = pow(10.0, (double)(db + preamp) / 2000.0) * REPLAYGAIN_UNITY + 0.5;
+    int32_t multiplier = scale >= REPLAYGAIN_MAX_MULTIPLIER ? REPLAYGAIN_MAX_MULTIPLIER : (int32_t)scale;
+    // The largest peak * multiplier that replayGainApply() still rounds to
+    // INT16_MAX; dividing rounds down, so the peak never reaches saturation
+    const uint64_t fullScale = ((uint64_t)INT16_MAX << 15) + (1 << 14) - 1;
+    if (preventClipping && peak > 0 && (uint64_t)multiplier * peak > fullScale) {
+        multiplier = (int32_t)(fullScale / peak);
+    }
+    return multiplier;
+}
+
+void replayGainApply(int16_t *samples, size_t count, int32_t multiplier) {
+    if (multiplier == REPLAYGAIN_UNITY) return;
+    for (size_t i = 0; i < count; ++i) {
+        // Up to 2^15 * 2^17: one 32x32->64 multiply, then round to nearest
+        int32_t v = (int32_t)(((int64_t)samples[i] * multiplier + (1 << 14)) >> 15);
+        if (v > INT16_MAX) v = INT16_MAX;
+        else if (v < INT16_MIN) v = INT16_MIN;
+        samples[i] = (int16_t)v;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef REPLAYGAIN_H
+#define REPLAYGAIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// --- ReplayGain Tags ---
+// Loudness tags written by a tagger or encoder, read in the metadata pass:
+// REPLAYGAIN_TRACK_GAIN / _PEAK and REPLAYGAIN_ALBUM_GAIN / _PEAK (Vorbis
+// comments, ID3 TXXX frames, MP4 "----" items, cue sheet REMs), and Opus's
+// R128_TRACK_GAIN / R128_ALBUM_GAIN. Gains are kept in hundredths of a dB
+// against the ReplayGain 2 reference of -18 LUFS; R128 tags, which count
+// from -23 LUFS in Q7.8 dB, are moved onto it (+5 dB). Peaks are the largest
+// sample magnitude in Q15, 32768 = full scale, saturating just below 2.0.
+//
+// Memory: 8 bytes per track.
+
+#define REPLAYGAIN_NONE  INT16_MIN // A gain that wasn't tagged
+#define REPLAYGAIN_UNITY 32768     // 1.0 in Q15: a gain of 0 dB, or a full-scale peak
+
+typedef struct {
+    int16_t trackGain;  // Hundredths of a dB (REPLAYGAIN_NONE if absent)
+    int16_t albumGain;
+    uint16_t trackPeak; // Q15 of full scale (0 if absent)
+    uint16_t albumPeak;
+} ReplayGain;
+
+// Marks every value absent.
+void replayGainInit(ReplayGain *gain);
+// Stores a tag's value if `key` (any case) names one of the tags above and
+// `gain` doesn't have that value yet. Returns true if the key was one of
+// them, parsed or not.
+bool replayGainTag(ReplayGain *gain, const uint8_t *key, uint32_t keyLen, const uint8_t *value, uint32_t valueLen);
+
+// True once all four values are in, so a tag reader can stop looking.
+static inline bool replayGainComplete(const ReplayGain *gain) {
+    return gain->trackGain != REPLAYGAIN_NONE && gain->albumGain != REPLAYGAIN_NONE && gain->trackPeak != 0 &&
+           gain->albumPeak != 0;
+}
+
+// --- Gain Stage ---
+// Per track, the tags become one Q15 multiplier (replayGainMultiplier(),
+// once, when the track starts). Per sample, the output path then only
+// multiplies, rounds, shifts and saturates (replayGainApply()): no float
+// math and no table lookups. Clipping prevention lowers the multiplier so
+// the tagged peak lands at full scale at most; the saturation only catches
+// samples louder than the tag says (e.g. a lossy decoder's overshoot).
+
+typedef enum {
+    REPLAYGAIN_OFF,
+    REPLAYGAIN_TRACK, // Each track to the reference loudness
+    REPLAYGAIN_ALBUM  // Whole albums, keeping their loud and quiet tracks
+} ReplayGainMode;
+
+#define REPLAYGAIN_MAX_MULTIPLIER (REPLAYGAIN_UNITY * 4) // +12 dB; quieter tags are honoured, louder ones capped
+
+// The Q15 multiplier for a track. `mode`'s gain falls back to the other
+// one if untagged; an untagged track plays at unity. `preamp` (hundredths
+// of a dB) is added to tagged gains. With `preventClipping`, the peak that
+// goes with the chosen gain limits it.
+int32_t replayGainMultiplier(const ReplayGain *gain, ReplayGainMode mode, int16_t preamp, bool preventClipping);
+// Scales `count` interleaved 16-bit samples in place.
+void replayGainApply(int16_t *samples, size_t count, int32_t multiplier);
+
+#endif
@@ -0,0 +1,907 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/stat.h>
+#ifdef __3DS__
+#include <3ds.h>
+#else
+#include <time.h>
+#endif
+
+#include "scanner.h"
+#include "metadata.h"
+#include "contenthash.h"
+
+// --- Helpers ---
+
+uint64_t scanNowUs(void) {
+#ifdef __3DS__
+    return (uint64_t)((double)svcGetSystemTick() / (SYSCLOCK_ARM11 / 1000000.0));
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+#endif
+}
+
+// Interns a NUL-terminated string; returns STRARENA_NONE for NULL input or out of memory.
+static uint32_t internString(StrArena *strings, const char *s) {
+    if (!s) return STRARENA_NONE;
+    return strArenaIntern(strings, s, strlen(s));
+}
+
+// The default for Scanner.trustDirStamp; a build may set it with -D.
+#ifndef SCAN_TRUST_DIR_STAMP
+#ifdef __3DS__
+// FAT does not reliably bump a folder's timestamp when files are added or
+// removed, so an unchanged stamp only means "check the names".
+#define SCAN_TRUST_DIR_STAMP 0
+#else
+#define SCAN_TRUST_DIR_STAMP 1
+#endif
+#endif
+
+// Joins a relative folder path and an entry name. Returns false if it doesn't fit.
+static bool joinPath(const char *dir, const char *name, char *out, size_t outSize) {
+    int n = dir[0] ? snprintf(out, outSize, "%s/%s", dir, name) : snprintf(out, outSize, "%s", name);
+    return n >= 0 && (size_t)n < outSize;
+}
+
+static bool fullPath(const Scanner *scanner, const char *relPath, char *out, size_t outSize) {
+    if (!relPath[0]) return joinPath("", scanner->musicDir, out, outSize);
+    return joinPath(scanner->musicDir, relPath, out, outSize);
+}
+
+bool scanStatPath(const char *path, struct stat *st, int64_t *mtime) {
+    if (stat(path, st) != 0) return false;
+    *mtime = (int64_t)st->st_mtime;
+#ifdef __3DS__
+    // sdmc's stat() leaves st_mtime at 0; the archive keeps the real timestamp
+    u64 sdmcMtime;
+    if (R_SUCCEEDED(sdmc_getmtime(path, &sdmcMtime))) *mtime = (int64_t)sdmcMtime;
+#endif
+    return true;
+}
+
+// --- State Machine ---
+
+void scannerBegin(Scanner *scanner, const char *musicDir, const char *dataDir, const char *indexPath,
+                  StrArena *strings, ScanItemCallback onItem, void *user) {
+    memset(scanner, 0, sizeof(*scanner));
+    scanner->state = SCAN_STATE_OPEN;
+    scanner->musicDir = musicDir;
+    scanner->dataDir = dataDir;
+    scanner->indexPath = indexPath;
+    scanner->strings = strings;
+    scanner->onItem = onItem;
+    scanner->user = user;
+    scanner->trustDirStamp = SCAN_TRUST_DIR_STAMP;
+    scanner->stats.startUs = scanNowUs();
+}
+
+static void closeScan(Scanner *scanner) {
+    if (scanner->pool) tagPoolDiscard(scanner->pool);
+    if (scanner->dir) {
+        closedir(scanner->dir);
+        scanner->dir = NULL;
+    }
+    for (uint32_t i = 0; i < scanner->pendingCount; ++i) free(scanner->pending[i].path);
+    free(scanner->pending);
+    scanner->pending = NULL;
+    scanner->pendingCount = scanner->pendingCapacity = 0;
+    scanner->cachedDir = NULL;
+    free(scanner->held);
+    scanner->held = NULL;
+    scanner->heldCount = scanner->heldCapacity = 0;
+    free(scanner->sheets);
+    scanner->sheets = NULL;
+    scanner->sheetCount = scanner->sheetCapacity = 0;
+    strArenaFree(&scanner->folderNames);
+    free(scanner->hashBuffer);
+    scanner->hashBuffer = NULL;
+
+    libIndexWriterFree(&scanner->writer);
+    libIndexFree(&scanner->index);
+    scanner->state = SCAN_STATE_DONE;
+    scanner->stats.finishUs = scanNowUs();
+}
+
+void scannerAbort(Scanner *scanner) {
+    if (scanner->state != SCAN_STATE_DONE) closeScan(scanner);
+}
+
+// Queues a folder to visit. Returns false if out of memory.
+static bool pushDir(Scanner *scanner, const char *relPath, uint32_t parent) {
+    if (scanner->pendingCount == scanner->pendingCapacity) {
+        uint32_t newCapacity = scanner->pendingCapacity ? scanner->pendingCapacity * 2 : 32;
+        ScanDirJob *grown = (ScanDirJob*)realloc(scanner->pending, newCapacity * sizeof(ScanDirJob));
+        if (!grown) return false;
+        scanner->pending = grown;
+        scanner->pendingCapacity = newCapacity;
+    }
+    char *path = strdup(relPath);
+    if (!path) return false;
+    scanner->pending[scanner->pendingCount].path = path;
+    scanner->pending[scanner->pendingCount].parent = parent;
+    scanner->pendingCount++;
+    return true;
+}
+
+static void stepOpen(Scanner *scanner) {
+    // Load the previous scan so unchanged folders and files can be skipped
+    scanner->haveIndex = libIndexLoad(&scanner->index, scanner->indexPath);
+    if (scanner->haveIndex) {
+        const LibIndex *index = &scanner->index;
+        scanner->stats.bytesRead += sizeof(LibIndexHeader) + (uint64_t)index->count * sizeof(LibIndexRecord) +
+                                    (uint64_t)index->dirCount * sizeof(LibIndexDir) + index->stringBytes;
+    }
+    libIndexWriterInit(&scanner->writer);
+
+    if (!pushDir(scanner, "", LIBINDEX_NONE)) {
+        perror("out of memory for scan queue");
+        closeScan(scanner);
+        return;
+    }
+    scanner->state = SCAN_STATE_NEXT_DIR;
+}
+
+// Counts an entry towards the folder's stamp. Returns false for "." and "..".
+static bool countEntry(Scanner *scanner, const char *name) {
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return false;
+    scanner->dirEntries++;
+    scanner->dirEntryHash += libIndexHashName(name);
+    return true;
+}
+
+static void beginCheckFiles(Scanner *scanner) {
+    scanner->cachedNext = scanner->cachedDir->firstRecord;
+    scanner->state = SCAN_STATE_CHECK_FILES;
+}
+
+static void beginReadDir(Scanner *scanner) {
+    scanner->dirEntries = 0;
+    scanner->dirEntryHash = 0;
+    scanner->heldCount = 0;
+    scanner->sheetCount = 0;
+    strArenaReset(&scanner->folderNames);
+    scanner->stats.dirsRead++;
+    scanner->state = SCAN_STATE_READ;
+}
+
+// Reads a folder that was to be replayed after all. sdmc has no
+// rewinddir(), so it is opened again.
+static void rereadDir(Scanner *scanner) {
+    if (scanner->dir) closedir(scanner->dir);
+    char path[PATH_MAX];
+    fullPath(scanner, scanner->dirPath, path, sizeof(path));
+    scanner->dir = opendir(path);
+    if (scanner->dir == NULL) {
+        perror("opendir failed");
+        libIndexWriterEndDir(&scanner->writer, 0, 0);
+        scanner->state = SCAN_STATE_NEXT_DIR;
+        return;
+    }
+    beginReadDir(scanner);
+}
+
+static void stepNextDir(Scanner *scanner) {
+    if (scanner->pendingCount == 0) {
+        scanner->state = SCAN_STATE_FINISH;
+        return;
+    }
+    ScanDirJob job = scanner->pending[--scanner->pendingCount];
+    snprintf(scanner->dirPath, sizeof(scanner->dirPath), "%s", job.path);
+    free(job.path);
+    scanner->stats.dirsVisited++;
+
+    bool isRoot = scanner->dirPath[0] == '\0';
+    char path[PATH_MAX];
+    struct stat st;
+    int64_t mtime = 0;
+    if (!fullPath(scanner, scanner->dirPath, path, sizeof(path)) || !scanStatPath(path, &st, &mtime)) {
+        if (isRoot) {
+            perror("stat failed for music directory");
+            scanner->openFailed = true;
+            closeScan(scanner);
+        }
+        return; // Removed since its parent was read; it drops out of the journal
+    }
+
+    const LibIndexDir *cached = scanner->haveIndex ? libIndexFindDir(&scanner->index, scanner->dirPath) : NULL;
+    bool sameStamp = cached && cached->mtime == mtime && cached->size == (uint64_t)st.st_size;
+    scanner->cachedDir = cached;
+
+    if (!(sameStamp && scanner->trustDirStamp)) {
+        scanner->dir = opendir(path);
+        if (scanner->dir == NULL) {
+            perror("opendir failed");
+            if (isRoot) {
+                scanner->openFailed = true;
+                closeScan(scanner);
+            }
+            return;
+        }
+    }
+
+    scanner->dirId = libIndexWriterBeginDir(&scanner->writer, scanner->dirPath, mtime, (uint64_t)st.st_size,
+                                            job.parent);
+    if (!sameStamp) {
+        beginReadDir(scanner);
+    } else if (scanner->trustDirStamp) {
+        beginCheckFiles(scanner);
+    } else {
+        scanner->dirEntries = 0;
+        scanner->dirEntryHash = 0;
+        scanner->state = SCAN_STATE_VERIFY;
+    }
+}
+
+// Reads an unchanged-looking folder's names only; replays it if they match the journal.
+static void stepVerify(Scanner *scanner, int *budget, uint64_t deadlineUs) {
+    while (*budget > 0 && scanNowUs() < deadlineUs) {
+        struct dirent *entry = readdir(scanner->dir);
+        if (entry == NULL) {
+            closedir(scanner->dir);
+            scanner->dir = NULL;
+            if (scanner->dirEntries == scanner->cachedDir->entryCount &&
+                scanner->dirEntryHash == scanner->cachedDir->entryHash) {
+                beginCheckFiles(scanner);
+                return;
+            }
+            rereadDir(scanner); // Something was added, removed or renamed
+            return;
+        }
+        (*budget)--;
+        scanner->stats.entriesRead++;
+        countEntry(scanner, entry->d_name);
+    }
+}
+
+// Stats an unchanged folder's files against their records, a bounded batch
+// per step. One that was rewritten in place (new size or mtime) sends the
+// whole folder to be read, so a cue image is split again from its sheet.
+static void stepCheckFiles(Scanner *scanner, int *budget, uint64_t deadlineUs) {
+    const LibIndex *index = &scanner->index;
+    const LibIndexDir *cached = scanner->cachedDir;
+    uint32_t end = cached->firstRecord + cached->recordCount;
+    while (scanner->cachedNext < end) {
+        if (*budget <= 0 || scanNowUs() >= deadlineUs) return;
+        (*budget)--;
+        const LibIndexRecord *rec = &index->records[scanner->cachedNext++];
+        const char *relPath = libIndexString(index, rec->nameOff);
+        // A cue image's tracks are consecutive records of one file; it is stat'ed once
+        if ((rec->flags & LIBINDEX_RECORD_CUE) && scanner->cachedNext - 1 > cached->firstRecord &&
+            rec[-1].nameHash == rec->nameHash && relPath && libIndexString(index, rec[-1].nameOff) &&
+            strcmp(libIndexString(index, rec[-1].nameOff), relPath) == 0) {
+            continue;
+        }
+        char path[PATH_MAX];
+        struct stat st;
+        int64_t mtime;
+        if (relPath && fullPath(scanner, relPath, path, sizeof(path)) && scanStatPath(path, &st, &mtime) &&
+            (uint64_t)st.st_size == rec->size && mtime == rec->mtime) {
+            continue;
+        }
+        scanner->stats.filesChanged++;
+        rereadDir(scanner);
+        return;
+    }
+    scanner->cachedNext = cached->firstRecord;
+    scanner->stats.dirsSkipped++;
+    scanner->state = SCAN_STATE_EMIT_CACHED;
+}
+
+// Fills in the filename, records the item for the next index and hands it to
+// the consumer. Returns false if the consumer asked to stop.
+static bool deliverItem(Scanner *scanner, CatalogEntry *item, const char *relPath, uint64_t size, int64_t mtime) {
+    StrArena *strings = scanner->strings;
+    uint32_t flags = (item->flags & CATALOG_FLAG_PENDING) ? LIBINDEX_RECORD_PENDING : 0;
+    if (item->flags & CATALOG_FLAG_TAG_GLYPHS) flags |= LIBINDEX_RECORD_NO_GLYPHS;
+    if (item->flags & CATALOG_FLAG_CUE) flags |= LIBINDEX_RECORD_CUE;
+    if (item->flags & CATALOG_FLAG_MEASURED) flags |= LIBINDEX_RECORD_MEASURED;
+    libIndexWriterAdd(&scanner->writer, relPath, size, mtime, item->contentHash, strArenaGet(strings, item->title),
+                      strArenaGet(strings, item->artist), strArenaGet(strings, item->album), item->durationMs,
+                      item->trackNumber, &item->gain, (flags & LIBINDEX_RECORD_PENDING) ? 0 : item->format, flags,
+                      item->startFrame, item->endFrame);
+
+    if (scanner->stats.itemsAdded++ == 0) scanner->stats.firstItemUs = scanNowUs();
+    return scanner->onItem(item, scanner->user);
+}
+
+// Starts an item for a music file. Returns false if out of string memory.
+static bool newItem(Scanner *scanner, CatalogEntry *item, const char *relPath, TrackFormat format) {
+    memset(item, 0, sizeof(*item));
+    replayGainInit(&item->gain);
+    item->format = (uint8_t)format;
+    item->filename = strArenaAdd(scanner->strings, relPath, strlen(relPath));
+    if (item->filename == STRARENA_NONE) {
+        perror("out of string memory for filename");
+        return false; // Stop adding items if memory runs out
+    }
+    const char *name = catalogBaseName(relPath); // What the list shows
+    if (!textDrawable(name, strlen(name))) item->flags |= CATALOG_FLAG_NAME_GLYPHS;
+    return true;
+}
+
+// Fills an item's tags from its index record.
+static void copyCachedTags(Scanner *scanner, const LibIndexRecord *rec, CatalogEntry *item) {
+    const LibIndex *index = &scanner->index;
+    item->title = internString(scanner->strings, libIndexString(index, rec->titleOff));
+    item->artist = internString(scanner->strings, libIndexString(index, rec->artistOff));
+    item->album = internString(scanner->strings, libIndexString(index, rec->albumOff));
+    item->durationMs = rec->durationMs;
+    item->trackNumber = catalogTrackNumber(rec->trackNumber);
+    item->gain = rec->gain;
+    if (rec->format != TRACK_FORMAT_NONE) item->format = (uint8_t)rec->format;
+    if (rec->flags & LIBINDEX_RECORD_NO_GLYPHS) item->flags |= CATALOG_FLAG_TAG_GLYPHS;
+    if (rec->flags & LIBINDEX_RECORD_MEASURED) item->flags |= CATALOG_FLAG_MEASURED;
+    if (rec->flags & LIBINDEX_RECORD_CUE) {
+        item->flags |= CATALOG_FLAG_CUE;
+        item->startFrame = rec->startFrame;
+        item->endFrame = rec->endFrame;
+    }
+}
+
+// Reads an item's tags from the file, or marks them for later when deferring.
+static void readTags(Scanner *scanner, CatalogEntry *item, const char *path, uint64_t fileSize) {
+    if (scanner->deferTags) {
+        item->flags |= CATALOG_FLAG_PENDING;
+        scanner->stats.itemsDeferred++;
+        return;
+    }
+    TrackMetadata meta;
+    MetaIoStats io = { 0, 0 };
+    metadataRead(path, (TrackFormat)item->format, fileSize, scanner->strings, &meta, &io);
+    item->title = meta.title;
+    item->artist = meta.artist;
+    item->album = meta.album;
+    item->durationMs = meta.durationMs;
+    item->trackNumber = catalogTrackNumber(meta.trackNumber);
+    item->gain = meta.gain;
+    item->format = (uint8_t)meta.format;
+    if (meta.textFlags & TEXT_FLAG_NO_GLYPHS) item->flags |= CATALOG_FLAG_TAG_GLYPHS;
+    scanner->stats.itemsProbed++;
+    scanner->stats.bytesRead += io.bytesRead;
+}
+
+// --- Tag Pool ---
+
+// Hands finished pool jobs to deliverItem() in order; with `wait`, every
+// job. Returns false if the consumer asked to stop.
+static bool collectQueued(Scanner *scanner, bool wait) {
+    TagPool *pool = scanner->pool;
+    TagJob *job;
+    while ((job = tagPoolOldest(pool, wait)) != NULL) {
+        ScanQueuedItem *queued = &scanner->queued[pool->head & (TAG_POOL_DEPTH - 1)];
+        if (job->read) {
+            TrackMetadata meta;
+            tagTextIntern(&job->text, scanner->strings, &meta);
+            queued->item.title = meta.title;
+            queued->item.artist = meta.artist;
+            queued->item.album = meta.album;
+            queued->item.durationMs = meta.durationMs;
+            queued->item.trackNumber = catalogTrackNumber(meta.trackNumber);
+            queued->item.gain = meta.gain;
+            queued->item.format = (uint8_t)meta.format;
+            if (meta.textFlags & TEXT_FLAG_NO_GLYPHS) queued->item.flags |= CATALOG_FLAG_TAG_GLYPHS;
+            scanner->stats.itemsProbed++;
+            scanner->stats.bytesRead += job->text.io.bytesRead;
+        }
+        tagPoolRelease(pool);
+        const char *relPath = strArenaGet(scanner->strings, queued->item.filename);
+        if (!deliverItem(scanner, &queued->item, relPath, queued->size, queued->mtime)) return false;
+    }
+    return true;
+}
+
+// Delivers an item, reading its tags first if `path` is set (see readTags()).
+// With a pool the read is queued, and so is any item behind one still in
+// flight. Returns false if the scan must stop.
+static bool submitItem(Scanner *scanner, CatalogEntry *item, const char *relPath, const char *path,
+                       uint64_t size, int64_t mtime) {
+    TagPool *pool = scanner->pool;
+    if (!pool || scanner->deferTags || (!path && tagPoolEmpty(pool))) {
+        if (path) readTags(scanner, item, path, size);
+        return deliverItem(scanner, item, relPath, size, mtime);
+    }
+    if (tagPoolFull(pool)) {
+        tagPoolOldest(pool, true); // Wait for the oldest read; it's collected just below
+        if (!collectQueued(scanner, false)) return false;
+    }
+    ScanQueuedItem *queued = &scanner->queued[atomic_load(&pool->tail) & (TAG_POOL_DEPTH - 1)];
+    queued->item = *item;
+    queued->size = size;
+    queued->mtime = mtime;
+    tagPoolSubmit(pool, path, (TrackFormat)item->format, size);
+    return collectQueued(scanner, false);
+}
+
+// Delivers everything still queued; a folder is complete after this.
+static bool finishQueued(Scanner *scanner) {
+    return !scanner->pool || collectQueued(scanner, true);
+}
+
+// Replays one track of an unchanged folder. Returns false if the scan must stop.
+static bool emitCached(Scanner *scanner, const LibIndexRecord *rec) {
+    const LibIndex *index = &scanner->index;
+    const char *relPath = libIndexString(index, rec->nameOff);
+    if (!relPath) return true;
+    TrackFormat format = trackFormatFromExtension(catalogBaseName(relPath));
+    if (format == TRACK_FORMAT_NONE) return true;
+
+    CatalogEntry item;
+    if (!newItem(scanner, &item, relPath, format)) return false;
+    item.contentHash = rec->contentHash;
+    char path[PATH_MAX];
+    bool read = (rec->flags & LIBINDEX_RECORD_PENDING) != 0;
+    if (read) {
+        // Never read; a scan that doesn't defer reads it now
+        fullPath(scanner, relPath, path, sizeof(path));
+    } else {
+        copyCachedTags(scanner, rec, &item);
+    }
+    return submitItem(scanner, &item, relPath, read ? path : NULL, rec->size, rec->mtime);
+}
+
+static void stepEmitCached(Scanner *scanner, int *budget, uint64_t deadlineUs) {
+    const LibIndexDir *cached = scanner->cachedDir;
+    uint32_t end = cached->firstRecord + cached->recordCount;
+    while (scanner->cachedNext < end) {
+        if (*budget <= 0 || scanNowUs() >= deadlineUs) return;
+        (*budget)--;
+        if (!emitCached(scanner, &scanner->index.records[scanner->cachedNext++])) {
+            closeScan(scanner); // A partial folder must not be journaled as complete
+            return;
+        }
+    }
+    if (!finishQueued(scanner)) {
+        closeScan(scanner);
+        return;
+    }
+
+    libIndexWriterEndDir(&scanner->writer, cached->entryCount, cached->entryHash);
+    // Sub-folders are still checked one by one: a change deeper down does not
+    // touch this folder's stamp
+    for (uint32_t child = cached->firstChild; child != LIBINDEX_NONE;
+         child = scanner->index.dirs[child].nextSibling) {
+        const char *childPath = libIndexString(&scanner->index, scanner->index.dirs[child].pathOff);
+        if (childPath && !pushDir(scanner, childPath, scanner->dirId)) {
+            perror("out of memory for scan queue");
+            closeScan(scanner);
+            return;
+        }
+    }
+    scanner->state = SCAN_STATE_NEXT_DIR;
+}
+
+// True if a directory entry is a folder; falls back to stat() when readdir can't tell.
+static bool isDirEntry(const Scanner *scanner, const struct dirent *entry, const char *relPath) {
+#ifdef DT_DIR
+    if (entry->d_type == DT_DIR) return true;
+    if (entry->d_type != DT_UNKNOWN) return false;
+#endif
+    char path[PATH_MAX];
+    struct stat st;
+    return fullPath(scanner, relPath, path, sizeof(path)) && stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// The record a file had before it was moved or renamed, found by content.
+// Only a file the size of some hashed record is hashed; its hash is kept
+// in `contentHash` whether a record matches or not. NULL if none does.
+static const LibIndexRecord* findMoved(Scanner *scanner, const char *path, uint64_t fileSize,
+                                       uint64_t *contentHash) {
+    if (!scanner->haveIndex || !libIndexHasSize(&scanner->index, fileSize)) return NULL;
+    if (!scanner->hashBuffer) {
+        scanner->hashBuffer = (uint8_t*)malloc(CONTENT_HASH_SPAN);
+        if (!scanner->hashBuffer) return NULL; // Probed like a new file instead
+    }
+    MetaIoStats io = { 0, 0 };
+    bool hashed = contentHashFile(path, fileSize, scanner->hashBuffer, contentHash, &io);
+    scanner->stats.itemsHashed++;
+    scanner->stats.bytesRead += io.bytesRead;
+    if (!hashed) {
+        *contentHash = CONTENT_HASH_NONE;
+        return NULL;
+    }
+    const LibIndexRecord *rec = libIndexFindContent(&scanner->index, fileSize, *contentHash);
+    if (rec) scanner->stats.itemsMoved++;
+    return rec;
+}
+
+// Delivers one file of a changed folder, from the index if it is unchanged
+// or was moved. Returns false if the scan must stop.
+static bool scanFile(Scanner *scanner, const char *relPath, const char *path, TrackFormat format,
+                     uint64_t fileSize, int64_t fileMtime) {
+    CatalogEntry item;
+    if (!newItem(scanner, &item, relPath, format)) return false;
+
+    const LibIndex *index = &scanner->index;
+    const LibIndexRecord* cached = scanner->haveIndex ? libIndexFind(index, relPath, fileSize, fileMtime) : NULL;
+    if (cached) item.contentHash = cached->contentHash;
+    else cached = findMoved(scanner, path, fileSize, &item.contentHash);
+    bool read = !cached || (cached->flags & LIBINDEX_RECORD_PENDING);
+    if (!read) copyCachedTags(scanner, cached, &item);
+    return submitItem(scanner, &item, relPath, read ? path : NULL, fileSize, fileMtime);
+}
+
+// --- Cue Sheets ---
+
+// FLACs at least this large that the index doesn't know are opened during
+// the scan to look for a CUESHEET block, deferred tags or not. A CD image
+// runs to a few hundred MiB; a single track rarely passes this.
+#define SCAN_CUE_IMAGE_MIN_SIZE (64ull << 20)
+
+// Holds a file back until the folder has been read. Returns false if it
+// can't be (out of memory, or a path the arena would clip); the caller then
+// handles it straight away.
+static bool holdFile(Scanner *scanner, const char *relPath, TrackFormat format, uint64_t size, int64_t mtime) {
+    size_t len = strlen(relPath);
+    if (len > STRARENA_MAX_LEN) return false;
+    if (scanner->heldCount == scanner->heldCapacity) {
+        uint32_t newCapacity = scanner->heldCapacity ? scanner->heldCapacity * 2 : 16;
+        ScanHeldFile *grown = (ScanHeldFile*)realloc(scanner->held, newCapacity * sizeof(ScanHeldFile));
+        if (!grown) return false;
+        scanner->held = grown;
+        scanner->heldCapacity = newCapacity;
+    }
+    uint32_t name = strArenaAdd(&scanner->folderNames, relPath, len);
+    if (name == STRARENA_NONE) return false;
+
+    ScanHeldFile *held = &scanner->held[scanner->heldCount++];
+    held->name = name;
+    held->size = size;
+    held->mtime = mtime;
+    held->format = (uint8_t)format;
+    held->sheet = 0;
+    return true;
+}
+
+static bool loadSheet(Scanner *scanner, const ScanHeldFile *held) {
+    char path[PATH_MAX];
+    if (!fullPath(scanner, strArenaGet(&scanner->folderNames, held->name), path, sizeof(path))) return false;
+    MetaIoStats io = { 0, 0 };
+    bool parsed = cueLoad(path, scanner->strings, &scanner->cue, &io);
+    scanner->stats.bytesRead += io.bytesRead;
+    return parsed;
+}
+
+// The held image a sheet's FILE names and no other sheet has claimed: an
+// exact match first, then one that differs only in extension.
+static ScanHeldFile* findImage(Scanner *scanner, const CueSheet *sheet) {
+    for (int pass = 0; pass < 2; ++pass) {
+        for (uint32_t i = 0; i < scanner->heldCount; ++i) {
+            ScanHeldFile *held = &scanner->held[i];
+            if ((held->format != TRACK_FORMAT_FLAC && held->format != TRACK_FORMAT_WAV) || held->sheet) continue;
+            const char *name = catalogBaseName(strArenaGet(&scanner->folderNames, held->name));
+            if (cueNamesFile(sheet, name, pass == 1)) return held;
+        }
+    }
+    return NULL;
+}
+
+// Keeps the parsed sheet for `image`, so it isn't read again to split it.
+// Returns false if out of memory; the image is then delivered whole.
+static bool keepSheet(Scanner *scanner, ScanHeldFile *image) {
+    if (scanner->sheetCount == scanner->sheetCapacity) {
+        uint32_t newCapacity = scanner->sheetCapacity ? scanner->sheetCapacity * 2 : 2;
+        CueSheet *grown = (CueSheet*)realloc(scanner->sheets, newCapacity * sizeof(CueSheet));
+        if (!grown) return false;
+        scanner->sheets = grown;
+        scanner->sheetCapacity = newCapacity;
+    }
+    scanner->sheets[scanner->sheetCount++] = scanner->cue;
+    image->sheet = scanner->sheetCount;
+    return true;
+}
+
+// Pairs the folder's sheets with the images they name, before any of them
+// is delivered. Each sheet is read and parsed here once.
+static void matchSheets(Scanner *scanner) {
+    for (uint32_t i = 0; i < scanner->heldCount; ++i) {
+        if (scanner->held[i].format != TRACK_FORMAT_NONE || !loadSheet(scanner, &scanner->held[i])) continue;
+        ScanHeldFile *image = findImage(scanner, &scanner->cue);
+        if (image) keepSheet(scanner, image);
+    }
+}
+
+// The album gain shared by an image's tracks: the sheet's album REMs, else
+// the image's own tags, whose track gain covers the whole album. Track
+// gains come only from the sheet's per-track REMs.
+static ReplayGain splitGain(const CueSheet *sheet, const ReplayGain *image) {
+    ReplayGain gain;
+    replayGainInit(&gain);
+    gain.albumGain = sheet->gain.albumGain != REPLAYGAIN_NONE ? sheet->gain.albumGain
+                   : image->albumGain != REPLAYGAIN_NONE ? image->albumGain : image->trackGain;
+    gain.albumPeak = sheet->gain.albumPeak ? sheet->gain.albumPeak
+                   : image->albumPeak ? image->albumPeak : image->trackPeak;
+    return gain;
+}
+
+// Splits an image into the tracks of `sheet`, or with NULL into those of its
+// own CUESHEET block, delivering an item per track. With NULL, an image with
+// no cuesheet is delivered whole with the tags just read. Sets `*delivered`
+// if it delivered anything. Returns false if the scan must stop.
+static bool expandImage(Scanner *scanner, const ScanHeldFile *image, const CueSheet *sheet, bool *delivered) {
+    *delivered = false;
+    const char *relPath = strArenaGet(&scanner->folderNames, image->name);
+    char path[PATH_MAX];
+    MetaReader reader;
+    if (!fullPath(scanner, relPath, path, sizeof(path)) || !metaReaderOpen(&reader, path, image->size)) return true;
+    TrackMetadata meta;
+    metadataParse(&reader, metadataSniff(&reader, (TrackFormat)image->format), scanner->strings, &meta);
+    if (!sheet && meta.format == TRACK_FORMAT_FLAC && cueReadFlac(&reader, &scanner->cue)) sheet = &scanner->cue;
+    scanner->stats.itemsProbed++;
+    scanner->stats.bytesRead += reader.stats.bytesRead;
+    metaReaderClose(&reader);
+
+    uint32_t rate = meta.sampleRate;
+    // The catalog keeps 32-bit frame numbers: over six hours even at 192 kHz
+    bool split = sheet && rate > 0 && meta.frameCount > 0 && meta.frameCount <= UINT32_MAX &&
+                 cueTrackStart(sheet, 0, rate) < meta.frameCount;
+    if (!split && sheet) return true; // Left for scanFile()
+
+    CatalogEntry item;
+    if (!newItem(scanner, &item, relPath, meta.format)) return false;
+    *delivered = true;
+    if (!split) {
+        item.title = meta.title;
+        item.artist = meta.artist;
+        item.album = meta.album;
+        item.durationMs = meta.durationMs;
+        item.trackNumber = catalogTrackNumber(meta.trackNumber);
+        item.gain = meta.gain;
+        if (meta.textFlags & TEXT_FLAG_NO_GLYPHS) item.flags |= CATALOG_FLAG_TAG_GLYPHS;
+        return submitItem(scanner, &item, relPath, NULL, image->size, image->mtime);
+    }
+
+    item.flags |= CATALOG_FLAG_CUE;
+    item.album = sheet->title != STRARENA_NONE ? sheet->title : meta.album;
+    item.gain = splitGain(sheet, &meta.gain);
+    for (uint32_t i = 0; i < sheet->count; ++i) {
+        const CueTrack *cueTrack = &sheet->tracks[i];
+        uint64_t start = cueTrackStart(sheet, i, rate);
+        uint64_t end = cueTrackEnd(sheet, i, rate, meta.frameCount);
+        if (end <= start) continue;
+
+        CatalogEntry track = item;
+        track.title = cueTrack->title;
+        if (track.title == STRARENA_NONE) {
+            char title[16];
+            snprintf(title, sizeof(title), "Track %02u", (unsigned)cueTrack->number);
+            track.title = internString(scanner->strings, title);
+        }
+        track.artist = cueTrack->performer != STRARENA_NONE ? cueTrack->performer
+                     : sheet->performer != STRARENA_NONE ? sheet->performer : meta.artist;
+        track.startFrame = (uint32_t)start;
+        track.endFrame = (uint32_t)end;
+        track.durationMs = (uint32_t)((end - start) * 1000 / rate);
+        track.trackNumber = catalogTrackNumber(cueTrack->number);
+        track.gain.trackGain = cueTrack->gain.trackGain;
+        track.gain.trackPeak = cueTrack->gain.trackPeak;
+        if ((cueTrack->textFlags | sheet->textFlags | meta.textFlags) & TEXT_FLAG_NO_GLYPHS) {
+            track.flags |= CATALOG_FLAG_TAG_GLYPHS;
+        }
+        if (!submitItem(scanner, &track, relPath, NULL, image->size, image->mtime)) return false;
+        scanner->stats.cueTracks++;
+    }
+    return true;
+}
+
+// Delivers one held-back file. Returns false if the scan must stop.
+static bool deliverHeld(Scanner *scanner, const ScanHeldFile *held) {
+    if (held->format == TRACK_FORMAT_NONE) return true;
+    bool delivered = false;
+    if (held->sheet) {
+        if (!expandImage(scanner, held, &scanner->sheets[held->sheet - 1], &delivered)) return false;
+        if (delivered) return true;
+    }
+
+    const char *relPath = strArenaGet(&scanner->folderNames, held->name);
+    char path[PATH_MAX];
+    fullPath(scanner, relPath, path, sizeof(path));
+    // An image split last time has only track records, which libIndexFind() skips
+    bool known = scanner->haveIndex && libIndexFind(&scanner->index, relPath, held->size, held->mtime);
+    if (!known && held->format == TRACK_FORMAT_FLAC && held->size >= SCAN_CUE_IMAGE_MIN_SIZE) {
+        if (!expandImage(scanner, held, NULL, &delivered)) return false;
+        if (delivered) return true;
+    }
+    return scanFile(scanner, relPath, path, (TrackFormat)held->format, held->size, held->mtime);
+}
+
+// Handles one entry of a changed folder. Returns false if the scan must stop.
+static bool scanEntry(Scanner *scanner, const char *name, const char *relPath) {
+    bool sheet = cueIsSheetName(name);
+    TrackFormat format = trackFormatFromExtension(name);
+    if (format == TRACK_FORMAT_NONE && !sheet) return true;
+
+    char path[PATH_MAX];
+    fullPath(scanner, relPath, path, sizeof(path));
+
+    // Size + mtime identify an unchanged file; a failed stat just forces a probe
+    struct stat st;
+    uint64_t fileSize = 0;
+    int64_t fileMtime = 0;
+    if (scanStatPath(path, &st, &fileMtime)) fileSize = (uint64_t)st.st_size;
+
+    // Once one file is held, the rest of the folder is too, to keep its order
+    if (sheet || format == TRACK_FORMAT_FLAC || format == TRACK_FORMAT_WAV || scanner->heldCount > 0) {
+        if (holdFile(scanner, relPath, format, fileSize, fileMtime) || sheet) return true;
+    }
+    return scanFile(scanner, relPath, path, format, fileSize, fileMtime);
+}
+
+// Ends a read folder: journals it and moves on. Returns false if the scan
+// must stop.
+static bool endReadDir(Scanner *scanner) {
+    if (!finishQueued(scanner)) return false;
+    libIndexWriterEndDir(&scanner->writer, scanner->dirEntries, scanner->dirEntryHash);
+    scanner->state = SCAN_STATE_NEXT_DIR;
+    return true;
+}
+
+static void stepRead(Scanner *scanner, int *budget, uint64_t deadlineUs) {
+    while (*budget > 0 && scanNowUs() < deadlineUs) {
+        struct dirent *entry = readdir(scanner->dir);
+        if (entry == NULL) {
+            closedir(scanner->dir);
+            scanner->dir = NULL;
+            if (scanner->heldCount > 0) {
+                matchSheets(scanner);
+                scanner->heldNext = 0;
+                scanner->state = SCAN_STATE_HELD;
+            } else if (!endReadDir(scanner)) {
+                closeScan(scanner);
+            }
+            return;
+        }
+        (*budget)--;
+        scanner->stats.entriesRead++;
+        if (!countEntry(scanner, entry->d_name)) continue;
+
+        char relPath[PATH_MAX];
+        if (!joinPath(scanner->dirPath, entry->d_name, relPath, sizeof(relPath))) continue;
+
+        bool ok = isDirEntry(scanner, entry, relPath) ? pushDir(scanner, relPath, scanner->dirId)
+                                                      : scanEntry(scanner, entry->d_name, relPath);
+        if (!ok) {
+            closeScan(scanner); // A partial folder must not be journaled as complete
+            return;
+        }
+    }
+}
+
+static void stepHeld(Scanner *scanner, int *budget, uint64_t deadlineUs) {
+    while (*budget > 0 && scanNowUs() < deadlineUs) {
+        if (scanner->heldNext == scanner->heldCount) {
+            if (!endReadDir(scanner)) closeScan(scanner);
+            return;
+        }
+        (*budget)--;
+        if (!deliverHeld(scanner, &scanner->held[scanner->heldNext++])) {
+            closeScan(scanner);
+            return;
+        }
+    }
+}
+
+static void stepFinish(Scanner *scanner) {
+    // Only rewrite the index if a folder was re-read or one disappeared, or
+    // tags a previous scan deferred have now been read
+    if (!scanner->haveIndex || scanner->stats.dirsRead > 0 || scanner->stats.itemsProbed > 0 ||
+        scanner->index.count != scanner->writer.count ||
+        scanner->index.dirCount != scanner->writer.dirCount) {
+        mkdir(scanner->dataDir, 0777); // May already exist
+        if (!libIndexWriterCommit(&scanner->writer, scanner->indexPath)) {
+            perror("failed to write library index");
+        }
+    }
+    closeScan(scanner);
+}
+
+bool scannerStep(Scanner *scanner, int maxEntries, uint32_t budgetUs) {
+    if (scanner->state == SCAN_STATE_DONE) return true;
+
+    uint64_t deadlineUs = scanNowUs() + budgetUs;
+    int budget = maxEntries;
+    scanner->stats.steps++;
+
+    // Opening, finishing and starting a folder are single, bounded operations;
+    // entries and replayed tracks are sliced
+    do {
+        switch (scanner->state) {
+            case SCAN_STATE_OPEN:        stepOpen(scanner); budget--; break;
+            case SCAN_STATE_NEXT_DIR:    stepNextDir(scanner); budget--; break;
+            case SCAN_STATE_VERIFY:      stepVerify(scanner, &budget, deadlineUs); break;
+            case SCAN_STATE_CHECK_FILES: stepCheckFiles(scanner, &budget, deadlineUs); break;
+            case SCAN_STATE_EMIT_CACHED: stepEmitCached(scanner, &budget, deadlineUs); break;
+            case SCAN_STATE_READ:        stepRead(scanner, &budget, deadlineUs); break;
+            case SCAN_STATE_HELD:        stepHeld(scanner, &budget, deadlineUs); break;
+            case SCAN_STATE_FINISH:      stepFinish(scanner); break;
+            case SCAN_STATE_DONE:        break;
+        }
+    } while (scanner->state != SCAN_STATE_DONE && budget > 0 && scanNowUs() < deadlineUs);
+    return scanner->state == SCAN_STATE_DONE;
+}
+
+// --- Background Scan ---
+
+#define SCAN_WORKER_STEP_ENTRIES 256
+#define SCAN_WORKER_STEP_US      20000
+#define SCAN_WORKER_BACKOFF_US   2000 // Wait while the ring is full
+
+// Producer callback: runs on the worker thread.
+static bool pushToRing(const CatalogEntry *item, void *user) {
+    ScanWorker *worker = (ScanWorker*)user;
+    while (!spscPush(&worker->ring, item)) {
+        if (atomic_load(&worker->stop)) return false;
+        bgThreadSleepUs(SCAN_WORKER_BACKOFF_US);
+    }
+    return true;
+}
+
+static void scanWorkerMain(void *arg) {
+    ScanWorker *worker = (ScanWorker*)arg;
+    Scanner *scanner = &worker->scanner;
+
+    while (!scannerStep(scanner, SCAN_WORKER_STEP_ENTRIES, SCAN_WORKER_STEP_US)) {
+        if (atomic_load(&worker->stop)) {
+            scannerAbort(scanner);
+            break;
+        }
+    }
+    atomic_store(&worker->finished, true);
+}
+
+bool scanWorkerStart(ScanWorker *worker, const char *musicDir, const char *dataDir, const char *indexPath,
+                     StrArena *strings, bool deferTags, TagPool *pool) {
+    spscInit(&worker->ring, worker->ringItems, sizeof(CatalogEntry), SCAN_RING_CAPACITY);
+    atomic_init(&worker->stop, false);
+    atomic_init(&worker->finished, false);
+    scannerBegin(&worker->scanner, musicDir, dataDir, indexPath, strings, pushToRing, worker);
+    worker->scanner.deferTags = deferTags;
+    worker->scanner.pool = pool;
+
+    worker->thread = bgThreadStart(scanWorkerMain, worker, true);
+    if (!worker->thread) {
+        perror("failed to start scan thread");
+        return false;
+    }
+    return true;
+}
+
+bool scanWorkerDrain(ScanWorker *worker, ScanItemCallback onItem, void *user, int maxItems) {
+    if (!worker->thread) return true;
+
+    // Read the flag first: if it was already set, the ring holds the final items
+    bool finished = atomic_load(&worker->finished);
+    CatalogEntry item;
+    int delivered = 0;
+    while (delivered < maxItems && spscPop(&worker->ring, &item)) {
+        delivered++;
+        if (!onItem(&item, user)) {
+            scanWorkerStop(worker);
+            return true;
+        }
+    }
+    if (!finished || delivered == maxItems) return false;
+
+    bgThreadJoin(worker->thread);
+    worker->thread = NULL;
+    return true;
+}
+
+void scanWorkerStop(ScanWorker *worker) {
+    if (!worker->thread) return;
+
+    atomic_store(&worker->stop, true);
+    // Keep draining so a producer blocked on a full ring can see the flag
+    CatalogEntry item;
+    while (!atomic_load(&worker->finished)) {
+        while (spscPop(&worker->ring, &item)) {}
+        bgThreadSleepUs(SCAN_WORKER_BACKOFF_US);
+    }
+    bgThreadJoin(worker->thread);
+    worker->thread = NULL;
+    while (spscPop(&worker->ring, &item)) {}
+}
@@ -0,0 +1,185 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "libindex.h"
+#include "catalog.h"
+#include "spsc.h"
+#include "bgthread.h"
+#include "tagpool.h"
+#include "cue.h"
+
+// Called for every finished item; copy it out before returning.
+// Return false to stop the scan early (e.g. out of memory).
+typedef bool (*ScanItemCallback)(const CatalogEntry *entry, void *user);
+
+typedef enum {
+    SCAN_STATE_OPEN,        // Load the library index and queue the music directory
+    SCAN_STATE_NEXT_DIR,    // Take the next queued folder and compare it to the journal
+    SCAN_STATE_VERIFY,      // Check an unstamped folder's names against the journal
+    SCAN_STATE_CHECK_FILES, // Stat an unchanged folder's files against their records
+    SCAN_STATE_EMIT_CACHED, // Replay an unchanged folder's tracks from the index
+    SCAN_STATE_READ,        // Read a changed folder's entries, a bounded batch per step
+    SCAN_STATE_HELD,        // Deliver the files it held back, in order, a bounded batch per step
+    SCAN_STATE_FINISH,      // Write the library index
+    SCAN_STATE_DONE
+} ScanState;
+
+// Timings are in microseconds from scanNowUs().
+typedef struct {
+    uint64_t startUs;
+    uint64_t firstItemUs;  // 0 until the first item is delivered
+    uint64_t finishUs;     // 0 until the scan is done
+    uint32_t steps;
+    uint32_t entriesRead;  // Directory entries visited, music or not
+    uint32_t itemsAdded;
+    uint32_t itemsProbed;  // Items that missed the index and went through metadataRead()
+    uint32_t itemsDeferred; // Items whose tags were left for the tag loader
+    uint32_t cueTracks;    // Items split out of single-file images by cue sheets
+    uint32_t itemsHashed;  // Files the index didn't know by path, hashed to look for a moved record
+    uint32_t itemsMoved;   // Of those, the ones a record was found for
+    uint32_t dirsVisited;
+    uint32_t dirsRead;     // Folders whose entries were read and diffed file by file
+    uint32_t dirsSkipped;  // Folders replayed from the journal without a readdir
+    uint32_t filesChanged; // Files found changed in a folder whose stamp was not (the folder is then read)
+    uint64_t bytesRead;    // File bytes read (index and tags; directory listings not counted)
+} ScanStats;
+
+// An item waiting on the tag pool, in the same ring position as its job.
+typedef struct {
+    CatalogEntry item;
+    uint64_t size;
+    int64_t mtime;
+} ScanQueuedItem;
+
+// A file held back until its folder has been read.
+typedef struct {
+    uint32_t name;         // Relative path, in Scanner.folderNames
+    uint64_t size;
+    int64_t mtime;
+    uint8_t format;        // TrackFormat; TRACK_FORMAT_NONE for a .cue
+    uint32_t sheet;        // 1 + the index in Scanner.sheets of the sheet that splits it; 0 if none
+} ScanHeldFile;
+
+// A folder waiting to be visited.
+typedef struct {
+    char *path;            // Relative to the music directory ("" for the root)
+    uint32_t parent;       // Writer journal index of the parent folder
+} ScanDirJob;
+
+// --- Resumable Directory Scan ---
+// Walks the music directory recursively. scannerStep() does at most
+// `maxEntries` units of work (folders, directory entries or replayed tracks)
+// or `budgetUs`, whichever runs out first, then returns so the caller can
+// draw a frame. Folders whose journal stamp is unchanged are not re-read:
+// each of their files is stat'ed against its record, since rewriting a file
+// in place doesn't touch its folder's stamp, and if all match their tracks
+// are replayed from the index. Otherwise the folder is read like a changed one.
+// Unless `trustDirStamp` is set, such a folder's names are read first and
+// must also match the journal (SCAN_STATE_VERIFY); the 3DS's FAT folder
+// stamps miss added and removed files, so there it is off by default.
+//
+// With `deferTags` set, files the index doesn't know are delivered with only
+// their filename, so the list fills in at readdir/stat speed; the tag loader
+// reads them later, nearest the screen first (see tagloader.h).
+//
+// Otherwise, given a `pool`, new files' tags are read on its workers while
+// the scan moves on. Items still come out in scan order: a folder's items
+// queue behind any read in flight, and a folder is only journaled once all
+// of them are out.
+//
+// In a folder that is read, the first .cue or possible image (FLAC, WAV) and
+// every file after it are held back until its last entry, then delivered in
+// order: each sheet splits the image it names into one item per track
+// (CATALOG_FLAG_CUE), and large FLACs the index doesn't know are checked for
+// a CUESHEET block of their own. The track items are journaled like any
+// other, so an unchanged folder replays them without reading the sheet again.
+//
+// A file the index doesn't know by path, but whose size a hashed record
+// has, is hashed (contenthash.h); if the content matches, the record it had
+// before it was moved or renamed supplies its tags.
+typedef struct {
+    ScanState state;
+    const char *musicDir;
+    const char *dataDir;   // Created before the index is written
+    const char *indexPath;
+    StrArena *strings;     // Receives every filename, title and artist (the catalog's arena)
+    ScanItemCallback onItem;
+    void *user;
+    bool deferTags;        // Leave new files' tags unread, marked CATALOG_FLAG_PENDING
+    bool trustDirStamp;    // Replay an unchanged stamp's folder without reading its names
+    TagPool *pool;         // Read tags on these workers (NULL = on the scan thread)
+    ScanQueuedItem queued[TAG_POOL_DEPTH];
+
+    LibIndex index;
+    bool haveIndex;
+    LibIndexWriter writer;
+    bool openFailed;       // Music directory could not be opened
+    ScanStats stats;
+
+    ScanDirJob *pending;   // Folders still to visit (a stack)
+    uint32_t pendingCount;
+    uint32_t pendingCapacity;
+
+    // The folder being visited
+    DIR *dir;
+    char dirPath[PATH_MAX]; // Relative path
+    uint32_t dirId;         // Its writer journal index
+    const LibIndexDir *cachedDir; // Its journal entry from the last scan, if any
+    uint32_t cachedNext;    // Next index record to check or replay
+    uint32_t dirEntries;    // Entries read so far, and the sum of their name hashes
+    uint32_t dirEntryHash;
+    ScanHeldFile *held;     // Its held-back files
+    uint32_t heldCount;
+    uint32_t heldCapacity;
+    uint32_t heldNext;      // Next one to deliver
+    StrArena folderNames;   // Their paths; reset per folder
+    CueSheet *sheets;       // Its sheets that name an image, each parsed once
+    uint32_t sheetCount;
+    uint32_t sheetCapacity;
+    CueSheet cue;           // The sheet being matched, or a FLAC's own
+    uint8_t *hashBuffer;    // CONTENT_HASH_SPAN bytes, allocated for the first file hashed
+} Scanner;
+
+void scannerBegin(Scanner *scanner, const char *musicDir, const char *dataDir, const char *indexPath,
+                  StrArena *strings, ScanItemCallback onItem, void *user);
+// Returns true once the scan has finished.
+bool scannerStep(Scanner *scanner, int maxEntries, uint32_t budgetUs);
+// Stops a scan in progress without writing the index.
+void scannerAbort(Scanner *scanner);
+
+// --- Background Scan ---
+// Runs a Scanner on its own thread. Finished items are copied by value to
+// the render thread through an SPSC ring, so nothing is malloc'd per item.
+// The arena is written only by the worker until the scan is drained.
+#define SCAN_RING_CAPACITY 256
+
+typedef struct {
+    Scanner scanner;     // Owned by the worker thread until the scan is drained
+    SpscRing ring;
+    CatalogEntry ringItems[SCAN_RING_CAPACITY];
+    BgThread *thread;
+    atomic_bool stop;    // Set by the consumer to abandon the scan
+    atomic_bool finished; // Set by the worker after its last push
+} ScanWorker;
+
+bool scanWorkerStart(ScanWorker *worker, const char *musicDir, const char *dataDir, const char *indexPath,
+                     StrArena *strings, bool deferTags, TagPool *pool);
+// Consumer side: delivers up to `maxItems` queued items to `onItem`, in scan order.
+// Returns true once the worker has finished and every item has been delivered;
+// the worker's stats are then safe to read.
+bool scanWorkerDrain(ScanWorker *worker, ScanItemCallback onItem, void *user, int maxItems);
+// Stops and joins the worker, discarding anything still queued.
+void scanWorkerStop(ScanWorker *worker);
+
+uint64_t scanNowUs(void);
+// stat() plus the modification time the index records. Returns false if the path can't be stat'ed.
+bool scanStatPath(const char *path, struct stat *st, int64_t *mtime);
+
+#endif
@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "search.h"
+
+static const uint32_t *s_searchRank; // qsort has no context argument
+
+// --- Folding ---
+
+static int foldSymbol(unsigned char c) {
+    if (c >= '0' && c <= '9') return 1 + (c - '0');
+    if (c >= 'a' && c <= 'z') return 11 + (c - 'a');
+    if (c >= 'A' && c <= 'Z') return 11 + (c - 'A');
+    if (c >= 0x80) return SEARCH_SYMBOLS - 1; // Part of a UTF-8 sequence
+    return 0;
+}
+
+static unsigned char foldChar(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 'a' - 'A') : c;
+}
+
+static uint32_t bucketOf(int first, int second) {
+    return (uint32_t)(first - 1) * SEARCH_SYMBOLS + (uint32_t)second;
+}
+
+// Runs `body` with `bucketVar` set to the bucket of every word start in `text`.
+#define FOR_EACH_WORD_BUCKET(text, bucketVar, body)                              \
+    do {                                                                         \
+        const unsigned char *p_ = (const unsigned char*)(text);                  \
+        int prev_ = 0;                                                           \
+        for (; p_ && *p_; ++p_) {                                                \
+            int sym_ = foldSymbol(*p_);                                          \
+            if (sym_ != 0 && prev_ == 0) {                                       \
+                uint32_t bucketVar = bucketOf(sym_, foldSymbol(p_[1]));          \
+                body                                                             \
+            }                                                                    \
+            prev_ = sym_;                                                        \
+        }                                                                        \
+    } while (0)
+
+// --- Index Build ---
+
+void searchIndexInit(SearchIndex *index) {
+    memset(index, 0, sizeof(*index));
+}
+
+void searchIndexFree(SearchIndex *index) {
+    free(index->offsets);
+    free(index->postings);
+    searchIndexInit(index);
+}
+
+static void rowStrings(const Catalog *catalog, uint32_t row, const char *out[4]) {
+    out[0] = catalogString(catalog, CATALOG_FIELD(catalog, title, row));
+    out[1] = catalogString(catalog, CATALOG_FIELD(catalog, artist, row));
+    out[2] = catalogString(catalog, CATALOG_FIELD(catalog, album, row));
+    out[3] = catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+}
+
+bool searchIndexBuild(SearchIndex *index, const Catalog *catalog) {
+    searchIndexFree(index);
+
+    uint32_t *offsets = (uint32_t*)calloc(SEARCH_BUCKETS + 1, sizeof(uint32_t));
+    uint32_t *lastRow = (uint32_t*)malloc(SEARCH_BUCKETS * sizeof(uint32_t));
+    if (!offsets || !lastRow) {
+        free(offsets);
+        free(lastRow);
+        return false;
+    }
+
+    // Pass 1: count (row, bucket) pairs, each row at most once per bucket
+    memset(lastRow, 0xFF, SEARCH_BUCKETS * sizeof(uint32_t));
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        const char *strings[4];
+        rowStrings(catalog, row, strings);
+        for (int s = 0; s < 4; ++s) {
+            FOR_EACH_WORD_BUCKET(strings[s], bucket, {
+                if (lastRow[bucket] != row) {
+                    lastRow[bucket] = row;
+                    offsets[bucket + 1]++;
+                }
+            });
+        }
+    }
+    for (uint32_t b = 0; b < SEARCH_BUCKETS; ++b) offsets[b + 1] += offsets[b];
+
+    uint32_t total = offsets[SEARCH_BUCKETS];
+    uint32_t *postings = (uint32_t*)malloc((total ? total : 1) * sizeof(uint32_t));
+    uint32_t *fill = (uint32_t*)malloc(SEARCH_BUCKETS * sizeof(uint32_t));
+    if (!postings || !fill) {
+        free(postings);
+        free(fill);
+        free(offsets);
+        free(lastRow);
+        return false;
+    }
+
+    // Pass 2: fill; rows are visited in order so every list comes out ascending
+    memcpy(fill, offsets, SEARCH_BUCKETS * sizeof(uint32_t));
+    memset(lastRow, 0xFF, SEARCH_BUCKETS * sizeof(uint32_t));
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        const char *strings[4];
+        rowStrings(catalog, row, strings);
+        for (int s = 0; s < 4; ++s) {
+            FOR_EACH_WORD_BUCKET(strings[s], bucket, {
+                if (lastRow[bucket] != row) {
+                    lastRow[bucket] = row;
+                    postings[fill[bucket]++] = row;
+                }
+            });
+        }
+    }
+    free(fill);
+    free(lastRow);
+
+    index->offsets = offsets;
+    index->postings = postings;
+    index->rows = catalog->count;
+    return true;
+}
+
+// --- Queries ---
+
+typedef struct {
+    const char *start;
+    size_t len;
+} QueryWord;
+
+static int splitQuery(const char *query, QueryWord words[SEARCH_MAX_WORDS]) {
+    int numWords = 0;
+    const char *p = query;
+    while (*p && numWords < SEARCH_MAX_WORDS) {
+        while (*p && foldSymbol((unsigned char)*p) == 0) p++;
+        if (!*p) break;
+        const char *start = p;
+        while (*p && foldSymbol((unsigned char)*p) != 0) p++;
+        words[numWords].start = start;
+        words[numWords].len = (size_t)(p - start);
+        numWords++;
+    }
+    return numWords;
+}
+
+// True if some word in `text` starts with `word` (ASCII case-insensitive).
+static bool textHasWordPrefix(const char *text, const QueryWord *word) {
+    if (!text) return false;
+    const unsigned char *p = (const unsigned char*)text;
+    int prev = 0;
+    for (; *p; ++p) {
+        int sym = foldSymbol(*p);
+        if (sym != 0 && prev == 0) {
+            size_t i = 0;
+            while (i < word->len && p[i] &&
+                   foldChar(p[i]) == foldChar((unsigned char)word->start[i])) i++;
+            if (i == word->len) return true;
+        }
+        prev = sym;
+    }
+    return false;
+}
+
+static bool rowMatches(const Catalog *catalog, uint32_t row, const QueryWord *words, int numWords) {
+    const char *strings[4];
+    rowStrings(catalog, row, strings);
+    for (int w = 0; w < numWords; ++w) {
+        if (!textHasWordPrefix(strings[0], &words[w]) && !textHasWordPrefix(strings[1], &words[w]) &&
+            !textHasWordPrefix(strings[2], &words[w]) && !textHasWordPrefix(strings[3], &words[w])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bucket range [first, last) holding every word that could start with `word`.
+static void wordBuckets(const QueryWord *word, uint32_t *first, uint32_t *last) {
+    int s1 = foldSymbol((unsigned char)word->start[0]);
+    if (word->len >= 2) {
+        *first = bucketOf(s1, foldSymbol((unsigned char)word->start[1]));
+        *last = *first + 1;
+    } else {
+        *first = bucketOf(s1, 0);
+        *last = *first + SEARCH_SYMBOLS;
+    }
+}
+
+static int compareByRank(const void *a, const void *b) {
+    uint32_t ra = s_searchRank[*(const uint32_t*)a];
+    uint32_t rb = s_searchRank[*(const uint32_t*)b];
+    return ra < rb ? -1 : (ra > rb ? 1 : 0);
+}
+
+void searchReorder(SearchResult *result, const uint32_t *rank) {
+    if (!rank || result->count < 2) return;
+    s_searchRank = rank;
+    qsort(result->rows, result->count, sizeof(uint32_t), compareByRank);
+    s_searchRank = NULL;
+}
+
+void searchResultInit(SearchResult *result) {
+    memset(result, 0, sizeof(*result));
+}
+
+void searchResultFree(SearchResult *result) {
+    free(result->rows);
+    searchResultInit(result);
+}
+
+static bool reserveResults(SearchResult *result, uint32_t capacity) {
+    if (capacity <= result->capacity) return true;
+    uint32_t *rows = (uint32_t*)realloc(result->rows, capacity * sizeof(uint32_t));
+    if (!rows) return false;
+    result->rows = rows;
+    result->capacity = capacity;
+    return true;
+}
+
+// Collects verified candidates from the index for the most selective word.
+static bool searchFromIndex(SearchResult *result, const SearchIndex *index, const Catalog *catalog,
+                            const QueryWord *words, int numWords) {
+    uint32_t bestFirst = 0, bestLast = 0, bestSize = UINT32_MAX;
+    for (int w = 0; w < numWords; ++w) {
+        uint32_t first, last;
+        wordBuckets(&words[w], &first, &last);
+        uint32_t size = index->offsets[last] - index->offsets[first];
+        if (size < bestSize) {
+            bestSize = size;
+            bestFirst = first;
+            bestLast = last;
+        }
+    }
+    result->count = 0;
+    if (!reserveResults(result, bestSize ? bestSize : 1)) return false;
+
+    if (bestLast - bestFirst == 1) {
+        // One bucket: already ascending and unique
+        for (uint32_t i = index->offsets[bestFirst]; i < index->offsets[bestLast]; ++i) {
+            uint32_t row = index->postings[i];
+            if (rowMatches(catalog, row, words, numWords)) result->rows[result->count++] = row;
+        }
+        return true;
+    }
+
+    // Several buckets (one-letter word): merge through a row bitmap
+    uint32_t words32 = (index->rows + 31) / 32;
+    uint32_t *seen = (uint32_t*)calloc(words32 ? words32 : 1, sizeof(uint32_t));
+    if (!seen) return false;
+    for (uint32_t i = index->offsets[bestFirst]; i < index->offsets[bestLast]; ++i) {
+        uint32_t row = index->postings[i];
+        seen[row >> 5] |= 1u << (row & 31);
+    }
+    for (uint32_t w = 0; w < words32; ++w) {
+        uint32_t bits = seen[w];
+        while (bits) {
+            uint32_t row = w * 32 + (uint32_t)__builtin_ctz(bits);
+            bits &= bits - 1;
+            if (rowMatches(catalog, row, words, numWords)) result->rows[result->count++] = row;
+        }
+    }
+    free(seen);
+    return true;
+}
+
+bool searchRun(SearchResult *result, const SearchIndex *index, const Catalog *catalog,
+               const char *query, const uint32_t *rank) {
+    QueryWord words[SEARCH_MAX_WORDS];
+    int numWords = splitQuery(query, words);
+    if (numWords == 0 || !index->offsets) {
+        result->query[0] = '\0';
+        result->count = 0;
+        return true;
+    }
+
+    size_t oldLen = strlen(result->query);
+    bool extendsPrevious = oldLen > 0 && strncmp(query, result->query, oldLen) == 0;
+
+    if (extendsPrevious) {
+        // Every new match is among the old ones; filter in place, order is kept
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < result->count; ++i) {
+            uint32_t row = result->rows[i];
+            if (rowMatches(catalog, row, words, numWords)) result->rows[kept++] = row;
+        }
+        result->count = kept;
+        result->refined++;
+    } else {
+        if (!searchFromIndex(result, index, catalog, words, numWords)) {
+            result->query[0] = '\0';
+            result->count = 0;
+            return false;
+        }
+        searchReorder(result, rank);
+        result->rebuilt++;
+    }
+
+    strncpy(result->query, query, SEARCH_MAX_QUERY - 1);
+    result->query[SEARCH_MAX_QUERY - 1] = '\0';
+    return true;
+}
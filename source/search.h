@@ -0,0 +1,53 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "catalog.h"
+
+// --- Search-as-you-type ---
+// Word-prefix index over title, artist, album and filename. Every word in
+// those strings is filed under its first two case-folded characters, stored
+// as CSR posting lists of ascending catalog rows (about 4 bytes per word).
+// A query matches a row when every query word is a prefix of some word in
+// the row. Posting lists only nominate candidates; each one is verified.
+//
+// When a query extends the previous one (another character typed), every
+// new match is already in the old result set, so searchRun() filters the
+// previous results in place instead of going back to the index.
+
+#define SEARCH_SYMBOLS     38  // 0 = separator / end of word, 1..36 = [0-9a-z], 37 = non-ASCII
+#define SEARCH_BUCKETS     ((SEARCH_SYMBOLS - 1) * SEARCH_SYMBOLS)
+#define SEARCH_MAX_QUERY   64
+#define SEARCH_MAX_WORDS   8
+
+typedef struct {
+    uint32_t *offsets;  // SEARCH_BUCKETS + 1 entries into postings
+    uint32_t *postings; // Catalog rows, ascending within each bucket
+    uint32_t rows;      // Catalog rows covered
+} SearchIndex;
+
+typedef struct {
+    char query[SEARCH_MAX_QUERY]; // Query the results belong to ("" = none)
+    uint32_t *rows;     // Matching catalog rows, ordered by `rank` (or by row)
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t refined;   // Stats: queries answered by filtering the previous results
+    uint32_t rebuilt;   // Stats: queries answered from the index
+} SearchResult;
+
+void searchIndexInit(SearchIndex *index);
+bool searchIndexBuild(SearchIndex *index, const Catalog *catalog);
+void searchIndexFree(SearchIndex *index);
+
+void searchResultInit(SearchResult *result);
+void searchResultFree(SearchResult *result);
+// Updates `result` for `query`. If `rank` is given (a SortIndex rank array),
+// results come out in that order. Returns false if out of memory.
+bool searchRun(SearchResult *result, const SearchIndex *index, const Catalog *catalog,
+               const char *query, const uint32_t *rank);
+// Re-sorts existing results for a new rank order (after a sort key change).
+void searchReorder(SearchResult *result, const uint32_t *rank);
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strcasecmp
+
+#include "sortindex.h"
+
+typedef struct {
+    uint64_t key;  // Collation key of the primary string
+    uint32_t row;  // Catalog row
+    const char *str; // Primary string (for prefix ties); NULL if absent
+} SortRecord;
+
+const char* sortKeyName(SortKey key) {
+    switch (key) {
+        case SORT_BY_TITLE:    return "Title";
+        case SORT_BY_ARTIST:   return "Artist";
+        case SORT_BY_ALBUM:    return "Album";
+        case SORT_BY_FILENAME: return "Filename";
+        default:               return "";
+    }
+}
+
+// First 8 case-folded bytes, big-endian, so integer order == string order.
+// Missing strings get the maximum key and sort last.
+uint64_t sortCollationKey(const char *s) {
+    if (!s) return UINT64_MAX;
+    uint64_t key = 0;
+    int i = 0;
+    for (; i < 8 && s[i]; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        key = (key << 8) | c;
+    }
+    return i == 0 ? 0 : key << (8 * (8 - i)); // Shifting by 64 is undefined
+}
+
+static const char* primaryString(const Catalog *catalog, SortKey key, uint32_t row) {
+    switch (key) {
+        case SORT_BY_TITLE: {
+            uint32_t title = CATALOG_FIELD(catalog, title, row);
+            if (title != STRARENA_NONE) return catalogString(catalog, title);
+            // Untagged tracks are listed by file name, so sort them that way too
+            const char *path = catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+            return path ? catalogBaseName(path) : NULL;
+        }
+        case SORT_BY_ARTIST: return catalogString(catalog, CATALOG_FIELD(catalog, artist, row));
+        case SORT_BY_ALBUM:  return catalogString(catalog, CATALOG_FIELD(catalog, album, row));
+        default:             return catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+    }
+}
+
+int sortCompareStrings(uint64_t keyA, const char *a, uint64_t keyB, const char *b) {
+    if (keyA != keyB) return keyA < keyB ? -1 : 1;
+    // Same 8-byte prefix: only strings that long can still differ
+    if (a != b && keyA != UINT64_MAX && (keyA & 0xFF) != 0) return strcasecmp(a, b);
+    return 0;
+}
+
+static int compareRecords(const void *a, const void *b) {
+    const SortRecord *ra = (const SortRecord*)a;
+    const SortRecord *rb = (const SortRecord*)b;
+    int cmp = sortCompareStrings(ra->key, ra->str, rb->key, rb->str);
+    if (cmp != 0) return cmp;
+    // Keep scan order among equal keys so the result is deterministic
+    return ra->row < rb->row ? -1 : (ra->row > rb->row ? 1 : 0);
+}
+
+void sortIndexInit(SortIndex *index) {
+    memset(index, 0, sizeof(*index));
+}
+
+void sortIndexFree(SortIndex *index) {
+    for (int k = 0; k < SORT_KEY_COUNT; ++k) {
+        free(index->order[k]);
+        free(index->rank[k]);
+    }
+    sortIndexInit(index);
+}
+
+bool sortIndexBuild(SortIndex *index, const Catalog *catalog) {
+    sortIndexFree(index);
+    uint32_t count = catalog->count;
+    if (count == 0) return true;
+
+    SortRecord *records = (SortRecord*)malloc(count * sizeof(SortRecord));
+    if (!records) return false;
+
+    for (int k = 0; k < SORT_KEY_COUNT; ++k) {
+        uint32_t *order = (uint32_t*)malloc(count * sizeof(uint32_t));
+        uint32_t *rank = (uint32_t*)malloc(count * sizeof(uint32_t));
+        if (!order || !rank) {
+            free(order);
+            free(rank);
+            free(records);
+            sortIndexFree(index);
+            return false;
+        }
+
+        for (uint32_t row = 0; row < count; ++row) {
+            const char *str = primaryString(catalog, (SortKey)k, row);
+            records[row].key = sortCollationKey(str);
+            records[row].row = row;
+            records[row].str = str;
+        }
+        qsort(records, count, sizeof(SortRecord), compareRecords);
+        for (uint32_t i = 0; i < count; ++i) {
+            order[i] = records[i].row;
+            rank[records[i].row] = i;
+        }
+        index->order[k] = order;
+        index->rank[k] = rank;
+    }
+    free(records);
+
+    index->count = count;
+    return true;
+}
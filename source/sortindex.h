@@ -0,0 +1,48 @@
+#ifndef SORTINDEX_H
+#define SORTINDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "catalog.h"
+
+// --- Precomputed Sort Orders ---
+// One permutation array per sort key, built once after a scan. order[k][row]
+// is the catalog index shown at list row `row` under sort key k, so switching
+// the sort order is just picking another array. rank[k] is the inverse
+// (catalog row -> list row), used to keep a selection across sort changes
+// and to put search results in sort order.
+//
+// Rows are compared by a 64-bit collation key: the first 8 bytes of the
+// case-folded string, packed big-endian. Almost every comparison is a single
+// integer compare; only rows whose 8-byte prefixes tie fall back to a full
+// case-insensitive compare. Bytes >= 0x80 (non-ASCII UTF-8) are not folded
+// and sort after ASCII.
+
+typedef enum {
+    SORT_BY_TITLE = 0, // Title, falling back to filename like the list does
+    SORT_BY_ARTIST,
+    SORT_BY_ALBUM,
+    SORT_BY_FILENAME,
+    SORT_KEY_COUNT
+} SortKey;
+
+typedef struct {
+    uint32_t *order[SORT_KEY_COUNT];
+    uint32_t *rank[SORT_KEY_COUNT];
+    uint32_t count; // Catalog rows covered
+} SortIndex;
+
+void sortIndexInit(SortIndex *index);
+// Builds every permutation for the catalog's current rows. Returns false if
+// out of memory; the index is left empty.
+bool sortIndexBuild(SortIndex *index, const Catalog *catalog);
+void sortIndexFree(SortIndex *index);
+
+const char* sortKeyName(SortKey key);
+// The 64-bit collation key described above; UINT64_MAX for NULL.
+uint64_t sortCollationKey(const char *s);
+// Orders two strings by collation key, then case-insensitively on a tie.
+int sortCompareStrings(uint64_t keyA, const char *a, uint64_t keyB, const char *b);
+
+#endif
@@ -0,0 +1,33 @@
+#include <string.h>
+
+#include "spsc.h"
+
+void spscInit(SpscRing *ring, void *storage, uint32_t elemSize, uint32_t capacity) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->storage = (uint8_t*)storage;
+    ring->elemSize = elemSize;
+    ring->capacity = capacity;
+}
+
+bool spscPush(SpscRing *ring, const void *elem) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == ring->capacity) return false;
+
+    memcpy(ring->storage + (head & (ring->capacity - 1)) * ring->elemSize, elem, ring->elemSize);
+    // Publish the slot contents before the new head becomes visible
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool spscPop(SpscRing *ring, void *elem) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) return false;
+
+    memcpy(elem, ring->storage + (tail & (ring->capacity - 1)) * ring->elemSize, ring->elemSize);
+    // Hand the slot back to the producer only after it has been read
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
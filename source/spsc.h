@@ -0,0 +1,31 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// --- Single-Producer/Single-Consumer Ring ---
+// Lock-free queue of fixed-size elements, copied in and out by value, between
+// exactly one producer thread and one consumer thread. The caller provides
+// the storage. Indices run freely and are masked on access.
+
+#define SPSC_CACHE_LINE 32 // ARM11 MPCore L1 line size
+
+typedef struct {
+    _Atomic uint32_t head; // Next slot to write; only the producer stores it
+    uint8_t pad0[SPSC_CACHE_LINE - sizeof(uint32_t)];
+    _Atomic uint32_t tail; // Next slot to read; only the consumer stores it
+    uint8_t pad1[SPSC_CACHE_LINE - sizeof(uint32_t)];
+    uint8_t *storage;
+    uint32_t elemSize;
+    uint32_t capacity;     // Must be a power of two
+} SpscRing;
+
+void spscInit(SpscRing *ring, void *storage, uint32_t elemSize, uint32_t capacity);
+// Producer side. Returns false if the ring is full.
+bool spscPush(SpscRing *ring, const void *elem);
+// Consumer side. Returns false if the ring is empty.
+bool spscPop(SpscRing *ring, void *elem);
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "strarena.h"
+
+#define STRARENA_INITIAL_SLOTS 1024
+
+static uint32_t hashBytes(const char *s, size_t len) {
+    // FNV-1a, 32-bit; never returns 0 so 0 can mark empty slots
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)s[i];
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+void strArenaInit(StrArena *arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+void strArenaFree(StrArena *arena) {
+    for (uint32_t i = 0; i < arena->numBlocks; ++i) free(arena->blocks[i]);
+    free(arena->slots);
+    strArenaInit(arena);
+}
+
+void strArenaReset(StrArena *arena) {
+    for (uint32_t i = 1; i < arena->numBlocks; ++i) {
+        free(arena->blocks[i]);
+        arena->blocks[i] = NULL;
+    }
+    if (arena->numBlocks > 1) arena->numBlocks = 1;
+    arena->blockUsed = 1; // Offset 0 of block 0 is never handed out (ref 0 = none)
+    if (arena->slots) memset(arena->slots, 0, (arena->slotMask + 1) * sizeof(StrArenaSlot));
+    arena->numInterned = 0;
+
+    uint32_t keptBytes = (arena->numBlocks ? STRARENA_BLOCK_SIZE : 0)
+                       + (arena->slots ? (arena->slotMask + 1) * (uint32_t)sizeof(StrArenaSlot) : 0);
+    memset(&arena->stats, 0, sizeof(arena->stats));
+    arena->stats.bytesReserved = keptBytes;
+}
+
+// Clips to STRARENA_MAX_LEN without splitting a UTF-8 sequence.
+static size_t clipLength(const char *s, size_t len) {
+    if (len <= STRARENA_MAX_LEN) return len;
+    len = STRARENA_MAX_LEN;
+    while (len > 0 && ((unsigned char)s[len] & 0xC0) == 0x80) len--;
+    return len;
+}
+
+// Makes room for `need` bytes in the last block, starting a new one if needed.
+static bool ensureSpace(StrArena *arena, uint32_t need) {
+    if (arena->numBlocks == 0 || arena->blockUsed + need > STRARENA_BLOCK_SIZE) {
+        if (arena->numBlocks == STRARENA_MAX_BLOCKS) return false;
+        char *block = (char*)malloc(STRARENA_BLOCK_SIZE);
+        if (!block) return false;
+        arena->stats.allocations++;
+        arena->stats.bytesReserved += STRARENA_BLOCK_SIZE;
+        arena->blocks[arena->numBlocks++] = block;
+        arena->blockUsed = (arena->numBlocks == 1) ? 1 : 0;
+        if (arena->numBlocks == 1) block[0] = '\0';
+    }
+    return true;
+}
+
+static char* tailOf(StrArena *arena) {
+    return arena->blocks[arena->numBlocks - 1] + arena->blockUsed;
+}
+
+// Terminates the `len` bytes written at the tail and hands out their ref.
+static uint32_t finishTail(StrArena *arena, size_t len) {
+    uint32_t need = (uint32_t)len + 1;
+    uint32_t block = arena->numBlocks - 1;
+    uint32_t offset = arena->blockUsed;
+    arena->blocks[block][offset + len] = '\0';
+    arena->blockUsed += need;
+    arena->stats.bytesUsed += need;
+    arena->stats.stringsAdded++;
+    return (block << STRARENA_BLOCK_SHIFT) | offset;
+}
+
+static uint32_t storeBytes(StrArena *arena, const char *s, size_t len) {
+    if (!ensureSpace(arena, (uint32_t)len + 1)) return STRARENA_NONE;
+    memcpy(tailOf(arena), s, len);
+    return finishTail(arena, len);
+}
+
+uint32_t strArenaAdd(StrArena *arena, const char *s, size_t len) {
+    if (!s) return STRARENA_NONE;
+    arena->stats.bytesRequested += (uint32_t)len + 1;
+    return storeBytes(arena, s, clipLength(s, len));
+}
+
+static bool growSlots(StrArena *arena) {
+    uint32_t oldCount = arena->slots ? arena->slotMask + 1 : 0;
+    uint32_t newCount = oldCount ? oldCount * 2 : STRARENA_INITIAL_SLOTS;
+    StrArenaSlot *slots = (StrArenaSlot*)calloc(newCount, sizeof(StrArenaSlot));
+    if (!slots) return false;
+    arena->stats.allocations++;
+    arena->stats.bytesReserved += (newCount - oldCount) * (uint32_t)sizeof(StrArenaSlot);
+
+    for (uint32_t i = 0; i < oldCount; ++i) {
+        StrArenaSlot slot = arena->slots[i];
+        if (slot.ref == STRARENA_NONE) continue;
+        uint32_t pos = slot.hash & (newCount - 1);
+        while (slots[pos].ref != STRARENA_NONE) pos = (pos + 1) & (newCount - 1);
+        slots[pos] = slot;
+    }
+    free(arena->slots);
+    arena->slots = slots;
+    arena->slotMask = newCount - 1;
+    return true;
+}
+
+// Looks `s` up in the intern table. Returns its ref, or STRARENA_NONE with
+// `*slot` set to where it would go. Grows the table first if needed; `*slot`
+// is NULL if that failed.
+static uint32_t findInterned(StrArena *arena, const char *s, size_t len, uint32_t hash, StrArenaSlot **slot) {
+    // Keep the load factor at or below 1/2
+    if (!arena->slots || (arena->numInterned + 1) * 2 > arena->slotMask + 1) {
+        if (!growSlots(arena)) {
+            *slot = NULL;
+            return STRARENA_NONE;
+        }
+    }
+
+    uint32_t pos = hash & arena->slotMask;
+    while (arena->slots[pos].ref != STRARENA_NONE) {
+        if (arena->slots[pos].hash == hash) {
+            const char *existing = strArenaGet(arena, arena->slots[pos].ref);
+            if (memcmp(existing, s, len) == 0 && existing[len] == '\0') {
+                arena->stats.internHits++;
+                return arena->slots[pos].ref;
+            }
+        }
+        pos = (pos + 1) & arena->slotMask;
+    }
+    *slot = &arena->slots[pos];
+    return STRARENA_NONE;
+}
+
+static void addInterned(StrArena *arena, StrArenaSlot *slot, uint32_t hash, uint32_t ref) {
+    if (!slot || ref == STRARENA_NONE) return;
+    slot->hash = hash;
+    slot->ref = ref;
+    arena->numInterned++;
+}
+
+uint32_t strArenaIntern(StrArena *arena, const char *s, size_t len) {
+    if (!s) return STRARENA_NONE;
+    arena->stats.bytesRequested += (uint32_t)len + 1;
+    len = clipLength(s, len);
+
+    uint32_t hash = hashBytes(s, len);
+    StrArenaSlot *slot;
+    uint32_t ref = findInterned(arena, s, len, hash, &slot);
+    if (ref != STRARENA_NONE) return ref;
+    ref = storeBytes(arena, s, len);
+    addInterned(arena, slot, hash, ref);
+    return ref;
+}
+
+// --- In-place Writes ---
+
+char* strArenaReserve(StrArena *arena, size_t maxLen) {
+    if (maxLen > STRARENA_MAX_LEN) maxLen = STRARENA_MAX_LEN;
+    if (!ensureSpace(arena, (uint32_t)maxLen + 1)) return NULL;
+    return tailOf(arena);
+}
+
+uint32_t strArenaCommit(StrArena *arena, size_t len, bool intern) {
+    arena->stats.bytesRequested += (uint32_t)len + 1;
+    const char *s = tailOf(arena);
+    if (!intern) return finishTail(arena, len);
+
+    // Look it up before terminating it: the tail isn't a string yet, and a
+    // match leaves it to be overwritten
+    uint32_t hash = hashBytes(s, len);
+    StrArenaSlot *slot;
+    uint32_t ref = findInterned(arena, s, len, hash, &slot);
+    if (ref != STRARENA_NONE) return ref;
+    ref = finishTail(arena, len);
+    addInterned(arena, slot, hash, ref);
+    return ref;
+}
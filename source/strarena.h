@@ -0,0 +1,73 @@
+#ifndef STRARENA_H
+#define STRARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// --- String Arena ---
+// Bump allocator for track strings. Strings are packed into 64 KiB blocks
+// and addressed by a 32-bit ref: (block << 16) | offset. Ref 0 means "no
+// string". Blocks never move and the block directory is fixed-size, so a
+// ref or pointer stays valid until strArenaReset(), and readers on other
+// threads never race a reallocation.
+//
+// strArenaIntern() deduplicates through a hash table (artists repeat a lot);
+// strArenaAdd() skips it for strings that are unique anyway (filenames).
+
+#define STRARENA_BLOCK_SHIFT 16
+#define STRARENA_BLOCK_SIZE  (1u << STRARENA_BLOCK_SHIFT)
+#define STRARENA_MAX_BLOCKS  1024  // 64 MiB of strings, more than the 3DS heap
+#define STRARENA_MAX_LEN     1023  // Longer strings are truncated (UTF-8 safe)
+#define STRARENA_NONE        0u
+
+typedef struct {
+    uint32_t allocations;    // malloc/realloc calls made by the arena
+    uint32_t bytesUsed;      // String bytes stored, including terminators
+    uint32_t bytesReserved;  // Block + hash table memory held
+    uint32_t stringsAdded;   // Add/intern calls that produced a string
+    uint32_t internHits;     // Intern calls answered by an existing copy
+    uint32_t bytesRequested; // Sum of len + 1 over all calls (what strdup would allocate)
+} StrArenaStats;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t ref;
+} StrArenaSlot;
+
+typedef struct {
+    char *blocks[STRARENA_MAX_BLOCKS];
+    uint32_t numBlocks;
+    uint32_t blockUsed;     // Bytes used in the last block
+    StrArenaSlot *slots;    // Intern table (open addressing, ref 0 = empty)
+    uint32_t slotMask;
+    uint32_t numInterned;
+    StrArenaStats stats;
+} StrArena;
+
+void strArenaInit(StrArena *arena);
+// Releases every string at once; keeps the first block for reuse.
+void strArenaReset(StrArena *arena);
+void strArenaFree(StrArena *arena);
+
+// Both return STRARENA_NONE for NULL input or when out of memory.
+uint32_t strArenaAdd(StrArena *arena, const char *s, size_t len);
+uint32_t strArenaIntern(StrArena *arena, const char *s, size_t len);
+
+// Writing in place: strArenaReserve() returns room for a string of up to
+// `maxLen` bytes (clipped to STRARENA_MAX_LEN) plus its terminator at the end
+// of the arena, or NULL when out of memory. The caller writes it there and
+// strArenaCommit() finishes it at `len` bytes (at most the reserved length,
+// not NUL-terminated yet). With `intern`, an existing copy is returned and
+// the reservation simply dropped. Nothing is visible to readers before the
+// commit, and any other arena call discards an uncommitted reservation.
+char* strArenaReserve(StrArena *arena, size_t maxLen);
+uint32_t strArenaCommit(StrArena *arena, size_t len, bool intern);
+
+// Resolves a ref; NULL for STRARENA_NONE.
+static inline const char* strArenaGet(const StrArena *arena, uint32_t ref) {
+    if (ref == STRARENA_NONE) return NULL;
+    return arena->blocks[ref >> STRARENA_BLOCK_SHIFT] + (ref & (STRARENA_BLOCK_SIZE - 1));
+}
+
+#endif
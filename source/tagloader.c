@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "tagloader.h"
+#include "libindex.h"
+
+void tagLoaderInit(TagLoader *loader, const char *musicDir, StrArena *strings) {
+    memset(loader, 0, sizeof(*loader));
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+        atomic_init(&loader->slots[i].state, TAG_SLOT_FREE);
+        atomic_init(&loader->slots[i].rank, PREFETCH_RANK_FAR);
+    }
+    loader->musicDir = musicDir;
+    loader->strings = strings;
+    atomic_init(&loader->stop, false);
+}
+
+// --- Worker ---
+
+bool tagLoaderStep(TagLoader *loader, StrArena *scratch, MetaIoStats *io) {
+    TagSlot *best = NULL;
+    uint32_t bestRank = PREFETCH_RANK_FAR;
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+        TagSlot *slot = &loader->slots[i];
+        if (atomic_load(&slot->state) != TAG_SLOT_QUEUED) continue;
+        uint32_t rank = atomic_load(&slot->rank);
+        if (!best || rank < bestRank) {
+            best = slot;
+            bestRank = rank;
+        }
+    }
+    if (!best) return false;
+
+    // The render thread may take the slot back at any moment until this succeeds
+    uint32_t expected = TAG_SLOT_QUEUED;
+    if (!atomic_compare_exchange_strong(&best->state, &expected, TAG_SLOT_BUSY)) return true;
+
+    memset(&best->text, 0, sizeof(best->text));
+    replayGainInit(&best->text.gain);
+    best->text.format = best->format; // Kept if the file has gone
+    const char *relPath = strArenaGet(loader->strings, best->filename);
+    char path[PATH_MAX];
+    struct stat st;
+    int n = relPath ? snprintf(path, sizeof(path), "%s/%s", loader->musicDir, relPath) : -1;
+    if (n >= 0 && (size_t)n < sizeof(path) && stat(path, &st) == 0) {
+        tagTextRead(path, (TrackFormat)best->format, (uint64_t)st.st_size, scratch, &best->text);
+    }
+    if (io) {
+        io->bytesRead += best->text.io.bytesRead;
+        io->reads += best->text.io.reads;
+    }
+    atomic_store(&best->state, TAG_SLOT_DONE); // A missing file still leaves the row filled (empty)
+    return true;
+}
+
+static void tagLoaderMain(void *arg) {
+    TagLoaderWorker *worker = (TagLoaderWorker*)arg;
+    TagLoader *loader = worker->loader;
+    while (!atomic_load(&loader->stop)) {
+        if (!tagLoaderStep(loader, &worker->scratch, NULL)) bgThreadSleepUs(TAG_LOADER_IDLE_US);
+    }
+}
+
+bool tagLoaderStart(TagLoader *loader, int workers) {
+    if (workers < 1) workers = 1;
+    if (workers > TAG_POOL_MAX_WORKERS) workers = TAG_POOL_MAX_WORKERS;
+    atomic_store(&loader->stop, false);
+
+    int cores = bgThreadCores();
+    loader->workerCount = 0;
+    for (int i = 0; i < workers; ++i) {
+        TagLoaderWorker *worker = &loader->workers[i];
+        worker->loader = loader;
+        strArenaInit(&worker->scratch);
+        worker->thread = bgThreadStartOn(tagLoaderMain, worker, true, i % cores);
+        if (!worker->thread) {
+            strArenaFree(&worker->scratch);
+            break; // Run with the ones that did start
+        }
+        loader->workerCount++;
+    }
+    if (loader->workerCount == 0) {
+        perror("failed to start tag loader thread");
+        return false;
+    }
+    return true;
+}
+
+void tagLoaderStop(TagLoader *loader) {
+    if (loader->workerCount == 0) return;
+    atomic_store(&loader->stop, true);
+    for (int i = 0; i < loader->workerCount; ++i) {
+        bgThreadJoin(loader->workers[i].thread);
+        loader->workers[i].thread = NULL;
+        strArenaFree(&loader->workers[i].scratch);
+    }
+    loader->workerCount = 0;
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) atomic_store(&loader->slots[i].state, TAG_SLOT_FREE);
+}
+
+// --- Render Thread ---
+
+static uint32_t viewRow(const uint32_t *viewRows, int listRow) {
+    return viewRows ? viewRows[listRow] : (uint32_t)listRow;
+}
+
+// Takes a queued slot back. Fails if the worker got to it first.
+static bool cancelSlot(TagLoader *loader, TagSlot *slot) {
+    uint32_t expected = TAG_SLOT_QUEUED;
+    if (!atomic_compare_exchange_strong(&slot->state, &expected, TAG_SLOT_FREE)) return false;
+    loader->stats.cancelled++;
+    return true;
+}
+
+static void applySlot(TagLoader *loader, Catalog *catalog, TagSlot *slot) {
+    if (slot->row < catalog->count && (CATALOG_FIELD(catalog, flags, slot->row) & CATALOG_FLAG_PENDING)) {
+        TrackMetadata meta;
+        tagTextIntern(&slot->text, loader->strings, &meta);
+        CATALOG_FIELD(catalog, title, slot->row) = meta.title;
+        CATALOG_FIELD(catalog, artist, slot->row) = meta.artist;
+        CATALOG_FIELD(catalog, album, slot->row) = meta.album;
+        CATALOG_FIELD(catalog, durationMs, slot->row) = meta.durationMs;
+        CATALOG_FIELD(catalog, trackNumber, slot->row) = catalogTrackNumber(meta.trackNumber);
+        CATALOG_FIELD(catalog, gain, slot->row) = meta.gain;
+        CATALOG_FIELD(catalog, format, slot->row) = (uint8_t)meta.format;
+        CATALOG_FIELD(catalog, flags, slot->row) &= (uint8_t)~CATALOG_FLAG_PENDING;
+        CATALOG_FIELD(catalog, flags, slot->row) |= CATALOG_FLAG_LATE;
+        if (meta.textFlags & TEXT_FLAG_NO_GLYPHS) CATALOG_FIELD(catalog, flags, slot->row) |= CATALOG_FLAG_TAG_GLYPHS;
+    }
+    loader->stats.loaded++;
+    loader->stats.bytesRead += slot->text.io.bytesRead;
+    loader->stats.reads += slot->text.io.reads;
+    atomic_store(&slot->state, TAG_SLOT_FREE);
+}
+
+// True if `row` already has a slot that isn't finished with.
+static bool inFlight(const TagLoader *loader, uint32_t row) {
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+        const TagSlot *slot = &loader->slots[i];
+        if (atomic_load(&slot->state) != TAG_SLOT_FREE && slot->row == row) return true;
+    }
+    return false;
+}
+
+// A free slot, or the worst-ranked queued one if its rank is worse than `rank`.
+static TagSlot* claimSlot(TagLoader *loader, uint32_t rank) {
+    TagSlot *worst = NULL;
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+        TagSlot *slot = &loader->slots[i];
+        uint32_t state = atomic_load(&slot->state);
+        if (state == TAG_SLOT_FREE) return slot;
+        if (state == TAG_SLOT_QUEUED && atomic_load(&slot->rank) > rank &&
+            (!worst || atomic_load(&slot->rank) > atomic_load(&worst->rank))) {
+            worst = slot;
+        }
+    }
+    return (worst && cancelSlot(loader, worst)) ? worst : NULL;
+}
+
+uint32_t tagLoaderUpdate(TagLoader *loader, Catalog *catalog, const PrefetchWindow *window,
+                         const uint32_t *viewRows) {
+    uint32_t filled = 0;
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+        TagSlot *slot = &loader->slots[i];
+        uint32_t state = atomic_load(&slot->state);
+        if (state == TAG_SLOT_DONE) {
+            applySlot(loader, catalog, slot);
+            filled++;
+        } else if (state == TAG_SLOT_QUEUED) {
+            // Drop rows that scrolled away or whose list position changed
+            // under a new sort or search; re-rank the rest
+            bool moved = slot->listRow >= window->count || viewRow(viewRows, slot->listRow) != slot->row;
+            if (moved || prefetchTooFar(window, slot->listRow)) {
+                cancelSlot(loader, slot);
+            } else {
+                atomic_store(&slot->rank, prefetchRank(window, slot->listRow));
+            }
+        }
+    }
+
+    int rows[PREFETCH_MAX_ROWS];
+    int n = prefetchOrder(window, rows, PREFETCH_MAX_ROWS);
+    for (int i = 0; i < n; ++i) {
+        uint32_t row = viewRow(viewRows, rows[i]);
+        if (row >= catalog->count || !(CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_PENDING)) continue;
+        if (inFlight(loader, row)) continue;
+        uint32_t rank = prefetchRank(window, rows[i]);
+        TagSlot *slot = claimSlot(loader, rank);
+        if (!slot) break; // Everything queued ranks better; the rest of the window waits
+        slot->row = row;
+        slot->listRow = rows[i];
+        slot->filename = CATALOG_FIELD(catalog, filename, row);
+        slot->format = CATALOG_FIELD(catalog, format, row);
+        atomic_store(&slot->rank, rank);
+        atomic_store(&slot->state, TAG_SLOT_QUEUED); // Publishes the fields above
+        loader->stats.queued++;
+    }
+    return filled;
+}
+
+// --- Saving ---
+
+bool tagLoaderCollect(Catalog *catalog, LibIndexUpdate *update) {
+    uint32_t count = 0;
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        if (CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_LATE) count++;
+    }
+    if (count == 0) return true;
+
+    LibIndexTags *tags = (LibIndexTags*)malloc(count * sizeof(LibIndexTags));
+    if (!tags) {
+        perror("out of memory for late tags");
+        return false;
+    }
+    uint32_t n = 0;
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        if (!(CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_LATE)) continue;
+        const char *name = catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+        if (!name) continue;
+        tags[n].name = name;
+        tags[n].title = catalogString(catalog, CATALOG_FIELD(catalog, title, row));
+        tags[n].artist = catalogString(catalog, CATALOG_FIELD(catalog, artist, row));
+        tags[n].album = catalogString(catalog, CATALOG_FIELD(catalog, album, row));
+        tags[n].durationMs = CATALOG_FIELD(catalog, durationMs, row);
+        tags[n].trackNumber = CATALOG_FIELD(catalog, trackNumber, row);
+        tags[n].gain = CATALOG_FIELD(catalog, gain, row);
+        tags[n].format = CATALOG_FIELD(catalog, format, row);
+        tags[n].flags = (CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_TAG_GLYPHS) ? LIBINDEX_RECORD_NO_GLYPHS : 0;
+        n++;
+    }
+    update->tags = tags;
+    update->tagCount = n;
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        CATALOG_FIELD(catalog, flags, row) &= (uint8_t)~CATALOG_FLAG_LATE;
+    }
+    return true;
+}
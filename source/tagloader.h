@@ -0,0 +1,101 @@
+#ifndef TAGLOADER_H
+#define TAGLOADER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "catalog.h"
+#include "metadata.h"
+#include "prefetch.h"
+#include "libindex.h"
+#include "bgthread.h"
+#include "tagpool.h"
+
+// --- Lazy Tag Loading ---
+// Reads the tags of rows the scan left pending (CATALOG_FLAG_PENDING), only
+// as they come near the screen. Requests sit in a small table of slots that
+// the render thread fills in prefetch order each frame; the worker always
+// takes the best-ranked queued slot next. A queued slot whose row scrolls
+// far away is taken back before the worker reaches it, and when every slot
+// is busy a better row pushes out the worst queued one.
+//
+// Several workers can share the table (one per core on New 3DS). Each reads
+// into its own scratch arena and leaves plain text in the slot; the render
+// thread interns it, so the catalog's arena and columns are only written by
+// tagLoaderUpdate(). Start the loader after the scan is drained and stop it
+// before the catalog is cleared.
+
+#define TAG_LOADER_SLOTS   8
+#define TAG_LOADER_IDLE_US 4000 // Worker sleep while nothing is queued
+
+typedef enum {
+    TAG_SLOT_FREE = 0,
+    TAG_SLOT_QUEUED, // Filled by the render thread, not yet taken
+    TAG_SLOT_BUSY,   // Being read by the worker
+    TAG_SLOT_DONE    // Result ready for the render thread
+} TagSlotState;
+
+typedef struct {
+    _Atomic uint32_t state; // TagSlotState
+    _Atomic uint32_t rank;  // prefetchRank() of its row, refreshed every frame
+    uint32_t row;           // Catalog row
+    int listRow;            // List row when queued, to notice the view changing
+    uint32_t filename;      // Catalog string refs and format, copied so the
+    uint8_t format;         // workers never read the columns
+    TagText text;           // Written by the worker
+} TagSlot;
+
+typedef struct {
+    uint32_t queued;    // Rows handed to a slot
+    uint32_t loaded;    // Rows filled in
+    uint32_t cancelled; // Queued rows taken back before being read
+    uint64_t bytesRead;
+    uint32_t reads;
+} TagLoaderStats;
+
+typedef struct TagLoader TagLoader;
+
+typedef struct {
+    TagLoader *loader;
+    StrArena scratch;
+    BgThread *thread;
+} TagLoaderWorker;
+
+struct TagLoader {
+    TagSlot slots[TAG_LOADER_SLOTS];
+    const char *musicDir;
+    StrArena *strings;  // The catalog's arena; workers only read filenames from it
+    TagLoaderWorker workers[TAG_POOL_MAX_WORKERS];
+    int workerCount;
+    atomic_bool stop;
+    TagLoaderStats stats;
+};
+
+void tagLoaderInit(TagLoader *loader, const char *musicDir, StrArena *strings);
+// Runs tagLoaderStep() on up to `workers` low-priority threads (clamped to
+// 1..TAG_POOL_MAX_WORKERS), spread over bgThreadCores(), until stopped.
+// Returns false if not even one started.
+bool tagLoaderStart(TagLoader *loader, int workers);
+// Stops and joins the workers; queued and finished reads are discarded.
+void tagLoaderStop(TagLoader *loader);
+
+// Worker side: reads the best-ranked queued slot, if any, using `scratch`,
+// and adds its I/O to `io` (may be NULL). Returns false if there was nothing
+// to do. Exposed so host tools can drive the loader on a simulated clock
+// instead of threads.
+bool tagLoaderStep(TagLoader *loader, StrArena *scratch, MetaIoStats *io);
+
+// Render thread, once per frame: fills finished rows into the catalog, drops
+// or re-ranks queued ones and queues the window's pending rows. `viewRows`
+// maps list rows to catalog rows (NULL = catalog order). Returns the number
+// of rows filled in.
+uint32_t tagLoaderUpdate(TagLoader *loader, Catalog *catalog, const PrefetchWindow *window,
+                         const uint32_t *viewRows);
+
+// Hands every CATALOG_FLAG_LATE row's tags to `update`, to be saved into the
+// library index so the next scan has them, and clears the flag. Returns
+// false if out of memory.
+bool tagLoaderCollect(Catalog *catalog, LibIndexUpdate *update);
+
+#endif
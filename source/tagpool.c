@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "tagpool.h"
+
+// --- Tag Text ---
+
+static void copyText(const StrArena *scratch, uint32_t ref, char *out) {
+    const char *s = strArenaGet(scratch, ref);
+    size_t len = s ? strlen(s) : 0; // The arena already clipped it to STRARENA_MAX_LEN
+    memcpy(out, s ? s : "", len);
+    out[len] = '\0';
+}
+
+void tagTextRead(const char *path, TrackFormat format, uint64_t fileSize, StrArena *scratch, TagText *text) {
+    strArenaReset(scratch);
+    TrackMetadata meta;
+    memset(&meta, 0, sizeof(meta));
+    memset(&text->io, 0, sizeof(text->io));
+    metadataRead(path, format, fileSize, scratch, &meta, &text->io);
+    copyText(scratch, meta.title, text->title);
+    copyText(scratch, meta.artist, text->artist);
+    copyText(scratch, meta.album, text->album);
+    text->durationMs = meta.durationMs;
+    text->trackNumber = meta.trackNumber;
+    text->gain = meta.gain;
+    text->format = (uint8_t)meta.format;
+    text->textFlags = meta.textFlags;
+}
+
+static uint32_t internText(StrArena *strings, const char *s) {
+    return s[0] ? strArenaIntern(strings, s, strlen(s)) : STRARENA_NONE;
+}
+
+void tagTextIntern(const TagText *text, StrArena *strings, TrackMetadata *meta) {
+    memset(meta, 0, sizeof(*meta));
+    meta->title = internText(strings, text->title);
+    meta->artist = internText(strings, text->artist);
+    meta->album = internText(strings, text->album);
+    meta->durationMs = text->durationMs;
+    meta->trackNumber = text->trackNumber;
+    meta->gain = text->gain;
+    meta->format = (TrackFormat)text->format;
+    meta->textFlags = text->textFlags;
+}
+
+// --- Workers ---
+
+#define TAG_POOL_MASK (TAG_POOL_DEPTH - 1)
+
+// Claims and runs the next unclaimed job. Returns false if there was none.
+static bool runNext(TagPool *pool, StrArena *scratch) {
+    uint32_t seq = atomic_load(&pool->next);
+    do {
+        if (seq == atomic_load(&pool->tail)) return false;
+    } while (!atomic_compare_exchange_weak(&pool->next, &seq, seq + 1));
+
+    // Ours until marked done: the slot is only reused after collection
+    TagJob *job = &pool->jobs[seq & TAG_POOL_MASK];
+    if (job->read) tagTextRead(job->path, (TrackFormat)job->format, job->fileSize, scratch, &job->text);
+    atomic_store(&job->state, TAG_JOB_DONE);
+    return true;
+}
+
+static void tagPoolMain(void *arg) {
+    TagPoolWorker *worker = (TagPoolWorker*)arg;
+    TagPool *pool = worker->pool;
+    while (!atomic_load(&pool->stop)) {
+        if (!runNext(pool, &worker->scratch)) bgThreadSleepUs(TAG_POOL_IDLE_US);
+    }
+}
+
+bool tagPoolStart(TagPool *pool, int workers) {
+    if (workers < 1) workers = 1;
+    if (workers > TAG_POOL_MAX_WORKERS) workers = TAG_POOL_MAX_WORKERS;
+    for (int i = 0; i < TAG_POOL_DEPTH; ++i) atomic_init(&pool->jobs[i].state, TAG_JOB_FREE);
+    pool->head = 0;
+    atomic_init(&pool->tail, 0);
+    atomic_init(&pool->next, 0);
+    atomic_init(&pool->stop, false);
+    strArenaInit(&pool->scratch);
+
+    int cores = bgThreadCores();
+    pool->workerCount = 0;
+    for (int i = 0; i < workers; ++i) {
+        TagPoolWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        strArenaInit(&worker->scratch);
+        worker->thread = bgThreadStartOn(tagPoolMain, worker, true, i % cores);
+        if (!worker->thread) {
+            strArenaFree(&worker->scratch);
+            break; // Run with the ones that did start
+        }
+        pool->workerCount++;
+    }
+    if (pool->workerCount == 0) {
+        perror("failed to start tag pool thread");
+        strArenaFree(&pool->scratch);
+        return false;
+    }
+    return true;
+}
+
+void tagPoolStop(TagPool *pool) {
+    atomic_store(&pool->stop, true);
+    for (int i = 0; i < pool->workerCount; ++i) {
+        bgThreadJoin(pool->workers[i].thread);
+        pool->workers[i].thread = NULL;
+        strArenaFree(&pool->workers[i].scratch);
+    }
+    pool->workerCount = 0;
+    strArenaFree(&pool->scratch);
+}
+
+// --- Submitter ---
+
+uint32_t tagPoolSubmit(TagPool *pool, const char *path, TrackFormat format, uint64_t fileSize) {
+    uint32_t seq = atomic_load(&pool->tail);
+    TagJob *job = &pool->jobs[seq & TAG_POOL_MASK];
+    job->read = path != NULL;
+    job->format = (uint8_t)format;
+    job->fileSize = fileSize;
+    if (path) {
+        snprintf(job->path, sizeof(job->path), "%s", path);
+    } else {
+        memset(&job->text, 0, sizeof(job->text));
+        job->text.format = (uint8_t)format;
+    }
+    atomic_store(&job->state, TAG_JOB_QUEUED);
+    atomic_store(&pool->tail, seq + 1); // Publishes the job to the workers
+    return seq;
+}
+
+TagJob* tagPoolOldest(TagPool *pool, bool wait) {
+    if (tagPoolEmpty(pool)) return NULL;
+    TagJob *job = &pool->jobs[pool->head & TAG_POOL_MASK];
+    while (atomic_load(&job->state) != TAG_JOB_DONE) {
+        if (!wait) return NULL;
+        // Help out rather than sleep; the oldest may be one nobody has taken yet
+        if (!runNext(pool, &pool->scratch)) bgThreadSleepUs(TAG_POOL_WAIT_US);
+    }
+    return job;
+}
+
+void tagPoolRelease(TagPool *pool) {
+    atomic_store(&pool->jobs[pool->head & TAG_POOL_MASK].state, TAG_JOB_FREE);
+    pool->head++;
+}
+
+void tagPoolDiscard(TagPool *pool) {
+    while (tagPoolOldest(pool, true)) tagPoolRelease(pool);
+}
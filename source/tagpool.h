@@ -0,0 +1,109 @@
+#ifndef TAGPOOL_H
+#define TAGPOOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
+
+#include "catalog.h"
+#include "metadata.h"
+#include "bgthread.h"
+
+// --- Tag Text ---
+// A file's tags read on a worker thread, as plain text. Each worker reads
+// into a private scratch arena and copies the strings out, so only the
+// thread that merges the result ever writes the catalog's arena.
+
+typedef struct {
+    char title[STRARENA_MAX_LEN + 1];  // "" if absent
+    char artist[STRARENA_MAX_LEN + 1];
+    char album[STRARENA_MAX_LEN + 1];
+    uint32_t durationMs;
+    uint32_t trackNumber;
+    ReplayGain gain;
+    uint8_t format;                    // TrackFormat, as metadataRead() found it
+    uint8_t textFlags;                 // TEXT_FLAG_*
+    MetaIoStats io;
+} TagText;
+
+// Reads `path` with `scratch` as working space (reset first). A file that
+// can't be opened leaves the text empty.
+void tagTextRead(const char *path, TrackFormat format, uint64_t fileSize, StrArena *scratch, TagText *text);
+// Interns the text into `strings`; empty fields become STRARENA_NONE.
+void tagTextIntern(const TagText *text, StrArena *strings, TrackMetadata *meta);
+
+// --- Tag Reading Pool ---
+// Reads tags for up to TAG_POOL_MAX_WORKERS files at once. One thread
+// submits jobs and collects them, strictly in submission order, so results
+// are merged in the same order, and into the same arena layout, whatever
+// the worker count. Jobs sit in a ring indexed by sequence number; workers
+// claim the next unclaimed one, and a job's slot is only reused once it has
+// been finished and collected. A collector left waiting runs unclaimed jobs
+// itself, so a full ring or the end of a folder never stalls on a sleeping
+// worker.
+
+#define TAG_POOL_MAX_WORKERS 8
+#define TAG_POOL_DEPTH       16   // Jobs in flight; a power of two
+#define TAG_POOL_IDLE_US     200  // Worker sleep while nothing is queued
+#define TAG_POOL_WAIT_US     50   // Collector sleep while only running jobs remain
+
+typedef enum {
+    TAG_JOB_FREE = 0,
+    TAG_JOB_QUEUED, // Submitted; claimed by a worker through `next`
+    TAG_JOB_DONE    // Result ready for the collector
+} TagJobState;
+
+typedef struct {
+    _Atomic uint32_t state; // TagJobState
+    bool read;              // false: a placeholder that only keeps its place in the order
+    uint8_t format;
+    uint64_t fileSize;
+    char path[PATH_MAX];
+    TagText text;           // Written by the worker
+} TagJob;
+
+typedef struct TagPool TagPool;
+
+typedef struct {
+    TagPool *pool;
+    StrArena scratch;
+    BgThread *thread;
+} TagPoolWorker;
+
+struct TagPool {
+    TagJob jobs[TAG_POOL_DEPTH];
+    uint32_t head;          // Oldest job not yet collected (collector only)
+    _Atomic uint32_t tail;  // Next sequence number to submit
+    _Atomic uint32_t next;  // Next sequence number a worker takes
+    TagPoolWorker workers[TAG_POOL_MAX_WORKERS];
+    int workerCount;
+    StrArena scratch;       // For jobs the collector runs itself
+    atomic_bool stop;
+};
+
+// Starts up to `workers` threads (clamped to 1..TAG_POOL_MAX_WORKERS),
+// spread over bgThreadCores(). Returns false if not even one started.
+bool tagPoolStart(TagPool *pool, int workers);
+// Joins the workers. Everything submitted must have been collected.
+void tagPoolStop(TagPool *pool);
+
+// Submitter side. Every job must be collected before the pool is stopped.
+static inline bool tagPoolEmpty(const TagPool *pool) {
+    return atomic_load(&pool->tail) == pool->head;
+}
+static inline bool tagPoolFull(const TagPool *pool) {
+    return atomic_load(&pool->tail) - pool->head == TAG_POOL_DEPTH;
+}
+// Queues a read of `path`, or with NULL a placeholder. The pool must not be
+// full. Returns the job's sequence number.
+uint32_t tagPoolSubmit(TagPool *pool, const char *path, TrackFormat format, uint64_t fileSize);
+// The oldest job once it's done, else NULL; with `wait` it runs or waits out
+// jobs until then (NULL only if nothing is queued). Finish with it before
+// tagPoolRelease().
+TagJob* tagPoolOldest(TagPool *pool, bool wait);
+void tagPoolRelease(TagPool *pool);
+// Waits out and drops everything still queued.
+void tagPoolDiscard(TagPool *pool);
+
+#endif
@@ -0,0 +1,293 @@
+#include <string.h>
+
+#include "textconv.h"
+
+// The UTF-16 fast path narrows units by shifting loaded words, which assumes
+// little-endian loads (the 3DS and the machines the host tools run on).
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "textconv.c assumes a little-endian CPU"
+#endif
+
+// --- Glyph Coverage ---
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} GlyphRange;
+
+// Sorted, non-overlapping
+static const GlyphRange s_fontRanges[] = {
+    { 0x0020, 0x007E }, // ASCII
+    { 0x00A0, 0x024F }, // Latin-1 Supplement, Latin Extended-A and -B
+    { 0x0370, 0x04FF }, // Greek, Cyrillic
+    { 0x2000, 0x22FF }, // Punctuation, currency, letterlike symbols, arrows, maths
+    { 0x2460, 0x26FF }, // Enclosed numbers, box drawing, shapes, misc symbols
+    { 0x3000, 0x30FF }, // CJK punctuation, hiragana, katakana
+    { 0x4E00, 0x9FFF }, // CJK unified ideographs
+    { 0xE000, 0xE0FF }, // Nintendo's private-use button and icon glyphs
+    { 0xFF00, 0xFFEF }, // Halfwidth and fullwidth forms
+};
+
+bool textGlyphInFont(uint32_t cp) {
+    size_t lo = 0;
+    size_t hi = sizeof(s_fontRanges) / sizeof(s_fontRanges[0]);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (cp < s_fontRanges[mid].first) hi = mid;
+        else if (cp > s_fontRanges[mid].last) lo = mid + 1;
+        else return true;
+    }
+    return false;
+}
+
+// --- UTF-8 ---
+
+// Appends one code point as UTF-8. Returns false (writing nothing) if it doesn't fit.
+static inline bool putUtf8(uint8_t *out, uint32_t *pos, uint32_t cap, uint32_t cp) {
+    uint32_t p = *pos;
+    if (cp < 0x80) {
+        if (p + 1 > cap) return false;
+        out[p] = (uint8_t)cp;
+        *pos = p + 1;
+    } else if (cp < 0x800) {
+        if (p + 2 > cap) return false;
+        out[p] = (uint8_t)(0xC0 | (cp >> 6));
+        out[p + 1] = (uint8_t)(0x80 | (cp & 0x3F));
+        *pos = p + 2;
+    } else if (cp < 0x10000) {
+        if (p + 3 > cap) return false;
+        out[p] = (uint8_t)(0xE0 | (cp >> 12));
+        out[p + 1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        out[p + 2] = (uint8_t)(0x80 | (cp & 0x3F));
+        *pos = p + 3;
+    } else {
+        if (p + 4 > cap) return false;
+        out[p] = (uint8_t)(0xF0 | (cp >> 18));
+        out[p + 1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+        out[p + 2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        out[p + 3] = (uint8_t)(0x80 | (cp & 0x3F));
+        *pos = p + 4;
+    }
+    return true;
+}
+
+// Length of the UTF-8 sequence starting at `p`, with its code point in
+// `*cp`; 0 if it is malformed (overlong forms and surrogates included). A
+// sequence that is fine as far as `avail` bytes go but needs more returns
+// its full length, which is then more than `avail`.
+static uint32_t utf8Sequence(const uint8_t *p, uint32_t avail, uint32_t *cp) {
+    uint8_t c = p[0];
+    uint8_t min2 = 0x80, max2 = 0xBF; // Range allowed for the second byte
+    uint32_t need;
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+        need = 2;
+        *cp = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        need = 3;
+        *cp = c & 0x0F;
+        if (c == 0xE0) min2 = 0xA0;
+        if (c == 0xED) max2 = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        need = 4;
+        *cp = c & 0x07;
+        if (c == 0xF0) min2 = 0x90;
+        if (c == 0xF4) max2 = 0x8F;
+    } else {
+        return 0;
+    }
+    for (uint32_t i = 1; i < need; ++i) {
+        if (i >= avail) return need;
+        uint8_t b = p[i];
+        if (i == 1 ? (b < min2 || b > max2) : (b & 0xC0) != 0x80) return 0;
+        *cp = (*cp << 6) | (b & 0x3F);
+    }
+    return need;
+}
+
+// --- Conversion ---
+
+#define BYTE_ONES  0x01010101u
+#define BYTE_HIGHS 0x80808080u
+
+// Copies bytes four at a time while all four are ASCII and none is zero,
+// advancing `*i` and `*pos`. Leaves the rest, at most a few bytes of a run,
+// to the caller.
+static inline void copyAscii(const uint8_t *data, uint32_t len, uint32_t *i, uint8_t *out, uint32_t *pos,
+                             uint32_t cap) {
+    uint32_t s = *i, d = *pos;
+    while (s + 4 <= len && d + 4 <= cap) {
+        uint32_t w;
+        memcpy(&w, data + s, 4);
+        if ((w | ((w - BYTE_ONES) & ~w)) & BYTE_HIGHS) break; // High bit set, or a zero byte
+        memcpy(out + d, &w, 4);
+        s += 4;
+        d += 4;
+    }
+    *i = s;
+    *pos = d;
+}
+
+static uint32_t fromLatin1(const uint8_t *data, uint32_t len, uint8_t *out, uint32_t cap, bool *missing) {
+    uint32_t i = 0, pos = 0;
+    while (i < len) {
+        copyAscii(data, len, &i, out, &pos, cap);
+        if (i >= len || data[i] == 0) break;
+        uint32_t cp = data[i];
+        if (!putUtf8(out, &pos, cap, cp)) break;
+        if (cp >= 0x80 && !textGlyphInFont(cp)) *missing = true;
+        i++;
+    }
+    return pos;
+}
+
+static uint32_t fromUtf8(const uint8_t *data, uint32_t len, uint8_t *out, uint32_t cap, bool *missing) {
+    uint32_t i = 0, pos = 0;
+    while (i < len) {
+        copyAscii(data, len, &i, out, &pos, cap);
+        if (i >= len || data[i] == 0) break;
+        uint32_t cp;
+        uint32_t n = utf8Sequence(data + i, len - i, &cp);
+        if (n > len - i) break; // A character cut off by the end of the field
+        if (n == 0) {
+            cp = data[i]; // Not UTF-8: take it as Latin-1
+            n = 1;
+            if (!putUtf8(out, &pos, cap, cp)) break;
+        } else {
+            if (pos + n > cap) break;
+            memcpy(out + pos, data + i, n);
+            pos += n;
+        }
+        if (cp >= 0x80 && !textGlyphInFont(cp)) *missing = true;
+        i += n;
+    }
+    return pos;
+}
+
+#define UNIT_ONES  0x0001000100010001ull
+#define UNIT_HIGHS 0x8000800080008000ull
+#define UNIT_WIDE  0xFF80FF80FF80FF80ull // Bits that must be clear in an ASCII unit
+#define UNIT_LOW   0x00FF00FF00FF00FFull
+
+static inline uint32_t readUnit(const uint8_t *p, bool bigEndian) {
+    return bigEndian ? ((uint32_t)p[0] << 8 | p[1]) : ((uint32_t)p[1] << 8 | p[0]);
+}
+
+static uint32_t fromUtf16(const uint8_t *data, uint32_t len, bool bigEndian, uint8_t *out, uint32_t cap,
+                          bool *missing) {
+    uint32_t i = 0, pos = 0;
+    len &= ~1u;
+    while (i < len) {
+        // Four units at a time while all four are ASCII and none is zero
+        while (i + 8 <= len && pos + 4 <= cap) {
+            uint64_t w;
+            memcpy(&w, data + i, 8);
+            if (bigEndian) w = ((w & UNIT_LOW) << 8) | ((w >> 8) & UNIT_LOW);
+            if ((w & UNIT_WIDE) || ((w - UNIT_ONES) & ~w & UNIT_HIGHS)) break;
+            uint32_t narrow = (uint32_t)(w & 0xFF) | (uint32_t)((w >> 8) & 0xFF00) |
+                              (uint32_t)((w >> 16) & 0xFF0000) | (uint32_t)((w >> 24) & 0xFF000000);
+            memcpy(out + pos, &narrow, 4);
+            i += 8;
+            pos += 4;
+        }
+        if (i >= len) break;
+
+        uint32_t unit = readUnit(data + i, bigEndian);
+        if (unit == 0) break;
+        uint32_t cp = unit;
+        uint32_t step = 2;
+        if (unit >= 0xD800 && unit < 0xDC00 && i + 4 <= len) {
+            uint32_t low = readUnit(data + i + 2, bigEndian);
+            if (low >= 0xDC00 && low < 0xE000) {
+                cp = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                step = 4;
+            } else {
+                cp = 0xFFFD;
+            }
+        } else if (unit >= 0xD800 && unit < 0xE000) {
+            cp = 0xFFFD; // Unpaired surrogate
+        }
+        if (!putUtf8(out, &pos, cap, cp)) break;
+        if (cp >= 0x80 && !textGlyphInFont(cp)) *missing = true;
+        i += step;
+    }
+    return pos;
+}
+
+uint32_t textConvert(StrArena *strings, MetaTextEncoding encoding, const uint8_t *data, uint32_t len,
+                     uint8_t *flags) {
+    // Worst cases: UTF-16 grows by half (3 bytes per unit); Latin-1 doubles,
+    // and so does "UTF-8" that turns out to be Latin-1
+    bool wide = encoding == META_TEXT_UTF16 || encoding == META_TEXT_UTF16BE;
+    size_t bound = wide ? (size_t)len + len / 2 : (size_t)len * 2;
+    if (bound > STRARENA_MAX_LEN) bound = STRARENA_MAX_LEN;
+    uint8_t *out = (uint8_t*)strArenaReserve(strings, bound);
+    if (!out) return STRARENA_NONE;
+    uint32_t cap = (uint32_t)bound;
+
+    bool missing = false;
+    uint32_t pos;
+    switch (encoding) {
+        case META_TEXT_LATIN1:
+            pos = fromLatin1(data, len, out, cap, &missing);
+            break;
+        case META_TEXT_UTF16: {
+            bool bigEndian = false; // No BOM: assume little-endian, as most taggers write
+            if (len >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
+                bigEndian = true;
+                data += 2;
+                len -= 2;
+            } else if (len >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+                data += 2;
+                len -= 2;
+            }
+            pos = fromUtf16(data, len, bigEndian, out, cap, &missing);
+            break;
+        }
+        case META_TEXT_UTF16BE:
+            pos = fromUtf16(data, len, true, out, cap, &missing);
+            break;
+        case META_TEXT_UTF8:
+        default:
+            pos = fromUtf8(data, len, out, cap, &missing);
+            break;
+    }
+
+    while (pos > 0 && out[pos - 1] == ' ') pos--;
+    if (pos == 0) return STRARENA_NONE; // The reservation is simply dropped
+    if (missing && flags) *flags |= TEXT_FLAG_NO_GLYPHS;
+    return strArenaCommit(strings, pos, true);
+}
+
+// Checks each character of valid UTF-8 with `keep`, skipping ASCII a word at
+// a time. False at the first malformed sequence or character `keep` rejects.
+static bool scanUtf8(const char *s, size_t len, bool (*keep)(uint32_t cp)) {
+    const uint8_t *p = (const uint8_t*)s;
+    size_t i = 0;
+    while (i < len) {
+        while (i + 4 <= len) {
+            uint32_t w;
+            memcpy(&w, p + i, 4);
+            if (w & BYTE_HIGHS) break;
+            i += 4;
+        }
+        if (i >= len) break;
+        uint32_t cp;
+        uint32_t avail = len - i < 4 ? (uint32_t)(len - i) : 4;
+        uint32_t n = utf8Sequence(p + i, avail, &cp);
+        if (n == 0 || n > avail) return false;
+        if (keep && cp >= 0x80 && !keep(cp)) return false;
+        i += n;
+    }
+    return true;
+}
+
+bool textDrawable(const char *s, size_t len) {
+    return scanUtf8(s, len, textGlyphInFont);
+}
+
+bool textIsUtf8(const char *s, size_t len) {
+    return scanUtf8(s, len, NULL);
+}
@@ -0,0 +1,47 @@
+#ifndef TEXTCONV_H
+#define TEXTCONV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "strarena.h"
+
+// --- Tag Text Conversion ---
+// Turns tag text in any of the encodings tags use into the UTF-8 that
+// C2D_TextParse() expects, writing it straight into the string arena
+// (strArenaReserve()) with no buffer in between. Runs of plain ASCII, most
+// tag text, are checked and copied a word at a time.
+//
+// The system font only covers Latin, Greek, Cyrillic, kana, the common CJK
+// ideographs and some symbols, so conversion also notes any code point it
+// would draw as a box, for the list to fall back on the filename.
+
+// Tag text encodings (the ID3v2 numbering).
+typedef enum {
+    META_TEXT_LATIN1 = 0,
+    META_TEXT_UTF16 = 1,   // With byte order mark
+    META_TEXT_UTF16BE = 2,
+    META_TEXT_UTF8 = 3
+} MetaTextEncoding;
+
+#define TEXT_FLAG_NO_GLYPHS 0x01 // Has a code point the system font can't draw
+
+// Converts and interns tag text. Stops at the first terminator, trims
+// trailing spaces and cuts at STRARENA_MAX_LEN bytes on a character
+// boundary; returns STRARENA_NONE for empty text. Malformed UTF-16 becomes
+// U+FFFD; a byte that isn't part of valid UTF-8 is taken as Latin-1, the
+// usual mistake of taggers. ORs TEXT_FLAG_* for the result into `*flags`
+// (may be NULL).
+uint32_t textConvert(StrArena *strings, MetaTextEncoding encoding, const uint8_t *data, uint32_t len,
+                     uint8_t *flags);
+
+// True if the system font has a glyph for `cp`. An approximation by Unicode
+// block of the JPN/USA/EUR shared font; U+FFFD counts as missing.
+bool textGlyphInFont(uint32_t cp);
+// True if all of `len` bytes of `s` are valid UTF-8 the system font can draw.
+bool textDrawable(const char *s, size_t len);
+// True if all of `len` bytes of `s` are valid UTF-8.
+bool textIsUtf8(const char *s, size_t len);
+
+#endif
@@ -0,0 +1,42 @@
+#include <string.h>
+
+#include "metadata.h"
+
+// --- WAV (RIFF/WAVE) ---
+// Walks the chunk headers for "fmt " and "data"; the length is the data
+// chunk's size over the byte rate, so samples are never read.
+
+#define WAV_MAX_CHUNKS 64
+
+void wavRead(MetaReader *reader, StrArena *strings, TrackMetadata *meta) {
+    (void)strings;
+    const uint8_t *riff = metaReaderPeek(reader, 0, 12);
+    if (!riff || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) return;
+
+    uint32_t byteRate = 0;
+    uint32_t blockAlign = 0;
+    uint64_t pos = 12;
+    for (int n = 0; n < WAV_MAX_CHUNKS; ++n) {
+        const uint8_t *chunk = metaReaderPeek(reader, pos, 8);
+        if (!chunk) return;
+        uint64_t size = metaLe32(chunk + 4);
+        uint64_t body = pos + 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            const uint8_t *fmt = metaReaderPeek(reader, body, 16);
+            if (!fmt) return;
+            meta->sampleRate = metaLe32(fmt + 4);
+            byteRate = metaLe32(fmt + 8);
+            blockAlign = metaLe16(fmt + 12);
+            if (byteRate == 0) byteRate = meta->sampleRate * blockAlign;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            // Streaming writers leave the size 0 or 0xFFFFFFFF; the data then runs to the end
+            uint64_t available = reader->fileSize - body;
+            if (size == 0 || size > available) size = available;
+            if (byteRate > 0) meta->durationMs = (uint32_t)(size * 1000 / byteRate);
+            if (blockAlign > 0) meta->frameCount = size / blockAlign;
+            return;
+        }
+        pos = body + size + (size & 1); // Chunks are padded to an even length
+    }
+}
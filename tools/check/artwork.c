@@ -0,0 +1,229 @@
+// Checks that cached cover art never outlives what it was built from: a
+// moved file keeps its thumbnail, but a file re-tagged with a new picture,
+// a replaced or added folder picture, and byte-identical copies of a file
+// in folders with different pictures each get the art they have now, run
+// after run. Every answer is compared with one built straight from the files.
+
+#include <limits.h>
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "check.h"
+#include "fsutil.h"
+#include "artwork.h"
+#include "contenthash.h"
+
+#define PICTURE_SIZE  48
+#define TRACK_BYTES   8192
+#define STAMP_STEP    100 // Seconds a replaced picture's mtime is moved by, so its stamp changes
+
+typedef struct {
+    char music[PATH_MAX];
+    char index[PATH_MAX];
+    char thumbs[PATH_MAX];
+    ArtCache cache;
+    bool open;
+} ArtRun;
+
+// --- Test Files ---
+
+// A PNG of one colour.
+static bool writePng(const char *path, uint32_t rgb) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, info ? &info : NULL);
+        fclose(f);
+        return false;
+    }
+    png_init_io(png, f);
+    png_set_IHDR(png, info, PICTURE_SIZE, PICTURE_SIZE, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    png_byte row[PICTURE_SIZE * 3];
+    for (int x = 0; x < PICTURE_SIZE; ++x) {
+        row[x * 3] = (png_byte)(rgb >> 16);
+        row[x * 3 + 1] = (png_byte)(rgb >> 8);
+        row[x * 3 + 2] = (png_byte)rgb;
+    }
+    for (int y = 0; y < PICTURE_SIZE; ++y) png_write_row(png, row);
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    return fclose(f) == 0;
+}
+
+static void putFrameHeader(uint8_t *out, const char *id, uint32_t size) {
+    memcpy(out, id, 4);
+    out[4] = (uint8_t)(size >> 24);
+    out[5] = (uint8_t)(size >> 16);
+    out[6] = (uint8_t)(size >> 8);
+    out[7] = (uint8_t)size;
+    out[8] = out[9] = 0;
+}
+
+// An MP3 of TRACK_BYTES bytes titled `title`, with an APIC front cover of
+// colour `rgb` unless `rgb` is negative. Equal titles give equal files.
+static bool writeTrack(const char *path, const char *title, long rgb) {
+    fsMakeParents(path);
+    uint8_t tag[4096];
+    uint32_t len = 10;
+    uint32_t titleLen = (uint32_t)strlen(title);
+    putFrameHeader(tag + len, "TIT2", titleLen + 1);
+    tag[len + 10] = 0; // ISO-8859-1
+    memcpy(tag + len + 11, title, titleLen);
+    len += 11 + titleLen;
+    if (rgb >= 0) {
+        char png[PATH_MAX];
+        snprintf(png, sizeof(png), "%s.png", path);
+        FILE *f = writePng(png, (uint32_t)rgb) ? fopen(png, "rb") : NULL;
+        if (!f) return false;
+        // Encoding, MIME type and front cover; the string's own NUL ends an empty description
+        static const uint8_t header[] = "\0image/png\0\x03";
+        uint32_t headerLen = sizeof(header);
+        memcpy(tag + len + 10, header, headerLen);
+        size_t n = fread(tag + len + 10 + headerLen, 1, sizeof(tag) - len - 10 - headerLen, f);
+        fclose(f);
+        remove(png);
+        putFrameHeader(tag + len, "APIC", headerLen + (uint32_t)n);
+        len += 10 + headerLen + (uint32_t)n;
+    }
+    uint32_t body = len - 10;
+    memcpy(tag, "ID3\x03\x00\x00", 6);
+    tag[6] = (uint8_t)((body >> 21) & 0x7F); // Syncsafe size
+    tag[7] = (uint8_t)((body >> 14) & 0x7F);
+    tag[8] = (uint8_t)((body >> 7) & 0x7F);
+    tag[9] = (uint8_t)(body & 0x7F);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(tag, 1, len, f) == len;
+    static const uint8_t frameHeader[4] = { 0xFF, 0xFB, 0x90, 0x00 }; // MPEG-1 layer III, 128 kb/s, 44.1 kHz
+    for (uint32_t at = len; ok && at < TRACK_BYTES; ++at) {
+        uint32_t pos = (at - len) % 417;
+        ok = fputc(pos < 4 ? frameHeader[pos] : 0x55, f) != EOF;
+    }
+    return fclose(f) == 0 && ok;
+}
+
+// Writes a folder picture over any old one, with a later mtime.
+static bool writeFolderPicture(const char *path, uint32_t rgb) {
+    struct stat st;
+    bool existed = stat(path, &st) == 0;
+    fsMakeParents(path);
+    if (!writePng(path, rgb)) return false;
+    if (!existed) return true;
+    struct timeval times[2] = { { st.st_atime, 0 }, { st.st_mtime + STAMP_STEP, 0 } };
+    return utimes(path, times) == 0;
+}
+
+// --- Runs ---
+
+// A run of the app: the cache as loaded from disk at start.
+static bool startRun(ArtRun *run) {
+    run->open = artCacheOpen(&run->cache, run->index, run->thumbs);
+    return run->open;
+}
+
+static void endRun(ArtRun *run) {
+    if (run->open) artCacheClose(&run->cache);
+    run->open = false;
+}
+
+static uint64_t hashTrack(const ArtRun *run, const char *relPath) {
+    static uint8_t buffer[CONTENT_HASH_SPAN];
+    char path[PATH_MAX];
+    struct stat st;
+    uint64_t hash;
+    if (!fsJoinPath(path, run->music, relPath) || stat(path, &st) != 0 ||
+        !contentHashFile(path, (uint64_t)st.st_size, buffer, &hash, NULL)) {
+        return CONTENT_HASH_NONE;
+    }
+    return hash;
+}
+
+// Builds `relPath`'s thumbnail as the app would, hashed or not, and compares
+// it with one built from the files. Returns 1 on a mismatch.
+static int expectFresh(ArtRun *run, const char *label, const char *relPath, bool hashed, ArtworkStats *stats) {
+    uint64_t hash = hashed ? hashTrack(run, relPath) : CONTENT_HASH_NONE;
+    uint32_t thumb = artworkBuild(&run->cache, run->music, relPath, hash, stats);
+    uint16_t cached[ART_THUMB_PIXELS], source[ART_THUMB_PIXELS];
+    bool haveSource = artworkLoadThumb(run->music, relPath, source);
+    bool ok;
+    if (thumb == ART_THUMB_NONE) ok = !haveSource;
+    else ok = haveSource && artCacheReadThumb(&run->cache, thumb, cached) && !memcmp(cached, source, sizeof(cached));
+    printf("  %-40s %-24s %s\n", label, relPath, ok ? "ok" : (thumb == ART_THUMB_NONE ? "no art, has some" : "stale"));
+    return ok ? 0 : 1;
+}
+
+static int checkArt(ArtRun *run) {
+    int failures = 0;
+    char path[PATH_MAX], moved[PATH_MAX];
+    ArtworkStats stats;
+    printf("cover art against the files, run after run\n");
+
+    // Run 1: embedded pictures, a folder picture, copies of one untagged file
+    bool written = fsJoinPath(path, run->music, "Moved/01.mp3") && writeTrack(path, "Moved", 0xC03020) &&
+                   fsJoinPath(path, run->music, "Retag/01.mp3") && writeTrack(path, "Retag", 0x20C030) &&
+                   fsJoinPath(path, run->music, "Copies/A/01.mp3") && writeTrack(path, "Copy", -1) &&
+                   fsJoinPath(path, run->music, "Copies/A/folder.png") && writeFolderPicture(path, 0xE0E020) &&
+                   fsJoinPath(path, run->music, "Copies/B/01.mp3") && writeTrack(path, "Copy", -1) &&
+                   fsJoinPath(path, run->music, "Copies/B/cover.png") && writeFolderPicture(path, 0x20E0E0) &&
+                   fsJoinPath(path, run->music, "Bare/01.mp3") && writeTrack(path, "Bare", -1);
+    if (!written || !startRun(run)) {
+        printf("  cannot write the first library\n");
+        return 1;
+    }
+    failures += expectFresh(run, "embedded, hashed", "Moved/01.mp3", true, NULL);
+    failures += expectFresh(run, "embedded, not hashed yet", "Retag/01.mp3", false, NULL);
+    failures += expectFresh(run, "copy, its folder's picture", "Copies/A/01.mp3", true, NULL);
+    failures += expectFresh(run, "same bytes, another folder's picture", "Copies/B/01.mp3", true, NULL);
+    failures += expectFresh(run, "no art anywhere", "Bare/01.mp3", true, NULL);
+    endRun(run);
+
+    // Run 2: between runs, a file moves, one is re-tagged with a new picture,
+    // a folder picture is replaced and another folder gains one
+    written = fsJoinPath(path, run->music, "Moved/01.mp3") && fsJoinPath(moved, run->music, "Elsewhere/renamed.mp3");
+    if (written) fsMakeParents(moved);
+    written = written && rename(path, moved) == 0 &&
+              fsJoinPath(path, run->music, "Retag/01.mp3") && writeTrack(path, "Retag", 0x3020C0) &&
+              fsJoinPath(path, run->music, "Copies/A/folder.png") && writeFolderPicture(path, 0xE020E0) &&
+              fsJoinPath(path, run->music, "Bare/folder.png") && writeFolderPicture(path, 0x808080);
+    if (!written || !startRun(run)) {
+        printf("  cannot change the library\n");
+        return failures + 1;
+    }
+    memset(&stats, 0, sizeof(stats));
+    failures += expectFresh(run, "moved, found by its hash", "Elsewhere/renamed.mp3", true, &stats);
+    if (stats.decoded != 0 || stats.bytesRead != 0) {
+        printf("  the moved file's picture was read again\n");
+        failures++;
+    }
+    failures += expectFresh(run, "re-tagged, path key from the last run", "Retag/01.mp3", false, NULL);
+    failures += expectFresh(run, "re-tagged, now hashed", "Retag/01.mp3", true, NULL);
+    failures += expectFresh(run, "folder picture replaced", "Copies/A/01.mp3", true, NULL);
+    failures += expectFresh(run, "copy elsewhere, unchanged folder", "Copies/B/01.mp3", true, NULL);
+    failures += expectFresh(run, "folder picture added", "Bare/01.mp3", true, NULL);
+    endRun(run);
+    return failures;
+}
+
+int main(void) {
+    char root[] = "/tmp/pearartXXXXXX";
+    static ArtRun run;
+    int failures;
+    if (mkdtemp(root) && fsJoinPath(run.music, root, "music") && fsJoinPath(run.index, root, "art.idx") &&
+        fsJoinPath(run.thumbs, root, "art.bin")) {
+        failures = checkArt(&run);
+    } else {
+        printf("cover art: cannot make %s\n", root);
+        failures = 1;
+    }
+    fsRemoveTree(root);
+    return checkReport("artwork", failures);
+}
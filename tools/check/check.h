@@ -0,0 +1,18 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+// --- Host Checks ---
+// One program per module, built and run by `make -C tools check`. Each
+// prints what it checked and every mismatch, and exits non-zero if there
+// was any. Timings are pearscan's; nothing here measures speed.
+
+// Prints the verdict for `module` and returns the exit status.
+static inline int checkReport(const char *module, int failures) {
+    if (failures) printf("%s: %d FAILED\n", module, failures);
+    else printf("%s: ok\n", module);
+    return failures ? 1 : 0;
+}
+
+#endif
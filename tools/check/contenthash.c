@@ -0,0 +1,163 @@
+// Checks the content hash: every single-bit change and every length of a
+// buffer gives a different hash, a file's hash follows its size and both
+// ends but not its middle, and the tail of a file past 4 GiB is read where
+// it is, not at a wrapped 32-bit offset.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "synth.h"
+#include "contenthash.h"
+
+#define HASH_CHECK_BYTES 1024
+#define HASH_FILE_BYTES  (3 * CONTENT_HASH_SPAN + 123)
+#define HASH_LARGE_BYTES (5ull * 1024 * 1024 * 1024 + 300) // Sparse, so it costs no disk space
+
+// Every single-bit change to a buffer, and every length of it, must give
+// a different hash.
+static int checkHashMixing(uint8_t *data, uint32_t len) {
+    int failures = 0;
+    uint64_t base = contentHashBytes(data, len, 0);
+    for (uint32_t i = 0; i < len * 8; ++i) {
+        data[i / 8] ^= (uint8_t)(1u << (i % 8));
+        if (contentHashBytes(data, len, 0) == base) failures++;
+        data[i / 8] ^= (uint8_t)(1u << (i % 8));
+    }
+    for (uint32_t n = 0; n < len; ++n) {
+        if (contentHashBytes(data, n, 0) == base) failures++;
+    }
+    printf("hash mixing: %u bit flips and %u lengths of %u bytes, %d collisions\n", len * 8, len, len, failures);
+    return failures;
+}
+
+static bool writeBytes(const char *path, const uint8_t *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && ok;
+}
+
+// Hashes `data` written to `path`; CONTENT_HASH_NONE if it can't be.
+static uint64_t hashWritten(const char *path, const uint8_t *data, size_t len, uint8_t *buffer, MetaIoStats *io) {
+    uint64_t hash;
+    if (!writeBytes(path, data, len) || !contentHashFile(path, len, buffer, &hash, io)) return CONTENT_HASH_NONE;
+    return hash;
+}
+
+// A file larger than two spans: the bytes between the spans are not read.
+static int checkFileHash(uint8_t *data) {
+    char path[] = "/tmp/pearcheckXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    static uint8_t buffer[CONTENT_HASH_SPAN];
+    MetaIoStats io = { 0, 0 };
+    int failures = 0;
+    uint64_t base = hashWritten(path, data, HASH_FILE_BYTES, buffer, &io);
+    if (base == CONTENT_HASH_NONE || io.reads != 2 || io.bytesRead != 2 * CONTENT_HASH_SPAN) {
+        printf("  file hash: %u reads of %llu bytes, want 2 of %u\n", io.reads, (unsigned long long)io.bytesRead,
+               2 * CONTENT_HASH_SPAN);
+        failures++;
+    }
+
+    static const struct {
+        size_t offset;
+        bool changes;
+        const char *what;
+    } edits[] = {
+        { 0, true, "first byte" },
+        { CONTENT_HASH_SPAN - 1, true, "last byte of the head" },
+        { CONTENT_HASH_SPAN, false, "first byte past the head" },
+        { HASH_FILE_BYTES / 2, false, "middle" },
+        { HASH_FILE_BYTES - CONTENT_HASH_SPAN, true, "first byte of the tail" },
+        { HASH_FILE_BYTES - 1, true, "last byte" },
+    };
+    for (size_t i = 0; i < sizeof(edits) / sizeof(edits[0]); ++i) {
+        data[edits[i].offset] ^= 0x40;
+        uint64_t hash = hashWritten(path, data, HASH_FILE_BYTES, buffer, &io);
+        data[edits[i].offset] ^= 0x40;
+        if ((hash != base) != edits[i].changes) {
+            printf("  file hash: editing the %s %s it\n", edits[i].what, edits[i].changes ? "kept" : "changed");
+            failures++;
+        }
+    }
+    // One byte longer, with the same head and tail bytes shifted along
+    if (hashWritten(path, data, HASH_FILE_BYTES + 1, buffer, &io) == base) {
+        printf("  file hash: a longer file kept it\n");
+        failures++;
+    }
+    // Small files are read whole, in one read
+    memset(&io, 0, sizeof(io));
+    if (hashWritten(path, data, 100, buffer, &io) == CONTENT_HASH_NONE || io.reads != 1) {
+        printf("  file hash: a 100-byte file took %u reads\n", io.reads);
+        failures++;
+    }
+    remove(path);
+    printf("file hash: %zu edits and two sizes, %d mismatches\n", sizeof(edits) / sizeof(edits[0]), failures);
+    return failures;
+}
+
+// A sparse file past 4 GiB with a marker in its last bytes: the marker must
+// be what the reader sees there, and changing it must change the hash.
+static int checkLargeFile(void) {
+    char path[] = "/tmp/pearcheckXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    static const uint8_t marker[2][4] = { { 'P', 'E', 'A', 'R' }, { 'p', 'e', 'a', 'r' } };
+    off_t at = (off_t)(HASH_LARGE_BYTES - sizeof(marker[0]));
+    if (ftruncate(fd, (off_t)HASH_LARGE_BYTES) != 0) {
+        printf("large file: skipped, cannot make a %llu-byte file\n", (unsigned long long)HASH_LARGE_BYTES);
+        close(fd);
+        remove(path);
+        return 0;
+    }
+    static uint8_t buffer[CONTENT_HASH_SPAN];
+    uint64_t hashes[2] = { CONTENT_HASH_NONE, CONTENT_HASH_NONE };
+    int failures = 0;
+    for (int i = 0; i < 2; ++i) {
+        if (pwrite(fd, marker[i], sizeof(marker[i]), at) != (ssize_t)sizeof(marker[i]) ||
+            !contentHashFile(path, HASH_LARGE_BYTES, buffer, &hashes[i], NULL)) {
+            failures++;
+        }
+        MetaReader reader;
+        const uint8_t *seen = NULL;
+        if (metaReaderOpen(&reader, path, HASH_LARGE_BYTES)) {
+            seen = metaReaderPeek(&reader, (uint64_t)at, sizeof(marker[i]));
+            if (!seen || memcmp(seen, marker[i], sizeof(marker[i])) != 0) failures++;
+            metaReaderClose(&reader);
+        } else {
+            failures++;
+        }
+    }
+    if (hashes[0] == hashes[1]) failures++;
+    close(fd);
+    remove(path);
+    printf("large file: %llu bytes, tail marker %s, hash %s\n", (unsigned long long)HASH_LARGE_BYTES,
+           failures ? "misread" : "read in place", hashes[0] != hashes[1] ? "follows it" : "ignores it");
+    return failures;
+}
+
+int main(void) {
+    uint8_t *data = (uint8_t*)malloc(HASH_FILE_BYTES + 1);
+    if (!data) return 1;
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < HASH_FILE_BYTES + 1; ++i) data[i] = (uint8_t)synthRandom(&seed);
+    int failures = checkHashMixing(data, HASH_CHECK_BYTES);
+    for (uint32_t n = 0; n < 64; ++n) {
+        if (contentHashBytes(data, n, 0) == CONTENT_HASH_NONE) failures++;
+    }
+    failures += checkFileHash(data);
+    failures += checkLargeFile();
+    free(data);
+    return checkReport("contenthash", failures);
+}
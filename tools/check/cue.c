@@ -0,0 +1,238 @@
+// Checks cueParse() against a sheet with known answers and the sheets it
+// must turn down, and cueReadFlac() and cueTrackEnd() against FLAC CUESHEET
+// blocks written with known sample offsets.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "cue.h"
+
+// A sheet with known answers: CRLF lines, a FILE in a subfolder with a
+// backslash, a pregap (INDEX 00), an unquoted title, a data track to drop
+// and a Latin-1 title from an old ripper.
+static const char s_cueSample[] =
+    "REM GENRE Rock\r\n"
+    "PERFORMER \"Sample Band\"\r\n"
+    "TITLE \"Sample Album\"\r\n"
+    "FILE \"rips\\Sample Album.wav\" WAVE\r\n"
+    "  TRACK 01 AUDIO\r\n"
+    "    TITLE \"Opening\"\r\n"
+    "    INDEX 01 00:00:00\r\n"
+    "  TRACK 02 AUDIO\r\n"
+    "    TITLE Second Song\r\n"
+    "    PERFORMER \"Guest Singer\"\r\n"
+    "    INDEX 00 03:23:10\r\n"
+    "    INDEX 01 03:25:40\r\n"
+    "  TRACK 03 MODE1/2352\r\n"
+    "    INDEX 01 07:00:00\r\n"
+    "  TRACK 04 AUDIO\r\n"
+    "    TITLE \"Caf\xE9\"\r\n"
+    "    INDEX 01 09:59:74\r\n";
+
+typedef struct {
+    uint32_t number;
+    uint64_t start;        // At 44.1 kHz
+    const char *title;
+    const char *performer; // NULL: the sheet's
+} CueExpected;
+
+static const CueExpected s_cueExpected[] = {
+    { 1, 0, "Opening", NULL },
+    { 2, 9064020, "Second Song", "Guest Singer" }, // 03:25:40 = 15415 sectors of 588 frames
+    { 4, 26459412, "Caf\xC3\xA9", NULL },
+};
+
+// Sheets cueParse() must turn down.
+static const char *const s_cueRejected[] = {
+    "FILE \"a.wav\" WAVE\nTRACK 01 AUDIO\nINDEX 01 00:00:00\nFILE \"b.wav\" WAVE\nTRACK 02 AUDIO\n"
+    "INDEX 01 00:00:00\n",
+    "FILE \"a.wav\" WAVE\nTRACK 01 AUDIO\nINDEX 01 01:00:00\nTRACK 02 AUDIO\nINDEX 01 00:30:00\n",
+    "FILE \"a.wav\" WAVE\nTRACK 01 AUDIO\nINDEX 01 00:61:00\n",
+    "TRACK 01 AUDIO\nINDEX 01 00:00:00\n",
+    "FILE \"data.bin\" BINARY\nTRACK 01 MODE1/2352\nINDEX 01 00:00:00\n",
+};
+
+static bool sameText(const StrArena *strings, uint32_t ref, const char *expected) {
+    const char *s = strArenaGet(strings, ref);
+    return s && strcmp(s, expected) == 0;
+}
+
+// Checks cueParse() against the sample and the sheets it must reject.
+static int checkCueSample(StrArena *strings) {
+    static CueSheet sheet;
+    int failures = 0;
+    uint32_t count = sizeof(s_cueExpected) / sizeof(s_cueExpected[0]);
+    if (!cueParse(s_cueSample, sizeof(s_cueSample) - 1, strings, &sheet) || sheet.count != count ||
+        !sameText(strings, sheet.title, "Sample Album") || !sameText(strings, sheet.performer, "Sample Band") ||
+        !cueNamesFile(&sheet, "sample album.flac", true) || cueNamesFile(&sheet, "Sample Album.flac", false) ||
+        !cueNamesFile(&sheet, "Sample Album.wav", false)) {
+        printf("  sample sheet: parsed wrongly\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        const CueExpected *want = &s_cueExpected[i];
+        const CueTrack *track = &sheet.tracks[i];
+        bool performer = want->performer ? sameText(strings, track->performer, want->performer)
+                                         : track->performer == STRARENA_NONE;
+        if (track->number != want->number || cueTrackStart(&sheet, i, 44100) != want->start ||
+            !sameText(strings, track->title, want->title) || !performer) {
+            printf("  sample track %u: got %u at %llu\n", want->number, track->number,
+                   (unsigned long long)cueTrackStart(&sheet, i, 44100));
+            failures++;
+        }
+    }
+    for (size_t i = 0; i < sizeof(s_cueRejected) / sizeof(s_cueRejected[0]); ++i) {
+        if (cueParse(s_cueRejected[i], strlen(s_cueRejected[i]), strings, &sheet)) {
+            printf("  rejected sheet %zu: accepted\n", i);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// --- FLAC CUESHEET Blocks ---
+
+typedef struct {
+    uint64_t offset;    // In samples
+    uint8_t number;
+    bool audio;
+    uint8_t indexCount;
+    uint64_t index[2];  // Offsets from the track's
+    uint8_t indexNumber[2];
+} FlacCueTrack;
+
+typedef struct {
+    uint32_t number;
+    uint64_t start;
+    uint64_t end;
+} FlacCueExpected;
+
+// Track 2 has a pregap, track 3 is data and track 4 has only an INDEX 00;
+// the lead-out comes last.
+static const FlacCueTrack s_flacTracks[] = {
+    { 0, 1, true, 1, { 0 }, { 1 } },
+    { 441000, 2, true, 2, { 0, 88200 }, { 0, 1 } },
+    { 1000000, 3, false, 1, { 0 }, { 1 } },
+    { 1323000, 4, true, 1, { 4410 }, { 0 } },
+};
+
+static void putBe(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i, value >>= 8) out[i] = (uint8_t)value;
+}
+
+// Writes a FLAC holding a STREAMINFO block and a CUESHEET block of
+// s_flacTracks ended by lead-out `leadOut` at `leadOutOffset`. No audio
+// follows: cueReadFlac() reads only the metadata.
+static bool writeFlacCue(const char *path, uint8_t leadOut, uint64_t leadOutOffset) {
+    static uint8_t file[4096];
+    memset(file, 0, sizeof(file));
+    size_t len = 0;
+    memcpy(file, "fLaC", 4);
+    len += 4;
+    file[len] = 0; // STREAMINFO, not last
+    putBe(file + len + 1, 34, 3);
+    len += 4 + 34;
+
+    size_t block = len;
+    len += 4;
+    size_t trackCount = sizeof(s_flacTracks) / sizeof(s_flacTracks[0]);
+    file[len + 128 + 8] = 0x80; // Compact disc
+    file[len + 395] = (uint8_t)(trackCount + 1);
+    len += 396;
+    for (size_t t = 0; t <= trackCount; ++t) {
+        const FlacCueTrack *track = t < trackCount ? &s_flacTracks[t] : NULL;
+        putBe(file + len, track ? track->offset : leadOutOffset, 8);
+        file[len + 8] = track ? track->number : leadOut;
+        if (track && !track->audio) file[len + 21] = 0x80;
+        file[len + 35] = track ? track->indexCount : 0;
+        len += 36;
+        for (uint8_t i = 0; track && i < track->indexCount; ++i) {
+            putBe(file + len, track->index[i], 8);
+            file[len + 8] = track->indexNumber[i];
+            len += 12;
+        }
+    }
+    file[block] = 0x80 | 5; // CUESHEET, last
+    putBe(file + block + 1, len - block - 4, 3);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(file, 1, len, f) == len;
+    return fclose(f) == 0 && ok;
+}
+
+// Reads the sheet back and compares each track's start and end.
+static int expectFlacCue(const char *path, const char *label, uint64_t frameCount, const FlacCueExpected *want,
+                         uint32_t count) {
+    static CueSheet sheet;
+    MetaReader reader;
+    struct stat st;
+    bool read = stat(path, &st) == 0 && metaReaderOpen(&reader, path, (uint64_t)st.st_size);
+    if (read) {
+        read = cueReadFlac(&reader, &sheet);
+        metaReaderClose(&reader);
+    }
+    bool ok = read && sheet.rate == 0 && sheet.count == count;
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        uint64_t start = cueTrackStart(&sheet, i, 44100);
+        uint64_t end = cueTrackEnd(&sheet, i, 44100, frameCount);
+        if (sheet.tracks[i].number != want[i].number || start != want[i].start || end != want[i].end) {
+            printf("  %s: track %u runs %llu-%llu\n", label, sheet.tracks[i].number, (unsigned long long)start,
+                   (unsigned long long)end);
+            ok = false;
+        }
+    }
+    printf("  %-40s %s\n", label, ok ? "ok" : (read ? "wrong tracks" : "not read"));
+    return ok ? 0 : 1;
+}
+
+static int checkFlacCue(void) {
+    char path[] = "/tmp/pearcueXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("  cannot make %s\n", path);
+        return 1;
+    }
+    close(fd);
+    int failures = 0;
+    printf("FLAC CUESHEET blocks\n");
+
+    // CD lead-out past the end of the audio: the last track stops at the last frame
+    static const FlacCueExpected clipped[] = {
+        { 1, 0, 529200 },
+        { 2, 529200, 1327410 },
+        { 4, 1327410, 1800000 },
+    };
+    if (writeFlacCue(path, 170, 2000000)) {
+        failures += expectFlacCue(path, "lead-out 170, clipped to the audio", 1800000, clipped, 3);
+    } else {
+        failures++;
+    }
+
+    // Lead-out 255 inside the audio: the last track stops at it
+    static const FlacCueExpected leadOut[] = {
+        { 1, 0, 529200 },
+        { 2, 529200, 1327410 },
+        { 4, 1327410, 1700000 },
+    };
+    if (writeFlacCue(path, 255, 1700000)) {
+        failures += expectFlacCue(path, "lead-out 255, before the last frame", 1800000, leadOut, 3);
+    } else {
+        failures++;
+    }
+    remove(path);
+    return failures;
+}
+
+int main(void) {
+    StrArena strings;
+    strArenaInit(&strings);
+    int failures = checkCueSample(&strings);
+    failures += checkFlacCue();
+    strArenaFree(&strings);
+    return checkReport("cue", failures);
+}
@@ -0,0 +1,82 @@
+// Builds the artist/album groups of a synthetic library and checks they
+// cover every row once, in order: within an album by track number, the
+// unnumbered tracks last, and equal numbers by filename rank.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.h"
+#include "synth.h"
+#include "sortindex.h"
+#include "groupindex.h"
+
+#define GROUP_CHECK_TRACKS 20000
+
+// Where a row falls within its album.
+static uint64_t trackOrder(const Catalog *catalog, const uint32_t *rank, uint32_t row) {
+    uint16_t number = CATALOG_FIELD(catalog, trackNumber, row);
+    return ((uint64_t)(number ? number : UINT32_MAX) << 32) | (rank ? rank[row] : row);
+}
+
+// Checks the groups cover every row once, in order. Returns the mismatches.
+static uint32_t checkGroups(const GroupIndex *groups, const Catalog *catalog, const uint32_t *rank) {
+    uint32_t errors = 0;
+    uint8_t *seen = (uint8_t*)calloc(catalog->count, 1);
+    if (!seen) return 1;
+    for (uint32_t ar = 0; ar < groups->artistCount; ++ar) {
+        if (ar > 0 && synthCompareNames(catalog, groups->artists[ar - 1].name, groups->artists[ar].name) >= 0) errors++;
+        uint32_t firstAlbum;
+        uint32_t albums = groupArtistAlbums(groups, ar, &firstAlbum);
+        for (uint32_t al = firstAlbum; al < firstAlbum + albums; ++al) {
+            if (groups->albums[al].artist != ar) errors++;
+            if (al > firstAlbum && synthCompareNames(catalog, groups->albums[al - 1].name, groups->albums[al].name) >= 0) {
+                errors++;
+            }
+            const uint32_t *rows;
+            uint32_t n = groupAlbumTracks(groups, al, &rows);
+            if (n == 0 || groups->albumRows[al] != rows[0]) errors++;
+            for (uint32_t t = 0; t < n; ++t) {
+                uint32_t row = rows[t];
+                if (seen[row]++ || groups->albumOf[row] != al) errors++;
+                if (t > 0 && trackOrder(catalog, rank, rows[t - 1]) >= trackOrder(catalog, rank, row)) errors++;
+                if (synthCompareNames(catalog, CATALOG_FIELD(catalog, artist, row), groups->artists[ar].name) != 0 ||
+                    synthCompareNames(catalog, CATALOG_FIELD(catalog, album, row), groups->albums[al].name) != 0) {
+                    errors++;
+                }
+            }
+        }
+    }
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        if (!seen[row]) errors++;
+    }
+    free(seen);
+    return errors;
+}
+
+int main(void) {
+    Catalog catalog;
+    catalogInit(&catalog);
+    synthCatalog(&catalog, GROUP_CHECK_TRACKS);
+    SortIndex sortIndex;
+    sortIndexInit(&sortIndex);
+    GroupIndex groups;
+    groupIndexInit(&groups);
+    int failures = 0;
+    // With the filename rank and without it
+    if (!sortIndexBuild(&sortIndex, &catalog)) failures++;
+    const uint32_t *ranks[2] = { sortIndex.rank[SORT_BY_FILENAME], NULL };
+    for (int r = 0; r < 2 && !failures; ++r) {
+        if (!groupIndexBuild(&groups, &catalog, ranks[r])) {
+            failures++;
+            break;
+        }
+        uint32_t errors = checkGroups(&groups, &catalog, ranks[r]);
+        printf("%u tracks, %u artists, %u albums%s: %u mismatches\n", catalog.count, groups.artistCount,
+               groups.albumCount, ranks[r] ? "" : " (no rank)", errors);
+        failures += (int)errors;
+    }
+    groupIndexFree(&groups);
+    sortIndexFree(&sortIndex);
+    catalogFree(&catalog);
+    return checkReport("groupindex", failures);
+}
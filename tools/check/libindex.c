@@ -0,0 +1,240 @@
+// Checks the library index on a synthetic 20000-file tree: a warm scan
+// reads no tags and gives the same rows as the cold one, every record is
+// found by path, size and mtime, what the background jobs find is saved in
+// one update, and a damaged index falls back to a cold scan. pearscan -c and
+// a second run time the same two scans.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "synth.h"
+#include "fsutil.h"
+#include "scanner.h"
+#include "libindex.h"
+
+#define INDEX_ARTISTS    40
+#define INDEX_ALBUMS     25 // Per artist
+#define INDEX_TRACKS     20 // Per album: 20000 files
+#define INDEX_FILES      (INDEX_ARTISTS * INDEX_ALBUMS * INDEX_TRACKS)
+#define INDEX_FILE_BYTES 1024
+
+static bool appendItem(const CatalogEntry *entry, void *user) {
+    return catalogAppend((Catalog*)user, entry);
+}
+
+static bool scan(const char *musicDir, const char *dataDir, const char *indexPath, Catalog *catalog,
+                 ScanStats *stats) {
+    catalogClear(catalog);
+    Scanner scanner;
+    scannerBegin(&scanner, musicDir, dataDir, indexPath, &catalog->strings, appendItem, catalog);
+    while (!scannerStep(&scanner, 256, 20000)) {}
+    *stats = scanner.stats;
+    return !scanner.openFailed;
+}
+
+static bool sameString(const Catalog *a, uint32_t refA, const Catalog *b, uint32_t refB) {
+    const char *sa = catalogString(a, refA);
+    const char *sb = catalogString(b, refB);
+    return sa == sb || (sa && sb && strcmp(sa, sb) == 0);
+}
+
+// Rows that differ between two scans of the same tree.
+static uint32_t diffCatalogs(const Catalog *a, const Catalog *b) {
+    if (a->count != b->count) return a->count > b->count ? a->count - b->count : b->count - a->count;
+    uint32_t diffs = 0;
+    for (uint32_t r = 0; r < a->count; ++r) {
+        bool same = sameString(a, CATALOG_FIELD(a, filename, r), b, CATALOG_FIELD(b, filename, r)) &&
+                    sameString(a, CATALOG_FIELD(a, title, r), b, CATALOG_FIELD(b, title, r)) &&
+                    sameString(a, CATALOG_FIELD(a, artist, r), b, CATALOG_FIELD(b, artist, r)) &&
+                    sameString(a, CATALOG_FIELD(a, album, r), b, CATALOG_FIELD(b, album, r)) &&
+                    CATALOG_FIELD(a, durationMs, r) == CATALOG_FIELD(b, durationMs, r) &&
+                    CATALOG_FIELD(a, trackNumber, r) == CATALOG_FIELD(b, trackNumber, r) &&
+                    CATALOG_FIELD(a, format, r) == CATALOG_FIELD(b, format, r) &&
+                    CATALOG_FIELD(a, flags, r) == CATALOG_FIELD(b, flags, r);
+        if (!same) diffs++;
+    }
+    return diffs;
+}
+
+// Rows whose track number is not the one their file is named after.
+static uint32_t misnumbered(const Catalog *catalog) {
+    uint32_t wrong = 0;
+    for (uint32_t r = 0; r < catalog->count; ++r) {
+        const char *path = catalogString(catalog, CATALOG_FIELD(catalog, filename, r));
+        if (!path || CATALOG_FIELD(catalog, trackNumber, r) != atoi(catalogBaseName(path))) wrong++;
+    }
+    return wrong;
+}
+
+static void printScan(const char *label, const Catalog *catalog, const ScanStats *stats) {
+    printf("  %-16s %5u rows, %5u probed, %3u folders read, %8llu bytes read\n", label, catalog->count,
+           stats->itemsProbed, stats->dirsRead, (unsigned long long)stats->bytesRead);
+}
+
+// Every record is found by its own path, size and mtime, and by nothing else.
+static int checkLookups(const char *indexPath) {
+    LibIndex index;
+    if (!libIndexLoad(&index, indexPath)) {
+        printf("  cannot load %s\n", indexPath);
+        return 1;
+    }
+    uint32_t misses = 0;
+    for (uint32_t i = 0; i < index.count; ++i) {
+        const LibIndexRecord *rec = &index.records[i];
+        const char *name = libIndexString(&index, rec->nameOff);
+        if (!name || libIndexFind(&index, name, rec->size, rec->mtime) != rec) misses++;
+        if (name && libIndexFind(&index, name, rec->size + 1, rec->mtime)) misses++;
+        if (name && libIndexFind(&index, name, rec->size, rec->mtime + 1)) misses++;
+    }
+    if (libIndexFind(&index, "Artist 00/Album 00/99.mp3", INDEX_FILE_BYTES, index.records[0].mtime)) misses++;
+    printf("  lookups          %5u records, %u wrong\n", index.count, misses);
+    int failures = index.count == INDEX_FILES && misses == 0 ? 0 : 1;
+    libIndexFree(&index);
+    return failures;
+}
+
+// Late tags, a measured gain and content hashes saved together: each lands
+// on its record, and a hash of a file that changed since is left out.
+static int checkUpdate(const char *indexPath) {
+    LibIndex index;
+    if (!libIndexLoad(&index, indexPath) || index.count < 4) {
+        printf("  cannot load %s\n", indexPath);
+        return 1;
+    }
+    const LibIndexRecord before[4] = { index.records[0], index.records[1], index.records[2], index.records[3] };
+    char names[4][PATH_MAX];
+    for (int i = 0; i < 4; ++i) snprintf(names[i], PATH_MAX, "%s", libIndexString(&index, before[i].nameOff));
+    libIndexFree(&index);
+
+    LibIndexUpdate update;
+    libIndexUpdateInit(&update);
+    update.tags = (LibIndexTags*)calloc(2, sizeof(LibIndexTags));
+    update.gains = (LibIndexGain*)calloc(2, sizeof(LibIndexGain));
+    update.hashes = (LibIndexHash*)calloc(2, sizeof(LibIndexHash));
+    if (!update.tags || !update.gains || !update.hashes) {
+        libIndexUpdateFree(&update);
+        return 1;
+    }
+    LibIndexTags *tags = update.tags;
+    tags[0].name = names[0];
+    tags[0].title = "Retitled";
+    tags[0].artist = "Someone Else";
+    tags[0].durationMs = 1234;
+    tags[0].trackNumber = 42;
+    replayGainInit(&tags[0].gain);
+    tags[0].flags = LIBINDEX_RECORD_NO_GLYPHS;
+    tags[1].name = "No Such/Track.mp3";
+    update.tagCount = 2;
+    update.gains[0].name = names[1];
+    replayGainInit(&update.gains[0].gain);
+    update.gains[0].gain.trackGain = -650;
+    update.gainCount = 1;
+    update.hashes[0] = (LibIndexHash){ names[2], before[2].size, before[2].mtime, 0x123456789ABCDEFull };
+    update.hashes[1] = (LibIndexHash){ names[3], before[3].size, before[3].mtime + 1, 0xFEDCBA987654321ull };
+    update.hashCount = 2;
+    bool saved = libIndexUpdate(indexPath, &update);
+    libIndexUpdateFree(&update);
+
+    int failures = 0;
+    if (!saved || !libIndexLoad(&index, indexPath)) {
+        printf("  update: cannot save or reload\n");
+        return 1;
+    }
+    const LibIndexRecord *rec = index.records;
+    const char *title = libIndexString(&index, rec[0].titleOff);
+    const char *artist = libIndexString(&index, rec[0].artistOff);
+    bool tagsOk = title && strcmp(title, "Retitled") == 0 && artist && strcmp(artist, "Someone Else") == 0 &&
+                  rec[0].albumOff == LIBINDEX_NONE && rec[0].durationMs == 1234 && rec[0].trackNumber == 42 &&
+                  (rec[0].flags & LIBINDEX_RECORD_NO_GLYPHS) && !(rec[0].flags & LIBINDEX_RECORD_PENDING);
+    bool gainOk = rec[1].gain.trackGain == -650 && (rec[1].flags & LIBINDEX_RECORD_MEASURED) &&
+                  rec[1].titleOff != LIBINDEX_NONE && strcmp(libIndexString(&index, rec[1].titleOff),
+                                                             libIndexString(&index, before[1].titleOff)) == 0;
+    bool hashOk = rec[2].contentHash == 0x123456789ABCDEFull && rec[3].contentHash == before[3].contentHash;
+    bool restOk = index.count == INDEX_FILES && libIndexFind(&index, names[0], before[0].size, before[0].mtime);
+    printf("  one update       tags %s, gain %s, hashes %s, other records %s\n", tagsOk ? "ok" : "wrong",
+           gainOk ? "ok" : "wrong", hashOk ? "ok" : "wrong", restOk ? "ok" : "wrong");
+    if (!tagsOk || !gainOk || !hashOk || !restOk) failures++;
+    libIndexFree(&index);
+    return failures;
+}
+
+static int checkIndex(const char *musicDir, const char *dataDir, const char *indexPath) {
+    int failures = 0;
+    Catalog cold, warm;
+    catalogInit(&cold);
+    catalogInit(&warm);
+    ScanStats coldStats, warmStats;
+    printf("library index: %u files in %u folders\n", INDEX_FILES, INDEX_ARTISTS * INDEX_ALBUMS);
+
+    if (!scan(musicDir, dataDir, indexPath, &cold, &coldStats) ||
+        !scan(musicDir, dataDir, indexPath, &warm, &warmStats)) {
+        printf("  cannot scan %s\n", musicDir);
+        failures++;
+    }
+    printScan("cold", &cold, &coldStats);
+    printScan("warm", &warm, &warmStats);
+    uint32_t diffs = diffCatalogs(&cold, &warm);
+    if (cold.count != INDEX_FILES || coldStats.itemsProbed != INDEX_FILES || warmStats.itemsProbed != 0 ||
+        warmStats.dirsRead != 0 || warmStats.bytesRead >= coldStats.bytesRead || diffs != 0) {
+        printf("  warm scan: want 0 probed, 0 folders read, fewer bytes and the same rows (%u differ)\n", diffs);
+        failures++;
+    }
+    uint32_t wrong = misnumbered(&warm);
+    if (wrong != 0) {
+        printf("  %u rows lost their track numbers\n", wrong);
+        failures++;
+    }
+    failures += checkLookups(indexPath);
+    failures += checkUpdate(indexPath);
+
+    // Cut the index short: it must be refused whole, not half-trusted
+    struct stat st;
+    if (stat(indexPath, &st) != 0 || truncate(indexPath, st.st_size / 2) != 0) {
+        printf("  cannot truncate %s\n", indexPath);
+        failures++;
+    }
+    LibIndex damaged;
+    if (libIndexLoad(&damaged, indexPath)) {
+        printf("  a truncated index loaded\n");
+        libIndexFree(&damaged);
+        failures++;
+    }
+    if (!scan(musicDir, dataDir, indexPath, &warm, &warmStats)) failures++;
+    printScan("damaged index", &warm, &warmStats);
+    diffs = diffCatalogs(&cold, &warm);
+    if (warmStats.itemsProbed != INDEX_FILES || diffs != 0) {
+        printf("  after a damaged index: want a cold scan with the same rows (%u differ)\n", diffs);
+        failures++;
+    }
+    if (!scan(musicDir, dataDir, indexPath, &warm, &warmStats)) failures++;
+    printScan("rewritten", &warm, &warmStats);
+    if (warmStats.itemsProbed != 0 || diffCatalogs(&cold, &warm) != 0) {
+        printf("  the index was not rewritten after a damaged one\n");
+        failures++;
+    }
+
+    catalogFree(&warm);
+    catalogFree(&cold);
+    return failures;
+}
+
+int main(void) {
+    char root[] = "/tmp/pearindexXXXXXX";
+    char musicDir[PATH_MAX], dataDir[PATH_MAX], indexPath[PATH_MAX];
+    int failures;
+    if (mkdtemp(root) && fsJoinPath(musicDir, root, "music") && fsJoinPath(dataDir, root, "data") &&
+        fsJoinPath(indexPath, dataDir, "library.idx") &&
+        synthWriteTree(musicDir, INDEX_ARTISTS, INDEX_ALBUMS, INDEX_TRACKS, INDEX_FILE_BYTES)) {
+        failures = checkIndex(musicDir, dataDir, indexPath);
+    } else {
+        printf("library index: cannot build the tree under %s\n", root);
+        failures = 1;
+    }
+    fsRemoveTree(root);
+    return checkReport("libindex", failures);
+}
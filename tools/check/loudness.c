@@ -0,0 +1,234 @@
+// Checks the loudness meter against BS.1770's coefficients, EBU Tech
+// 3341's loudness and true-peak cases and an exact reference.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "synth.h"
+#include "loudness.h"
+
+// BS.1770-4's published K-weighting coefficients at 48 kHz.
+static const double s_shelf48k[5] = { 1.53512485958697, -2.69169618940638, 1.19839281085285, -1.69065929318241,
+                                      0.73248077421585 };
+static const double s_highPass48k[5] = { 1.0, -2.0, 1.0, -1.99004745483398, 0.99007225036621 };
+
+// A stretch of 1 kHz sine, its peak in dBFS per channel (LOUDNESS_OFF for silence).
+#define LOUDNESS_OFF (-999.0)
+
+typedef struct {
+    double seconds;
+    double dbfs[6];
+} ToneSegment;
+
+// EBU Tech 3341's integrated loudness cases that fit a sine generator, each
+// expected at its `want` LUFS within 0.1 LU.
+typedef struct {
+    const char *name;
+    uint32_t channels;
+    double want;
+    ToneSegment segments[5];
+    int segmentCount;
+} ToneCase;
+
+static const ToneCase s_toneCases[] = {
+    { "3341 #1 stereo -23", 2, -23.0, { { 20.0, { -23, -23 } } }, 1 },
+    { "3341 #2 stereo -33", 2, -33.0, { { 20.0, { -33, -33 } } }, 1 },
+    { "3341 #3 relative gate", 2, -23.0,
+      { { 10.0, { -36, -36 } }, { 60.0, { -23, -23 } }, { 10.0, { -36, -36 } } }, 3 },
+    { "3341 #4 both gates", 2, -23.0,
+      { { 10.0, { -72, -72 } }, { 10.0, { -36, -36 } }, { 60.0, { -23, -23 } }, { 10.0, { -36, -36 } },
+        { 10.0, { -72, -72 } } }, 5 },
+    { "3341 #5 level steps", 2, -23.0,
+      { { 20.0, { -26, -26 } }, { 20.1, { -20, -20 } }, { 20.0, { -26, -26 } } }, 3 },
+    { "3341 #6 5.1 weights", 6, -23.0, { { 20.0, { -28, -28, -24, LOUDNESS_OFF, -30, -30 } } }, 1 },
+};
+
+// Sines whose peaks fall between samples: Tech 3341's true-peak cases, at
+// -6 dBTP; within +0.2 / -0.4 dB is a pass. Each fades in over 20 ms, as a
+// sine switched on at full level really does overshoot.
+typedef struct {
+    double cyclesPerSample;
+    double phaseDegrees;
+} PeakCase;
+
+static const PeakCase s_peakCases[] = {
+    { 1000.0 / 48000.0, 0.0 },
+    { 1.0 / 4.0, 45.0 },
+    { 1.0 / 6.0, 60.0 },
+    { 1.0 / 8.0, 67.5 },
+};
+
+#define LOUDNESS_GEN_FRAMES 4096
+
+// Feeds a tone case to a fresh meter, chunk by chunk.
+static bool meterTone(LoudnessMeter *meter, const ToneCase *c, uint32_t rate, LoudnessResult *result) {
+    static float pcm[LOUDNESS_GEN_FRAMES * LOUDNESS_MAX_CHANNELS];
+    if (!loudnessMeterInit(meter, rate, c->channels)) return false;
+    uint64_t n = 0;
+    for (int s = 0; s < c->segmentCount; ++s) {
+        const ToneSegment *seg = &c->segments[s];
+        double amplitude[LOUDNESS_MAX_CHANNELS];
+        for (uint32_t ch = 0; ch < c->channels; ++ch) {
+            amplitude[ch] = seg->dbfs[ch] == LOUDNESS_OFF ? 0.0 : pow(10.0, seg->dbfs[ch] / 20.0);
+        }
+        uint64_t frames = (uint64_t)llround(seg->seconds * rate);
+        while (frames > 0) {
+            uint32_t chunk = frames < LOUDNESS_GEN_FRAMES ? (uint32_t)frames : LOUDNESS_GEN_FRAMES;
+            for (uint32_t i = 0; i < chunk; ++i, ++n) {
+                double v = sin(2.0 * M_PI * 1000.0 * (double)n / rate);
+                for (uint32_t ch = 0; ch < c->channels; ++ch) pcm[i * c->channels + ch] = (float)(amplitude[ch] * v);
+            }
+            loudnessMeterAdd(meter, pcm, chunk);
+            frames -= chunk;
+        }
+    }
+    loudnessMeterResult(meter, result);
+    return true;
+}
+
+// BS.1770 done the long way, as the meter's reference: double-precision
+// filters with the published 48 kHz coefficients, every block kept, exact
+// gates. 48 kHz only.
+typedef struct {
+    double state[LOUDNESS_MAX_CHANNELS][4];
+    double *blocks;      // Block energies
+    uint32_t blockCount;
+    uint32_t blockCapacity;
+    double steps[4];
+    uint32_t stepCount;
+    double stepSum;
+    uint32_t stepFill;
+} ReferenceMeter;
+
+static double biquad(const double *k, double *state, double x) {
+    double y = k[0] * x + state[0];
+    state[0] = k[1] * x - k[3] * y + state[1];
+    state[1] = k[2] * x - k[4] * y;
+    return y;
+}
+
+static void referenceAdd(ReferenceMeter *ref, const float *pcm, uint32_t frames, uint32_t channels) {
+    for (uint32_t i = 0; i < frames; ++i) {
+        for (uint32_t ch = 0; ch < channels; ++ch) {
+            double y = biquad(s_shelf48k, ref->state[ch], pcm[i * channels + ch]);
+            double z = biquad(s_highPass48k, ref->state[ch] + 2, y);
+            ref->stepSum += z * z;
+        }
+        if (++ref->stepFill < 4800) continue;
+        ref->steps[ref->stepCount++ & 3] = ref->stepSum;
+        ref->stepSum = 0.0;
+        ref->stepFill = 0;
+        if (ref->stepCount < 4) continue;
+        if (ref->blockCount == ref->blockCapacity) {
+            ref->blockCapacity = ref->blockCapacity ? ref->blockCapacity * 2 : 1024;
+            ref->blocks = (double*)realloc(ref->blocks, ref->blockCapacity * sizeof(double));
+        }
+        ref->blocks[ref->blockCount++] = (ref->steps[0] + ref->steps[1] + ref->steps[2] + ref->steps[3]) / 19200.0;
+    }
+}
+
+static double referenceLoudness(const ReferenceMeter *ref) {
+    double gates[2] = { -70.0, 0.0 };
+    double energy = 0.0;
+    for (int pass = 0; pass < 2; ++pass) {
+        uint32_t kept = 0;
+        energy = 0.0;
+        for (uint32_t b = 0; b < ref->blockCount; ++b) {
+            double lufs = -0.691 + 10.0 * log10(ref->blocks[b]);
+            if (lufs > gates[0] && (pass == 0 || lufs > gates[1])) {
+                energy += ref->blocks[b];
+                kept++;
+            }
+        }
+        if (kept == 0) return LOUDNESS_GATE;
+        energy /= kept;
+        gates[1] = -0.691 + 10.0 * log10(energy) - 10.0;
+    }
+    return -0.691 + 10.0 * log10(energy);
+}
+
+static int checkLoudnessMeter(void) {
+    static LoudnessMeter meter;
+    int failures = 0;
+
+    // Coefficients derived at 48 kHz against the published ones
+    loudnessMeterInit(&meter, 48000, 2);
+    const float derived[2][5] = {
+        { meter.shelf.b0, meter.shelf.b1, meter.shelf.b2, meter.shelf.a1, meter.shelf.a2 },
+        { meter.highPass.b0, meter.highPass.b1, meter.highPass.b2, meter.highPass.a1, meter.highPass.a2 },
+    };
+    double worst = 0.0;
+    for (int k = 0; k < 5; ++k) {
+        worst = fmax(worst, fabs(derived[0][k] - s_shelf48k[k]));
+        worst = fmax(worst, fabs(derived[1][k] - s_highPass48k[k]));
+    }
+    printf("K-weighting at 48 kHz: largest coefficient difference from BS.1770 %.2e\n", worst);
+    if (worst > 1e-6) failures++;
+
+    printf("integrated loudness, EBU Tech 3341 (want within 0.1 LU)\n");
+    static const uint32_t rates[] = { 48000, 44100 };
+    for (size_t i = 0; i < sizeof(s_toneCases) / sizeof(s_toneCases[0]); ++i) {
+        const ToneCase *c = &s_toneCases[i];
+        printf("  %-22s want %6.1f:", c->name, c->want);
+        for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r) {
+            LoudnessResult result;
+            meterTone(&meter, c, rates[r], &result);
+            bool pass = fabs(result.integrated - c->want) <= 0.1;
+            printf("  %u Hz %7.2f%s", rates[r], result.integrated, pass ? "" : " FAIL");
+            if (!pass) failures++;
+        }
+        printf("\n");
+    }
+
+    printf("true peak at -6.02 dBTP (want +0.2 / -0.4 dB)\n");
+    static float pcm[LOUDNESS_GEN_FRAMES * 2];
+    for (size_t i = 0; i < sizeof(s_peakCases) / sizeof(s_peakCases[0]); ++i) {
+        const PeakCase *c = &s_peakCases[i];
+        loudnessMeterInit(&meter, 48000, 2);
+        for (uint32_t n = 0; n < LOUDNESS_GEN_FRAMES; ++n) {
+            double fade = n < 960 ? 0.5 - 0.5 * cos(M_PI * n / 960.0) : 1.0;
+            float v = (float)(0.5 * fade * sin(2.0 * M_PI * c->cyclesPerSample * n + c->phaseDegrees * M_PI / 180.0));
+            pcm[n * 2] = pcm[n * 2 + 1] = v;
+        }
+        loudnessMeterAdd(&meter, pcm, LOUDNESS_GEN_FRAMES);
+        LoudnessResult result;
+        loudnessMeterResult(&meter, &result);
+        double truePeak = 20.0 * log10(result.truePeak), samplePeak = 20.0 * log10(result.samplePeak);
+        double error = truePeak - 20.0 * log10(0.5);
+        bool pass = error <= 0.2 && error >= -0.4;
+        printf("  %7.1f Hz, %5.1f deg: true peak %6.2f dBTP, sample peak %6.2f dBFS%s\n",
+               c->cyclesPerSample * 48000.0, c->phaseDegrees, truePeak, samplePeak, pass ? "" : "  FAIL");
+        if (!pass) failures++;
+    }
+
+    // The float meter with its histogram against the exact reference
+    printf("histogram gating against exact gating, 48 kHz noise programmes (want within 0.05 LU)\n");
+    double worstError = 0.0;
+    for (uint32_t seed = 1; seed <= 8; ++seed) {
+        ReferenceMeter ref;
+        memset(&ref, 0, sizeof(ref));
+        loudnessMeterInit(&meter, 48000, 2);
+        uint32_t state = seed, left = 0;
+        float level = 0.0f;
+        for (uint32_t chunk = 0; chunk < 48000 * 120 / LOUDNESS_GEN_FRAMES; ++chunk) {
+            synthProgramme(pcm, LOUDNESS_GEN_FRAMES, &state, &left, &level);
+            loudnessMeterAdd(&meter, pcm, LOUDNESS_GEN_FRAMES);
+            referenceAdd(&ref, pcm, LOUDNESS_GEN_FRAMES, 2);
+        }
+        LoudnessResult result;
+        loudnessMeterResult(&meter, &result);
+        double want = referenceLoudness(&ref);
+        worstError = fmax(worstError, fabs(result.integrated - want));
+        free(ref.blocks);
+    }
+    printf("  8 programmes of 120 s: largest difference %.4f LU\n", worstError);
+    if (worstError > 0.05) failures++;
+    return failures;
+}
+
+int main(void) {
+    return checkReport("loudness", checkLoudnessMeter());
+}
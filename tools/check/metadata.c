@@ -0,0 +1,431 @@
+// Checks metadataRead() against files built with known answers. Ogg files,
+// page by page: a comment packet that runs over several pages, pages of a
+// second multiplexed stream between the first stream's, Opus pre-skip, and a
+// last page on which no packet ends (granule -1); tags, sample rate and
+// duration must all be the first stream's. MP3s, frame by frame: timed from
+// a Xing header with and without LAME's delay and padding, from VBRI, from
+// the size of a CBR stream behind an ID3v2 tag, and by walking a VBR stream
+// that has no header. Files named for the wrong container must still be
+// read by their own reader, and a FLAC file behind an ID3v2 tag too long
+// for the first read is taken to be FLAC only if it is named so.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "metadata.h"
+
+#define CHECK_FILE_MAX     16384
+#define OGG_MAIN_SERIAL    0x4F474731
+#define OGG_OTHER_SERIAL   0x4F474732
+#define OGG_NO_GRANULE     UINT64_MAX // No packet ends on the page
+#define OGG_FLAG_CONTINUED 0x01
+#define OGG_FLAG_FIRST     0x02
+#define OGG_FLAG_LAST      0x04
+#define OGG_PAD_LEN        2500 // A comment long enough to push the tags after it onto later pages
+#define MPEG_SIDE_INFO     32   // MPEG-1 stereo; the Xing header follows it, VBRI is always 32 bytes in
+#define MPEG_SIDE_INFO_M2  9    // MPEG-2 mono
+#define ID3_LONG_PADDING   6000 // Pushes what follows the tag past the first read
+
+typedef struct {
+    uint8_t data[CHECK_FILE_MAX];
+    size_t len;
+} ByteWriter;
+
+typedef struct {
+    const char *label;
+    TrackFormat format;   // The container found, whatever the file is named
+    const char *title;
+    const char *artist;
+    const char *album;
+    uint32_t trackNumber;
+    uint32_t durationMs;
+    uint32_t sampleRate;
+} ReaderExpected;
+
+// --- Test Files ---
+
+static void putBytes(ByteWriter *w, const void *data, size_t len) {
+    memcpy(w->data + w->len, data, len);
+    w->len += len;
+}
+
+// `bytes` may run past the value's 8, as zeros, to pad a field.
+static void putLe(ByteWriter *w, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) w->data[w->len++] = i < 8 ? (uint8_t)(value >> (8 * i)) : 0;
+}
+
+static void putComment(ByteWriter *w, const char *comment) {
+    putLe(w, strlen(comment), 4);
+    putBytes(w, comment, strlen(comment));
+}
+
+// One page. The CRC is left zero; the reader doesn't check it.
+static void putPage(ByteWriter *file, uint32_t serial, uint8_t flags, uint64_t granule, const uint8_t *lacing,
+                    uint32_t numSegments, const uint8_t *body, size_t bodyLen) {
+    putBytes(file, "OggS", 4);
+    putLe(file, 0, 1);
+    putLe(file, flags, 1);
+    putLe(file, granule, 8);
+    putLe(file, serial, 4);
+    putLe(file, 0, 8); // Sequence number, CRC
+    putLe(file, numSegments, 1);
+    putBytes(file, lacing, numSegments);
+    putBytes(file, body, bodyLen);
+}
+
+// Lays `packet` out over pages of at most `pageSegments` segments; only the
+// page it ends on carries `granule`. A nonzero `otherSerial` puts a page of
+// that stream between each two pages of this one.
+static void putPacket(ByteWriter *file, uint32_t serial, uint8_t flags, uint64_t granule, const ByteWriter *packet,
+                      uint32_t pageSegments, uint32_t otherSerial) {
+    uint32_t numSegments = (uint32_t)(packet->len / 255) + 1; // The last is short, even if empty
+    size_t offset = 0;
+    for (uint32_t segment = 0; segment < numSegments;) {
+        uint8_t lacing[255];
+        uint32_t n = numSegments - segment < pageSegments ? numSegments - segment : pageSegments;
+        size_t bodyLen = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            lacing[i] = segment + i + 1 < numSegments ? 255 : (uint8_t)(packet->len % 255);
+            bodyLen += lacing[i];
+        }
+        bool ends = segment + n == numSegments;
+        uint8_t pageFlags = (uint8_t)(segment > 0 ? OGG_FLAG_CONTINUED : flags);
+        putPage(file, serial, pageFlags, ends ? granule : OGG_NO_GRANULE, lacing, n, packet->data + offset, bodyLen);
+        offset += bodyLen;
+        segment += n;
+        if (!ends && otherSerial) {
+            static const uint8_t filler[16] = { 0 };
+            uint8_t fillerLacing = sizeof(filler);
+            putPage(file, otherSerial, 0, 8000, &fillerLacing, 1, filler, sizeof(filler));
+        }
+    }
+}
+
+static void vorbisIdent(ByteWriter *w, uint32_t sampleRate) {
+    w->len = 0;
+    putBytes(w, "\x01vorbis", 7);
+    putLe(w, 0, 4);          // Version
+    putLe(w, 2, 1);          // Channels
+    putLe(w, sampleRate, 4);
+    putLe(w, 0, 12);         // Bitrates
+    putLe(w, 0xB8, 1);       // Block sizes
+    putLe(w, 1, 1);          // Framing
+}
+
+// The comment packet's fields after the codec's magic. The tags straddle
+// page boundaries when the packet is laid out a few segments per page.
+static void putTags(ByteWriter *w, const char *title, const char *artist, const char *album, const char *track) {
+    static char pad[OGG_PAD_LEN + 1];
+    memcpy(pad, "DESCRIPTION=", 12);
+    memset(pad + 12, 'x', OGG_PAD_LEN - 12);
+    putComment(w, "pear check");  // Vendor
+    putLe(w, 5, 4);
+    putComment(w, title);
+    putComment(w, pad);
+    putComment(w, artist);
+    putComment(w, album);
+    putComment(w, track);
+}
+
+static bool writeFile(const char *path, const ByteWriter *w) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(w->data, 1, w->len, f) == w->len;
+    return fclose(f) == 0 && ok;
+}
+
+// --- Reading ---
+
+static bool sameText(const StrArena *strings, uint32_t ref, const char *expected) {
+    const char *s = strArenaGet(strings, ref);
+    return expected ? s && strcmp(s, expected) == 0 : ref == STRARENA_NONE;
+}
+
+static const char *const s_formatNames[] = { "other", "mp3", "ogg", "wav", "flac", "m4a" };
+
+// Reads `path` as if its name said `guess`.
+static int expectRead(const char *path, uint64_t fileSize, TrackFormat guess, const ReaderExpected *want) {
+    StrArena strings;
+    strArenaInit(&strings);
+    TrackMetadata meta;
+    bool read = metadataRead(path, guess, fileSize, &strings, &meta, NULL);
+    bool tags = read && meta.format == want->format && sameText(&strings, meta.title, want->title) &&
+                sameText(&strings, meta.artist, want->artist) && sameText(&strings, meta.album, want->album) &&
+                meta.trackNumber == want->trackNumber;
+    bool timing = read && meta.durationMs == want->durationMs && meta.sampleRate == want->sampleRate;
+    char label[64];
+    if (guess == want->format) snprintf(label, sizeof(label), "%s", want->label);
+    else snprintf(label, sizeof(label), "%s, named .%s", want->label, s_formatNames[guess]);
+    printf("  %-48s %u ms at %u Hz, track %u  %s\n", label, meta.durationMs, meta.sampleRate, meta.trackNumber,
+           !tags ? "wrong tags" : (!timing ? "wrong timing" : "ok"));
+    strArenaFree(&strings);
+    return tags && timing ? 0 : 1;
+}
+
+// --- Ogg ---
+
+// Vorbis at 44.1 kHz multiplexed with a second stream at 8 kHz whose pages
+// come between the first's and outlast it. The comment packet spans four
+// pages, and the first stream's last page ends no packet.
+static int checkVorbis(const char *path, TrackFormat guess) {
+    static ByteWriter file, packet;
+    file.len = 0;
+    vorbisIdent(&packet, 44100);
+    putPacket(&file, OGG_MAIN_SERIAL, OGG_FLAG_FIRST, 0, &packet, 255, 0);
+    vorbisIdent(&packet, 8000);
+    putPacket(&file, OGG_OTHER_SERIAL, OGG_FLAG_FIRST, 0, &packet, 255, 0);
+
+    packet.len = 0;
+    putBytes(&packet, "\x03vorbis", 7);
+    putTags(&packet, "TITLE=Interleaved", "ARTIST=Main Stream", "album=Ogg Pages", "TRACKNUMBER=3/9");
+    putLe(&packet, 1, 1); // Framing
+    putPacket(&file, OGG_MAIN_SERIAL, 0, 0, &packet, 3, OGG_OTHER_SERIAL);
+
+    // Setup header, audio, then the start of a packet the file ends inside
+    packet.len = 300;
+    memset(packet.data, 0x55, packet.len);
+    putPacket(&file, OGG_MAIN_SERIAL, 0, 0, &packet, 255, 0);
+    putPacket(&file, OGG_MAIN_SERIAL, 0, 44100ull * 125, &packet, 255, 0);
+    uint8_t lacing = 255;
+    putPage(&file, OGG_MAIN_SERIAL, OGG_FLAG_LAST, OGG_NO_GRANULE, &lacing, 1, packet.data, 255);
+    putPacket(&file, OGG_OTHER_SERIAL, OGG_FLAG_LAST, 8000ull * 999, &packet, 255, 0);
+
+    static const ReaderExpected want = {
+        "Vorbis, interleaved, cut-off last page", TRACK_FORMAT_OGG, "Interleaved", "Main Stream", "Ogg Pages", 3,
+        125000, 44100,
+    };
+    return writeFile(path, &file) ? expectRead(path, file.len, guess, &want) : 1;
+}
+
+// Opus: granules are 48 kHz samples counting the 312-sample pre-skip; the
+// rate reported is the input rate from OpusHead.
+static int checkOpus(const char *path, TrackFormat guess) {
+    static ByteWriter file, packet;
+    file.len = 0;
+    packet.len = 0;
+    putBytes(&packet, "OpusHead", 8);
+    putLe(&packet, 1, 1);     // Version
+    putLe(&packet, 2, 1);     // Channels
+    putLe(&packet, 312, 2);   // Pre-skip
+    putLe(&packet, 44100, 4); // Input rate
+    putLe(&packet, 0, 3);     // Output gain, mapping family
+    putPacket(&file, OGG_MAIN_SERIAL, OGG_FLAG_FIRST, 0, &packet, 255, 0);
+
+    packet.len = 0;
+    putBytes(&packet, "OpusTags", 8);
+    putTags(&packet, "title=Pre-skip", "Artist=Opus Encoder", "ALBUM=Ogg Pages", "tracknumber=11");
+    putPacket(&file, OGG_MAIN_SERIAL, 0, 0, &packet, 4, 0);
+
+    packet.len = 200;
+    memset(packet.data, 0x55, packet.len);
+    putPacket(&file, OGG_MAIN_SERIAL, 0, 312 + 48000ull * 30, &packet, 255, 0);
+    putPacket(&file, OGG_MAIN_SERIAL, OGG_FLAG_LAST, 312 + 48000ull * 61 + 24000, &packet, 255, 0);
+
+    static const ReaderExpected want = {
+        "Opus, pre-skip trimmed", TRACK_FORMAT_OGG, "Pre-skip", "Opus Encoder", "Ogg Pages", 11, 61500, 44100,
+    };
+    return writeFile(path, &file) ? expectRead(path, file.len, guess, &want) : 1;
+}
+
+// --- MPEG ---
+
+// Frame headers: MPEG-1 layer III 44.1 kHz 128 and 160 kb/s, 48 kHz 128 kb/s
+// (417, 522 and 384 bytes), and MPEG-2 layer III 22.05 kHz 64 kb/s (208
+// bytes), stereo and mono.
+static const uint8_t s_mpeg1At128[4] = { 0xFF, 0xFB, 0x90, 0x00 };
+static const uint8_t s_mpeg1At160[4] = { 0xFF, 0xFB, 0xA0, 0x00 };
+static const uint8_t s_mpeg1At48k[4] = { 0xFF, 0xFB, 0x94, 0x00 };
+static const uint8_t s_mpeg2Stereo[4] = { 0xFF, 0xF3, 0x80, 0x00 };
+static const uint8_t s_mpeg2Mono[4] = { 0xFF, 0xF3, 0x80, 0xC0 };
+
+static void putBe32(ByteWriter *w, uint32_t value) {
+    for (int i = 3; i >= 0; --i) w->data[w->len++] = (uint8_t)(value >> (8 * i));
+}
+
+// `count` frames of `len` bytes, silent after the header.
+static void putFrames(ByteWriter *w, const uint8_t *header, size_t len, int count) {
+    for (int i = 0; i < count; ++i) {
+        putBytes(w, header, 4);
+        memset(w->data + w->len, 0, len - 4);
+        w->len += len - 4;
+    }
+}
+
+static void putTextFrame(ByteWriter *w, const char *id, const char *text) {
+    putBytes(w, id, 4);
+    putBe32(w, (uint32_t)strlen(text) + 1);
+    putLe(w, 0, 3); // Flags, ISO-8859-1
+    putBytes(w, text, strlen(text));
+}
+
+// An ID3v2.3 tag followed by `padding` zero bytes, which the timing must start after.
+static void putId3(ByteWriter *w, const char *title, const char *artist, const char *album, const char *track,
+                   size_t padding) {
+    size_t start = w->len;
+    putBytes(w, "ID3\x03\x00\x00\x00\x00\x00\x00", 10);
+    putTextFrame(w, "TIT2", title);
+    putTextFrame(w, "TPE1", artist);
+    putTextFrame(w, "TALB", album);
+    putTextFrame(w, "TRCK", track);
+    memset(w->data + w->len, 0, padding);
+    w->len += padding;
+    uint32_t body = (uint32_t)(w->len - start - 10);
+    for (int i = 0; i < 4; ++i) w->data[start + 6 + (size_t)i] = (uint8_t)((body >> (7 * (3 - i))) & 0x7F);
+}
+
+// A first frame carrying a Xing (or "Info") header, all fields present when
+// `lame` is set, followed by LAME's extension with `delay` and `padding`.
+static void putXingFrame(ByteWriter *w, const uint8_t *header, size_t len, size_t sideInfo, const char *magic,
+                         uint32_t frames, bool lame, uint32_t delay, uint32_t padding) {
+    size_t start = w->len;
+    putFrames(w, header, len, 1);
+    w->len = start + 4 + sideInfo;
+    putBytes(w, magic, 4);
+    putBe32(w, lame ? 0x0F : 0x01); // Frames, then bytes, TOC and quality if LAME
+    putBe32(w, frames);
+    if (lame) {
+        putBe32(w, frames * (uint32_t)len);
+        w->len += 100 + 4; // TOC, quality
+        putBytes(w, "LAME3.100", 9);
+        w->len += 12;
+        putLe(w, delay >> 4, 1);
+        putLe(w, ((delay & 0x0F) << 4) | (padding >> 8), 1);
+        putLe(w, padding & 0xFF, 1);
+    }
+    w->len = start + len;
+}
+
+// Xing with LAME's extension: 1000 frames of 1152 samples less 576 + 1000
+// samples of delay and padding.
+static int checkXing(const char *path, TrackFormat guess) {
+    static ByteWriter w;
+    w.len = 0;
+    putXingFrame(&w, s_mpeg1At128, 417, MPEG_SIDE_INFO, "Xing", 1000, true, 576, 1000);
+    putFrames(&w, s_mpeg1At128, 417, 4);
+    static const ReaderExpected want = {
+        "MP3, Xing with LAME delay and padding", TRACK_FORMAT_MP3, NULL, NULL, NULL, 0, 26086, 44100,
+    };
+    return writeFile(path, &w) ? expectRead(path, w.len, guess, &want) : 1;
+}
+
+// "Info" without the extension after MPEG-2 mono's shorter side info: 500
+// frames of 576 samples, untrimmed.
+static int checkInfo(const char *path, TrackFormat guess) {
+    static ByteWriter w;
+    w.len = 0;
+    putXingFrame(&w, s_mpeg2Mono, 208, MPEG_SIDE_INFO_M2, "Info", 500, false, 0, 0);
+    putFrames(&w, s_mpeg2Mono, 208, 4);
+    static const ReaderExpected want = {
+        "MP3, MPEG-2 mono Info, no LAME tag", TRACK_FORMAT_MP3, NULL, NULL, NULL, 0, 13061, 22050,
+    };
+    return writeFile(path, &w) ? expectRead(path, w.len, guess, &want) : 1;
+}
+
+// VBRI, 32 bytes after the header: 2000 frames at 48 kHz.
+static int checkVbri(const char *path, TrackFormat guess) {
+    static ByteWriter w;
+    w.len = 0;
+    putFrames(&w, s_mpeg1At48k, 384, 1);
+    w.len = 4 + MPEG_SIDE_INFO;
+    putBytes(&w, "VBRI", 4);
+    w.len += 10; // Version, delay, quality, bytes
+    putBe32(&w, 2000);
+    w.len = 384;
+    putFrames(&w, s_mpeg1At48k, 384, 4);
+    static const ReaderExpected want = {
+        "MP3, VBRI", TRACK_FORMAT_MP3, NULL, NULL, NULL, 0, 48000, 48000,
+    };
+    return writeFile(path, &w) ? expectRead(path, w.len, guess, &want) : 1;
+}
+
+// No VBR header and frames of one bitrate behind an ID3v2 tag: timed from
+// the audio's size, 50 frames of 208 bytes at 64 kb/s.
+static int checkCbr(const char *path, TrackFormat guess) {
+    static ByteWriter w;
+    w.len = 0;
+    putId3(&w, "Constant", "Fixed Rate", "Frames", "4/10", 0);
+    putFrames(&w, s_mpeg2Stereo, 208, 50);
+    static const ReaderExpected want = {
+        "MP3, CBR after an ID3v2 tag", TRACK_FORMAT_MP3, "Constant", "Fixed Rate", "Frames", 4, 1300, 22050,
+    };
+    return writeFile(path, &w) ? expectRead(path, w.len, guess, &want) : 1;
+}
+
+// No VBR header and two bitrates: every frame is walked, 20 of 1152 samples.
+static int checkWalk(const char *path, TrackFormat guess) {
+    static ByteWriter w;
+    w.len = 0;
+    for (int i = 0; i < 10; ++i) {
+        putFrames(&w, s_mpeg1At128, 417, 1);
+        putFrames(&w, s_mpeg1At160, 522, 1);
+    }
+    static const ReaderExpected want = {
+        "MP3, VBR without a header, walked", TRACK_FORMAT_MP3, NULL, NULL, NULL, 0, 522, 44100,
+    };
+    return writeFile(path, &w) ? expectRead(path, w.len, guess, &want) : 1;
+}
+
+// --- FLAC ---
+
+// STREAMINFO for 90 s at 44.1 kHz and a VORBIS_COMMENT, after an ID3v2 tag
+// `id3Padding` bytes longer than its frames if `id3Padding` is nonzero. The
+// tags are the Vorbis comments'; the ID3v2 tag's text is not read.
+static int checkFlac(const char *path, TrackFormat guess, size_t id3Padding) {
+    static ByteWriter w;
+    w.len = 0;
+    if (id3Padding) putId3(&w, "Tag Title", "Tag Artist", "Tag Album", "1", id3Padding);
+    putBytes(&w, "fLaC", 4);
+    putBe32(&w, 34);                   // STREAMINFO, its length
+    putBe32(&w, (4096u << 16) | 4096); // Block sizes
+    putLe(&w, 0, 6);                   // Frame sizes
+    putBe32(&w, (44100u << 12) | (1u << 9) | (15u << 4)); // Rate, channels - 1, bits - 1, top bits of the count
+    putBe32(&w, 44100u * 90);          // Samples
+    putLe(&w, 0, 16);                  // MD5
+    size_t comments = w.len;
+    putBe32(&w, 0);
+    putComment(&w, "pear check");
+    putLe(&w, 4, 4);
+    putComment(&w, "TITLE=Native");
+    putComment(&w, "ARTIST=Free Lossless");
+    putComment(&w, "ALBUM=Blocks");
+    putComment(&w, "TRACKNUMBER=6");
+    uint32_t length = (uint32_t)(w.len - comments - 4);
+    w.data[comments] = 0x84; // Last block, VORBIS_COMMENT
+    for (int i = 1; i < 4; ++i) w.data[comments + (size_t)i] = (uint8_t)(length >> (8 * (3 - i)));
+
+    const char *label = !id3Padding ? "FLAC" : id3Padding < ID3_LONG_PADDING ? "FLAC after an ID3v2 tag"
+                                                                            : "FLAC after a long ID3v2 tag";
+    ReaderExpected want = { label, TRACK_FORMAT_FLAC, "Native", "Free Lossless", "Blocks", 6, 90000, 44100 };
+    return writeFile(path, &w) ? expectRead(path, w.len, guess, &want) : 1;
+}
+
+int main(void) {
+    char path[] = "/tmp/pearmetaXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    printf("Ogg, MP3 and FLAC tags and timing against files with known answers\n");
+    int failures = checkVorbis(path, TRACK_FORMAT_OGG);
+    failures += checkOpus(path, TRACK_FORMAT_OGG);
+    failures += checkXing(path, TRACK_FORMAT_MP3);
+    failures += checkInfo(path, TRACK_FORMAT_MP3);
+    failures += checkVbri(path, TRACK_FORMAT_MP3);
+    failures += checkCbr(path, TRACK_FORMAT_MP3);
+    failures += checkWalk(path, TRACK_FORMAT_MP3);
+    failures += checkFlac(path, TRACK_FORMAT_FLAC, 0);
+    failures += checkFlac(path, TRACK_FORMAT_MP3, 64);
+    failures += checkFlac(path, TRACK_FORMAT_FLAC, ID3_LONG_PADDING);
+
+    // Named for the wrong container
+    failures += checkOpus(path, TRACK_FORMAT_MP3);
+    failures += checkCbr(path, TRACK_FORMAT_M4A);
+    failures += checkFlac(path, TRACK_FORMAT_OGG, 0);
+    remove(path);
+    return checkReport("metadata", failures);
+}
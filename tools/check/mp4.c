@@ -0,0 +1,297 @@
+// Checks mp4Read() against files built atom by atom with known answers: moov
+// before mdat (faststart), moov after an mdat too large for a 32-bit size,
+// the iTunes and QuickTime forms of meta, and durations from the sound
+// track's mdhd or, without one, from mvhd. The atoms the walk steps over,
+// mdat above all, must not be read.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "metadata.h"
+
+#define MP4_CHECK_DEPTH  8
+#define MP4_LARGE_MDAT   (5ull * 1024 * 1024 * 1024) // Sparse, so it costs no disk space
+#define MP4_MAX_READS    2                           // The sniff, then moov if it is past the first window
+
+typedef struct {
+    uint8_t data[4096];
+    size_t len;
+    size_t open[MP4_CHECK_DEPTH]; // Offsets of the atoms still being written
+    int depth;
+} AtomWriter;
+
+typedef struct {
+    const char *label;
+    const char *title;
+    const char *artist;
+    const char *album;
+    uint32_t trackNumber;
+    uint32_t durationMs;
+    uint32_t sampleRate;
+} Mp4Expected;
+
+// --- Test Files ---
+
+static void putBe32(AtomWriter *w, uint32_t value) {
+    for (int i = 3; i >= 0; --i) w->data[w->len++] = (uint8_t)(value >> (8 * i));
+}
+
+static void putBe64(AtomWriter *w, uint64_t value) {
+    putBe32(w, (uint32_t)(value >> 32));
+    putBe32(w, (uint32_t)value);
+}
+
+static void putZeros(AtomWriter *w, size_t n) {
+    memset(w->data + w->len, 0, n);
+    w->len += n;
+}
+
+static void beginAtom(AtomWriter *w, const char *type) {
+    w->open[w->depth++] = w->len;
+    putBe32(w, 0); // Size, filled in by endAtom()
+    memcpy(w->data + w->len, type, 4);
+    w->len += 4;
+}
+
+static void endAtom(AtomWriter *w) {
+    size_t start = w->open[--w->depth];
+    uint32_t size = (uint32_t)(w->len - start);
+    for (int i = 0; i < 4; ++i) w->data[start + (size_t)i] = (uint8_t)(size >> (8 * (3 - i)));
+}
+
+static void putFtyp(AtomWriter *w) {
+    beginAtom(w, "ftyp");
+    memcpy(w->data + w->len, "M4A \0\0\0\0M4A mp42isom", 20);
+    w->len += 20;
+    endAtom(w);
+}
+
+// mvhd or mdhd: version 1 has 64-bit times. mvhd's rate, volume and matrix
+// follow; they are zeros here.
+static void putTimes(AtomWriter *w, const char *type, int version, uint32_t timescale, uint64_t duration) {
+    beginAtom(w, type);
+    putBe32(w, (uint32_t)version << 24);
+    putZeros(w, version == 1 ? 16 : 8); // Creation and modification times
+    putBe32(w, timescale);
+    if (version == 1) putBe64(w, duration);
+    else putBe32(w, (uint32_t)duration);
+    putZeros(w, strcmp(type, "mvhd") == 0 ? 80 : 4);
+    endAtom(w);
+}
+
+static void putHandler(AtomWriter *w, const char *handler) {
+    beginAtom(w, "hdlr");
+    putZeros(w, 8); // Version/flags, pre-defined
+    memcpy(w->data + w->len, handler, 4);
+    w->len += 4;
+    putZeros(w, 13); // Reserved, empty name
+    endAtom(w);
+}
+
+// A sound track. A zero `sampleRate` leaves out the sample description.
+static void putSoundTrack(AtomWriter *w, int version, uint32_t timescale, uint64_t duration, uint32_t sampleRate) {
+    beginAtom(w, "trak");
+    beginAtom(w, "mdia");
+    putTimes(w, "mdhd", version, timescale, duration);
+    putHandler(w, "soun");
+    beginAtom(w, "minf");
+    beginAtom(w, "stbl");
+    if (sampleRate) {
+        beginAtom(w, "stsd");
+        putBe32(w, 0);
+        putBe32(w, 1); // Entry count
+        beginAtom(w, "mp4a");
+        putZeros(w, 6);
+        putBe32(w, 1 << 16); // Data reference index, then the version
+        putZeros(w, 6);
+        putBe32(w, (2u << 16) | 16); // Channels, sample size
+        putZeros(w, 4);
+        putBe32(w, sampleRate << 16);
+        endAtom(w);
+        endAtom(w);
+    }
+    beginAtom(w, "stco");
+    putZeros(w, 8);
+    endAtom(w);
+    endAtom(w);
+    endAtom(w);
+    endAtom(w);
+    endAtom(w);
+}
+
+static void putTextItem(AtomWriter *w, const char *type, const char *text) {
+    beginAtom(w, type);
+    beginAtom(w, "data");
+    putBe32(w, 1); // UTF-8
+    putBe32(w, 0); // Locale
+    memcpy(w->data + w->len, text, strlen(text));
+    w->len += strlen(text);
+    endAtom(w);
+    endAtom(w);
+}
+
+static void putTrackNumber(AtomWriter *w, uint16_t number, uint16_t total) {
+    beginAtom(w, "trkn");
+    beginAtom(w, "data");
+    putBe32(w, 0); // Binary
+    putBe32(w, 0);
+    putBe32(w, number);
+    putBe32(w, (uint32_t)total << 16);
+    endAtom(w);
+    endAtom(w);
+}
+
+// udta/meta/ilst. iTunes writes meta as a full box, QuickTime without the
+// version field, so its hdlr comes first.
+static void beginTags(AtomWriter *w, bool quickTime) {
+    beginAtom(w, "udta");
+    beginAtom(w, "meta");
+    if (!quickTime) putBe32(w, 0);
+    putHandler(w, "mdir");
+    beginAtom(w, "ilst");
+}
+
+static void endTags(AtomWriter *w) {
+    endAtom(w);
+    endAtom(w);
+    endAtom(w);
+}
+
+static bool writeAt(FILE *f, uint64_t offset, const AtomWriter *w) {
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0 && fwrite(w->data, 1, w->len, f) == w->len;
+}
+
+// --- Reading ---
+
+static bool sameText(const StrArena *strings, uint32_t ref, const char *expected) {
+    const char *s = strArenaGet(strings, ref);
+    return expected ? s && strcmp(s, expected) == 0 : ref == STRARENA_NONE;
+}
+
+// Reads `path` as an M4A and compares it with `want`; its reads must be few
+// and small whatever the file's size.
+static int expectMp4(const char *path, uint64_t fileSize, const Mp4Expected *want) {
+    StrArena strings;
+    strArenaInit(&strings);
+    TrackMetadata meta;
+    MetaIoStats io = { 0, 0 };
+    bool read = metadataRead(path, TRACK_FORMAT_M4A, fileSize, &strings, &meta, &io);
+    bool tags = read && sameText(&strings, meta.title, want->title) && sameText(&strings, meta.artist, want->artist) &&
+                sameText(&strings, meta.album, want->album) && meta.trackNumber == want->trackNumber;
+    bool timing = read && meta.durationMs == want->durationMs && meta.sampleRate == want->sampleRate;
+    bool small = io.reads <= MP4_MAX_READS && io.bytesRead <= MP4_MAX_READS * META_WINDOW_SIZE;
+    printf("  %-34s %u ms at %u Hz, track %u, %u reads, %llu bytes  %s\n", want->label, meta.durationMs,
+           meta.sampleRate, meta.trackNumber, io.reads, (unsigned long long)io.bytesRead,
+           !tags ? "wrong tags" : (!timing ? "wrong timing" : (!small ? "read too much" : "ok")));
+    strArenaFree(&strings);
+    return tags && timing && small ? 0 : 1;
+}
+
+// moov first, iTunes meta, a sound track whose mdhd outranks mvhd and whose
+// sample entry's rate outranks the media timescale.
+static int checkFaststart(const char *path) {
+    static AtomWriter w;
+    w.len = 0;
+    putFtyp(&w);
+    beginAtom(&w, "moov");
+    putTimes(&w, "mvhd", 0, 1000, 199000);
+    putSoundTrack(&w, 0, 44100, 44100ull * 200, 48000);
+    beginTags(&w, false);
+    putTextItem(&w, "\xA9nam", "Faststart");
+    putTextItem(&w, "\xA9" "ART", "Track Artist");
+    putTextItem(&w, "\xA9" "alb", "Some Album");
+    putTextItem(&w, "aART", "Album Artist");
+    putTrackNumber(&w, 7, 12);
+    endTags(&w);
+    endAtom(&w);
+    beginAtom(&w, "mdat");
+    putZeros(&w, 1000);
+    endAtom(&w);
+
+    FILE *f = fopen(path, "wb");
+    bool written = f && writeAt(f, 0, &w);
+    if (f && fclose(f) != 0) written = false;
+    static const Mp4Expected want = {
+        "moov before mdat, iTunes meta", "Faststart", "Track Artist", "Some Album", 7, 200000, 48000,
+    };
+    return written ? expectMp4(path, w.len, &want) : 1;
+}
+
+// moov after an mdat with a 64-bit size, QuickTime meta, a version 1 mdhd
+// and no sample description: the rate is the media timescale. The album
+// artist stands in for a missing artist.
+static int checkLargeMdat(const char *path) {
+    static AtomWriter head, moov;
+    head.len = moov.len = 0;
+    putFtyp(&head);
+    uint64_t mdatAt = head.len;
+    putBe32(&head, 1);
+    memcpy(head.data + head.len, "mdat", 4);
+    head.len += 4;
+    putBe64(&head, MP4_LARGE_MDAT);
+
+    beginAtom(&moov, "moov");
+    putTimes(&moov, "mvhd", 0, 1000, 1000);
+    putSoundTrack(&moov, 1, 44100, 44100ull * 3600 * 30, 0);
+    beginTags(&moov, true);
+    putTextItem(&moov, "\xA9nam", "Long Recording");
+    putTextItem(&moov, "aART", "Album Artist");
+    putTrackNumber(&moov, 12, 12);
+    endTags(&moov);
+    endAtom(&moov);
+
+    uint64_t moovAt = mdatAt + MP4_LARGE_MDAT;
+    FILE *f = fopen(path, "wb");
+    bool written = f && writeAt(f, 0, &head) && writeAt(f, moovAt, &moov);
+    if (f && fclose(f) != 0) written = false;
+    if (!written) {
+        printf("  moov after a 64-bit mdat: skipped, cannot make a %llu-byte file\n",
+               (unsigned long long)(moovAt + moov.len));
+        return 0;
+    }
+    static const Mp4Expected want = {
+        "moov after a 64-bit mdat, QT meta", "Long Recording", "Album Artist", NULL, 12, 108000000, 44100,
+    };
+    return expectMp4(path, moovAt + moov.len, &want);
+}
+
+// No track at all: the duration is mvhd's, the rate unknown.
+static int checkMovieOnly(const char *path) {
+    static AtomWriter w;
+    w.len = 0;
+    putFtyp(&w);
+    beginAtom(&w, "mdat");
+    putZeros(&w, 100);
+    endAtom(&w);
+    beginAtom(&w, "moov");
+    putTimes(&w, "mvhd", 0, 600, 600 * 61);
+    beginTags(&w, false);
+    putTextItem(&w, "\xA9nam", "Movie Header Only");
+    endTags(&w);
+    endAtom(&w);
+
+    FILE *f = fopen(path, "wb");
+    bool written = f && writeAt(f, 0, &w);
+    if (f && fclose(f) != 0) written = false;
+    static const Mp4Expected want = { "no track, mvhd only", "Movie Header Only", NULL, NULL, 0, 61000, 0 };
+    return written ? expectMp4(path, w.len, &want) : 1;
+}
+
+int main(void) {
+    char path[] = "/tmp/pearmp4XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    printf("M4A tags and timing against files with known answers\n");
+    int failures = checkFaststart(path);
+    failures += checkLargeMdat(path);
+    failures += checkMovieOnly(path);
+    remove(path);
+    return checkReport("mp4", failures);
+}
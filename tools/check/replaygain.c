@@ -0,0 +1,227 @@
+// Checks ReplayGain and R128 tag parsing, cue sheet REMs and the Q15 gain
+// stage, the latter against a double-precision reference over test signals.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "synth.h"
+#include "replaygain.h"
+#include "cue.h"
+
+// Tag values with known answers, each read into a fresh ReplayGain.
+typedef struct {
+    const char *key;
+    const char *value;
+    bool known;      // replayGainTag() should claim the key
+    ReplayGain want; // trackGain, albumGain, trackPeak, albumPeak afterwards
+} GainTagCase;
+
+#define NO_GAIN REPLAYGAIN_NONE
+
+static const GainTagCase s_gainTags[] = {
+    { "REPLAYGAIN_TRACK_GAIN", "-6.54 dB", true, { -654, NO_GAIN, 0, 0 } },
+    { "replaygain_album_gain", "+2.10 dB", true, { NO_GAIN, 210, 0, 0 } },
+    { "REPLAYGAIN_TRACK_GAIN", " -6,545 dB", true, { -655, NO_GAIN, 0, 0 } }, // Decimal comma, rounded
+    { "REPLAYGAIN_TRACK_GAIN", "-400 dB", true, { -32767, NO_GAIN, 0, 0 } },
+    { "REPLAYGAIN_TRACK_GAIN", "dB", true, { NO_GAIN, NO_GAIN, 0, 0 } },
+    { "REPLAYGAIN_TRACK_PEAK", "0.988525", true, { NO_GAIN, NO_GAIN, 32392, 0 } },
+    { "Replaygain_Album_Peak", "1.203", true, { NO_GAIN, NO_GAIN, 0, 39420 } },
+    { "REPLAYGAIN_TRACK_PEAK", "3.5", true, { NO_GAIN, NO_GAIN, 65535, 0 } },
+    { "REPLAYGAIN_TRACK_PEAK", "0", true, { NO_GAIN, NO_GAIN, 0, 0 } },
+    { "R128_TRACK_GAIN", "-1280", true, { 0, NO_GAIN, 0, 0 } },    // -5 dB from -23 LUFS is -18
+    { "R128_ALBUM_GAIN", "256", true, { NO_GAIN, 600, 0, 0 } },
+    { "R128_TRACK_GAIN", "-2000", true, { -281, NO_GAIN, 0, 0 } }, // -7.8125 dB
+    { "REPLAYGAIN_REFERENCE_LOUDNESS", "89.0 dB", false, { NO_GAIN, NO_GAIN, 0, 0 } },
+    { "REPLAYGAIN_TRACK_GAINS", "-1 dB", false, { NO_GAIN, NO_GAIN, 0, 0 } },
+};
+
+// Multipliers with known answers.
+typedef struct {
+    ReplayGain gain;
+    ReplayGainMode mode;
+    int16_t preamp;
+    bool preventClipping;
+    int32_t want;
+} GainStageCase;
+
+static const GainStageCase s_gainStages[] = {
+    { { -600, NO_GAIN, 0, 0 }, REPLAYGAIN_TRACK, 0, true, 16423 },            // 10^(-6/20)
+    { { -600, NO_GAIN, 0, 0 }, REPLAYGAIN_ALBUM, 0, true, 16423 },            // Falls back to the track gain
+    { { -600, -300, 0, 0 }, REPLAYGAIN_ALBUM, 0, true, 23198 },
+    { { -600, -300, 0, 0 }, REPLAYGAIN_OFF, 0, true, REPLAYGAIN_UNITY },
+    { { NO_GAIN, NO_GAIN, 30000, 0 }, REPLAYGAIN_TRACK, 600, true, REPLAYGAIN_UNITY }, // Untagged
+    { { -600, NO_GAIN, 0, 0 }, REPLAYGAIN_TRACK, 600, true, REPLAYGAIN_UNITY },        // Preamp cancels it
+    { { 1000, NO_GAIN, 32768, 0 }, REPLAYGAIN_TRACK, 0, true, 32767 },  // Peak at full scale: rounds to INT16_MAX
+    { { 1000, NO_GAIN, 32768, 0 }, REPLAYGAIN_TRACK, 0, false, 103622 },
+    { { 1000, NO_GAIN, 0, 16384 }, REPLAYGAIN_TRACK, 0, true, 65534 },  // The album peak stands in
+    { { 1500, NO_GAIN, 0, 0 }, REPLAYGAIN_TRACK, 0, false, REPLAYGAIN_MAX_MULTIPLIER },
+};
+
+// Album gain before the first TRACK, track gain inside one.
+static const char s_gainSheet[] =
+    "REM REPLAYGAIN_ALBUM_GAIN -7.89 dB\n"
+    "REM REPLAYGAIN_ALBUM_PEAK 1.000000\n"
+    "FILE \"album.flac\" WAVE\n"
+    "  TRACK 01 AUDIO\n"
+    "    REM REPLAYGAIN_TRACK_GAIN -8.12 dB\n"
+    "    REM REPLAYGAIN_TRACK_PEAK 0.977000\n"
+    "    INDEX 01 00:00:00\n"
+    "  TRACK 02 AUDIO\n"
+    "    INDEX 01 03:00:00\n";
+
+static bool sameGain(const ReplayGain *a, const ReplayGain *b) {
+    return a->trackGain == b->trackGain && a->albumGain == b->albumGain && a->trackPeak == b->trackPeak &&
+           a->albumPeak == b->albumPeak;
+}
+
+static int checkGainTags(void) {
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(s_gainTags) / sizeof(s_gainTags[0]); ++i) {
+        const GainTagCase *c = &s_gainTags[i];
+        ReplayGain gain;
+        replayGainInit(&gain);
+        bool known = replayGainTag(&gain, (const uint8_t*)c->key, (uint32_t)strlen(c->key),
+                                   (const uint8_t*)c->value, (uint32_t)strlen(c->value));
+        if (known != c->known || !sameGain(&gain, &c->want)) {
+            printf("  %s=%s: got %d %d %u %u\n", c->key, c->value, gain.trackGain, gain.albumGain, gain.trackPeak,
+                   gain.albumPeak);
+            failures++;
+        }
+    }
+    // The first value read stays
+    ReplayGain gain;
+    replayGainInit(&gain);
+    replayGainTag(&gain, (const uint8_t*)"REPLAYGAIN_TRACK_GAIN", 21, (const uint8_t*)"-3 dB", 5);
+    replayGainTag(&gain, (const uint8_t*)"R128_TRACK_GAIN", 15, (const uint8_t*)"-512", 4);
+    if (gain.trackGain != -300) {
+        printf("  second track gain replaced the first: %d\n", gain.trackGain);
+        failures++;
+    }
+
+    static CueSheet sheet;
+    StrArena strings;
+    strArenaInit(&strings);
+    ReplayGain album = { NO_GAIN, -789, 0, 32768 };
+    ReplayGain first = { -812, NO_GAIN, 32014, 0 };
+    ReplayGain second = { NO_GAIN, NO_GAIN, 0, 0 };
+    if (!cueParse(s_gainSheet, sizeof(s_gainSheet) - 1, &strings, &sheet) || sheet.count != 2 ||
+        !sameGain(&sheet.gain, &album) || !sameGain(&sheet.tracks[0].gain, &first) ||
+        !sameGain(&sheet.tracks[1].gain, &second)) {
+        printf("  cue sheet REMs read wrongly\n");
+        failures++;
+    }
+    strArenaFree(&strings);
+
+    for (size_t i = 0; i < sizeof(s_gainStages) / sizeof(s_gainStages[0]); ++i) {
+        const GainStageCase *c = &s_gainStages[i];
+        int32_t got = replayGainMultiplier(&c->gain, c->mode, c->preamp, c->preventClipping);
+        if (got != c->want) {
+            printf("  multiplier case %zu: got %d, want %d\n", i, got, c->want);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+#define GAIN_SIGNAL_SAMPLES (16 * 1024)
+
+typedef enum {
+    GAIN_SIGNAL_SINE,  // -3 dBFS, 997 Hz at 44.1 kHz
+    GAIN_SIGNAL_NOISE, // Full-range white noise
+    GAIN_SIGNAL_EDGES, // Square wave between -32768 and +32767
+    GAIN_SIGNAL_COUNT
+} GainSignal;
+
+static const char *const s_gainSignalNames[] = { "sine", "noise", "edges" };
+
+static void fillSignal(int16_t *samples, size_t count, GainSignal signal, uint32_t seed) {
+    for (size_t i = 0; i < count; ++i) {
+        if (signal == GAIN_SIGNAL_SINE) {
+            samples[i] = (int16_t)lrint(23197.0 * sin(2 * M_PI * 997.0 * (double)i / 44100.0));
+        } else if (signal == GAIN_SIGNAL_NOISE) {
+            samples[i] = (int16_t)(synthRandom(&seed) & 0xFFFF);
+        } else {
+            samples[i] = (i / 50) & 1 ? INT16_MIN : INT16_MAX;
+        }
+    }
+}
+
+// The float reference the gain stage is held to, in double precision:
+// x * 10^(dB/20), limited so the peak scales to at most INT16_MAX + 0.5
+// (what still rounds to INT16_MAX), rounded to nearest and saturated.
+static int16_t referenceSample(int16_t x, double scale) {
+    double y = nearbyint(x * scale);
+    return (int16_t)(y > INT16_MAX ? INT16_MAX : y < INT16_MIN ? INT16_MIN : y);
+}
+
+static double referenceScale(int16_t db, uint16_t peak, bool preventClipping) {
+    double scale = pow(10.0, db / 2000.0);
+    double cap = (double)REPLAYGAIN_MAX_MULTIPLIER / REPLAYGAIN_UNITY;
+    if (scale > cap) scale = cap;
+    if (preventClipping && peak > 0 && scale * peak > INT16_MAX + 0.5) scale = (INT16_MAX + 0.5) / peak;
+    return scale;
+}
+
+// Largest magnitude in `samples`, in Q15: what a tagger writes as the peak.
+static uint16_t signalPeak(const int16_t *samples, size_t count) {
+    uint32_t peak = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t m = (uint32_t)(samples[i] < 0 ? -(int32_t)samples[i] : samples[i]);
+        if (m > peak) peak = m;
+    }
+    return (uint16_t)peak;
+}
+
+// Runs the gain stage over each signal at gains from -24 to +12 dB, with
+// and without clipping prevention, against the float reference. With the
+// signal's own peak tagged, clipping prevention must leave nothing to
+// saturate.
+static int checkGainStage(void) {
+    static int16_t source[GAIN_SIGNAL_SAMPLES], out[GAIN_SIGNAL_SAMPLES];
+    int failures = 0;
+    for (int sig = 0; sig < GAIN_SIGNAL_COUNT; ++sig) {
+        fillSignal(source, GAIN_SIGNAL_SAMPLES, (GainSignal)sig, 777);
+        uint16_t exactPeak = signalPeak(source, GAIN_SIGNAL_SAMPLES);
+        const uint16_t peaks[] = { 0, exactPeak, 16384, 39322 };
+        uint32_t maxError = 0, settings = 0, saturated = 0;
+        uint64_t off = 0, compared = 0;
+        for (int db = -2400; db <= 1200; db += 25) {
+            for (size_t p = 0; p < sizeof(peaks) / sizeof(peaks[0]); ++p) {
+                for (int clip = 0; clip < 2; ++clip) {
+                    ReplayGain gain = { (int16_t)db, NO_GAIN, peaks[p], 0 };
+                    int32_t multiplier = replayGainMultiplier(&gain, REPLAYGAIN_TRACK, 0, clip);
+                    double scale = referenceScale((int16_t)db, peaks[p], clip);
+                    memcpy(out, source, sizeof(out));
+                    replayGainApply(out, GAIN_SIGNAL_SAMPLES, multiplier);
+                    for (size_t i = 0; i < GAIN_SIGNAL_SAMPLES; ++i) {
+                        int32_t error = out[i] - referenceSample(source[i], scale);
+                        uint32_t e = (uint32_t)(error < 0 ? -error : error);
+                        if (e > maxError) maxError = e;
+                        if (e) off++;
+                        if (clip && peaks[p] == exactPeak &&
+                            ((int64_t)source[i] * multiplier + (1 << 14)) >> 15 > INT16_MAX) {
+                            saturated++;
+                        }
+                    }
+                    compared += GAIN_SIGNAL_SAMPLES;
+                    settings++;
+                }
+            }
+        }
+        printf("  %-6s %4u settings, %9llu samples: max error %u LSB, %.3f%% off by one, %u saturated "
+               "under their own peak\n", s_gainSignalNames[sig], settings, (unsigned long long)compared,
+               maxError, 100.0 * (double)off / (double)compared, saturated);
+        if (maxError > 1 || saturated > 0) failures++;
+    }
+    return failures;
+}
+
+int main(void) {
+    int failures = checkGainTags();
+    printf("tags and multipliers: %d mismatches\n", failures);
+    printf("gain stage against the float reference\n");
+    failures += checkGainStage();
+    return checkReport("replaygain", failures);
+}
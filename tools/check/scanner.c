@@ -0,0 +1,212 @@
+// Checks the directory journal on a synthetic tree: an unchanged rescan reads
+// no folder, touching one folder re-reads only it, and a file re-tagged in
+// place inside an unchanged folder is found and probed again. It runs twice:
+// trusting folder stamps, and as on the 3DS, reading every unchanged folder's
+// names (SCAN_STATE_VERIFY), which also finds a file added behind a stamp
+// that did not move.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "check.h"
+#include "synth.h"
+#include "fsutil.h"
+#include "scanner.h"
+
+#define JOURNAL_ARTISTS        20
+#define JOURNAL_ALBUMS         25 // Per artist: 500 album folders
+#define JOURNAL_TRACKS         2  // Per album
+#define JOURNAL_FOLDERS        (1 + JOURNAL_ARTISTS + JOURNAL_ARTISTS * JOURNAL_ALBUMS)
+#define JOURNAL_FILES          (JOURNAL_ARTISTS * JOURNAL_ALBUMS * JOURNAL_TRACKS)
+#define JOURNAL_ENTRIES        (JOURNAL_FOLDERS - 1 + JOURNAL_FILES + 2 * JOURNAL_FOLDERS) // "." and ".." included
+#define JOURNAL_FILE_BYTES     4096
+#define JOURNAL_STAMP_STEP     100 // Seconds a changed stamp is moved by, clear of the scan's own second
+
+typedef struct {
+    char root[PATH_MAX];
+    char music[PATH_MAX];
+    char data[PATH_MAX];
+    char index[PATH_MAX];
+    bool trustDirStamp;
+    uint32_t names;  // Entries a scan reading every folder's names reads
+} JournalTree;
+
+static bool appendItem(const CatalogEntry *entry, void *user) {
+    return catalogAppend((Catalog*)user, entry);
+}
+
+static bool buildTree(JournalTree *tree) {
+    snprintf(tree->root, sizeof(tree->root), "/tmp/pearjournalXXXXXX");
+    if (!mkdtemp(tree->root) || !fsJoinPath(tree->music, tree->root, "music") ||
+        !fsJoinPath(tree->data, tree->root, "data") || !fsJoinPath(tree->index, tree->data, "library.idx")) {
+        perror("mkdtemp");
+        return false;
+    }
+    return synthWriteTree(tree->music, JOURNAL_ARTISTS, JOURNAL_ALBUMS, JOURNAL_TRACKS, JOURNAL_FILE_BYTES);
+}
+
+// Moves the modification time of `path` by `seconds` from what it is now.
+static bool shiftStamp(const char *path, int seconds) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    struct timeval times[2] = {
+        { st.st_atime, 0 },
+        { st.st_mtime + seconds, 0 },
+    };
+    return utimes(path, times) == 0;
+}
+
+static bool scan(const JournalTree *tree, Catalog *catalog, ScanStats *stats) {
+    catalogClear(catalog);
+    Scanner scanner;
+    scannerBegin(&scanner, tree->music, tree->data, tree->index, &catalog->strings, appendItem, catalog);
+    scanner.trustDirStamp = tree->trustDirStamp;
+    while (!scannerStep(&scanner, 256, 20000)) {}
+    *stats = scanner.stats;
+    return !scanner.openFailed;
+}
+
+// Rows whose title is `title`.
+static uint32_t countTitle(const Catalog *catalog, const char *title) {
+    uint32_t n = 0;
+    for (uint32_t r = 0; r < catalog->count; ++r) {
+        const char *t = catalogString(catalog, CATALOG_FIELD(catalog, title, r));
+        if (t && strcmp(t, title) == 0) n++;
+    }
+    return n;
+}
+
+typedef struct {
+    uint32_t rows;
+    uint32_t dirsRead;
+    uint32_t dirsSkipped;
+    uint32_t probed;
+    uint32_t filesChanged;
+    uint32_t entries; // Read besides the names every untrusted scan reads
+} ScanExpect;
+
+static int checkScan(const char *label, const JournalTree *tree, Catalog *catalog, const ScanExpect *want) {
+    ScanStats stats;
+    if (!scan(tree, catalog, &stats)) {
+        printf("  %s: cannot scan %s\n", label, tree->music);
+        return 1;
+    }
+    uint32_t entries = want->entries + (tree->trustDirStamp ? 0 : tree->names);
+    printf("  %-26s %5u rows, %3u folders read, %3u replayed, %4u probed, %u changed in place, %4u names\n",
+           label, catalog->count, stats.dirsRead, stats.dirsSkipped, stats.itemsProbed, stats.filesChanged,
+           stats.entriesRead);
+    bool ok = catalog->count == want->rows && stats.dirsRead == want->dirsRead &&
+              stats.dirsSkipped == want->dirsSkipped && stats.itemsProbed == want->probed &&
+              stats.filesChanged == want->filesChanged && stats.entriesRead == entries;
+    if (!ok) {
+        printf("  %s: want %u rows, %u read, %u replayed, %u probed, %u changed in place, %u names\n", label,
+               want->rows, want->dirsRead, want->dirsSkipped, want->probed, want->filesChanged, entries);
+    }
+    return ok ? 0 : 1;
+}
+
+static int checkJournal(JournalTree *tree) {
+    int failures = 0;
+    Catalog catalog;
+    catalogInit(&catalog);
+    printf("journal: %u folders, %u files, %s\n", JOURNAL_FOLDERS, JOURNAL_FILES,
+           tree->trustDirStamp ? "folder stamps trusted" : "folder names verified");
+
+    // A folder that is read has its names read once, whether it is verified first or not
+    ScanExpect cold = { JOURNAL_FILES, JOURNAL_FOLDERS, 0, JOURNAL_FILES, 0, 0 };
+    ScanExpect warm = { JOURNAL_FILES, 0, JOURNAL_FOLDERS, 0, 0, 0 };
+    tree->names = JOURNAL_ENTRIES;
+    if (tree->trustDirStamp) cold.entries = JOURNAL_ENTRIES;
+    failures += checkScan("cold", tree, &catalog, &cold);
+    failures += checkScan("unchanged", tree, &catalog, &warm);
+
+    // A track added to one album: only that folder is read, and only the new file probed
+    char dir[PATH_MAX];
+    if (!synthAlbumPath(dir, tree->music, 7, 13) ||
+        !synthWriteTrack(tree->music, 7, 13, JOURNAL_TRACKS + 1, 1, JOURNAL_FILE_BYTES) ||
+        !shiftStamp(dir, JOURNAL_STAMP_STEP)) {
+        printf("  cannot add a track to %s\n", dir);
+        failures++;
+    }
+    tree->names++;
+    ScanExpect touched = { JOURNAL_FILES + 1, 1, JOURNAL_FOLDERS - 1, 1, 0, tree->trustDirStamp ? 5 : 0 };
+    failures += checkScan("one folder touched", tree, &catalog, &touched);
+    if (countTitle(&catalog, "Take 1 of 07-13-03") != 1) {
+        printf("  the added track is missing\n");
+        failures++;
+    }
+
+    // A track re-tagged in place, same size, in a folder whose stamp is kept
+    char path[PATH_MAX];
+    struct stat before, after;
+    bool rewritten = synthAlbumPath(dir, tree->music, 3, 21) && fsJoinPath(path, dir, "01.mp3") &&
+                     stat(dir, &before) == 0 && synthWriteTrack(tree->music, 3, 21, 1, 2, JOURNAL_FILE_BYTES) &&
+                     shiftStamp(path, JOURNAL_STAMP_STEP);
+    if (rewritten) {
+        struct timeval times[2] = { { before.st_atime, 0 }, { before.st_mtime, 0 } };
+        rewritten = utimes(dir, times) == 0 && stat(dir, &after) == 0 && after.st_mtime == before.st_mtime &&
+                    after.st_size == before.st_size;
+    }
+    if (!rewritten) {
+        printf("  cannot re-tag %s in place\n", path);
+        failures++;
+    }
+    ScanExpect retagged = { JOURNAL_FILES + 1, 1, JOURNAL_FOLDERS - 1, 1, 1, 4 };
+    failures += checkScan("re-tagged in place", tree, &catalog, &retagged);
+    ScanExpect settled = { JOURNAL_FILES + 1, 0, JOURNAL_FOLDERS, 0, 0, 0 };
+    failures += checkScan("unchanged again", tree, &catalog, &settled);
+    if (countTitle(&catalog, "Take 2 of 03-21-01") != 1 || countTitle(&catalog, "Take 1 of 03-21-01") != 0) {
+        printf("  the re-tagged track kept its old title\n");
+        failures++;
+    }
+
+    // A track added behind a folder stamp that did not move, as FAT leaves it:
+    // only verifying the names finds it, reading that one folder again
+    bool added = synthAlbumPath(dir, tree->music, 5, 9) && stat(dir, &before) == 0 &&
+                 synthWriteTrack(tree->music, 5, 9, JOURNAL_TRACKS + 1, 1, JOURNAL_FILE_BYTES);
+    if (added) {
+        struct timeval times[2] = { { before.st_atime, 0 }, { before.st_mtime, 0 } };
+        added = utimes(dir, times) == 0 && stat(dir, &after) == 0 && after.st_mtime == before.st_mtime &&
+                after.st_size == before.st_size;
+    }
+    if (!added) {
+        printf("  cannot add a track to %s behind its stamp\n", dir);
+        failures++;
+    }
+    if (tree->trustDirStamp) {
+        ScanExpect missed = { JOURNAL_FILES + 1, 0, JOURNAL_FOLDERS, 0, 0, 0 };
+        failures += checkScan("added, stamp kept (missed)", tree, &catalog, &missed);
+    } else {
+        // Its names are read twice: to verify them, then to read the folder
+        ScanExpect found = { JOURNAL_FILES + 2, 1, JOURNAL_FOLDERS - 1, 1, 0, 2 + JOURNAL_TRACKS + 1 };
+        tree->names++;
+        failures += checkScan("added, stamp kept", tree, &catalog, &found);
+        if (countTitle(&catalog, "Take 1 of 05-09-03") != 1) {
+            printf("  the added track is missing\n");
+            failures++;
+        }
+    }
+
+    catalogFree(&catalog);
+    return failures;
+}
+
+int main(void) {
+    int failures = 0;
+    for (int trust = 1; trust >= 0; --trust) {
+        JournalTree tree;
+        tree.trustDirStamp = trust != 0;
+        if (buildTree(&tree)) {
+            failures += checkJournal(&tree);
+        } else {
+            printf("journal: cannot build the tree under %s\n", tree.root);
+            failures++;
+        }
+        fsRemoveTree(tree.root);
+    }
+    return checkReport("scanner", failures);
+}
@@ -0,0 +1,185 @@
+// Checks search-as-you-type on a synthetic 20000-track library: every
+// keystroke of a set of queries, typed and backspaced, must give the rows a
+// brute-force word-prefix match over every row gives, in rank order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strncasecmp
+
+#include "check.h"
+#include "synth.h"
+#include "sortindex.h"
+#include "search.h"
+
+#define SEARCH_CHECK_TRACKS 20000
+
+// Typed one character at a time, then erased the same way.
+static const char *const s_queries[] = {
+    "song 123",
+    "The Artist 42",
+    "artist 7 album 3 of",
+    "greatest hits",
+    "hits greatest",
+    "  s  1  ",
+    "album 0 of artist 10 song",
+    "mp3",
+    "zebra",
+    "\xc3\x89t\xc3\xa9",
+    "caf\xc3\xa9 -",
+    "x-ray",
+};
+
+// Rows with punctuation and UTF-8 between the words.
+static const char *const s_edgeTitles[] = {
+    "\xc3\x89t\xc3\xa9 Song",
+    "Caf\xc3\xa9-Society",
+    "X-Ray Spex",
+    "song123",
+    "(Song) 123!",
+};
+
+static bool addEdgeRows(Catalog *catalog) {
+    for (size_t i = 0; i < sizeof(s_edgeTitles) / sizeof(s_edgeTitles[0]); ++i) {
+        char filename[32];
+        int n = snprintf(filename, sizeof(filename), "edge/%02zu.mp3", i);
+        CatalogEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.filename = strArenaAdd(&catalog->strings, filename, (size_t)n);
+        entry.title = strArenaIntern(&catalog->strings, s_edgeTitles[i], strlen(s_edgeTitles[i]));
+        entry.artist = entry.album = STRARENA_NONE;
+        entry.format = TRACK_FORMAT_MP3;
+        if (!catalogAppend(catalog, &entry)) return false;
+    }
+    return true;
+}
+
+// --- Brute Force ---
+
+// Letters, digits and UTF-8 bytes make up words; everything else splits them.
+static bool isWordByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+static bool hasWordPrefix(const char *text, const char *word, size_t len) {
+    if (!text) return false;
+    for (size_t i = 0; text[i]; ++i) {
+        bool start = isWordByte((unsigned char)text[i]) && (i == 0 || !isWordByte((unsigned char)text[i - 1]));
+        if (start && strncasecmp(text + i, word, len) == 0) return true;
+    }
+    return false;
+}
+
+static bool bruteMatches(const Catalog *catalog, uint32_t row, const char *query) {
+    const char *fields[4] = {
+        catalogString(catalog, CATALOG_FIELD(catalog, title, row)),
+        catalogString(catalog, CATALOG_FIELD(catalog, artist, row)),
+        catalogString(catalog, CATALOG_FIELD(catalog, album, row)),
+        catalogString(catalog, CATALOG_FIELD(catalog, filename, row)),
+    };
+    bool any = false;
+    for (size_t i = 0; query[i];) {
+        if (!isWordByte((unsigned char)query[i])) {
+            ++i;
+            continue;
+        }
+        size_t len = 0;
+        while (isWordByte((unsigned char)query[i + len])) len++;
+        bool found = false;
+        for (int f = 0; f < 4 && !found; ++f) found = hasWordPrefix(fields[f], query + i, len);
+        if (!found) return false;
+        any = true;
+        i += len;
+    }
+    return any;
+}
+
+// Matching rows in list order: by `rank`, or by row if NULL.
+static uint32_t bruteSearch(const Catalog *catalog, const uint32_t *order, const char *query, uint32_t *out) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < catalog->count; ++i) {
+        uint32_t row = order ? order[i] : i;
+        if (bruteMatches(catalog, row, query)) out[n++] = row;
+    }
+    return n;
+}
+
+// --- Checks ---
+
+// Runs one keystroke; returns 1 if the result differs from brute force.
+static int checkQuery(SearchResult *result, const SearchIndex *index, const Catalog *catalog,
+                      const SortIndex *sort, SortKey key, const char *query, uint32_t *want) {
+    const uint32_t *rank = sort ? sort->rank[key] : NULL;
+    if (!searchRun(result, index, catalog, query, rank)) {
+        printf("  \"%s\": out of memory\n", query);
+        return 1;
+    }
+    uint32_t n = bruteSearch(catalog, sort ? sort->order[key] : NULL, query, want);
+    if (n == result->count && memcmp(want, result->rows, n * sizeof(uint32_t)) == 0) return 0;
+    printf("  \"%s\"%s: %u rows, want %u\n", query, sort ? " (ranked)" : "", result->count, n);
+    return 1;
+}
+
+// Types each query a character at a time, then erases it the same way.
+static int checkTyping(const SearchIndex *index, const Catalog *catalog, const SortIndex *sort, uint32_t *want) {
+    SearchResult result;
+    searchResultInit(&result);
+    int failures = 0;
+    uint32_t keystrokes = 0;
+    char query[SEARCH_MAX_QUERY];
+    for (size_t q = 0; q < sizeof(s_queries) / sizeof(s_queries[0]); ++q) {
+        size_t len = strlen(s_queries[q]);
+        SortKey key = (SortKey)(q % SORT_KEY_COUNT);
+        for (size_t i = 1; i <= len; ++i, ++keystrokes) {
+            memcpy(query, s_queries[q], i);
+            query[i] = '\0';
+            failures += checkQuery(&result, index, catalog, sort, key, query, want);
+        }
+        for (size_t i = len - 1; i > 0; --i, ++keystrokes) {
+            query[i] = '\0';
+            failures += checkQuery(&result, index, catalog, sort, key, query, want);
+        }
+    }
+    printf("  %u keystrokes%s: %u refined, %u from the index, %d mismatches\n", keystrokes,
+           sort ? " in rank order" : "", result.refined, result.rebuilt, failures);
+    if (result.refined == 0 || result.rebuilt == 0) failures++;
+
+    // A new sort order re-sorts the results in place
+    if (sort && searchRun(&result, index, catalog, "song 1", sort->rank[SORT_BY_TITLE])) {
+        searchReorder(&result, sort->rank[SORT_BY_FILENAME]);
+        uint32_t n = bruteSearch(catalog, sort->order[SORT_BY_FILENAME], "song 1", want);
+        if (n != result.count || memcmp(want, result.rows, n * sizeof(uint32_t)) != 0) {
+            printf("  reordered results differ from a fresh search\n");
+            failures++;
+        }
+    }
+    searchResultFree(&result);
+    return failures;
+}
+
+int main(void) {
+    Catalog catalog;
+    catalogInit(&catalog);
+    synthCatalog(&catalog, SEARCH_CHECK_TRACKS);
+    int failures = 0;
+    if (!addEdgeRows(&catalog)) failures++;
+
+    SearchIndex index;
+    searchIndexInit(&index);
+    SortIndex sort;
+    sortIndexInit(&sort);
+    uint32_t *want = (uint32_t*)malloc(catalog.count * sizeof(uint32_t));
+    if (!want || !searchIndexBuild(&index, &catalog) || !sortIndexBuild(&sort, &catalog)) {
+        printf("search: cannot build the indexes\n");
+        failures++;
+    } else {
+        printf("search against a brute-force word-prefix match, %u rows\n", catalog.count);
+        failures += checkTyping(&index, &catalog, NULL, want);
+        failures += checkTyping(&index, &catalog, &sort, want);
+    }
+    free(want);
+    sortIndexFree(&sort);
+    searchIndexFree(&index);
+    catalogFree(&catalog);
+    return checkReport("search", failures);
+}
@@ -0,0 +1,119 @@
+// Checks the sort permutations of a synthetic 50000-track library, plus rows
+// that stress the 8-byte collation keys, against a plain qsort of the rows
+// with strcasecmp.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strcasecmp
+
+#include "check.h"
+#include "synth.h"
+#include "sortindex.h"
+
+#define SORT_CHECK_TRACKS 50000
+
+// Rows whose keys tie or differ only past the 8 bytes the collation key holds.
+static const struct {
+    const char *title;
+    const char *artist;
+    const char *album;
+    const char *filename;
+} s_edgeRows[] = {
+    { "abcdefgh", "Same Prefix Band", "Same Prefix Album One", "edge/abcdefgh.mp3" },
+    { "ABCDEFGH", "same prefix band", "Same Prefix Album Two", "edge/ABCDEFGH.mp3" },
+    { "abcdefghi", "Same Prefix Bandits", "Same Prefix Album", "edge/abcdefghi.mp3" },
+    { "abcdefg", "Same Prefix", "Same Prefix Album One", "edge/abcdefg.mp3" },
+    { "\xc3\x89t\xc3\xa9", "\xc3\x89lodie", "\xc3\x89t\xc3\xa9 Album", "edge/ete-accent.mp3" },
+    { "ete", "Elodie", "Ete Album", "edge/ete.mp3" },
+    { "Zebra", NULL, NULL, "edge/no-artist.mp3" },
+    { NULL, NULL, NULL, "edge/Untitled 01.mp3" },
+    { NULL, "Same Prefix Band", NULL, "edge/untitled 02.mp3" },
+    { "", "", "", "edge/empty.mp3" },
+};
+
+static uint32_t addString(Catalog *catalog, const char *s) {
+    return s ? strArenaIntern(&catalog->strings, s, strlen(s)) : STRARENA_NONE;
+}
+
+static bool addEdgeRows(Catalog *catalog) {
+    for (size_t i = 0; i < sizeof(s_edgeRows) / sizeof(s_edgeRows[0]); ++i) {
+        CatalogEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.filename = addString(catalog, s_edgeRows[i].filename);
+        entry.title = addString(catalog, s_edgeRows[i].title);
+        entry.artist = addString(catalog, s_edgeRows[i].artist);
+        entry.album = addString(catalog, s_edgeRows[i].album);
+        entry.format = TRACK_FORMAT_MP3;
+        if (!catalogAppend(catalog, &entry)) return false;
+    }
+    return true;
+}
+
+static const Catalog *s_refCatalog; // qsort has no context argument
+static SortKey s_refKey;
+
+// The string a row is listed under for `key`: untagged tracks go by file name.
+static const char* refString(uint32_t row) {
+    const Catalog *catalog = s_refCatalog;
+    switch (s_refKey) {
+        case SORT_BY_TITLE: {
+            const char *title = catalogString(catalog, CATALOG_FIELD(catalog, title, row));
+            if (title) return title;
+            const char *path = catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+            return path ? catalogBaseName(path) : NULL;
+        }
+        case SORT_BY_ARTIST: return catalogString(catalog, CATALOG_FIELD(catalog, artist, row));
+        case SORT_BY_ALBUM:  return catalogString(catalog, CATALOG_FIELD(catalog, album, row));
+        default:             return catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+    }
+}
+
+// Case-insensitive, missing strings last, scan order among equals.
+static int compareRef(const void *a, const void *b) {
+    uint32_t ra = *(const uint32_t*)a;
+    uint32_t rb = *(const uint32_t*)b;
+    const char *sa = refString(ra);
+    const char *sb = refString(rb);
+    int cmp = (!sa || !sb) ? (sa ? -1 : (sb ? 1 : 0)) : strcasecmp(sa, sb);
+    if (cmp != 0) return cmp;
+    return ra < rb ? -1 : (ra > rb ? 1 : 0);
+}
+
+static uint32_t checkKey(const SortIndex *index, const Catalog *catalog, SortKey key, uint32_t *want) {
+    for (uint32_t row = 0; row < catalog->count; ++row) want[row] = row;
+    s_refCatalog = catalog;
+    s_refKey = key;
+    qsort(want, catalog->count, sizeof(uint32_t), compareRef);
+
+    uint32_t errors = 0;
+    for (uint32_t i = 0; i < catalog->count; ++i) {
+        if (index->order[key][i] != want[i]) errors++;
+        if (index->rank[key][index->order[key][i]] != i) errors++;
+    }
+    printf("  %-8s %u rows: %u mismatches\n", sortKeyName(key), catalog->count, errors);
+    return errors;
+}
+
+int main(void) {
+    Catalog catalog;
+    catalogInit(&catalog);
+    synthCatalog(&catalog, SORT_CHECK_TRACKS);
+    int failures = 0;
+    if (!addEdgeRows(&catalog)) failures++;
+
+    SortIndex index;
+    sortIndexInit(&index);
+    uint32_t *want = (uint32_t*)malloc(catalog.count * sizeof(uint32_t));
+    if (!want || !sortIndexBuild(&index, &catalog) || index.count != catalog.count) {
+        printf("sort index: cannot build\n");
+        failures++;
+    } else {
+        printf("sort index against qsort with strcasecmp\n");
+        for (int k = 0; k < SORT_KEY_COUNT; ++k) failures += (int)checkKey(&index, &catalog, (SortKey)k, want);
+    }
+    free(want);
+    sortIndexFree(&index);
+    catalogFree(&catalog);
+    return checkReport("sortindex", failures);
+}
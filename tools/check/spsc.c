@@ -0,0 +1,209 @@
+// Stress-checks the producer/consumer hand-off: a million records through
+// a small SPSC ring with both sides stalling at random, then a background
+// scan drained in uneven batches, which must deliver the same items in the
+// same order as a scan on the calling thread, none lost or repeated.
+
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "synth.h"
+#include "fsutil.h"
+#include "spsc.h"
+#include "bgthread.h"
+#include "scanner.h"
+
+#define RING_STRESS_ITEMS    1000000
+#define RING_STRESS_CAPACITY 8 // Small, so the ring is full and empty over and over
+#define RING_STALL_ODDS      4096 // One push or pop in this many waits a while
+
+#define WORKER_ARTISTS       10
+#define WORKER_ALBUMS        20
+#define WORKER_TRACKS        10 // Per album: 2000 files
+#define WORKER_FILE_BYTES    1024
+
+// --- Ring ---
+
+typedef struct {
+    uint32_t seq;
+    uint32_t check; // Derived from seq, so a torn copy shows
+    uint64_t payload[2];
+} RingRecord;
+
+typedef struct {
+    SpscRing ring;
+    RingRecord storage[RING_STRESS_CAPACITY];
+    uint32_t producerFull; // Pushes refused because the ring was full
+} RingStress;
+
+static uint32_t recordCheck(uint32_t seq) {
+    return seq * 2654435761u ^ 0x5bd1e995u;
+}
+
+// Spins a little, or now and then sleeps, so the two sides drift apart.
+static void stall(uint32_t *seed) {
+    uint32_t r = synthRandom(seed);
+    if (r % RING_STALL_ODDS == 0) bgThreadSleepUs(100);
+    else for (volatile uint32_t spin = r % 64; spin > 0; --spin) {}
+}
+
+static void ringProducer(void *arg) {
+    RingStress *stress = (RingStress*)arg;
+    uint32_t seed = 777;
+    for (uint32_t seq = 0; seq < RING_STRESS_ITEMS; ++seq) {
+        RingRecord record = { seq, recordCheck(seq), { seq, ~(uint64_t)seq } };
+        while (!spscPush(&stress->ring, &record)) {
+            stress->producerFull++;
+            sched_yield(); // Let the consumer run, even on one core
+        }
+        stall(&seed);
+    }
+}
+
+static int checkRing(void) {
+    static RingStress stress;
+    spscInit(&stress.ring, stress.storage, sizeof(RingRecord), RING_STRESS_CAPACITY);
+    BgThread *producer = bgThreadStart(ringProducer, &stress, false);
+    if (!producer) {
+        printf("  cannot start the producer\n");
+        return 1;
+    }
+    uint32_t expected = 0, outOfOrder = 0, torn = 0, consumerEmpty = 0;
+    uint32_t seed = 999;
+    while (expected < RING_STRESS_ITEMS) {
+        RingRecord record;
+        if (!spscPop(&stress.ring, &record)) {
+            consumerEmpty++;
+            sched_yield();
+            continue;
+        }
+        if (record.seq != expected) outOfOrder++;
+        if (record.check != recordCheck(record.seq) || record.payload[0] != record.seq ||
+            record.payload[1] != ~(uint64_t)record.seq) {
+            torn++;
+        }
+        expected = record.seq + 1;
+        stall(&seed);
+    }
+    bgThreadJoin(producer);
+    RingRecord extra;
+    bool leftover = spscPop(&stress.ring, &extra);
+    printf("ring: %u records through %u slots, %u full and %u empty waits, %u out of order, %u torn%s\n",
+           RING_STRESS_ITEMS, RING_STRESS_CAPACITY, stress.producerFull, consumerEmpty, outOfOrder, torn,
+           leftover ? ", extra record left" : "");
+    return (outOfOrder || torn || leftover) ? 1 : 0;
+}
+
+// --- Scan Worker ---
+
+static bool appendItem(const CatalogEntry *entry, void *user) {
+    return catalogAppend((Catalog*)user, entry);
+}
+
+static bool scanInline(const char *musicDir, const char *dataDir, const char *indexPath, Catalog *catalog) {
+    catalogClear(catalog);
+    Scanner scanner;
+    scannerBegin(&scanner, musicDir, dataDir, indexPath, &catalog->strings, appendItem, catalog);
+    while (!scannerStep(&scanner, 256, 20000)) {}
+    return !scanner.openFailed;
+}
+
+static TagPool s_pool; // Too big for the stack
+static ScanWorker s_worker;
+
+// Drains in batches of 1 to 64 items, sleeping between some, like frames
+// of uneven length.
+static bool scanInBackground(const char *musicDir, const char *dataDir, const char *indexPath, TagPool *pool,
+                             Catalog *catalog) {
+    catalogClear(catalog);
+    if (!scanWorkerStart(&s_worker, musicDir, dataDir, indexPath, &catalog->strings, false, pool)) return false;
+    uint32_t seed = 4242;
+    while (!scanWorkerDrain(&s_worker, appendItem, catalog, 1 + (int)(synthRandom(&seed) % 64))) {
+        if (synthRandom(&seed) % 4 == 0) bgThreadSleepUs(200);
+    }
+    bool ok = !s_worker.scanner.openFailed;
+    scanWorkerStop(&s_worker);
+    return ok;
+}
+
+// Rows out of place against the reference, plus filenames seen twice.
+static uint32_t diffOrder(const Catalog *want, const Catalog *got) {
+    uint32_t diffs = want->count > got->count ? want->count - got->count : got->count - want->count;
+    uint32_t n = want->count < got->count ? want->count : got->count;
+    for (uint32_t r = 0; r < n; ++r) {
+        const char *a = catalogString(want, CATALOG_FIELD(want, filename, r));
+        const char *b = catalogString(got, CATALOG_FIELD(got, filename, r));
+        const char *ta = catalogString(want, CATALOG_FIELD(want, title, r));
+        const char *tb = catalogString(got, CATALOG_FIELD(got, title, r));
+        if (!a || !b || strcmp(a, b) != 0 || !ta || !tb || strcmp(ta, tb) != 0) diffs++;
+        if (r > 0 && b && strcmp(b, catalogString(got, CATALOG_FIELD(got, filename, r - 1))) == 0) diffs++;
+    }
+    return diffs;
+}
+
+static int checkWorker(const char *musicDir, const char *root) {
+    char refData[PATH_MAX], refIndex[PATH_MAX], bgData[PATH_MAX], bgIndex[PATH_MAX];
+    if (!fsJoinPath(refData, root, "ref") || !fsJoinPath(refIndex, refData, "library.idx") ||
+        !fsJoinPath(bgData, root, "bg") || !fsJoinPath(bgIndex, bgData, "library.idx")) {
+        return 1;
+    }
+    int failures = 0;
+    Catalog want, got;
+    catalogInit(&want);
+    catalogInit(&got);
+    if (!scanInline(musicDir, refData, refIndex, &want) ||
+        want.count != WORKER_ARTISTS * WORKER_ALBUMS * WORKER_TRACKS) {
+        printf("  reference scan found %u files\n", want.count);
+        failures++;
+    }
+
+    static const struct {
+        const char *label;
+        bool cold;   // Start from no index
+        int workers; // Tag pool threads (0 = tags read on the scan thread)
+    } runs[] = {
+        { "cold, tags on the scan thread", true, 0 },
+        { "warm, from the index", false, 0 },
+        { "cold, 4 tag workers", true, 4 },
+        { "warm again, 4 tag workers", false, 4 },
+    };
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i) {
+        if (runs[i].cold) fsRemoveTree(bgData);
+        TagPool *pool = NULL;
+        if (runs[i].workers > 0) {
+            if (!tagPoolStart(&s_pool, runs[i].workers)) {
+                printf("  cannot start the tag pool\n");
+                failures++;
+                continue;
+            }
+            pool = &s_pool;
+        }
+        bool ok = scanInBackground(musicDir, bgData, bgIndex, pool, &got);
+        if (pool) tagPoolStop(pool);
+        uint32_t diffs = ok ? diffOrder(&want, &got) : want.count;
+        printf("worker: %-30s %5u items, %u out of place, lost or repeated\n", runs[i].label, got.count, diffs);
+        if (diffs) failures++;
+    }
+    catalogFree(&got);
+    catalogFree(&want);
+    return failures;
+}
+
+int main(void) {
+    int failures = checkRing();
+    char root[] = "/tmp/pearspscXXXXXX";
+    char musicDir[PATH_MAX];
+    if (mkdtemp(root) && fsJoinPath(musicDir, root, "music") &&
+        synthWriteTree(musicDir, WORKER_ARTISTS, WORKER_ALBUMS, WORKER_TRACKS, WORKER_FILE_BYTES)) {
+        failures += checkWorker(musicDir, root);
+    } else {
+        printf("worker: cannot build the tree under %s\n", root);
+        failures++;
+    }
+    fsRemoveTree(root);
+    return checkReport("spsc", failures);
+}
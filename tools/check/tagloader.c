@@ -0,0 +1,277 @@
+// Checks the lazy tag loader on a synthetic 200-file tree scanned with tags
+// deferred, driven frame by frame as pearview does: the worker always takes
+// the best-ranked queued row, a row in the window only waits behind better
+// ones, nothing far from the window is read, the screen is filled within a
+// few frames of each jump, and every row filled in has the tags a scan that
+// read them would have given. The late tags are then saved, and the next
+// scan must have them without reading the files.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "synth.h"
+#include "fsutil.h"
+#include "scanner.h"
+#include "tagloader.h"
+
+#define LOADER_ARTISTS    4
+#define LOADER_ALBUMS     5
+#define LOADER_TRACKS     10 // Per album: 200 files
+#define LOADER_FILES      (LOADER_ARTISTS * LOADER_ALBUMS * LOADER_TRACKS)
+#define LOADER_FILE_BYTES 1024
+#define VIEW_HEIGHT       240.0f // The app's list (see main.c)
+#define ROW_HEIGHT        48.0f
+#define STEPS_PER_FRAME   2      // Reads the worker finishes in a frame
+#define FILL_FRAMES       5      // Frames the screen may show rows without tags after a jump
+
+typedef struct {
+    uint32_t takenOutOfOrder;   // Worker took a slot while a better one was queued
+    uint32_t waitedBehindWorse; // A window row left waiting while a worse one held a slot
+    uint32_t readFar;           // Filled rows that were far from the window when read
+    uint32_t wrongTags;         // Filled rows whose tags differ from the eager scan's
+    uint32_t slowFills;         // Stops whose screen was not filled within FILL_FRAMES
+    uint32_t filled;
+} LoaderTally;
+
+typedef struct {
+    int top;    // List row jumped to
+    int frames; // Held for; a stop shorter than FILL_FRAMES is only passed through
+} LoaderStop;
+
+static bool appendItem(const CatalogEntry *entry, void *user) {
+    return catalogAppend((Catalog*)user, entry);
+}
+
+static bool scan(const char *musicDir, const char *dataDir, const char *indexPath, bool deferTags, Catalog *catalog,
+                 ScanStats *stats) {
+    catalogClear(catalog);
+    Scanner scanner;
+    scannerBegin(&scanner, musicDir, dataDir, indexPath, &catalog->strings, appendItem, catalog);
+    scanner.deferTags = deferTags;
+    while (!scannerStep(&scanner, 256, 20000)) {}
+    *stats = scanner.stats;
+    return !scanner.openFailed;
+}
+
+static bool sameString(const Catalog *a, uint32_t refA, const Catalog *b, uint32_t refB) {
+    const char *sa = catalogString(a, refA);
+    const char *sb = catalogString(b, refB);
+    return sa == sb || (sa && sb && strcmp(sa, sb) == 0);
+}
+
+static bool sameTags(const Catalog *a, const Catalog *b, uint32_t r) {
+    return sameString(a, CATALOG_FIELD(a, filename, r), b, CATALOG_FIELD(b, filename, r)) &&
+           sameString(a, CATALOG_FIELD(a, title, r), b, CATALOG_FIELD(b, title, r)) &&
+           sameString(a, CATALOG_FIELD(a, artist, r), b, CATALOG_FIELD(b, artist, r)) &&
+           sameString(a, CATALOG_FIELD(a, album, r), b, CATALOG_FIELD(b, album, r)) &&
+           CATALOG_FIELD(a, durationMs, r) == CATALOG_FIELD(b, durationMs, r) &&
+           CATALOG_FIELD(a, trackNumber, r) == CATALOG_FIELD(b, trackNumber, r) &&
+           CATALOG_FIELD(a, format, r) == CATALOG_FIELD(b, format, r);
+}
+
+static bool pending(const Catalog *catalog, uint32_t row) {
+    return (CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_PENDING) != 0;
+}
+
+// --- Frames ---
+
+// Best rank among queued slots, PREFETCH_RANK_FAR if none.
+static uint32_t bestQueued(const TagLoader *loader) {
+    uint32_t best = PREFETCH_RANK_FAR;
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+        const TagSlot *slot = &loader->slots[i];
+        if (atomic_load(&slot->state) == TAG_SLOT_QUEUED && atomic_load(&slot->rank) < best) {
+            best = atomic_load(&slot->rank);
+        }
+    }
+    return best;
+}
+
+static bool inSlot(const TagLoader *loader, uint32_t row) {
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+        if (atomic_load(&loader->slots[i].state) != TAG_SLOT_FREE && loader->slots[i].row == row) return true;
+    }
+    return false;
+}
+
+// After the render thread's update, a pending row in the window without a
+// slot may only be waiting because every slot holds a row at least as good.
+static void checkQueue(const TagLoader *loader, const Catalog *catalog, const PrefetchWindow *window,
+                       LoaderTally *tally) {
+    uint32_t worstQueued = 0;
+    bool anyFree = false;
+    for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+        uint32_t state = atomic_load(&loader->slots[i].state);
+        if (state == TAG_SLOT_FREE) anyFree = true;
+        if (state == TAG_SLOT_QUEUED && atomic_load(&loader->slots[i].rank) > worstQueued) {
+            worstQueued = atomic_load(&loader->slots[i].rank);
+        }
+    }
+    int rows[PREFETCH_MAX_ROWS];
+    int n = prefetchOrder(window, rows, PREFETCH_MAX_ROWS);
+    for (int i = 0; i < n; ++i) {
+        uint32_t row = (uint32_t)rows[i];
+        if (!pending(catalog, row) || inSlot(loader, row)) continue;
+        if (anyFree || prefetchRank(window, rows[i]) < worstQueued) tally->waitedBehindWorse++;
+    }
+}
+
+// The worker's share of a frame: each read must be of the best-ranked slot
+// queued when it started.
+static void workerFrame(TagLoader *loader, StrArena *scratch, LoaderTally *tally) {
+    for (int step = 0; step < STEPS_PER_FRAME; ++step) {
+        bool wasDone[TAG_LOADER_SLOTS];
+        for (int i = 0; i < TAG_LOADER_SLOTS; ++i) wasDone[i] = atomic_load(&loader->slots[i].state) == TAG_SLOT_DONE;
+        uint32_t best = bestQueued(loader);
+        if (!tagLoaderStep(loader, scratch, NULL)) break;
+        for (int i = 0; i < TAG_LOADER_SLOTS; ++i) {
+            const TagSlot *slot = &loader->slots[i];
+            if (!wasDone[i] && atomic_load(&slot->state) == TAG_SLOT_DONE && atomic_load(&slot->rank) > best) {
+                tally->takenOutOfOrder++;
+            }
+        }
+    }
+}
+
+// Jumps to the stop's row and holds there, one frame at a time.
+static void holdAt(TagLoader *loader, Catalog *lazy, const Catalog *eager, PrefetchWindow *window,
+                   StrArena *scratch, const LoaderStop *stop, uint8_t *wasPending, LoaderTally *tally) {
+    float maxOffset = (float)lazy->count * ROW_HEIGHT - VIEW_HEIGHT;
+    float offset = (float)stop->top * ROW_HEIGHT;
+    if (offset > maxOffset) offset = maxOffset;
+    int screenFilledAt = -1;
+    for (int frame = 0; frame < stop->frames; ++frame) {
+        PrefetchWindow previous = *window;
+        for (uint32_t r = 0; r < lazy->count; ++r) wasPending[r] = pending(lazy, r);
+        prefetchUpdate(window, offset, ROW_HEIGHT, VIEW_HEIGHT, (int)lazy->count);
+        tagLoaderUpdate(loader, lazy, window, NULL);
+
+        for (uint32_t r = 0; r < lazy->count; ++r) {
+            if (!wasPending[r] || pending(lazy, r)) continue;
+            tally->filled++;
+            // Read during the last frame, so queued under its window
+            if (prefetchTooFar(&previous, (int)r)) tally->readFar++;
+            if (!sameTags(lazy, eager, r)) tally->wrongTags++;
+        }
+        bool screenFilled = true;
+        for (int row = window->first; row <= window->last; ++row) screenFilled &= !pending(lazy, (uint32_t)row);
+        if (screenFilled && screenFilledAt < 0) screenFilledAt = frame;
+
+        checkQueue(loader, lazy, window, tally);
+        workerFrame(loader, scratch, tally);
+    }
+    if (stop->frames <= FILL_FRAMES) {
+        printf("  pass row %-4d %d frame%s, %u rows read so far\n", stop->top, stop->frames,
+               stop->frames == 1 ? "" : "s", loader->stats.loaded);
+        return;
+    }
+    printf("  stop at row %-4d screen filled after %d frames, %u rows read so far\n", stop->top, screenFilledAt,
+           loader->stats.loaded);
+    if (screenFilledAt < 0 || screenFilledAt > FILL_FRAMES) tally->slowFills++;
+}
+
+// --- Runs ---
+
+static int checkLoader(const char *musicDir, const char *dataDir, const char *indexPath, const char *eagerDir,
+                       const char *eagerIndex) {
+    static TagLoader loader;
+    Catalog lazy, eager, again;
+    catalogInit(&lazy);
+    catalogInit(&eager);
+    catalogInit(&again);
+    ScanStats lazyStats, eagerStats, againStats;
+    int failures = 0;
+    printf("lazy tags: %u files, %d reads a frame\n", LOADER_FILES, STEPS_PER_FRAME);
+
+    uint8_t *wasPending = (uint8_t*)malloc(LOADER_FILES);
+    if (!wasPending || !scan(musicDir, dataDir, indexPath, true, &lazy, &lazyStats) ||
+        !scan(musicDir, eagerDir, eagerIndex, false, &eager, &eagerStats) || lazy.count != LOADER_FILES ||
+        eager.count != LOADER_FILES || lazyStats.itemsDeferred != LOADER_FILES) {
+        printf("  cannot scan %s with and without tags\n", musicDir);
+        free(wasPending);
+        catalogFree(&lazy);
+        catalogFree(&eager);
+        return 1;
+    }
+
+    tagLoaderInit(&loader, musicDir, &lazy.strings);
+    StrArena scratch;
+    strArenaInit(&scratch);
+    PrefetchWindow window;
+    prefetchInit(&window);
+    LoaderTally tally;
+    memset(&tally, 0, sizeof(tally));
+    // Passing row 120 leaves rows queued there, which going back to a screen
+    // already filled must drop rather than read. Moving on from row 60 before
+    // the worker catches up brings better rows than those queued, which must
+    // push them out.
+    static const LoaderStop stops[] = {
+        { 0, 20 }, { 3, 20 }, { 120, 1 }, { 0, 10 }, { 60, 1 }, { 63, 20 }, { LOADER_FILES, 20 },
+    };
+    for (size_t i = 0; i < sizeof(stops) / sizeof(stops[0]); ++i) {
+        holdAt(&loader, &lazy, &eager, &window, &scratch, &stops[i], wasPending, &tally);
+    }
+    strArenaFree(&scratch);
+
+    printf("  %u rows filled, %u queued rows cancelled, %u still pending\n", tally.filled, loader.stats.cancelled,
+           LOADER_FILES - tally.filled);
+    if (tally.takenOutOfOrder || tally.waitedBehindWorse || tally.readFar || tally.wrongTags || tally.slowFills ||
+        loader.stats.cancelled == 0 || tally.filled == 0 || tally.filled == LOADER_FILES) {
+        printf("  want reads in rank order (%u not), no window row behind a worse one (%u), nothing read far from "
+               "the window (%u), the scan's tags (%u wrong), screens filled in %d frames (%u not), some queued "
+               "rows cancelled and rows never near the screen left unread\n", tally.takenOutOfOrder,
+               tally.waitedBehindWorse, tally.readFar, tally.wrongTags, FILL_FRAMES, tally.slowFills);
+        failures++;
+    }
+
+    // Save what was read; the next scan has those rows and defers the rest
+    LibIndexUpdate update;
+    libIndexUpdateInit(&update);
+    bool saved = tagLoaderCollect(&lazy, &update) && update.tagCount == tally.filled &&
+                 libIndexUpdate(indexPath, &update);
+    libIndexUpdateFree(&update);
+    uint32_t stillLate = 0;
+    for (uint32_t r = 0; r < lazy.count; ++r) {
+        if (CATALOG_FIELD(&lazy, flags, r) & CATALOG_FLAG_LATE) stillLate++;
+    }
+    uint32_t wrong = 0;
+    if (saved && scan(musicDir, dataDir, indexPath, true, &again, &againStats) && again.count == lazy.count) {
+        for (uint32_t r = 0; r < again.count; ++r) {
+            if (pending(&again, r) != pending(&lazy, r) || (!pending(&again, r) && !sameTags(&again, &eager, r))) {
+                wrong++;
+            }
+        }
+    } else {
+        saved = false;
+    }
+    printf("  saved            %u rows, next scan probed %u and deferred %u, %u rows differ  %s\n", tally.filled,
+           againStats.itemsProbed, againStats.itemsDeferred, wrong,
+           saved && wrong == 0 && stillLate == 0 && againStats.itemsProbed == 0 ? "ok" : "wrong");
+    if (!saved || wrong != 0 || stillLate != 0 || againStats.itemsProbed != 0) failures++;
+
+    free(wasPending);
+    catalogFree(&again);
+    catalogFree(&eager);
+    catalogFree(&lazy);
+    return failures;
+}
+
+int main(void) {
+    char root[] = "/tmp/pearloaderXXXXXX";
+    char musicDir[PATH_MAX], dataDir[PATH_MAX], indexPath[PATH_MAX], eagerDir[PATH_MAX], eagerIndex[PATH_MAX];
+    int failures;
+    if (mkdtemp(root) && fsJoinPath(musicDir, root, "music") && fsJoinPath(dataDir, root, "data") &&
+        fsJoinPath(indexPath, dataDir, "library.idx") && fsJoinPath(eagerDir, root, "eager") &&
+        fsJoinPath(eagerIndex, eagerDir, "library.idx") &&
+        synthWriteTree(musicDir, LOADER_ARTISTS, LOADER_ALBUMS, LOADER_TRACKS, LOADER_FILE_BYTES)) {
+        failures = checkLoader(musicDir, dataDir, indexPath, eagerDir, eagerIndex);
+    } else {
+        printf("lazy tags: cannot build the tree under %s\n", root);
+        failures = 1;
+    }
+    fsRemoveTree(root);
+    return checkReport("tagloader", failures);
+}
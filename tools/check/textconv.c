@@ -0,0 +1,42 @@
+// Checks textConvert() against tag text in every encoding and the edge
+// cases: cut-off and malformed input, terminators, clipping.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "textsamples.h"
+
+// Converts every input once, checking text and flags. Returns the mismatches.
+static int checkConversions(const TextInput *inputs, uint32_t count, StrArena *strings) {
+    int failures = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const TextInput *in = &inputs[i];
+        uint8_t flags = 0;
+        uint32_t ref = textConvert(strings, in->encoding, in->data, in->len, &flags);
+        const char *got = strArenaGet(strings, ref);
+        bool textOk = in->expected ? got && strlen(got) == in->expectedLen &&
+                                         memcmp(got, in->expected, in->expectedLen) == 0
+                                   : ref == STRARENA_NONE;
+        bool flagOk = ((flags & TEXT_FLAG_NO_GLYPHS) != 0) == in->noGlyphs;
+        if (!textOk || !flagOk) {
+            printf("  MISMATCH input %u (encoding %d): got \"%s\"%s, want \"%.*s\"%s\n", i, (int)in->encoding,
+                   got ? got : "(none)", (flags & TEXT_FLAG_NO_GLYPHS) ? " no glyphs" : "",
+                   (int)in->expectedLen, in->expected ? in->expected : "", in->noGlyphs ? " no glyphs" : "");
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(void) {
+    static TextInput inputs[TEXT_SAMPLE_INPUTS_MAX];
+    uint32_t edges;
+    uint32_t count = textSampleInputs(inputs, &edges);
+    StrArena strings;
+    strArenaInit(&strings);
+    int failures = checkConversions(inputs, count + edges, &strings);
+    printf("%u conversions checked\n", count + edges);
+    strArenaFree(&strings);
+    return checkReport("textconv", failures);
+}
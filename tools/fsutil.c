@@ -0,0 +1,57 @@
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "fsutil.h"
+
+bool fsJoinPath(char *out, const char *dir, const char *name) {
+    int n = dir[0] ? snprintf(out, PATH_MAX, "%s/%s", dir, name) : snprintf(out, PATH_MAX, "%s", name);
+    return n >= 0 && n < PATH_MAX;
+}
+
+void fsMakeParents(const char *path) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *slash = strchr(dir + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(dir, 0777);
+        *slash = '/';
+    }
+}
+
+bool fsCopyFile(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb");
+    if (!in) return false;
+    FILE *out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    static uint8_t buffer[1 << 16];
+    bool ok = true;
+    size_t got;
+    while (ok && (got = fread(buffer, 1, sizeof(buffer), in)) > 0) ok = fwrite(buffer, 1, got, out) == got;
+    fclose(in);
+    if (fclose(out) != 0) ok = false;
+    return ok;
+}
+
+void fsRemoveTree(const char *path) {
+    DIR *d = opendir(path);
+    if (d) {
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            char child[PATH_MAX];
+            struct stat st;
+            if (!fsJoinPath(child, path, entry->d_name)) continue;
+            if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) fsRemoveTree(child);
+            else remove(child);
+        }
+        closedir(d);
+    }
+    remove(path);
+}
@@ -0,0 +1,17 @@
+#ifndef FSUTIL_H
+#define FSUTIL_H
+
+#include <stdbool.h>
+
+// --- File Helpers ---
+// Small filesystem chores shared by the tools and the host checks.
+
+// `dir`/`name` into a PATH_MAX buffer; false if it doesn't fit.
+bool fsJoinPath(char *out, const char *dir, const char *name);
+// Creates every folder above `path`.
+void fsMakeParents(const char *path);
+bool fsCopyFile(const char *from, const char *to);
+// Deletes `path` and everything under it.
+void fsRemoveTree(const char *path);
+
+#endif
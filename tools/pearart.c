@@ -0,0 +1,194 @@
+// pearart: builds and checks the player's cover-art cache on a desktop machine.
+// Runs the app's library scan over MUSIC_DIR, then the same thumbnail code the
+// app uses for every track, so a cache built here can be copied to the SD card.
+//
+//   pearart [-d dataDir] [-v] [-p dumpDir] MUSIC_DIR
+//
+//   -d DIR Where library.idx, art.idx and art.bin are kept (default ./pearscan-data)
+//   -v     Verify instead of building: every track's thumbnail must match
+//          one rebuilt from the source picture; tracks the cache keeps only
+//          for a run (see artcache.h) are looked up again first, as the app
+//          would
+//   -p DIR Also write each track's thumbnail to DIR as a PPM, untiled
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "scanner.h"
+#include "catalog.h"
+#include "artwork.h"
+#include "contenthash.h"
+
+static bool appendItem(const CatalogEntry *entry, void *user) {
+    return catalogAppend((Catalog*)user, entry);
+}
+
+static bool scanLibrary(const char *musicDir, const char *dataDir, Catalog *catalog) {
+    char indexPath[PATH_MAX];
+    snprintf(indexPath, sizeof(indexPath), "%s/library.idx", dataDir);
+    Scanner scanner;
+    scannerBegin(&scanner, musicDir, dataDir, indexPath, &catalog->strings, appendItem, catalog);
+    while (!scannerStep(&scanner, 256, 20000)) {}
+    if (scanner.openFailed) {
+        fprintf(stderr, "pearart: cannot open %s\n", musicDir);
+        return false;
+    }
+    return true;
+}
+
+// The track's content hash as the app's hash job would take it, so its
+// thumbnail is saved under the key the app looks up once it has hashed the
+// file. Cue sheet tracks are not hashed there either.
+static uint64_t trackHash(const Catalog *catalog, uint32_t row, const char *musicDir, const char *relPath) {
+    static uint8_t buffer[CONTENT_HASH_SPAN];
+    uint64_t hash = CATALOG_FIELD(catalog, contentHash, row);
+    if (hash != CONTENT_HASH_NONE || (CATALOG_FIELD(catalog, flags, row) & CATALOG_FLAG_CUE)) return hash;
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", musicDir, relPath);
+    if (stat(path, &st) != 0 || !contentHashFile(path, (uint64_t)st.st_size, buffer, &hash, NULL)) {
+        return CONTENT_HASH_NONE;
+    }
+    return hash;
+}
+
+// Writes a thumbnail as a binary PPM, undoing the tiling.
+static void dumpThumb(const char *dumpDir, uint32_t row, const uint16_t *thumb) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%05u.ppm", dumpDir, row);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", ART_THUMB_SIZE, ART_THUMB_SIZE);
+    for (uint32_t y = 0; y < ART_THUMB_SIZE; ++y) {
+        for (uint32_t x = 0; x < ART_THUMB_SIZE; ++x) {
+            uint16_t p = thumb[artworkTileIndex(x, y, ART_THUMB_SIZE)];
+            uint8_t rgb[3] = { (uint8_t)((p >> 11) << 3), (uint8_t)(((p >> 5) & 0x3F) << 2), (uint8_t)((p & 0x1F) << 3) };
+            fwrite(rgb, 1, 3, f);
+        }
+    }
+    fclose(f);
+}
+
+static int build(ArtCache *cache, const Catalog *catalog, const char *musicDir, const char *dumpDir) {
+    ArtworkStats stats = { 0, 0, 0, 0 };
+    uint32_t tracks = 0;
+    uint64_t startUs = scanNowUs();
+    for (uint32_t i = 0; i < catalog->count; ++i) {
+        const char *relPath = catalogString(catalog, CATALOG_FIELD(catalog, filename, i));
+        if (!relPath || (CATALOG_FIELD(catalog, flags, i) & CATALOG_FLAG_MESSAGE)) continue;
+        tracks++;
+        uint64_t contentHash = trackHash(catalog, i, musicDir, relPath);
+        uint32_t thumb = artworkBuild(cache, musicDir, relPath, contentHash, &stats);
+        uint16_t pixels[ART_THUMB_PIXELS];
+        if (dumpDir && thumb != ART_THUMB_NONE && artCacheReadThumb(cache, thumb, pixels)) dumpThumb(dumpDir, i, pixels);
+    }
+    uint64_t doneUs = scanNowUs();
+    if (!artCacheFlush(cache)) fprintf(stderr, "pearart: could not write the art index\n");
+
+    printf("tracks       %9u\n", tracks);
+    printf("decoded      %9u      %u shared, %u without art\n", stats.decoded, stats.shared, stats.missing);
+    printf("picture bytes%9llu\n", (unsigned long long)stats.bytesRead);
+    printf("time         %9.2f ms\n", (doneUs - startUs) / 1000.0);
+    printf("cache        %9u thumbnails (%u KiB), %u keys in %u slots, %u more for this run only\n",
+           cache->thumbCount, cache->thumbCount * ART_THUMB_BYTES / 1024, cache->used, cache->slotCount,
+           cache->sessionUsed);
+    return 0;
+}
+
+static int verify(ArtCache *cache, const Catalog *catalog, const char *musicDir, const char *dumpDir) {
+    uint32_t bad = 0, checked = 0, none = 0, rebuilt = 0;
+    for (uint32_t s = 0; s < cache->slotCount; ++s) {
+        const ArtCacheSlot *slot = &cache->slots[s];
+        if (slot->key != 0 && slot->thumb != ART_THUMB_NONE && slot->thumb >= cache->thumbCount) {
+            printf("slot %u: thumbnail %u out of range\n", s, slot->thumb);
+            bad++;
+        }
+    }
+
+    uint64_t startUs = scanNowUs();
+    for (uint32_t i = 0; i < catalog->count; ++i) {
+        const char *relPath = catalogString(catalog, CATALOG_FIELD(catalog, filename, i));
+        if (!relPath || (CATALOG_FIELD(catalog, flags, i) & CATALOG_FLAG_MESSAGE)) continue;
+        checked++;
+        uint32_t thumb;
+        uint64_t contentHash = trackHash(catalog, i, musicDir, relPath);
+        if (!artworkLookup(cache, relPath, contentHash, &thumb)) {
+            thumb = artworkBuild(cache, musicDir, relPath, contentHash, NULL);
+            rebuilt++;
+        }
+        uint16_t stored[ART_THUMB_PIXELS], rebuilt[ART_THUMB_PIXELS];
+        bool haveSource = artworkLoadThumb(musicDir, relPath, rebuilt);
+        if (thumb == ART_THUMB_NONE) {
+            none++;
+            if (haveSource) {
+                printf("%s: cached as having no art, but has some\n", relPath);
+                bad++;
+            }
+            continue;
+        }
+        if (!artCacheReadThumb(cache, thumb, stored)) {
+            printf("%s: thumbnail %u unreadable\n", relPath, thumb);
+            bad++;
+        } else if (!haveSource || memcmp(stored, rebuilt, ART_THUMB_BYTES) != 0) {
+            printf("%s: thumbnail %u differs from its source\n", relPath, thumb);
+            bad++;
+        } else if (dumpDir) {
+            dumpThumb(dumpDir, i, stored);
+        }
+    }
+    printf("verified     %9u tracks (%u without art, %u looked up again) in %.2f ms, %u problems\n", checked,
+           none, rebuilt, (scanNowUs() - startUs) / 1000.0, bad);
+    return bad ? 1 : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: pearart [-d dataDir] [-v] [-p dumpDir] MUSIC_DIR\n");
+}
+
+int main(int argc, char **argv) {
+    const char *dataDir = "pearscan-data";
+    const char *dumpDir = NULL;
+    bool check = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:vp:")) != -1) {
+        switch (opt) {
+            case 'd': dataDir = optarg; break;
+            case 'v': check = true; break;
+            case 'p': dumpDir = optarg; break;
+            default:  usage(); return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        return 2;
+    }
+    const char *musicDir = argv[optind];
+    if (dumpDir) mkdir(dumpDir, 0777);
+
+    Catalog catalog;
+    catalogInit(&catalog);
+    if (!scanLibrary(musicDir, dataDir, &catalog)) {
+        catalogFree(&catalog);
+        return 1;
+    }
+
+    char indexPath[PATH_MAX], thumbPath[PATH_MAX];
+    snprintf(indexPath, sizeof(indexPath), "%s/art.idx", dataDir);
+    snprintf(thumbPath, sizeof(thumbPath), "%s/art.bin", dataDir);
+    ArtCache cache;
+    if (!artCacheOpen(&cache, indexPath, thumbPath)) {
+        catalogFree(&catalog);
+        return 1;
+    }
+    int status = check ? verify(&cache, &catalog, musicDir, dumpDir) : build(&cache, &catalog, musicDir, dumpDir);
+    artCacheClose(&cache);
+    catalogFree(&catalog);
+    return status;
+}
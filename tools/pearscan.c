@@ -0,0 +1,2056 @@
+// pearscan: runs the player's library scan on a desktop machine.
+// Builds from the same scanner, index, catalog, sort and search sources as
+// the app, so a change can be measured off-device before it ships. It only
+// measures; the pass/fail checks of each module are under tools/check
+// (make -C tools check).
+//
+//   pearscan [-r runs] [-d dataDir] [-c] [-t] [-j workers] MUSIC_DIR
+//   pearscan -s [-r runs] [-d dataDir] [-t] MUSIC_DIR
+//   pearscan -m [-r runs] FILE...
+//   pearscan -e [-r runs]
+//   pearscan -u [-r runs] FILE...
+//   pearscan -o [-r runs] [TRACKS]
+//   pearscan -q [-r runs] [TRACKS]
+//   pearscan -g [-r runs] [TRACKS]
+//   pearscan -b [-r runs] [TRACKS]
+//   pearscan -a [-r runs] [FILE...]
+//   pearscan -l [-r runs] [-d dataDir] [-j threads] [MUSIC_DIR]
+//   pearscan -k [-r runs] [-d dataDir] [-j workers] MUSIC_DIR
+//
+//   -r N   Scan N times (default 2: a cold pass, then a warm one)
+//   -d DIR Where library.idx is kept (default ./pearscan-data)
+//   -c     Cold every run: delete the index first
+//   -t     Scan on the background worker, the way the app does
+//   -j N   Read tags on N pool threads (default: one per core, up to 8;
+//          0 reads them on the scan thread)
+//   -s     Compare cold scans with tags read on the scan thread and on
+//          1, 2, 4 and 8 pool threads, best of -r runs each
+//   -m     Time the tag and duration readers on each FILE instead, next
+//          to the reader the extension alone would pick and a full decoder
+//          open where one is vendored (dr_flac), and average them per
+//          format (as sniffed from the first bytes)
+//   -e     Time tag text conversion on a built-in corpus of titles in
+//          every tag encoding, per encoding, pure ASCII apart from the rest
+//   -u     List the tracks each FILE (a .cue, or a FLAC with a CUESHEET block)
+//          splits into; FLAC blocks are compared with dr_flac's reading,
+//          and each FLAC image is decoded at every track start after a
+//          seek and from the beginning, timing both
+//   -o     Build the sort orders of a synthetic library of TRACKS tracks
+//          (default 50000) and time it, and switching between them, against
+//          re-sorting the rows with qsort and strcasecmp on every switch;
+//          then time re-sorting, an artist filter and a walk of every row
+//          over the columns and over an array of pointers to rows and
+//          strings malloc'd one by one, as the list once held them
+//   -q     Build the search index of a synthetic library of TRACKS tracks
+//          (default 100000) and time each keystroke of a set of queries
+//          against a case-insensitive substring scan of every row
+//   -g     Build the artist/album groups of a synthetic library of TRACKS
+//          tracks (default 100000) and time opening artists through the
+//          index against filtering the whole catalog
+//   -b     Append a synthetic library of TRACKS tracks (default 100000) to
+//          an empty catalog row by row, exiting non-zero if any row moves
+//          as chunks are added, and time sequential and random reads of
+//          its columns against the same reads from one flat array
+//   -a     Time the Q15 gain stage against per-sample float scaling, then
+//          print the loudness tags of each FILE and the multipliers they give
+//   -l     Time the loudness meter, then measure every untagged file under
+//          MUSIC_DIR on -j threads, report seconds of audio measured per
+//          second, save the gains into the index and rescan to check they
+//          stick
+//   -k     Time the content hash's mixing, then mirror MUSIC_DIR's music
+//          files under dataDir/moves (hard links where possible), scan and
+//          hash the mirror, move every file to a new folder and name (one in
+//          ten copied, one in ten also edited), and rescan with the hashes
+//          and without; reports the hashing cost and the cache-hit rate, and
+//          exits non-zero if a file that kept its bytes is not found or
+//          comes back with other tags
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strcasecmp, strncasecmp
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "scanner.h"
+#include "catalog.h"
+#include "sortindex.h"
+#include "search.h"
+#include "groupindex.h"
+#include "metadata.h"
+#include "textconv.h"
+#include "cue.h"
+#include "replaygain.h"
+#include "loudness.h"
+#include "contenthash.h"
+#include "artcache.h"
+#include "dr_flac.h"
+#include "synth.h"
+#include "fsutil.h"
+#include "textsamples.h"
+
+// --- Allocation Counting ---
+// Linked with -Wl,--wrap=malloc,... (see tools/Makefile), so every heap call
+// made by the scanner modules passes through here. Allocations libc makes for
+// itself (strdup, opendir, stdio buffers) are not seen.
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static _Atomic uint64_t s_allocCalls; // Bumped from the worker thread too
+static _Atomic uint64_t s_allocBytes;
+
+void *__wrap_malloc(size_t size) {
+    s_allocCalls++;
+    s_allocBytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    s_allocCalls++;
+    s_allocBytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    s_allocCalls++;
+    s_allocBytes += size;
+    return __real_realloc(ptr, size);
+}
+
+// --- Scan ---
+
+#define STEP_ENTRIES 256
+#define STEP_US      20000
+
+// The list row before the string arena: a malloc'd item whose fields were
+// each a strdup. Kept to price that scheme against the arena's counters.
+typedef struct {
+    char *filename;
+    char *title;
+    char *artist;
+    char *album;
+} StrdupListItem;
+
+static bool appendItem(const CatalogEntry *entry, void *user) {
+    return catalogAppend((Catalog*)user, entry);
+}
+
+static long peakRssKiB(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return usage.ru_maxrss; // KiB on Linux
+}
+
+static double msBetween(uint64_t startUs, uint64_t endUs) {
+    return (endUs - startUs) / 1000.0;
+}
+
+static TagPool s_pool; // Too big for the stack
+
+// Scans into `catalog`, reading tags on `workers` pool threads (0 = on the
+// scan thread).
+static bool scanOnce(const char *musicDir, const char *dataDir, const char *indexPath, bool threaded,
+                     int workers, Catalog *catalog, ScanStats *stats) {
+    catalogClear(catalog);
+    TagPool *pool = NULL;
+    if (workers > 0) {
+        if (!tagPoolStart(&s_pool, workers)) return false;
+        pool = &s_pool;
+    }
+
+    bool openFailed;
+    if (threaded) {
+        static ScanWorker worker;
+        if (!scanWorkerStart(&worker, musicDir, dataDir, indexPath, &catalog->strings, false, pool)) {
+            if (pool) tagPoolStop(pool);
+            return false;
+        }
+        while (!scanWorkerDrain(&worker, appendItem, catalog, SCAN_RING_CAPACITY)) {
+            bgThreadSleepUs(1000); // Stand-in for a frame
+        }
+        *stats = worker.scanner.stats;
+        openFailed = worker.scanner.openFailed;
+    } else {
+        Scanner scanner;
+        scannerBegin(&scanner, musicDir, dataDir, indexPath, &catalog->strings, appendItem, catalog);
+        scanner.pool = pool;
+        while (!scannerStep(&scanner, STEP_ENTRIES, STEP_US)) {}
+        *stats = scanner.stats;
+        openFailed = scanner.openFailed;
+    }
+    if (pool) tagPoolStop(pool);
+    if (openFailed) {
+        fprintf(stderr, "pearscan: cannot open %s\n", musicDir);
+        return false;
+    }
+    return true;
+}
+
+// One full scan into `catalog`, followed by the post-scan index builds.
+static bool runScan(int run, const char *musicDir, const char *dataDir, const char *indexPath,
+                    bool threaded, int workers, Catalog *catalog) {
+    uint64_t callsBefore = s_allocCalls;
+    uint64_t bytesBefore = s_allocBytes;
+    ScanStats stats;
+    if (!scanOnce(musicDir, dataDir, indexPath, threaded, workers, catalog, &stats)) return false;
+
+    uint64_t sortStartUs = scanNowUs();
+    SortIndex sortIndex;
+    sortIndexInit(&sortIndex);
+    sortIndexBuild(&sortIndex, catalog);
+    uint64_t searchStartUs = scanNowUs();
+    SearchIndex searchIndex;
+    searchIndexInit(&searchIndex);
+    searchIndexBuild(&searchIndex, catalog);
+    uint64_t groupStartUs = scanNowUs();
+    GroupIndex groups;
+    groupIndexInit(&groups);
+    groupIndexBuild(&groups, catalog, sortIndex.count ? sortIndex.rank[SORT_BY_FILENAME] : NULL);
+    uint64_t doneUs = scanNowUs();
+
+    double scanMs = msBetween(stats.startUs, stats.finishUs);
+    double filesPerSec = scanMs > 0 ? stats.itemsAdded / (scanMs / 1000.0) : 0;
+    const StrArenaStats *arena = &catalog->strings.stats;
+
+    printf("run %d%s, %d tag workers\n", run, threaded ? " (worker)" : "", workers);
+    printf("  scan         %9.2f ms  first item %.2f ms  %u steps\n", scanMs,
+           stats.itemsAdded ? msBetween(stats.startUs, stats.firstItemUs) : 0.0, stats.steps);
+    printf("  files        %9u      %.0f files/sec  %u probed  %u cue tracks\n", stats.itemsAdded, filesPerSec,
+           stats.itemsProbed, stats.cueTracks);
+    printf("  folders      %9u      %u read  %u skipped  %u entries  %u files changed in place\n",
+           stats.dirsVisited, stats.dirsRead, stats.dirsSkipped, stats.entriesRead, stats.filesChanged);
+    printf("  bytes read   %9llu      %.0f per probed file\n", (unsigned long long)stats.bytesRead,
+           stats.itemsProbed ? (double)stats.bytesRead / stats.itemsProbed : 0.0);
+    printf("  allocations  %9llu      %llu bytes requested\n",
+           (unsigned long long)(s_allocCalls - callsBefore), (unsigned long long)(s_allocBytes - bytesBefore));
+    printf("  catalog      %9u B    strings %u B used / %u B reserved, %u interned hits\n",
+           catalogMemoryUsed(catalog), arena->bytesUsed, arena->bytesReserved, arena->internHits);
+    // Per-field strdup: one item per row and one copy per string stored, intern hits included
+    uint64_t strdupCalls = (uint64_t)catalog->count + arena->stringsAdded + arena->internHits;
+    uint64_t strdupBytes = (uint64_t)catalog->count * sizeof(StrdupListItem) + arena->bytesRequested;
+    printf("  string heap  %9u allocs %u B reserved; malloc + strdup per field: %llu allocs, %llu B\n",
+           arena->allocations, arena->bytesReserved, (unsigned long long)strdupCalls,
+           (unsigned long long)strdupBytes);
+    printf("  sort index   %9.2f ms\n", msBetween(sortStartUs, searchStartUs));
+    printf("  search index %9.2f ms\n", msBetween(searchStartUs, groupStartUs));
+    printf("  group index  %9.2f ms  %u artists  %u albums  %u B\n", msBetween(groupStartUs, doneUs),
+           groups.artistCount, groups.albumCount, groupIndexMemoryUsed(&groups));
+    printf("  peak RSS     %9ld KiB\n", peakRssKiB());
+
+    groupIndexFree(&groups);
+    searchIndexFree(&searchIndex);
+    sortIndexFree(&sortIndex);
+    return true;
+}
+
+// --- Worker Scaling ---
+
+// FNV-1a over every row's strings, duration and ReplayGain, in catalog
+// order: equal digests mean the pool merged the same items in the same order.
+static uint32_t hashBytes(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < len; ++i) hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+static uint32_t catalogDigest(const Catalog *catalog) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        uint32_t refs[4] = { CATALOG_FIELD(catalog, filename, row), CATALOG_FIELD(catalog, title, row),
+                             CATALOG_FIELD(catalog, artist, row), CATALOG_FIELD(catalog, album, row) };
+        for (int i = 0; i < 4; ++i) {
+            const char *text = catalogString(catalog, refs[i]);
+            hash = hashBytes(hash, text ? text : "", text ? strlen(text) + 1 : 1);
+        }
+        uint32_t durationMs = CATALOG_FIELD(catalog, durationMs, row);
+        hash = hashBytes(hash, &durationMs, sizeof(durationMs));
+        ReplayGain gain = CATALOG_FIELD(catalog, gain, row);
+        hash = hashBytes(hash, &gain, sizeof(gain));
+    }
+    return hash;
+}
+
+// Cold scans with tags read on the scan thread, then on 1, 2, 4 and 8 pool
+// workers; best of `runs` each. The page cache is warm after the first
+// pass, so this measures how well tag parsing spreads over cores.
+static int benchWorkers(const char *musicDir, const char *dataDir, const char *indexPath, bool threaded,
+                        int runs, Catalog *catalog) {
+    static const int workerCounts[] = { 0, 1, 2, 4, 8 };
+    double baseRate = 0;
+    uint32_t baseDigest = 0;
+    int status = 0;
+    printf("%d cores online\n", bgThreadCores());
+    for (size_t w = 0; w < sizeof(workerCounts) / sizeof(workerCounts[0]); ++w) {
+        int workers = workerCounts[w];
+        double bestMs = 0;
+        ScanStats stats = { 0 };
+        for (int run = 0; run < runs; ++run) {
+            remove(indexPath);
+            if (!scanOnce(musicDir, dataDir, indexPath, threaded, workers, catalog, &stats)) return 1;
+            double ms = msBetween(stats.startUs, stats.finishUs);
+            if (run == 0 || ms < bestMs) bestMs = ms;
+        }
+        double rate = bestMs > 0 ? stats.itemsProbed / (bestMs / 1000.0) : 0;
+        uint32_t digest = catalogDigest(catalog);
+        if (w == 0) baseDigest = digest;
+        if (workers == 1) baseRate = rate;
+        bool same = digest == baseDigest;
+        if (!same) status = 1;
+
+        char label[32];
+        if (workers) snprintf(label, sizeof(label), "%d worker%s", workers, workers == 1 ? "" : "s");
+        else snprintf(label, sizeof(label), "scan thread");
+        printf("  %-12s %9.2f ms  %8.0f files/sec", label, bestMs, rate);
+        if (workers > 0 && baseRate > 0) printf("  x%.2f", rate / baseRate);
+        printf("  digest %08x%s\n", digest, same ? "" : "  MISMATCH");
+    }
+    return status;
+}
+
+// --- Tag Reader Benchmark ---
+
+typedef struct {
+    double us;
+    uint64_t bytes;
+    uint64_t reads;
+    uint64_t allocCalls;
+    uint64_t allocBytes;
+} ProbeCost;
+
+typedef struct {
+    FILE *file;
+    ProbeCost *cost;
+} DecoderInput;
+
+static size_t decoderRead(void *user, void *out, size_t bytes) {
+    DecoderInput *input = (DecoderInput*)user;
+    size_t got = fread(out, 1, bytes, input->file);
+    input->cost->bytes += got;
+    input->cost->reads++;
+    return got;
+}
+
+static drflac_bool32 decoderSeek(void *user, int offset, drflac_seek_origin origin) {
+    DecoderInput *input = (DecoderInput*)user;
+    return fseek(input->file, offset, origin == drflac_seek_origin_current ? SEEK_CUR : SEEK_SET) == 0;
+}
+
+// What the app would pay to get at the same fields through dr_flac.
+static bool probeFullFlacOpen(const char *path, ProbeCost *cost) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    setvbuf(file, NULL, _IONBF, 0); // Count the decoder's own reads, as the tag reader's are counted
+    DecoderInput input = { file, cost };
+    drflac *flac = drflac_open(decoderRead, decoderSeek, &input, NULL);
+    bool ok = flac != NULL;
+    if (flac) drflac_close(flac);
+    fclose(file);
+    return ok;
+}
+
+static bool probeTagReader(const char *path, TrackFormat format, uint64_t fileSize, StrArena *strings,
+                           ProbeCost *cost, TrackMetadata *meta) {
+    MetaIoStats io = { 0, 0 };
+    bool ok = metadataRead(path, format, fileSize, strings, meta, &io);
+    cost->bytes += io.bytesRead;
+    cost->reads += io.reads;
+    return ok;
+}
+
+// The reader the extension picks, run without sniffing the first bytes.
+static bool probeByExtension(const char *path, TrackFormat format, uint64_t fileSize, StrArena *strings,
+                             ProbeCost *cost, TrackMetadata *meta) {
+    MetaReader reader;
+    if (!metaReaderOpen(&reader, path, fileSize)) return false;
+    metadataParse(&reader, format, strings, meta);
+    cost->bytes += reader.stats.bytesRead;
+    cost->reads += reader.stats.reads;
+    metaReaderClose(&reader);
+    return true;
+}
+
+static void addCost(ProbeCost *total, const ProbeCost *cost) {
+    total->us += cost->us;
+    total->bytes += cost->bytes;
+    total->reads += cost->reads;
+    total->allocCalls += cost->allocCalls;
+    total->allocBytes += cost->allocBytes;
+}
+
+static void printCost(const char *label, const ProbeCost *total, int runs) {
+    printf("  %-12s %9.1f us  %9llu bytes  %4llu reads  %4llu allocs  %8llu alloc bytes\n", label,
+           total->us / runs, (unsigned long long)(total->bytes / runs), (unsigned long long)(total->reads / runs),
+           (unsigned long long)(total->allocCalls / runs), (unsigned long long)(total->allocBytes / runs));
+}
+
+static const char *const s_formatNames[] = { "other", "mp3", "ogg", "wav", "flac", "m4a" };
+#define FORMAT_COUNT (sizeof(s_formatNames) / sizeof(s_formatNames[0]))
+
+// Per-file averages over `runs` probes, then per-format averages. The OS page
+// cache is warm after the first run, so this measures CPU, bytes and call
+// counts rather than SD latency.
+static int benchTagReaders(char **files, int count, int runs) {
+    StrArena strings;
+    strArenaInit(&strings);
+    ProbeCost formatCost[FORMAT_COUNT] = { { 0 } };
+    uint32_t formatFiles[FORMAT_COUNT] = { 0 };
+    uint32_t formatTimed[FORMAT_COUNT] = { 0 };
+    ProbeCost extCost[FORMAT_COUNT] = { { 0 } };
+    uint32_t formatMislabelled[FORMAT_COUNT] = { 0 };
+    for (int f = 0; f < count; ++f) {
+        const char *path = files[f];
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            perror(path);
+            continue;
+        }
+        TrackFormat format = trackFormatFromExtension(path);
+        printf("%s (%llu bytes)\n", path, (unsigned long long)st.st_size);
+
+        ProbeCost tags = { 0 }, byExt = { 0 }, full = { 0 };
+        TrackMetadata meta, extMeta;
+        bool haveFull = false;
+        for (int run = 0; run < runs; ++run) {
+            strArenaReset(&strings);
+            uint64_t calls = s_allocCalls, bytes = s_allocBytes, startUs = scanNowUs();
+            probeTagReader(path, format, (uint64_t)st.st_size, &strings, &tags, &meta);
+            tags.us += scanNowUs() - startUs;
+            tags.allocCalls += s_allocCalls - calls;
+            tags.allocBytes += s_allocBytes - bytes;
+
+            calls = s_allocCalls;
+            bytes = s_allocBytes;
+            startUs = scanNowUs();
+            probeByExtension(path, format, (uint64_t)st.st_size, &strings, &byExt, &extMeta);
+            byExt.us += scanNowUs() - startUs;
+            byExt.allocCalls += s_allocCalls - calls;
+            byExt.allocBytes += s_allocBytes - bytes;
+
+            if (meta.format == TRACK_FORMAT_FLAC) {
+                calls = s_allocCalls;
+                bytes = s_allocBytes;
+                startUs = scanNowUs();
+                haveFull = probeFullFlacOpen(path, &full);
+                full.us += scanNowUs() - startUs;
+                full.allocCalls += s_allocCalls - calls;
+                full.allocBytes += s_allocBytes - bytes;
+            }
+        }
+        if (meta.format != format) printf("  %-12s %s, named .%s\n", "sniffed", s_formatNames[meta.format],
+                                          s_formatNames[format]);
+        printCost("tag reader", &tags, runs);
+        printCost("by extension", &byExt, runs);
+        if (haveFull) printCost("drflac_open", &full, runs);
+        printf("  %-12s %9u ms  %u Hz", "duration", meta.durationMs, meta.sampleRate);
+        if (extMeta.durationMs != meta.durationMs) printf("  (%u ms by extension)", extMeta.durationMs);
+        printf("\n");
+
+        format = meta.format;
+        addCost(&formatCost[format], &tags);
+        addCost(&extCost[format], &byExt);
+        formatFiles[format]++;
+        if (meta.format != trackFormatFromExtension(path)) formatMislabelled[format]++;
+        if (meta.durationMs) formatTimed[format]++;
+    }
+
+    printf("per format (average per file)\n");
+    for (uint32_t f = 0; f < FORMAT_COUNT; ++f) {
+        if (formatFiles[f] == 0) continue;
+        char label[32];
+        snprintf(label, sizeof(label), "%s x%u", s_formatNames[f], formatFiles[f]);
+        printCost(label, &formatCost[f], runs * (int)formatFiles[f]);
+        printCost("by extension", &extCost[f], runs * (int)formatFiles[f]);
+        printf("  %-12s %9u of %u files, %u mislabelled\n", "timed", formatTimed[f], formatFiles[f],
+               formatMislabelled[f]);
+    }
+    strArenaFree(&strings);
+    return 0;
+}
+
+// --- Text Conversion Benchmark ---
+
+#define TEXT_BENCH_PASSES 20000
+
+typedef struct {
+    MetaTextEncoding encoding;
+    const char *name;
+} TextKind;
+
+static const TextKind s_textKinds[] = {
+    { META_TEXT_LATIN1, "latin-1" },
+    { META_TEXT_UTF16, "utf-16" },
+    { META_TEXT_UTF16BE, "utf-16be" },
+    { META_TEXT_UTF8, "utf-8" },
+};
+
+// Converts every input of one encoding TEXT_BENCH_PASSES times; best of
+// `runs`. Only the first pass stores the strings: later ones find them
+// interned, as repeated artist and album names do in a scan.
+static void benchTextKind(const TextInput *inputs, uint32_t count, const TextKind *kind, bool ascii, int runs,
+                          StrArena *strings) {
+    uint32_t numStrings = 0;
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (inputs[i].encoding != kind->encoding || inputs[i].ascii != ascii) continue;
+        numStrings++;
+        bytes += inputs[i].len;
+    }
+    if (numStrings == 0) return;
+
+    double bestUs = 0;
+    uint64_t allocs = 0;
+    for (int run = 0; run < runs; ++run) {
+        strArenaReset(strings);
+        uint64_t calls = s_allocCalls;
+        uint64_t startUs = scanNowUs();
+        for (int pass = 0; pass < TEXT_BENCH_PASSES; ++pass) {
+            for (uint32_t i = 0; i < count; ++i) {
+                const TextInput *in = &inputs[i];
+                if (in->encoding != kind->encoding || in->ascii != ascii) continue;
+                textConvert(strings, in->encoding, in->data, in->len, NULL);
+            }
+        }
+        double us = (double)(scanNowUs() - startUs);
+        if (run == 0 || us < bestUs) bestUs = us;
+        allocs += s_allocCalls - calls;
+    }
+    double conversions = (double)numStrings * TEXT_BENCH_PASSES;
+    printf("  %-9s %-9s %3u strings %5llu bytes  %8.1f MB/s  %6.1f ns/string  %llu allocs\n", kind->name,
+           ascii ? "ascii" : "non-ascii", numStrings, (unsigned long long)bytes,
+           bestUs > 0 ? bytes * (double)TEXT_BENCH_PASSES / bestUs : 0.0, bestUs * 1000.0 / conversions,
+           (unsigned long long)allocs);
+}
+
+// Times textConvert() on the tag text samples per encoding, pure ASCII
+// apart from the rest.
+static int benchTextConvert(int runs) {
+    static TextInput inputs[TEXT_SAMPLE_INPUTS_MAX];
+    uint32_t edges;
+    uint32_t count = textSampleInputs(inputs, &edges);
+
+    StrArena strings;
+    strArenaInit(&strings);
+    printf("throughput, best of %d runs of %d passes\n", runs, TEXT_BENCH_PASSES);
+    for (size_t k = 0; k < sizeof(s_textKinds) / sizeof(s_textKinds[0]); ++k) {
+        benchTextKind(inputs, count, &s_textKinds[k], true, runs, &strings);
+        benchTextKind(inputs, count, &s_textKinds[k], false, runs, &strings);
+    }
+    strArenaFree(&strings);
+    return 0;
+}
+
+// --- Sort Benchmark ---
+
+#define SORT_BENCH_TRACKS   50000
+#define SORT_BENCH_SWITCHES 1000000
+
+static const Catalog *s_sortCatalog; // qsort has no context argument
+static SortKey s_sortKey;
+
+// The string a row sorts by, looked up on every compare like a sort
+// without the index would.
+static const char* sortString(uint32_t row) {
+    const Catalog *catalog = s_sortCatalog;
+    switch (s_sortKey) {
+        case SORT_BY_TITLE: {
+            const char *title = catalogString(catalog, CATALOG_FIELD(catalog, title, row));
+            if (title) return title;
+            const char *path = catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+            return path ? catalogBaseName(path) : NULL;
+        }
+        case SORT_BY_ARTIST: return catalogString(catalog, CATALOG_FIELD(catalog, artist, row));
+        case SORT_BY_ALBUM:  return catalogString(catalog, CATALOG_FIELD(catalog, album, row));
+        default:             return catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+    }
+}
+
+static int compareRowStrings(const void *a, const void *b) {
+    uint32_t ra = *(const uint32_t*)a;
+    uint32_t rb = *(const uint32_t*)b;
+    const char *sa = sortString(ra);
+    const char *sb = sortString(rb);
+    int cmp = (!sa || !sb) ? (sa ? -1 : (sb ? 1 : 0)) : strcasecmp(sa, sb);
+    if (cmp != 0) return cmp;
+    return ra < rb ? -1 : (ra > rb ? 1 : 0);
+}
+
+// The list before the column catalog: an array of pointers to rows
+// malloc'd one by one, each string a strdup of its own. Built from the same
+// catalog, in the shuffled order a scan meets files, so rows and strings end
+// up scattered over the heap the way they did on the device.
+typedef struct {
+    char *filename;
+    char *title;
+    char *artist;
+    char *album;
+    uint32_t durationMs;
+} PointerListItem;
+
+static char* dupString(const char *s) {
+    return s ? strdup(s) : NULL;
+}
+
+static PointerListItem** pointerListBuild(const Catalog *catalog) {
+    PointerListItem **items = (PointerListItem**)calloc(catalog->count, sizeof(PointerListItem*));
+    uint32_t *visit = (uint32_t*)malloc(catalog->count * sizeof(uint32_t));
+    if (!items || !visit) {
+        free(items);
+        free(visit);
+        return NULL;
+    }
+    uint32_t seed = 4242;
+    for (uint32_t row = 0; row < catalog->count; ++row) visit[row] = row;
+    for (uint32_t i = catalog->count; i > 1; --i) {
+        uint32_t j = synthRandom(&seed) % i;
+        uint32_t t = visit[i - 1];
+        visit[i - 1] = visit[j];
+        visit[j] = t;
+    }
+    for (uint32_t i = 0; i < catalog->count; ++i) {
+        uint32_t row = visit[i];
+        PointerListItem *item = (PointerListItem*)malloc(sizeof(PointerListItem));
+        if (!item) break;
+        item->filename = dupString(catalogString(catalog, CATALOG_FIELD(catalog, filename, row)));
+        item->title = dupString(catalogString(catalog, CATALOG_FIELD(catalog, title, row)));
+        item->artist = dupString(catalogString(catalog, CATALOG_FIELD(catalog, artist, row)));
+        item->album = dupString(catalogString(catalog, CATALOG_FIELD(catalog, album, row)));
+        item->durationMs = CATALOG_FIELD(catalog, durationMs, row);
+        items[row] = item;
+    }
+    free(visit);
+    return items;
+}
+
+static void pointerListFree(PointerListItem **items, uint32_t count) {
+    if (!items) return;
+    for (uint32_t row = 0; row < count; ++row) {
+        if (!items[row]) continue;
+        free(items[row]->filename);
+        free(items[row]->title);
+        free(items[row]->artist);
+        free(items[row]->album);
+        free(items[row]);
+    }
+    free(items);
+}
+
+static const char* itemString(const PointerListItem *item) {
+    switch (s_sortKey) {
+        case SORT_BY_TITLE:
+            if (item->title) return item->title;
+            return item->filename ? catalogBaseName(item->filename) : NULL;
+        case SORT_BY_ARTIST: return item->artist;
+        case SORT_BY_ALBUM:  return item->album;
+        default:             return item->filename;
+    }
+}
+
+static int compareItems(const void *a, const void *b) {
+    const PointerListItem *ia = *(const PointerListItem* const*)a;
+    const PointerListItem *ib = *(const PointerListItem* const*)b;
+    const char *sa = itemString(ia);
+    const char *sb = itemString(ib);
+    int cmp = (!sa || !sb) ? (sa ? -1 : (sb ? 1 : 0)) : strcasecmp(sa, sb);
+    if (cmp != 0) return cmp;
+    return ia < ib ? -1 : (ia > ib ? 1 : 0);
+}
+
+// What drawing a list row reads: the title (or file name), artist and duration.
+static uint32_t renderCost(const char *title, const char *path, const char *artist, uint32_t durationMs) {
+    if (!title) title = path ? catalogBaseName(path) : "";
+    return (uint32_t)strlen(title) + (artist ? (uint32_t)strlen(artist) : 0) + durationMs / 1000;
+}
+
+// Filtering by an artist and walking every row in title order, as the list
+// draws them, over the columns and over the pointer array.
+static void benchLayouts(const Catalog *catalog, const SortIndex *index, PointerListItem **items, int runs) {
+    volatile uint32_t sink = 0;
+    uint32_t artist = CATALOG_FIELD(catalog, artist, catalog->count / 3);
+    const char *artistName = catalogString(catalog, artist);
+    double best[2][2] = { { 0, 0 }, { 0, 0 } }; // [filter, walk][columns, pointers]
+    uint32_t matches[2] = { 0, 0 };
+    for (int run = 0; run < runs; ++run) {
+        double ms[2][2];
+        // Interned strings compare by ref; the pointer rows have to compare text
+        uint64_t startUs = scanNowUs();
+        uint32_t n = 0;
+        for (uint32_t row = 0; row < catalog->count; ++row) n += CATALOG_FIELD(catalog, artist, row) == artist;
+        matches[0] = n;
+        ms[0][0] = msBetween(startUs, scanNowUs());
+        startUs = scanNowUs();
+        n = 0;
+        for (uint32_t row = 0; row < catalog->count; ++row) {
+            n += artistName && items[row]->artist && strcmp(items[row]->artist, artistName) == 0;
+        }
+        matches[1] = n;
+        ms[0][1] = msBetween(startUs, scanNowUs());
+
+        const uint32_t *order = index->order[SORT_BY_TITLE];
+        startUs = scanNowUs();
+        for (uint32_t i = 0; i < catalog->count; ++i) {
+            uint32_t row = order[i];
+            sink += renderCost(catalogString(catalog, CATALOG_FIELD(catalog, title, row)),
+                               catalogString(catalog, CATALOG_FIELD(catalog, filename, row)),
+                               catalogString(catalog, CATALOG_FIELD(catalog, artist, row)),
+                               CATALOG_FIELD(catalog, durationMs, row));
+        }
+        ms[1][0] = msBetween(startUs, scanNowUs());
+        startUs = scanNowUs();
+        for (uint32_t i = 0; i < catalog->count; ++i) {
+            const PointerListItem *item = items[order[i]];
+            sink += renderCost(item->title, item->filename, item->artist, item->durationMs);
+        }
+        ms[1][1] = msBetween(startUs, scanNowUs());
+        for (int t = 0; t < 2; ++t) {
+            for (int l = 0; l < 2; ++l) {
+                if (run == 0 || ms[t][l] < best[t][l]) best[t][l] = ms[t][l];
+            }
+        }
+    }
+    (void)sink;
+    printf("  filter       %9.3f ms  columns, %9.3f ms pointer array: artist match, %u and %u rows%s\n",
+           best[0][0], best[0][1], matches[0], matches[1], matches[0] == matches[1] ? "" : "  MISMATCH");
+    printf("  render walk  %9.3f ms  columns, %9.3f ms pointer array: every row in title order\n", best[1][0],
+           best[1][1]);
+}
+
+// Builds every sort order of a synthetic library and times switching
+// between them against re-sorting the rows with strcasecmp per switch,
+// over the columns and over an array of pointers to scattered rows.
+static int benchSorting(uint32_t tracks, int runs) {
+    Catalog catalog;
+    catalogInit(&catalog);
+    synthCatalog(&catalog, tracks);
+    printf("%u tracks\n", catalog.count);
+
+    SortIndex index;
+    sortIndexInit(&index);
+    double bestMs = 0;
+    uint64_t allocBytes = 0;
+    for (int run = 0; run < runs; ++run) {
+        uint64_t bytesBefore = s_allocBytes;
+        uint64_t startUs = scanNowUs();
+        if (!sortIndexBuild(&index, &catalog)) return 1;
+        double ms = msBetween(startUs, scanNowUs());
+        if (run == 0 || ms < bestMs) bestMs = ms;
+        allocBytes = s_allocBytes - bytesBefore;
+    }
+    printf("  sort index   %9.2f ms  best of %d, all %d keys; %llu B allocated\n", bestMs, runs, SORT_KEY_COUNT,
+           (unsigned long long)allocBytes);
+
+    // A switch picks another order and keeps the selected track selected
+    volatile uint32_t sink = 0;
+    uint32_t selected = catalog.count / 2;
+    SortKey key = SORT_BY_TITLE;
+    uint64_t startUs = scanNowUs();
+    for (uint32_t i = 0; i < SORT_BENCH_SWITCHES; ++i) {
+        SortKey next = (SortKey)((key + 1) % SORT_KEY_COUNT);
+        selected = index.rank[next][index.order[key][selected]];
+        key = next;
+    }
+    sink += selected;
+    printf("  switch       %9.3f ns  per sort key change, selection kept\n",
+           (double)(scanNowUs() - startUs) * 1000.0 / SORT_BENCH_SWITCHES);
+
+    // Without the index, each switch re-sorts the rows
+    uint32_t *rows = (uint32_t*)malloc(catalog.count * sizeof(uint32_t));
+    PointerListItem **items = pointerListBuild(&catalog);
+    PointerListItem **sorted = (PointerListItem**)malloc(catalog.count * sizeof(PointerListItem*));
+    if (!rows || !items || !sorted) return 1;
+    s_sortCatalog = &catalog;
+    for (int k = 0; k < SORT_KEY_COUNT; ++k) {
+        s_sortKey = (SortKey)k;
+        double bestSortMs = 0, bestItemsMs = 0;
+        for (int run = 0; run < runs; ++run) {
+            for (uint32_t row = 0; row < catalog.count; ++row) rows[row] = row;
+            startUs = scanNowUs();
+            qsort(rows, catalog.count, sizeof(uint32_t), compareRowStrings);
+            double ms = msBetween(startUs, scanNowUs());
+            if (run == 0 || ms < bestSortMs) bestSortMs = ms;
+
+            memcpy(sorted, items, catalog.count * sizeof(PointerListItem*));
+            startUs = scanNowUs();
+            qsort(sorted, catalog.count, sizeof(PointerListItem*), compareItems);
+            ms = msBetween(startUs, scanNowUs());
+            if (run == 0 || ms < bestItemsMs) bestItemsMs = ms;
+        }
+        sink += rows[0];
+        printf("  re-sort      %9.2f ms  columns, %9.2f ms pointer array: by %s with strcasecmp\n", bestSortMs,
+               bestItemsMs, sortKeyName((SortKey)k));
+    }
+    (void)sink;
+    benchLayouts(&catalog, &index, items, runs);
+
+    free(sorted);
+    pointerListFree(items, catalog.count);
+    free(rows);
+    sortIndexFree(&index);
+    catalogFree(&catalog);
+    return 0;
+}
+
+// --- Search Benchmark ---
+
+#define SEARCH_BENCH_TRACKS 100000
+
+// Typed a character at a time, the way the search box receives them.
+static const char *const s_benchQueries[] = {
+    "song 4711",
+    "the artist 123",
+    "greatest hits",
+    "album 2 of artist 99",
+    "artist 5 song",
+    "s",
+};
+
+// True if `word` (`len` bytes) occurs anywhere in `text`, ignoring ASCII case.
+static bool containsFolded(const char *text, const char *word, size_t len) {
+    if (!text) return false;
+    for (; *text; ++text) {
+        if (strncasecmp(text, word, len) == 0) return true;
+    }
+    return false;
+}
+
+// What a search without the index does per keystroke: every row, every
+// query word, a substring scan of each field. Returns the rows matched.
+static uint32_t scanRows(const Catalog *catalog, const char *query) {
+    const char *words[SEARCH_MAX_WORDS];
+    size_t lens[SEARCH_MAX_WORDS];
+    int numWords = 0;
+    for (const char *p = query; *p && numWords < SEARCH_MAX_WORDS;) {
+        while (*p == ' ') p++;
+        if (!*p) break;
+        words[numWords] = p;
+        while (*p && *p != ' ') p++;
+        lens[numWords] = (size_t)(p - words[numWords]);
+        numWords++;
+    }
+    uint32_t matched = 0;
+    for (uint32_t row = 0; row < catalog->count && numWords > 0; ++row) {
+        const char *fields[4] = {
+            catalogString(catalog, CATALOG_FIELD(catalog, title, row)),
+            catalogString(catalog, CATALOG_FIELD(catalog, artist, row)),
+            catalogString(catalog, CATALOG_FIELD(catalog, album, row)),
+            catalogString(catalog, CATALOG_FIELD(catalog, filename, row)),
+        };
+        bool all = true;
+        for (int w = 0; w < numWords && all; ++w) {
+            all = containsFolded(fields[0], words[w], lens[w]) || containsFolded(fields[1], words[w], lens[w]) ||
+                  containsFolded(fields[2], words[w], lens[w]) || containsFolded(fields[3], words[w], lens[w]);
+        }
+        if (all) matched++;
+    }
+    return matched;
+}
+
+// Builds the search index of a synthetic library and times every keystroke
+// of the queries above, with the index and by scanning every row.
+static int benchSearch(uint32_t tracks, int runs) {
+    Catalog catalog;
+    catalogInit(&catalog);
+    synthCatalog(&catalog, tracks);
+    printf("%u tracks\n", catalog.count);
+
+    SortIndex sort;
+    sortIndexInit(&sort);
+    SearchIndex index;
+    searchIndexInit(&index);
+    if (!sortIndexBuild(&sort, &catalog)) return 1;
+    double bestMs = 0;
+    uint64_t allocBytes = 0;
+    for (int run = 0; run < runs; ++run) {
+        uint64_t bytesBefore = s_allocBytes;
+        uint64_t startUs = scanNowUs();
+        if (!searchIndexBuild(&index, &catalog)) return 1;
+        double ms = msBetween(startUs, scanNowUs());
+        if (run == 0 || ms < bestMs) bestMs = ms;
+        allocBytes = s_allocBytes - bytesBefore;
+    }
+    printf("  search index %9.2f ms  best of %d; %llu B allocated\n", bestMs, runs,
+           (unsigned long long)allocBytes);
+
+    printf("  %-22s %5s %8s %10s %10s %10s\n", "query", "keys", "rows", "index us", "worst us", "scan us");
+    SearchResult result;
+    searchResultInit(&result);
+    volatile uint32_t sink = 0;
+    char query[SEARCH_MAX_QUERY];
+    for (size_t q = 0; q < sizeof(s_benchQueries) / sizeof(s_benchQueries[0]); ++q) {
+        size_t len = strlen(s_benchQueries[q]);
+        double bestIndexUs = 0, bestWorstUs = 0, bestScanUs = 0;
+        for (int run = 0; run < runs; ++run) {
+            double indexUs = 0, worstUs = 0, scanUs = 0;
+            result.query[0] = '\0'; // Start each run from an empty box
+            for (size_t i = 1; i <= len; ++i) {
+                memcpy(query, s_benchQueries[q], i);
+                query[i] = '\0';
+                uint64_t startUs = scanNowUs();
+                if (!searchRun(&result, &index, &catalog, query, sort.rank[SORT_BY_TITLE])) return 1;
+                double us = (double)(scanNowUs() - startUs);
+                indexUs += us;
+                if (us > worstUs) worstUs = us;
+                startUs = scanNowUs();
+                sink += scanRows(&catalog, query);
+                scanUs += (double)(scanNowUs() - startUs);
+            }
+            if (run == 0 || indexUs < bestIndexUs) bestIndexUs = indexUs;
+            if (run == 0 || worstUs < bestWorstUs) bestWorstUs = worstUs;
+            if (run == 0 || scanUs < bestScanUs) bestScanUs = scanUs;
+        }
+        printf("  %-22s %5zu %8u %10.1f %10.1f %10.1f\n", s_benchQueries[q], len, result.count,
+               bestIndexUs / len, bestWorstUs, bestScanUs / len);
+    }
+    printf("  (per keystroke: mean with the index, its worst, mean scanning every row)\n");
+    (void)sink;
+
+    searchResultFree(&result);
+    searchIndexFree(&index);
+    sortIndexFree(&sort);
+    catalogFree(&catalog);
+    return 0;
+}
+
+// --- Catalog Access Benchmark ---
+
+#define TABLE_BENCH_TRACKS 100000
+#define TABLE_BENCH_PASSES 20
+
+static void rowEntry(const Catalog *catalog, uint32_t row, CatalogEntry *entry) {
+    entry->contentHash = CATALOG_FIELD(catalog, contentHash, row);
+    entry->filename = CATALOG_FIELD(catalog, filename, row);
+    entry->title = CATALOG_FIELD(catalog, title, row);
+    entry->artist = CATALOG_FIELD(catalog, artist, row);
+    entry->album = CATALOG_FIELD(catalog, album, row);
+    entry->durationMs = CATALOG_FIELD(catalog, durationMs, row);
+    entry->startFrame = CATALOG_FIELD(catalog, startFrame, row);
+    entry->endFrame = CATALOG_FIELD(catalog, endFrame, row);
+    entry->gain = CATALOG_FIELD(catalog, gain, row);
+    entry->trackNumber = CATALOG_FIELD(catalog, trackNumber, row);
+    entry->format = CATALOG_FIELD(catalog, format, row);
+    entry->flags = CATALOG_FIELD(catalog, flags, row);
+}
+
+// Nanoseconds per row of reading two columns in `order`, best of `runs`,
+// through CATALOG_FIELD or (with `flat` set) from one flat array of pairs.
+static double timeAccess(const Catalog *catalog, const uint32_t *flat, const uint32_t *order, int runs) {
+    volatile uint32_t sink = 0;
+    double bestNs = 0;
+    for (int run = 0; run < runs; ++run) {
+        uint32_t sum = 0;
+        uint64_t startUs = scanNowUs();
+        for (int pass = 0; pass < TABLE_BENCH_PASSES; ++pass) {
+            if (flat) {
+                for (uint32_t i = 0; i < catalog->count; ++i) sum += flat[2 * order[i]] + flat[2 * order[i] + 1];
+            } else {
+                for (uint32_t i = 0; i < catalog->count; ++i) {
+                    uint32_t row = order[i];
+                    sum += CATALOG_FIELD(catalog, durationMs, row) + CATALOG_FIELD(catalog, title, row);
+                }
+            }
+        }
+        double ns = (double)(scanNowUs() - startUs) * 1000.0 / ((double)catalog->count * TABLE_BENCH_PASSES);
+        if (run == 0 || ns < bestNs) bestNs = ns;
+        sink += sum;
+    }
+    (void)sink;
+    return bestNs;
+}
+
+// Appends a synthetic library row by row into an empty catalog, checking
+// that no row moves as chunks are added, then times sequential and random
+// column reads against the same reads from one flat array.
+static int benchCatalog(uint32_t tracks, int runs) {
+    Catalog source, table;
+    catalogInit(&source);
+    catalogInit(&table);
+    synthCatalog(&source, tracks);
+    uint32_t count = source.count;
+    const uint32_t **where = (const uint32_t**)malloc(count * sizeof(uint32_t*));
+    uint32_t *order = (uint32_t*)malloc(count * sizeof(uint32_t));
+    uint32_t *flat = (uint32_t*)malloc(2 * count * sizeof(uint32_t));
+    if (!where || !order || !flat) return 1;
+    printf("%u rows in chunks of %u\n", count, CATALOG_CHUNK_SIZE);
+
+    double bestMs = 0;
+    uint32_t moved = 0;
+    for (int run = 0; run < runs; ++run) {
+        catalogClear(&table);
+        CatalogEntry entry;
+        uint64_t startUs = scanNowUs();
+        for (uint32_t row = 0; row < count; ++row) {
+            rowEntry(&source, row, &entry);
+            if (!catalogAppend(&table, &entry)) return 1;
+            where[row] = &CATALOG_FIELD(&table, title, row);
+        }
+        double ms = msBetween(startUs, scanNowUs());
+        if (run == 0 || ms < bestMs) bestMs = ms;
+        // Every row is where it was when it was appended
+        for (uint32_t row = 0; row < count; ++row) moved += where[row] != &CATALOG_FIELD(&table, title, row);
+    }
+    printf("  fill         %9.2f ms  best of %d, %.1f ns per row; %u rows moved while %u chunks were added\n",
+           bestMs, runs, bestMs * 1e6 / count, moved, table.numChunks);
+
+    for (uint32_t row = 0; row < count; ++row) {
+        order[row] = row;
+        flat[2 * row] = CATALOG_FIELD(&table, durationMs, row);
+        flat[2 * row + 1] = CATALOG_FIELD(&table, title, row);
+    }
+    double seqNs = timeAccess(&table, NULL, order, runs);
+    double seqFlatNs = timeAccess(&table, flat, order, runs);
+    uint32_t seed = 99;
+    for (uint32_t i = count; i > 1; --i) {
+        uint32_t j = synthRandom(&seed) % i;
+        uint32_t t = order[i - 1];
+        order[i - 1] = order[j];
+        order[j] = t;
+    }
+    double randNs = timeAccess(&table, NULL, order, runs);
+    double randFlatNs = timeAccess(&table, flat, order, runs);
+    printf("  sequential   %9.3f ns  per row through CATALOG_FIELD, %.3f ns from a flat array\n", seqNs, seqFlatNs);
+    printf("  random       %9.3f ns  per row through CATALOG_FIELD, %.3f ns from a flat array\n", randNs,
+           randFlatNs);
+
+    free(flat);
+    free(order);
+    free(where);
+    catalogFree(&table);
+    catalogFree(&source);
+    return moved ? 1 : 0;
+}
+
+// --- Grouping Benchmark ---
+
+#define GROUP_BENCH_TRACKS       100000
+#define GROUP_NAIVE_OPENS        200 // Artists opened by filtering the whole catalog, for comparison
+
+// Builds the artist/album groups of a synthetic library and times opening
+// artists and albums from the index against filtering the whole catalog,
+// the way the flat list would have to.
+static int benchGrouping(uint32_t tracks, int runs) {
+    Catalog catalog;
+    catalogInit(&catalog);
+    synthCatalog(&catalog, tracks);
+    printf("%u tracks\n", catalog.count);
+
+    SortIndex sortIndex;
+    sortIndexInit(&sortIndex);
+    uint64_t startUs = scanNowUs();
+    if (!sortIndexBuild(&sortIndex, &catalog)) return 1;
+    printf("  sort index   %9.2f ms  (for the filename rank)\n", msBetween(startUs, scanNowUs()));
+    const uint32_t *rank = sortIndex.rank[SORT_BY_FILENAME];
+
+    GroupIndex groups;
+    groupIndexInit(&groups);
+    double bestMs = 0;
+    uint64_t allocBytes = 0;
+    for (int run = 0; run < runs; ++run) {
+        uint64_t bytesBefore = s_allocBytes;
+        startUs = scanNowUs();
+        if (!groupIndexBuild(&groups, &catalog, rank)) return 1;
+        double ms = msBetween(startUs, scanNowUs());
+        if (run == 0 || ms < bestMs) bestMs = ms;
+        allocBytes = s_allocBytes - bytesBefore;
+    }
+    uint32_t memory = groupIndexMemoryUsed(&groups);
+    printf("  group index  %9.2f ms  best of %d  %u artists  %u albums\n", bestMs, runs, groups.artistCount,
+           groups.albumCount);
+    printf("  memory       %9u B    %.1f per track; %llu B allocated while building\n", memory,
+           (double)memory / catalog.count, (unsigned long long)allocBytes);
+
+    // Every artist's albums and every album's tracks, walked through the index
+    volatile uint32_t sink = 0;
+    startUs = scanNowUs();
+    uint64_t walked = 0;
+    for (uint32_t ar = 0; ar < groups.artistCount; ++ar) {
+        uint32_t firstAlbum;
+        uint32_t albums = groupArtistAlbums(&groups, ar, &firstAlbum);
+        for (uint32_t al = firstAlbum; al < firstAlbum + albums; ++al) {
+            const uint32_t *rows;
+            uint32_t n = groupAlbumTracks(&groups, al, &rows);
+            for (uint32_t t = 0; t < n; ++t) sink += rows[t];
+            walked += n;
+        }
+    }
+    double indexUs = (double)(scanNowUs() - startUs);
+    printf("  open (index) %9.3f us   per artist, all albums and tracks walked (%llu rows)\n",
+           indexUs / groups.artistCount, (unsigned long long)walked);
+
+    // The same for a sample of artists by filtering every row
+    uint32_t opens = groups.artistCount < GROUP_NAIVE_OPENS ? groups.artistCount : GROUP_NAIVE_OPENS;
+    startUs = scanNowUs();
+    for (uint32_t i = 0; i < opens; ++i) {
+        uint32_t name = groups.artists[i * (groups.artistCount / opens)].name;
+        for (uint32_t row = 0; row < catalog.count; ++row) {
+            if (synthCompareNames(&catalog, CATALOG_FIELD(&catalog, artist, row), name) == 0) sink += row;
+        }
+    }
+    double naiveUs = (double)(scanNowUs() - startUs);
+    printf("  open (scan)  %9.3f us   per artist, filtering all rows\n", naiveUs / opens);
+    (void)sink;
+
+    groupIndexFree(&groups);
+    sortIndexFree(&sortIndex);
+    catalogFree(&catalog);
+    return 0;
+}
+
+// --- Cue Sheets ---
+
+// A FLAC's CUESHEET as dr_flac reads it, for comparing with cueReadFlac().
+typedef struct {
+    bool found;
+    uint32_t count;
+    uint32_t numbers[CUE_MAX_TRACKS];
+    uint64_t starts[CUE_MAX_TRACKS];
+} FlacCueTracks;
+
+static void onFlacMetadata(void *user, drflac_metadata *metadata) {
+    FlacCueTracks *out = (FlacCueTracks*)user;
+    if (metadata->type != DRFLAC_METADATA_BLOCK_TYPE_CUESHEET) return;
+    out->found = true;
+    drflac_cuesheet_track_iterator it;
+    drflac_init_cuesheet_track_iterator(&it, metadata->data.cuesheet.trackCount, metadata->data.cuesheet.pTrackData);
+    drflac_cuesheet_track track;
+    while (drflac_next_cuesheet_track(&it, &track) && out->count < CUE_MAX_TRACKS) {
+        if (track.trackNumber == 170 || track.trackNumber == 255) break; // Lead-out
+        // dr_flac's isAudio is the format's non-audio bit, as read
+        if (track.isAudio || track.indexCount == 0) continue;
+        uint64_t start = 0;
+        for (uint32_t i = 0; i < track.indexCount; ++i) {
+            drflac_cuesheet_track_index index; // Not aligned in dr_flac's buffer
+            memcpy(&index, &track.pIndexPoints[i], sizeof(index));
+            if (i == 0 || index.index == 1) start = track.offset + index.offset;
+        }
+        out->numbers[out->count] = track.trackNumber;
+        out->starts[out->count++] = start;
+    }
+}
+
+// Compares an embedded sheet with dr_flac's reading of the same block.
+static int crossCheckFlacCue(const char *path, const CueSheet *sheet) {
+    static FlacCueTracks ref;
+    memset(&ref, 0, sizeof(ref));
+    drflac *flac = drflac_open_file_with_metadata(path, onFlacMetadata, &ref, NULL);
+    if (flac) drflac_close(flac);
+    bool same = ref.found && ref.count == sheet->count;
+    for (uint32_t i = 0; same && i < ref.count; ++i) {
+        same = ref.numbers[i] == sheet->tracks[i].number && ref.starts[i] == sheet->tracks[i].start;
+    }
+    printf("  dr_flac      %9s      %u tracks\n", same ? "same" : "DIFFERS", ref.count);
+    return same ? 0 : 1;
+}
+
+#define CUE_CHECK_FRAMES 4096 // Decoded and compared at each track start
+
+// Decodes the first frames of each track two ways, after a seek and by
+// decoding from the start of the image, and times both.
+static int checkCueSeeks(const char *path, const CueSheet *sheet, uint32_t rate, uint64_t frameCount, int runs) {
+    drflac *flac = drflac_open_file(path, NULL);
+    if (!flac) {
+        printf("  seek check   cannot decode\n");
+        return 1;
+    }
+    size_t span = (size_t)CUE_CHECK_FRAMES * flac->channels;
+    int32_t *expected = (int32_t*)calloc(sheet->count * span, sizeof(int32_t));
+    int32_t *got = (int32_t*)calloc(span, sizeof(int32_t));
+    uint32_t *lengths = (uint32_t*)calloc(sheet->count, sizeof(uint32_t));
+    if (!expected || !got || !lengths) {
+        free(expected);
+        free(got);
+        free(lengths);
+        drflac_close(flac);
+        return 1;
+    }
+
+    // From the start: what a player with no seek pays to reach each track
+    uint64_t startUs = scanNowUs();
+    double reachUs = 0;
+    uint64_t pos = 0;
+    for (uint32_t i = 0; i < sheet->count; ++i) {
+        uint64_t start = cueTrackStart(sheet, i, rate);
+        while (pos < start) {
+            uint64_t n = start - pos < CUE_CHECK_FRAMES ? start - pos : CUE_CHECK_FRAMES;
+            uint64_t read = drflac_read_pcm_frames_s32(flac, n, got);
+            if (read == 0) break;
+            pos += read;
+        }
+        reachUs += (double)(scanNowUs() - startUs);
+        uint64_t want = cueTrackEnd(sheet, i, rate, frameCount) - start;
+        if (want > CUE_CHECK_FRAMES) want = CUE_CHECK_FRAMES;
+        lengths[i] = (uint32_t)drflac_read_pcm_frames_s32(flac, want, expected + i * span);
+        pos += lengths[i];
+    }
+
+    double bestUs = 0;
+    uint32_t matched = 0;
+    for (int run = 0; run < runs; ++run) {
+        matched = 0;
+        uint64_t seekStartUs = scanNowUs();
+        for (uint32_t i = 0; i < sheet->count; ++i) {
+            if (!drflac_seek_to_pcm_frame(flac, cueTrackStart(sheet, i, rate))) continue;
+            uint64_t read = drflac_read_pcm_frames_s32(flac, lengths[i], got);
+            if (read == lengths[i] && memcmp(got, expected + i * span, read * flac->channels * sizeof(int32_t)) == 0) {
+                matched++;
+            }
+        }
+        double us = (double)(scanNowUs() - seekStartUs);
+        if (run == 0 || us < bestUs) bestUs = us;
+    }
+    printf("  seek         %9.1f us   per track, %u of %u tracks decode the same\n", bestUs / sheet->count, matched,
+           sheet->count);
+    printf("  from start   %9.1f us   per track on average\n", reachUs / sheet->count);
+
+    free(expected);
+    free(got);
+    free(lengths);
+    drflac_close(flac);
+    return matched == sheet->count ? 0 : 1;
+}
+
+// The image a .cue names, in the sheet's folder: an exact name first, then
+// the same stem, as the scanner matches it.
+static bool findCueImage(const char *cuePath, const CueSheet *sheet, char *path, size_t size) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", cuePath);
+    char *slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    else snprintf(dir, sizeof(dir), ".");
+    for (int pass = 0; pass < 2; ++pass) {
+        DIR *d = opendir(dir);
+        if (!d) return false;
+        struct dirent *entry;
+        while ((entry = readdir(d))) {
+            TrackFormat format = trackFormatFromExtension(entry->d_name);
+            if ((format != TRACK_FORMAT_FLAC && format != TRACK_FORMAT_WAV) ||
+                !cueNamesFile(sheet, entry->d_name, pass == 1)) {
+                continue;
+            }
+            int n = snprintf(path, size, "%s/%s", dir, entry->d_name);
+            closedir(d);
+            return n >= 0 && (size_t)n < size;
+        }
+        closedir(d);
+    }
+    return false;
+}
+
+// Lists the tracks each .cue or FLAC splits into, cross-checks FLAC
+// CUESHEET blocks with dr_flac and times seeking to each track.
+static int listCueSheets(char **files, int count, int runs) {
+    StrArena strings;
+    strArenaInit(&strings);
+    int failures = 0;
+
+    static CueSheet sheet;
+    for (int f = 0; f < count; ++f) {
+        const char *path = files[f];
+        char image[PATH_MAX];
+        bool embedded = !cueIsSheetName(path);
+        if (!embedded) {
+            MetaIoStats io = { 0, 0 };
+            if (!cueLoad(path, &strings, &sheet, &io) || !findCueImage(path, &sheet, image, sizeof(image))) {
+                printf("%s: no sheet, or no image for it\n", path);
+                failures++;
+                continue;
+            }
+        } else {
+            snprintf(image, sizeof(image), "%s", path);
+        }
+
+        struct stat st;
+        MetaReader reader;
+        if (stat(image, &st) != 0 || !metaReaderOpen(&reader, image, (uint64_t)st.st_size)) {
+            perror(image);
+            failures++;
+            continue;
+        }
+        TrackMetadata meta;
+        metadataParse(&reader, metadataSniff(&reader, trackFormatFromExtension(image)), &strings, &meta);
+        bool haveSheet = !embedded || (meta.format == TRACK_FORMAT_FLAC && cueReadFlac(&reader, &sheet));
+        metaReaderClose(&reader);
+        printf("%s -> %s, %u Hz, %llu frames\n", path, image, meta.sampleRate, (unsigned long long)meta.frameCount);
+        if (!haveSheet || meta.sampleRate == 0) {
+            printf("  no cuesheet\n");
+            if (embedded) failures++;
+            continue;
+        }
+
+        for (uint32_t i = 0; i < sheet.count; ++i) {
+            const CueTrack *track = &sheet.tracks[i];
+            uint64_t start = cueTrackStart(&sheet, i, meta.sampleRate);
+            uint64_t end = cueTrackEnd(&sheet, i, meta.sampleRate, meta.frameCount);
+            const char *performer = strArenaGet(&strings, track->performer);
+            printf("  %02u %10llu..%-10llu %8.2f s  %s%s%s\n", track->number, (unsigned long long)start,
+                   (unsigned long long)end, end > start ? (double)(end - start) / meta.sampleRate : 0.0,
+                   track->title != STRARENA_NONE ? strArenaGet(&strings, track->title) : "-",
+                   performer ? " / " : "", performer ? performer : "");
+        }
+        if (embedded) failures += crossCheckFlacCue(image, &sheet);
+        if (meta.format == TRACK_FORMAT_FLAC) {
+            failures += checkCueSeeks(image, &sheet, meta.sampleRate, meta.frameCount, runs);
+        }
+    }
+    strArenaFree(&strings);
+    return failures ? 1 : 0;
+}
+
+// --- ReplayGain ---
+
+// Float per-sample scaling, as an output path without the gain stage would do it.
+static void applyFloat(int16_t *samples, size_t count, float scale) {
+    for (size_t i = 0; i < count; ++i) {
+        float y = samples[i] * scale;
+        samples[i] = (int16_t)(y > 32767.0f ? 32767 : y < -32768.0f ? -32768 : lrintf(y));
+    }
+}
+
+#define GAIN_BENCH_SAMPLES  (1024 * 1024)
+#define GAIN_BENCH_PASSES   16
+
+static void benchGainStage(int runs) {
+    int16_t *source = (int16_t*)malloc(GAIN_BENCH_SAMPLES * sizeof(int16_t));
+    int16_t *work = (int16_t*)malloc(GAIN_BENCH_SAMPLES * sizeof(int16_t));
+    if (!source || !work) {
+        free(source);
+        free(work);
+        return;
+    }
+    uint32_t seed = 99;
+    for (size_t i = 0; i < GAIN_BENCH_SAMPLES; ++i) source[i] = (int16_t)(synthRandom(&seed) & 0xFFFF);
+    ReplayGain gain = { -654, REPLAYGAIN_NONE, 32392, 0 };
+    int32_t multiplier = replayGainMultiplier(&gain, REPLAYGAIN_TRACK, 0, true);
+    float scale = (float)multiplier / REPLAYGAIN_UNITY;
+
+    double bestFixed = 0, bestFloat = 0;
+    for (int run = 0; run < runs; ++run) {
+        double fixedUs = 0, floatUs = 0;
+        for (int pass = 0; pass < GAIN_BENCH_PASSES; ++pass) {
+            memcpy(work, source, GAIN_BENCH_SAMPLES * sizeof(int16_t));
+            uint64_t startUs = scanNowUs();
+            replayGainApply(work, GAIN_BENCH_SAMPLES, multiplier);
+            fixedUs += (double)(scanNowUs() - startUs);
+            memcpy(work, source, GAIN_BENCH_SAMPLES * sizeof(int16_t));
+            startUs = scanNowUs();
+            applyFloat(work, GAIN_BENCH_SAMPLES, scale);
+            floatUs += (double)(scanNowUs() - startUs);
+        }
+        if (run == 0 || fixedUs < bestFixed) bestFixed = fixedUs;
+        if (run == 0 || floatUs < bestFloat) bestFloat = floatUs;
+    }
+    double samples = (double)GAIN_BENCH_SAMPLES * GAIN_BENCH_PASSES;
+    printf("throughput, best of %d runs of %d x %d samples\n", runs, GAIN_BENCH_PASSES, GAIN_BENCH_SAMPLES);
+    printf("  Q15 stage    %8.1f Msamples/s  (%.0fx real time at 48 kHz stereo)\n", samples / bestFixed,
+           samples / bestFixed * 1e6 / 96000.0);
+    printf("  float scale  %8.1f Msamples/s\n", samples / bestFloat);
+    free(source);
+    free(work);
+}
+
+static void printGainValue(const char *label, int16_t db, uint16_t peak) {
+    if (db == REPLAYGAIN_NONE) printf("  %-6s gain -", label);
+    else printf("  %-6s gain %+7.2f dB", label, db / 100.0);
+    if (peak) printf("  peak %.6f", (double)peak / REPLAYGAIN_UNITY);
+    printf("\n");
+}
+
+// Times the gain stage, then prints the loudness tags of each FILE and the
+// multipliers they come to.
+static int benchReplayGain(char **files, int count, int runs) {
+    int failures = 0;
+    benchGainStage(runs);
+
+    StrArena strings;
+    strArenaInit(&strings);
+    for (int f = 0; f < count; ++f) {
+        struct stat st;
+        TrackMetadata meta;
+        if (stat(files[f], &st) != 0 ||
+            !metadataRead(files[f], trackFormatFromExtension(files[f]), (uint64_t)st.st_size, &strings, &meta, NULL)) {
+            perror(files[f]);
+            failures++;
+            continue;
+        }
+        printf("%s\n", files[f]);
+        printGainValue("track", meta.gain.trackGain, meta.gain.trackPeak);
+        printGainValue("album", meta.gain.albumGain, meta.gain.albumPeak);
+        printf("  multiplier track %d, album %d (Q15, clipping prevented)\n",
+               replayGainMultiplier(&meta.gain, REPLAYGAIN_TRACK, 0, true),
+               replayGainMultiplier(&meta.gain, REPLAYGAIN_ALBUM, 0, true));
+        strArenaReset(&strings);
+    }
+    strArenaFree(&strings);
+    return failures ? 1 : 0;
+}
+
+// --- Loudness Analysis ---
+
+// The meter alone over 48 kHz stereo noise, in seconds of audio per second.
+static void benchLoudnessMeter(int runs) {
+    static LoudnessMeter meter;
+    const uint32_t seconds = 60;
+    float *pcm = (float*)malloc(48000 * 2 * sizeof(float));
+    if (!pcm) return;
+    uint32_t state = 5, left = 0;
+    float level = 0.0f;
+    synthProgramme(pcm, 48000, &state, &left, &level);
+    double best = 0.0;
+    for (int run = 0; run < runs; ++run) {
+        loudnessMeterInit(&meter, 48000, 2);
+        uint64_t startUs = scanNowUs();
+        for (uint32_t s = 0; s < seconds; ++s) loudnessMeterAdd(&meter, pcm, 48000);
+        double us = (double)(scanNowUs() - startUs);
+        if (run == 0 || us < best) best = us;
+    }
+    printf("meter alone, 48 kHz stereo, best of %d runs: %.0f s of audio per second\n", runs,
+           seconds / (best / 1e6));
+    free(pcm);
+}
+
+// One file of a batch and what measuring it came to.
+typedef struct {
+    uint32_t row;
+    char path[PATH_MAX];
+    TrackFormat format;
+    bool measured;
+    LoudnessResult result;
+    MetaIoStats io;
+} BatchItem;
+
+typedef struct {
+    BatchItem *items;
+    uint32_t count;
+    _Atomic uint32_t next; // Next item to take
+} Batch;
+
+static void batchWorker(void *arg) {
+    Batch *batch = (Batch*)arg;
+    for (;;) {
+        uint32_t i = atomic_fetch_add(&batch->next, 1);
+        if (i >= batch->count) return;
+        BatchItem *item = &batch->items[i];
+        memset(&item->io, 0, sizeof(item->io));
+        item->measured = loudnessAnalyseFile(item->path, item->format, NULL, &item->result, &item->io);
+    }
+}
+
+// The rows the device job would measure: untagged, decodable, not cue
+// sheet tracks, not measured before.
+static bool batchWants(const Catalog *catalog, uint32_t row) {
+    uint8_t flags = CATALOG_FIELD(catalog, flags, row);
+    const ReplayGain *gain = &CATALOG_FIELD(catalog, gain, row);
+    return !(flags & (CATALOG_FLAG_MESSAGE | CATALOG_FLAG_CUE | CATALOG_FLAG_MEASURED | CATALOG_FLAG_PENDING)) &&
+           gain->trackGain == REPLAYGAIN_NONE && gain->albumGain == REPLAYGAIN_NONE &&
+           loudnessCanDecode((TrackFormat)CATALOG_FIELD(catalog, format, row));
+}
+
+static uint32_t collectBatch(const Catalog *catalog, const char *musicDir, BatchItem **items) {
+    uint32_t count = 0;
+    for (uint32_t row = 0; row < catalog->count; ++row) count += batchWants(catalog, row);
+    *items = count ? (BatchItem*)calloc(count, sizeof(BatchItem)) : NULL;
+    if (count && !*items) return 0;
+    uint32_t n = 0;
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        if (!batchWants(catalog, row)) continue;
+        BatchItem *item = &(*items)[n++];
+        item->row = row;
+        item->format = (TrackFormat)CATALOG_FIELD(catalog, format, row);
+        snprintf(item->path, sizeof(item->path), "%s/%s", musicDir,
+                 catalogString(catalog, CATALOG_FIELD(catalog, filename, row)));
+    }
+    return n;
+}
+
+// Measures every untagged file of the library on `threads` threads, `runs`
+// times, saves the gains into the index, then scans again to check none of
+// them is queued a second time.
+static int measureLibrary(const char *musicDir, const char *dataDir, const char *indexPath, int threads, int runs,
+                          Catalog *catalog) {
+    ScanStats stats;
+    if (threads > TAG_POOL_MAX_WORKERS) threads = TAG_POOL_MAX_WORKERS;
+    mkdir(dataDir, 0777);
+    if (!scanOnce(musicDir, dataDir, indexPath, false, 0, catalog, &stats)) return 1;
+    BatchItem *items;
+    uint32_t count = collectBatch(catalog, musicDir, &items);
+    printf("%s: %u tracks, %u to measure, %d threads\n", musicDir, catalog->count, count, threads);
+    if (count == 0) return 0;
+
+    static BgThread *workers[TAG_POOL_MAX_WORKERS];
+    for (int run = 1; run <= runs; ++run) {
+        Batch batch = { items, count, 0 };
+        uint64_t startUs = scanNowUs();
+        int started = 0;
+        for (int t = 0; t < threads; ++t) {
+            workers[t] = bgThreadStart(batchWorker, &batch, true);
+            if (workers[t]) started++;
+        }
+        if (started == 0) {
+            batchWorker(&batch);
+            started = 1;
+        }
+        for (int t = 0; t < threads; ++t) bgThreadJoin(workers[t]);
+        double seconds = (double)(scanNowUs() - startUs) / 1e6;
+
+        double audio = 0.0;
+        uint64_t bytes = 0;
+        uint32_t measured = 0, silent = 0;
+        float quietest = 0.0f, loudest = LOUDNESS_GATE;
+        for (uint32_t i = 0; i < count; ++i) {
+            const BatchItem *item = &items[i];
+            bytes += item->io.bytesRead;
+            if (!item->measured) continue;
+            measured++;
+            audio += (double)item->result.frames / item->result.sampleRate;
+            if (item->result.blocks == 0) {
+                silent++;
+                continue;
+            }
+            if (item->result.integrated < quietest) quietest = item->result.integrated;
+            if (item->result.integrated > loudest) loudest = item->result.integrated;
+        }
+        printf("run %d\n", run);
+        printf("  files     %6u measured  %u failed  %u silent\n", measured, count - measured, silent);
+        printf("  audio     %9.1f s in %.2f s: %.0f s of audio per second (%.0f per thread)\n", audio, seconds,
+               audio / seconds, audio / seconds / started);
+        printf("  read      %9.1f MiB\n", bytes / 1048576.0);
+        if (measured > silent) printf("  loudness  %6.1f to %.1f LUFS\n", quietest, loudest);
+    }
+
+    // Into the library index, the way the device job saves them
+    LibIndexGain *gains = (LibIndexGain*)malloc(count * sizeof(LibIndexGain));
+    int status = 0;
+    if (gains) {
+        for (uint32_t i = 0; i < count; ++i) {
+            gains[i].name = catalogString(catalog, CATALOG_FIELD(catalog, filename, items[i].row));
+            replayGainInit(&gains[i].gain);
+            if (items[i].measured) loudnessToReplayGain(&items[i].result, &gains[i].gain);
+        }
+        LibIndexUpdate update;
+        libIndexUpdateInit(&update);
+        update.gains = gains;
+        update.gainCount = count;
+        if (!libIndexUpdate(indexPath, &update)) status = 1;
+        libIndexUpdateFree(&update);
+    }
+    free(items);
+    if (status == 0 && scanOnce(musicDir, dataDir, indexPath, false, 0, catalog, &stats)) {
+        uint32_t left = collectBatch(catalog, musicDir, &items);
+        free(items);
+        printf("saved to %s; a rescan finds %u left to measure\n", indexPath, left);
+        if (left > 0) status = 1;
+    } else {
+        status = 1;
+    }
+    return status;
+}
+
+// Times the meter, then measures the untagged files under `musicDir` if one
+// is given.
+static int benchLoudness(const char *musicDir, const char *dataDir, const char *indexPath, int threads, int runs) {
+    benchLoudnessMeter(runs);
+    int status = 0;
+    if (musicDir) {
+        Catalog catalog;
+        catalogInit(&catalog);
+        if (measureLibrary(musicDir, dataDir, indexPath, threads, runs, &catalog) != 0) status = 1;
+        catalogFree(&catalog);
+    }
+    return status;
+}
+
+// --- Content Hashes ---
+
+#define MOVE_ROOT       "moves" // Under the data directory; deleted and rebuilt every run
+#define MOVE_FOLDERS    16      // The reorganised layout: Sorted/00 to Sorted/15
+#define MOVE_EVERY      10      // In every 10 files, one is copied rather than moved...
+#define MOVE_COPY_SLOT  4
+#define MOVE_EDIT_SLOT  9       // ...and one is copied and has its last byte changed
+
+typedef enum {
+    MOVE_RENAMED, // rename(): same file, new folder and name
+    MOVE_COPIED,  // Same bytes in a new file, with a new mtime
+    MOVE_EDITED   // Copied, then its last byte changed: must be read again
+} MoveKind;
+
+// One file of the mirrored library and where the reorganisation puts it.
+typedef struct {
+    char *from; // Relative to the mirror's music folder
+    char *to;
+    MoveKind kind;
+} Move;
+
+typedef struct {
+    Move *items;
+    uint32_t count;
+    uint32_t capacity;
+} MoveList;
+
+static volatile uint64_t s_hashSink; // Keeps the timed hashes from being optimised away
+
+// Mixing speed on data already in memory, next to the byte-wise FNV-1a the
+// art cache keys pictures with. A file hash reads 128 KiB; this is the
+// part of its cost that isn't I/O.
+static void benchHashMixing(const uint8_t *data, uint32_t bytes, int runs) {
+    double bestMix = 0.0, bestFnv = 0.0;
+    for (int run = 0; run < runs; ++run) {
+        uint64_t h = 0;
+        uint64_t startUs = scanNowUs();
+        for (uint32_t off = 0; off < bytes; off += CONTENT_HASH_SPAN) {
+            h = contentHashBytes(data + off, CONTENT_HASH_SPAN, h);
+        }
+        uint64_t mixUs = scanNowUs();
+        for (uint32_t off = 0; off < bytes; off += CONTENT_HASH_SPAN) {
+            h ^= artCacheKey(data + off, CONTENT_HASH_SPAN, h);
+        }
+        uint64_t fnvUs = scanNowUs();
+        s_hashSink = h;
+        double mix = (double)(mixUs - startUs), fnv = (double)(fnvUs - mixUs);
+        if (run == 0 || mix < bestMix) bestMix = mix;
+        if (run == 0 || fnv < bestFnv) bestFnv = fnv;
+    }
+    double mib = bytes / 1048576.0;
+    printf("mixing, best of %d runs: content hash %.0f MiB/s (%.1f us per file), byte-wise FNV-1a %.0f MiB/s\n",
+           runs, mib / (bestMix / 1e6), bestMix / (bytes / (2.0 * CONTENT_HASH_SPAN)), mib / (bestFnv / 1e6));
+}
+
+static bool addMove(MoveList *list, const char *relPath) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 256;
+        Move *grown = (Move*)realloc(list->items, capacity * sizeof(Move));
+        if (!grown) return false;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    uint32_t i = list->count;
+    Move *move = &list->items[i];
+    char to[PATH_MAX];
+    int n = snprintf(to, sizeof(to), "Sorted/%02u/%04u %s", i % MOVE_FOLDERS, i, catalogBaseName(relPath));
+    if (n < 0 || (size_t)n >= sizeof(to)) return true; // Left where it is
+    move->from = strdup(relPath);
+    move->to = strdup(to);
+    move->kind = (i % MOVE_EVERY == MOVE_EDIT_SLOT) ? MOVE_EDITED
+               : (i % MOVE_EVERY == MOVE_COPY_SLOT) ? MOVE_COPIED : MOVE_RENAMED;
+    if (!move->from || !move->to) {
+        free(move->from);
+        free(move->to);
+        return false;
+    }
+    list->count++;
+    return true;
+}
+
+static void freeMoves(MoveList *list) {
+    for (uint32_t i = 0; i < list->count; ++i) {
+        free(list->items[i].from);
+        free(list->items[i].to);
+    }
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+// Lists the music files under `dir` (cue sheets aside, so no image is split
+// by one after it has been renamed).
+static bool collectMoves(const char *musicDir, const char *dir, MoveList *list) {
+    char path[PATH_MAX];
+    if (!fsJoinPath(path, musicDir, dir)) return true;
+    DIR *d = opendir(path);
+    if (!d) return false;
+    bool ok = true;
+    struct dirent *entry;
+    while (ok && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char relPath[PATH_MAX];
+        struct stat st;
+        if (!fsJoinPath(relPath, dir, entry->d_name) || !fsJoinPath(path, musicDir, relPath) || stat(path, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) ok = collectMoves(musicDir, relPath, list);
+        else if (trackFormatFromExtension(entry->d_name) != TRACK_FORMAT_NONE) ok = addMove(list, relPath);
+    }
+    closedir(d);
+    return ok;
+}
+
+// The mirror: every music file hard-linked (or copied, across devices)
+// under the same relative path, so the originals are never touched.
+static bool buildMirror(const char *musicDir, const char *mirrorDir, const MoveList *moves) {
+    for (uint32_t i = 0; i < moves->count; ++i) {
+        char from[PATH_MAX], to[PATH_MAX];
+        const char *name = moves->items[i].from;
+        bool joined = fsJoinPath(from, musicDir, name) && fsJoinPath(to, mirrorDir, name);
+        if (joined) fsMakeParents(to);
+        if (!joined || (link(from, to) != 0 && !fsCopyFile(from, to))) {
+            fprintf(stderr, "pearscan: cannot mirror %s\n", from);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Moves every file to its new place: renamed, or copied and removed (a
+// linked file is copied before it is edited, so the original stays as is).
+static bool reorganise(const char *mirrorDir, const MoveList *moves) {
+    for (uint32_t i = 0; i < moves->count; ++i) {
+        const Move *move = &moves->items[i];
+        char from[PATH_MAX], to[PATH_MAX];
+        if (!fsJoinPath(from, mirrorDir, move->from) || !fsJoinPath(to, mirrorDir, move->to)) return false;
+        fsMakeParents(to);
+        bool ok = move->kind == MOVE_RENAMED ? rename(from, to) == 0 : fsCopyFile(from, to) && remove(from) == 0;
+        if (ok && move->kind == MOVE_EDITED) {
+            FILE *f = fopen(to, "r+b");
+            int c = EOF;
+            if (f && fseek(f, -1, SEEK_END) == 0) c = fgetc(f);
+            ok = c != EOF && fseek(f, -1, SEEK_END) == 0 && fputc(c ^ 0xFF, f) != EOF;
+            if (f && fclose(f) != 0) ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "pearscan: cannot move %s\n", from);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Catalog rows by filename (the first row of a cue sheet's file).
+typedef struct {
+    uint32_t *rows;
+    uint32_t mask;
+} RowTable;
+
+static bool rowTableBuild(RowTable *table, const Catalog *catalog) {
+    uint32_t size = 16;
+    while (size < catalog->count * 2u) size <<= 1;
+    table->rows = (uint32_t*)malloc(size * sizeof(uint32_t));
+    if (!table->rows) return false;
+    memset(table->rows, 0xFF, size * sizeof(uint32_t));
+    table->mask = size - 1;
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        const char *name = catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+        if (!name) continue;
+        uint32_t slot = libIndexHashName(name) & table->mask;
+        while (table->rows[slot] != UINT32_MAX) slot = (slot + 1) & table->mask;
+        table->rows[slot] = row;
+    }
+    return true;
+}
+
+static uint32_t rowTableFind(const RowTable *table, const Catalog *catalog, const char *name) {
+    uint32_t slot = libIndexHashName(name) & table->mask;
+    while (table->rows[slot] != UINT32_MAX) {
+        const char *rowName = catalogString(catalog, CATALOG_FIELD(catalog, filename, table->rows[slot]));
+        if (rowName && strcmp(rowName, name) == 0) return table->rows[slot];
+        slot = (slot + 1) & table->mask;
+    }
+    return UINT32_MAX;
+}
+
+static bool sameString(const Catalog *a, uint32_t refA, const Catalog *b, uint32_t refB) {
+    const char *x = catalogString(a, refA), *y = catalogString(b, refB);
+    return (!x && !y) || (x && y && strcmp(x, y) == 0);
+}
+
+// True if two rows carry the same tags, gains and format.
+static bool sameRow(const Catalog *a, uint32_t rowA, const Catalog *b, uint32_t rowB) {
+    const uint8_t kept = CATALOG_FLAG_TAG_GLYPHS | CATALOG_FLAG_MEASURED;
+    ReplayGain gainA = CATALOG_FIELD(a, gain, rowA), gainB = CATALOG_FIELD(b, gain, rowB);
+    return sameString(a, CATALOG_FIELD(a, title, rowA), b, CATALOG_FIELD(b, title, rowB)) &&
+           sameString(a, CATALOG_FIELD(a, artist, rowA), b, CATALOG_FIELD(b, artist, rowB)) &&
+           sameString(a, CATALOG_FIELD(a, album, rowA), b, CATALOG_FIELD(b, album, rowB)) &&
+           CATALOG_FIELD(a, durationMs, rowA) == CATALOG_FIELD(b, durationMs, rowB) &&
+           CATALOG_FIELD(a, trackNumber, rowA) == CATALOG_FIELD(b, trackNumber, rowB) &&
+           CATALOG_FIELD(a, format, rowA) == CATALOG_FIELD(b, format, rowB) &&
+           (CATALOG_FIELD(a, flags, rowA) & kept) == (CATALOG_FIELD(b, flags, rowB) & kept) &&
+           memcmp(&gainA, &gainB, sizeof(gainA)) == 0;
+}
+
+// Hashes every row the device job would, one file at a time as it does,
+// marks the rows hashed, and saves the hashes into the index.
+static bool hashLibrary(const Catalog *catalog, const char *mirrorDir, const char *indexPath, bool *hashedRows) {
+    uint8_t *buffer = (uint8_t*)malloc(CONTENT_HASH_SPAN);
+    LibIndexHash *hashes = (LibIndexHash*)calloc(catalog->count ? catalog->count : 1, sizeof(LibIndexHash));
+    if (!buffer || !hashes) {
+        free(buffer);
+        free(hashes);
+        return false;
+    }
+    MetaIoStats io = { 0, 0 };
+    uint32_t count = 0, failed = 0;
+    uint64_t startUs = scanNowUs();
+    for (uint32_t row = 0; row < catalog->count; ++row) {
+        if (CATALOG_FIELD(catalog, flags, row) & (CATALOG_FLAG_MESSAGE | CATALOG_FLAG_CUE | CATALOG_FLAG_PENDING)) {
+            continue;
+        }
+        LibIndexHash *hash = &hashes[count];
+        hash->name = catalogString(catalog, CATALOG_FIELD(catalog, filename, row));
+        char path[PATH_MAX];
+        struct stat st;
+        if (!fsJoinPath(path, mirrorDir, hash->name) || !scanStatPath(path, &st, &hash->mtime) ||
+            !contentHashFile(path, (uint64_t)st.st_size, buffer, &hash->contentHash, &io)) {
+            failed++;
+            continue;
+        }
+        hash->size = (uint64_t)st.st_size;
+        hashedRows[row] = true;
+        count++;
+    }
+    double ms = msBetween(startUs, scanNowUs());
+    printf("  hashing      %9.2f ms  %u files: %.3f ms, %.0f KiB and %.1f reads each, %u unreadable\n", ms, count,
+           count ? ms / count : 0.0, count ? io.bytesRead / 1024.0 / count : 0.0,
+           count ? (double)io.reads / count : 0.0, failed);
+    LibIndexUpdate update;
+    libIndexUpdateInit(&update);
+    update.hashes = hashes;
+    update.hashCount = count;
+    bool ok = libIndexUpdate(indexPath, &update);
+    libIndexUpdateFree(&update);
+    free(buffer);
+    return ok;
+}
+
+static void printRescan(const char *label, const ScanStats *stats) {
+    printf("  %-12s %9.2f ms  %u files, %u hashed for a size match, %u found moved, %u probed, %.1f MiB read\n",
+           label, msBetween(stats->startUs, stats->finishUs), stats->itemsAdded, stats->itemsHashed,
+           stats->itemsMoved, stats->itemsProbed, stats->bytesRead / 1048576.0);
+}
+
+// Checks every file that kept its bytes against its row before the move,
+// and that each one with a saved hash was found moved. Returns the mismatches.
+static uint32_t checkMoved(const Catalog *before, const RowTable *beforeRows, const bool *hashedRows,
+                           const Catalog *after, const MoveList *moves, const ScanStats *stats, uint32_t *expected) {
+    RowTable afterRows;
+    *expected = 0;
+    if (!rowTableBuild(&afterRows, after)) return moves->count;
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < moves->count; ++i) {
+        const Move *move = &moves->items[i];
+        uint32_t rowBefore = rowTableFind(beforeRows, before, move->from);
+        uint32_t rowAfter = rowTableFind(&afterRows, after, move->to);
+        if (rowBefore == UINT32_MAX || rowAfter == UINT32_MAX) {
+            mismatches++;
+            continue;
+        }
+        if (move->kind == MOVE_EDITED) continue; // Read again, and its tags may be what changed
+        if (hashedRows[rowBefore]) (*expected)++;
+        if (!sameRow(before, rowBefore, after, rowAfter)) {
+            printf("  MISMATCH %s -> %s\n", move->from, move->to);
+            mismatches++;
+        }
+    }
+    free(afterRows.rows);
+    if (stats->itemsMoved != *expected) mismatches++;
+    return mismatches;
+}
+
+// Folder stamps count whole seconds, so a folder changed in the second it
+// was scanned in would look unchanged to the rescan.
+static bool waitForNextSecond(void) {
+    time_t now = time(NULL);
+    while (time(NULL) == now) bgThreadSleepUs(10000);
+    return true;
+}
+
+static double hitRate(const ScanStats *stats) {
+    return stats->itemsAdded ? 100.0 * (stats->itemsAdded - stats->itemsProbed) / stats->itemsAdded : 0.0;
+}
+
+// One reorganisation of a mirror of `musicDir`: scan it, hash it, move
+// every file, then rescan with the hashes and, from a copy of the index
+// taken before they were saved, without them.
+static int runMoves(const char *musicDir, const char *dataDir, int workers, int run, MoveList *moves) {
+    char root[PATH_MAX], mirrorDir[PATH_MAX], indexPath[PATH_MAX], unhashedPath[PATH_MAX];
+    if (!fsJoinPath(root, dataDir, MOVE_ROOT) || !fsJoinPath(mirrorDir, root, "music") ||
+        !fsJoinPath(indexPath, root, "library.idx") || !fsJoinPath(unhashedPath, root, "unhashed.idx")) {
+        return 1;
+    }
+    fsRemoveTree(root);
+    mkdir(dataDir, 0777);
+    mkdir(root, 0777);
+    mkdir(mirrorDir, 0777);
+    if (!buildMirror(musicDir, mirrorDir, moves)) return 1;
+
+    printf("run %d: %u files\n", run, moves->count);
+    Catalog before, after, unhashed;
+    catalogInit(&before);
+    catalogInit(&after);
+    catalogInit(&unhashed);
+    RowTable beforeRows = { NULL, 0 };
+    bool *hashedRows = NULL;
+    ScanStats first, stats, plain;
+    bool ok = scanOnce(mirrorDir, root, indexPath, false, workers, &before, &first);
+    if (ok) {
+        printRescan("first scan", &first);
+        hashedRows = (bool*)calloc(before.count ? before.count : 1, sizeof(bool));
+        ok = hashedRows && rowTableBuild(&beforeRows, &before) && fsCopyFile(indexPath, unhashedPath) &&
+             hashLibrary(&before, mirrorDir, indexPath, hashedRows) && waitForNextSecond() &&
+             reorganise(mirrorDir, moves) &&
+             scanOnce(mirrorDir, root, indexPath, false, workers, &after, &stats) &&
+             scanOnce(mirrorDir, root, unhashedPath, false, workers, &unhashed, &plain);
+    }
+    int status = ok ? 0 : 1;
+    if (ok) {
+        uint32_t renamed = 0, copied = 0, edited = 0;
+        for (uint32_t i = 0; i < moves->count; ++i) {
+            renamed += moves->items[i].kind == MOVE_RENAMED;
+            copied += moves->items[i].kind == MOVE_COPIED;
+            edited += moves->items[i].kind == MOVE_EDITED;
+        }
+        printf("  moved        %9u renamed  %u copied  %u copied and edited\n", renamed, copied, edited);
+        printRescan("rescan", &stats);
+        printRescan("unhashed", &plain);
+        uint32_t expected;
+        uint32_t mismatches = checkMoved(&before, &beforeRows, hashedRows, &after, moves, &stats, &expected);
+        printf("  cache hits   %8.1f %% with hashes (%u found moved, %u expected), %.1f %% without\n",
+               hitRate(&stats), stats.itemsMoved, expected, hitRate(&plain));
+        if (mismatches) {
+            printf("  %u mismatches\n", mismatches);
+            status = 1;
+        }
+    }
+    free(hashedRows);
+    free(beforeRows.rows);
+    catalogFree(&unhashed);
+    catalogFree(&after);
+    catalogFree(&before);
+    return status;
+}
+
+// Times the hash's mixing, then reorganises a mirror of `musicDir` `runs`
+// times and reports what the rescan found again.
+static int benchMoves(const char *musicDir, const char *dataDir, int workers, int runs) {
+    const uint32_t bytes = 16u << 20;
+    uint8_t *data = (uint8_t*)malloc(bytes);
+    if (!data) return 1;
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < bytes; ++i) data[i] = (uint8_t)synthRandom(&seed);
+    benchHashMixing(data, bytes, runs);
+    free(data);
+    int status = 0;
+
+    MoveList moves = { NULL, 0, 0 };
+    if (!collectMoves(musicDir, "", &moves)) {
+        fprintf(stderr, "pearscan: cannot read %s\n", musicDir);
+        status = 1;
+    }
+    for (int run = 1; status == 0 && run <= runs; ++run) status = runMoves(musicDir, dataDir, workers, run, &moves);
+    freeMoves(&moves);
+    return status;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: pearscan [-r runs] [-d dataDir] [-c] [-t] [-j workers] MUSIC_DIR\n"
+                    "       pearscan -s [-r runs] [-d dataDir] [-t] MUSIC_DIR\n"
+                    "       pearscan -m [-r runs] FILE...\n"
+                    "       pearscan -e [-r runs]\n"
+                    "       pearscan -u [-r runs] FILE...\n"
+                    "       pearscan -o [-r runs] [TRACKS]\n"
+                    "       pearscan -q [-r runs] [TRACKS]\n"
+                    "       pearscan -g [-r runs] [TRACKS]\n"
+                    "       pearscan -b [-r runs] [TRACKS]\n"
+                    "       pearscan -a [-r runs] [FILE...]\n"
+                    "       pearscan -l [-r runs] [-d dataDir] [-j threads] [MUSIC_DIR]\n"
+                    "       pearscan -k [-r runs] [-d dataDir] [-j workers] MUSIC_DIR\n");
+}
+
+int main(int argc, char **argv) {
+    int runs = 2;
+    const char *dataDir = "pearscan-data";
+    bool cold = false;
+    bool threaded = false;
+    bool tagBench = false;
+    bool scaling = false;
+    bool textBench = false;
+    bool cueCheck = false;
+    bool sorting = false;
+    bool searching = false;
+    bool grouping = false;
+    bool tableBench = false;
+    bool gainCheck = false;
+    bool loudness = false;
+    bool moveCheck = false;
+    int workers = bgThreadCores();
+    if (workers > TAG_POOL_MAX_WORKERS) workers = TAG_POOL_MAX_WORKERS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:d:ctj:smeuoqgbalk")) != -1) {
+        switch (opt) {
+            case 'r': runs = atoi(optarg); break;
+            case 'd': dataDir = optarg; break;
+            case 'c': cold = true; break;
+            case 't': threaded = true; break;
+            case 'j': workers = atoi(optarg); break;
+            case 's': scaling = true; break;
+            case 'm': tagBench = true; break;
+            case 'e': textBench = true; break;
+            case 'u': cueCheck = true; break;
+            case 'o': sorting = true; break;
+            case 'q': searching = true; break;
+            case 'g': grouping = true; break;
+            case 'b': tableBench = true; break;
+            case 'a': gainCheck = true; break;
+            case 'l': loudness = true; break;
+            case 'k': moveCheck = true; break;
+            default:  usage(); return 2;
+        }
+    }
+    if (textBench && optind == argc && runs >= 1) return benchTextConvert(runs);
+    if (sorting && optind >= argc - 1 && runs >= 1) {
+        long tracks = optind < argc ? atol(argv[optind]) : SORT_BENCH_TRACKS;
+        if (tracks > 0) return benchSorting((uint32_t)tracks, runs);
+    }
+    if (searching && optind >= argc - 1 && runs >= 1) {
+        long tracks = optind < argc ? atol(argv[optind]) : SEARCH_BENCH_TRACKS;
+        if (tracks > 0) return benchSearch((uint32_t)tracks, runs);
+    }
+    if (grouping && optind >= argc - 1 && runs >= 1) {
+        long tracks = optind < argc ? atol(argv[optind]) : GROUP_BENCH_TRACKS;
+        if (tracks > 0) return benchGrouping((uint32_t)tracks, runs);
+    }
+    if (tableBench && optind >= argc - 1 && runs >= 1) {
+        long tracks = optind < argc ? atol(argv[optind]) : TABLE_BENCH_TRACKS;
+        if (tracks > 0) return benchCatalog((uint32_t)tracks, runs);
+    }
+    if (gainCheck && runs >= 1) return benchReplayGain(argv + optind, argc - optind, runs);
+    if (loudness && optind >= argc - 1 && runs >= 1 && workers >= 1) {
+        char loudIndexPath[PATH_MAX];
+        snprintf(loudIndexPath, sizeof(loudIndexPath), "%s/library.idx", dataDir);
+        return benchLoudness(optind < argc ? argv[optind] : NULL, dataDir, loudIndexPath, workers, runs);
+    }
+    if (moveCheck && optind == argc - 1 && runs >= 1 && workers >= 0) {
+        return benchMoves(argv[optind], dataDir, workers, runs);
+    }
+    if (cueCheck && runs >= 1) return listCueSheets(argv + optind, argc - optind, runs);
+    if (tagBench && optind < argc && runs >= 1) return benchTagReaders(argv + optind, argc - optind, runs);
+    if (optind != argc - 1 || runs < 1 || workers < 0) {
+        usage();
+        return 2;
+    }
+    const char *musicDir = argv[optind];
+
+    char indexPath[PATH_MAX];
+    snprintf(indexPath, sizeof(indexPath), "%s/library.idx", dataDir);
+
+    Catalog catalog;
+    catalogInit(&catalog);
+    if (scaling) {
+        int status = benchWorkers(musicDir, dataDir, indexPath, threaded, runs, &catalog);
+        catalogFree(&catalog);
+        return status;
+    }
+    int status = 0;
+    for (int run = 1; run <= runs; ++run) {
+        if (cold) remove(indexPath);
+        if (!runScan(run, musicDir, dataDir, indexPath, threaded, workers, &catalog)) {
+            status = 1;
+            break;
+        }
+    }
+    catalogFree(&catalog);
+    return status;
+}
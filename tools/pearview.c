@@ -0,0 +1,302 @@
+// pearview: replays scroll traces against the lazy tag loader on a desktop.
+// Scans MUSIC_DIR with tags deferred, the way the app does, then plays each
+// trace one 60 fps frame at a time. The loader's worker runs on the same
+// simulated clock, each read costed with an SD card model, so the results
+// don't depend on how fast the desktop's disk is. A finished read is seen
+// at the start of the next frame, as it would be on device.
+//
+//   pearview [-d dataDir] [-t TRACE]... [-r readUs] [-o openUs] [-b kibPerSec] MUSIC_DIR
+//
+//   -d DIR   Where library.idx is kept (default ./pearscan-data)
+//   -t FILE  Replay this trace instead of the built-in ones; may be repeated.
+//            One step per line, '#' starts a comment:
+//              FRAMES PIXELS   scroll PIXELS per frame (negative = up) for FRAMES frames
+//              FRAMES @ROW     jump to list row ROW, then hold for FRAMES frames
+//              FRAMES %PCT     jump PCT percent of the way down the list, then hold
+//   -r US    Simulated cost of one read call (default 2000)
+//   -o US    Simulated cost of opening a file (default 4000)
+//   -b N     Simulated read throughput in KiB/s (default 8192)
+//
+// A miss is a row on screen for a frame while its tags are still unread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "scanner.h"
+#include "catalog.h"
+#include "sortindex.h"
+#include "tagloader.h"
+
+// Same geometry as the app's list (see main.c)
+#define VIEW_HEIGHT   240.0f
+#define ROW_HEIGHT    48.0f
+#define PAGE_PIXELS   (VIEW_HEIGHT - ROW_HEIGHT)
+#define FRAME_US      16667
+#define TRACE_MAX_STEPS 256
+
+typedef struct {
+    int frames;
+    char kind;   // 'v' velocity, '@' row, '%' percent
+    float value;
+} TraceStep;
+
+typedef struct {
+    const char *name;
+    TraceStep steps[TRACE_MAX_STEPS];
+    int count;
+} Trace;
+
+typedef struct {
+    uint32_t readUs;
+    uint32_t openUs;
+    uint32_t kibPerSec;
+} CostModel;
+
+// --- Traces ---
+
+static bool parseStep(const char *line, TraceStep *step) {
+    char arg[32];
+    if (sscanf(line, "%d %31s", &step->frames, arg) != 2 || step->frames < 0) return false;
+    if (arg[0] == '@' || arg[0] == '%') {
+        step->kind = arg[0];
+        step->value = strtof(arg + 1, NULL);
+    } else {
+        step->kind = 'v';
+        step->value = strtof(arg, NULL);
+    }
+    return true;
+}
+
+static bool parseTrace(Trace *trace, const char *name, const char *text) {
+    trace->name = name;
+    trace->count = 0;
+    while (*text) {
+        const char *end = strchr(text, '\n');
+        size_t len = end ? (size_t)(end - text) : strlen(text);
+        char line[128];
+        snprintf(line, sizeof(line), "%.*s", (int)(len < sizeof(line) - 1 ? len : sizeof(line) - 1), text);
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        if (strspn(line, " \t\r") != strlen(line)) {
+            if (trace->count == TRACE_MAX_STEPS || !parseStep(line, &trace->steps[trace->count])) {
+                fprintf(stderr, "pearview: %s: bad step \"%s\"\n", name, line);
+                return false;
+            }
+            trace->count++;
+        }
+        text += len + (end ? 1 : 0);
+    }
+    return true;
+}
+
+static char* readFile(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = (size >= 0) ? (char*)malloc((size_t)size + 1) : NULL;
+    if (text) {
+        size_t got = fread(text, 1, (size_t)size, f);
+        text[got] = '\0';
+    }
+    fclose(f);
+    return text;
+}
+
+// Someone reading down the list a screen at a time
+static const char s_traceBrowse[] =
+    "60 0\n"
+    "24 8\n 90 0\n 24 8\n 90 0\n 24 8\n 90 0\n 24 8\n 90 0\n"
+    "24 -8\n 60 0\n";
+// Holding the D-pad: a steady drag down, a pause, then back up
+static const char s_traceDrag[] =
+    "30 0\n 300 6\n 60 0\n 150 -6\n 30 0\n";
+// Paging with left/right as fast as the thumb allows
+static const char s_traceFlick[] =
+    "30 0\n"
+    "1 192\n 6 0\n 1 192\n 6 0\n 1 192\n 6 0\n 1 192\n 6 0\n 1 192\n 6 0\n"
+    "1 192\n 6 0\n 1 192\n 6 0\n 1 192\n 6 0\n 1 192\n 6 0\n 1 192\n 6 0\n"
+    "60 0\n";
+// Jumping around (sort changes, search results)
+static const char s_traceJump[] =
+    "30 0\n 60 %50\n 60 %10\n 60 %90\n 60 %30\n 60 %70\n 60 @0\n";
+
+// --- Simulation ---
+
+static bool appendItem(const CatalogEntry *entry, void *user) {
+    return catalogAppend((Catalog*)user, entry);
+}
+
+static bool scanLibrary(const char *musicDir, const char *dataDir, Catalog *catalog, ScanStats *stats) {
+    char indexPath[PATH_MAX];
+    snprintf(indexPath, sizeof(indexPath), "%s/library.idx", dataDir);
+    catalogClear(catalog);
+    Scanner scanner;
+    scannerBegin(&scanner, musicDir, dataDir, indexPath, &catalog->strings, appendItem, catalog);
+    scanner.deferTags = true;
+    while (!scannerStep(&scanner, 256, 20000)) {}
+    *stats = scanner.stats;
+    if (scanner.openFailed) {
+        fprintf(stderr, "pearview: cannot open %s\n", musicDir);
+        return false;
+    }
+    return true;
+}
+
+static uint64_t readCostUs(const CostModel *model, const MetaIoStats *io) {
+    return model->openUs + (uint64_t)io->reads * model->readUs + io->bytesRead * 1000000u / (model->kibPerSec * 1024u);
+}
+
+static void replay(const Trace *trace, const char *musicDir, const char *dataDir, const CostModel *model) {
+    Catalog catalog;
+    catalogInit(&catalog);
+    ScanStats scan;
+    SortIndex sort;
+    sortIndexInit(&sort);
+    if (!scanLibrary(musicDir, dataDir, &catalog, &scan) || catalog.count == 0 || !sortIndexBuild(&sort, &catalog)) {
+        catalogFree(&catalog);
+        return;
+    }
+    const uint32_t *viewRows = sort.order[SORT_BY_TITLE]; // The app's default order
+    int count = (int)catalog.count;
+    float maxOffset = (float)count * ROW_HEIGHT - VIEW_HEIGHT;
+    if (maxOffset < 0.0f) maxOffset = 0.0f;
+
+    uint8_t *seen = (uint8_t*)calloc(catalog.count, 1);
+    if (!seen) {
+        sortIndexFree(&sort);
+        catalogFree(&catalog);
+        return;
+    }
+
+    static TagLoader loader;
+    tagLoaderInit(&loader, musicDir, &catalog.strings);
+    StrArena scratch;
+    strArenaInit(&scratch);
+    PrefetchWindow window;
+    prefetchInit(&window);
+
+    float offset = 0.0f;
+    uint64_t nowUs = 0, workerUs = 0, busyUs = 0;
+    uint32_t frames = 0, rowFrames = 0, misses = 0, rowsSeen = 0, firstSightMisses = 0, worstStreak = 0;
+    uint32_t *missStreak = (uint32_t*)calloc(catalog.count, sizeof(uint32_t));
+    MetaIoStats io = { 0, 0 };
+
+    for (int s = 0; s < trace->count && missStreak; ++s) {
+        const TraceStep *step = &trace->steps[s];
+        if (step->kind == '@') offset = step->value * ROW_HEIGHT;
+        else if (step->kind == '%') offset = step->value / 100.0f * maxOffset;
+        for (int f = 0; f < step->frames; ++f, ++frames) {
+            if (step->kind == 'v') offset += step->value;
+            if (offset < 0.0f) offset = 0.0f;
+            if (offset > maxOffset) offset = maxOffset;
+
+            // Render thread: what the app does in updateLazyLoads(), then draws
+            prefetchUpdate(&window, offset, ROW_HEIGHT, VIEW_HEIGHT, count);
+            tagLoaderUpdate(&loader, &catalog, &window, viewRows);
+            for (int row = window.first; row <= window.last; ++row) {
+                uint32_t c = viewRows[row];
+                bool pending = (CATALOG_FIELD(&catalog, flags, c) & CATALOG_FLAG_PENDING) != 0;
+                rowFrames++;
+                if (!seen[c]) {
+                    seen[c] = 1;
+                    rowsSeen++;
+                    if (pending) firstSightMisses++;
+                }
+                if (pending) {
+                    misses++;
+                    if (++missStreak[c] > worstStreak) worstStreak = missStreak[c];
+                }
+            }
+
+            // Worker: reads until it has caught up with the end of this frame
+            nowUs += FRAME_US;
+            if (workerUs < nowUs - FRAME_US) workerUs = nowUs - FRAME_US; // It was idle
+            while (workerUs < nowUs) {
+                MetaIoStats stepIo = { 0, 0 };
+                if (!tagLoaderStep(&loader, &scratch, &stepIo)) break;
+                uint64_t cost = readCostUs(model, &stepIo);
+                workerUs += cost;
+                busyUs += cost;
+                io.bytesRead += stepIo.bytesRead;
+                io.reads += stepIo.reads;
+            }
+        }
+    }
+    tagLoaderUpdate(&loader, &catalog, &window, viewRows); // Collect the last reads
+
+    uint32_t neverShown = 0;
+    for (uint32_t c = 0; c < catalog.count; ++c) {
+        if ((CATALOG_FIELD(&catalog, flags, c) & CATALOG_FLAG_LATE) && !seen[c]) neverShown++;
+    }
+
+    printf("%-8s %6u frames, %u tracks, %u deferred by the scan\n", trace->name, frames, catalog.count,
+           scan.itemsDeferred);
+    printf("  misses    %6u of %u row-frames (%.2f%%), longest %u frames (%.0f ms)\n", misses, rowFrames,
+           rowFrames ? 100.0 * misses / rowFrames : 0.0, worstStreak, worstStreak * FRAME_US / 1000.0);
+    printf("  rows      %6u shown, %u first shown without tags\n", rowsSeen, firstSightMisses);
+    printf("  reads     %6u tracks (%u never shown), %u cancelled, worker busy %.0f%%\n", loader.stats.loaded,
+           neverShown, loader.stats.cancelled, nowUs ? 100.0 * busyUs / nowUs : 0.0);
+    printf("  io        %6u calls, %llu KiB\n", io.reads, (unsigned long long)(io.bytesRead / 1024));
+
+    strArenaFree(&scratch);
+    free(missStreak);
+    free(seen);
+    sortIndexFree(&sort);
+    catalogFree(&catalog);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: pearview [-d dataDir] [-t TRACE]... [-r readUs] [-o openUs] [-b kibPerSec] MUSIC_DIR\n");
+}
+
+int main(int argc, char **argv) {
+    const char *dataDir = "pearscan-data";
+    const char *traceFiles[16];
+    int traceFileCount = 0;
+    CostModel model = { 2000, 4000, 8192 };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:t:r:o:b:")) != -1) {
+        switch (opt) {
+            case 'd': dataDir = optarg; break;
+            case 't':
+                if (traceFileCount < 16) traceFiles[traceFileCount++] = optarg;
+                break;
+            case 'r': model.readUs = (uint32_t)atoi(optarg); break;
+            case 'o': model.openUs = (uint32_t)atoi(optarg); break;
+            case 'b': model.kibPerSec = (uint32_t)atoi(optarg); break;
+            default:  usage(); return 2;
+        }
+    }
+    if (optind != argc - 1 || model.kibPerSec == 0) {
+        usage();
+        return 2;
+    }
+    const char *musicDir = argv[optind];
+
+    static Trace trace;
+    if (traceFileCount == 0) {
+        static const struct { const char *name, *text; } builtIn[] = {
+            { "browse", s_traceBrowse }, { "drag", s_traceDrag }, { "flick", s_traceFlick }, { "jump", s_traceJump }
+        };
+        for (size_t i = 0; i < sizeof(builtIn) / sizeof(builtIn[0]); ++i) {
+            if (parseTrace(&trace, builtIn[i].name, builtIn[i].text)) replay(&trace, musicDir, dataDir, &model);
+        }
+    }
+    for (int i = 0; i < traceFileCount; ++i) {
+        char *text = readFile(traceFiles[i]);
+        if (!text) return 1;
+        bool ok = parseTrace(&trace, traceFiles[i], text);
+        free(text);
+        if (!ok) return 1;
+        replay(&trace, musicDir, dataDir, &model);
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "synth.h"
+#include "fsutil.h"
+#include "sortindex.h"
+
+uint32_t synthRandom(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+void synthCatalog(Catalog *catalog, uint32_t tracks) {
+    catalogClear(catalog);
+    StrArena *strings = &catalog->strings;
+    uint32_t albumCount = (tracks + SYNTH_TRACKS_PER_ALBUM - 1) / SYNTH_TRACKS_PER_ALBUM;
+    uint32_t artistCount = (albumCount + SYNTH_ALBUMS_PER_ARTIST - 1) / SYNTH_ALBUMS_PER_ARTIST;
+    uint32_t *albumOrder = (uint32_t*)malloc(albumCount * sizeof(uint32_t));
+    if (!albumOrder) return;
+    uint32_t seed = 12345;
+    for (uint32_t a = 0; a < albumCount; ++a) albumOrder[a] = a;
+    for (uint32_t a = albumCount; a > 1; --a) {
+        uint32_t j = synthRandom(&seed) % a;
+        uint32_t t = albumOrder[a - 1];
+        albumOrder[a - 1] = albumOrder[j];
+        albumOrder[j] = t;
+    }
+
+    char text[96];
+    uint32_t row = 0;
+    for (uint32_t i = 0; i < albumCount && row < tracks; ++i) {
+        uint32_t album = albumOrder[i];
+        uint32_t artist = album % artistCount;
+        int n = snprintf(text, sizeof(text), "%s Artist %u", (album / artistCount) % 5 == 4 && artist % 7 == 0
+                         ? "the" : "The", artist);
+        uint32_t artistRef = strArenaIntern(strings, text, (size_t)n);
+        n = album % 40 == 0 ? snprintf(text, sizeof(text), "Greatest Hits")
+                            : snprintf(text, sizeof(text), "Album %u of artist %u", album / artistCount, artist);
+        uint32_t albumRef = strArenaIntern(strings, text, (size_t)n);
+        for (uint32_t t = 0; t < SYNTH_TRACKS_PER_ALBUM && row < tracks; ++t, ++row) {
+            CatalogEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            n = snprintf(text, sizeof(text), "Artist %u/Album %u/%02u - Song.mp3", artist, album,
+                         SYNTH_TRACKS_PER_ALBUM - t); // Scanned in reverse: the rank must reorder them
+            entry.filename = strArenaAdd(strings, text, (size_t)n);
+            n = snprintf(text, sizeof(text), "Song %u", row);
+            entry.title = strArenaIntern(strings, text, (size_t)n);
+            bool untagged = synthRandom(&seed) % 50 == 0;
+            entry.artist = untagged ? STRARENA_NONE : artistRef;
+            entry.album = untagged ? STRARENA_NONE : albumRef;
+            // Numbered like the files, against them in pairs, or not at all
+            if (!untagged && album % 3 == 1) entry.trackNumber = (uint16_t)(SYNTH_TRACKS_PER_ALBUM - t);
+            else if (!untagged && album % 3 == 2) entry.trackNumber = (uint16_t)(t / 2 + 1);
+            entry.durationMs = 180000;
+            entry.format = TRACK_FORMAT_MP3;
+            catalogAppend(catalog, &entry);
+        }
+    }
+    free(albumOrder);
+}
+
+int synthCompareNames(const Catalog *catalog, uint32_t a, uint32_t b) {
+    const char *sa = catalogString(catalog, a);
+    const char *sb = catalogString(catalog, b);
+    return sortCompareStrings(sortCollationKey(sa), sa, sortCollationKey(sb), sb);
+}
+
+void synthProgramme(float *pcm, uint32_t frames, uint32_t *seed, uint32_t *left, float *level) {
+    for (uint32_t i = 0; i < frames; ++i) {
+        if (*left == 0) {
+            *left = 9600 + synthRandom(seed) % 134400;
+            uint32_t r = synthRandom(seed);
+            *level = (r % 8 == 0) ? 0.0f : (float)pow(10.0, -(5.0 + (r >> 4) % 5500 / 100.0) / 20.0);
+        }
+        (*left)--;
+        for (int ch = 0; ch < 2; ++ch) {
+            float white = (float)((int32_t)(synthRandom(seed) & 0xFFFF) - 32768) / 32768.0f;
+            pcm[i * 2 + ch] = white * *level;
+        }
+    }
+}
+
+static uint32_t putTextFrame(uint8_t *out, const char *id, const char *text) {
+    uint32_t len = (uint32_t)strlen(text) + 1; // Encoding byte, then Latin-1
+    memcpy(out, id, 4);
+    out[4] = (uint8_t)(len >> 24);
+    out[5] = (uint8_t)(len >> 16);
+    out[6] = (uint8_t)(len >> 8);
+    out[7] = (uint8_t)len;
+    out[8] = out[9] = 0;
+    out[10] = 0;
+    memcpy(out + 11, text, len - 1);
+    return 10 + len;
+}
+
+bool synthWriteMp3(const char *path, const char *title, const char *artist, const char *album, uint32_t track,
+                   uint32_t bytes) {
+    uint8_t tag[1024];
+    char number[16];
+    snprintf(number, sizeof(number), "%u", track);
+    if (strlen(title) + strlen(artist) + strlen(album) + strlen(number) + 4 * 11 + 10 > sizeof(tag)) return false;
+    uint32_t len = 10;
+    len += putTextFrame(tag + len, "TIT2", title);
+    len += putTextFrame(tag + len, "TPE1", artist);
+    len += putTextFrame(tag + len, "TALB", album);
+    if (track) len += putTextFrame(tag + len, "TRCK", number);
+    uint32_t body = len - 10;
+    memcpy(tag, "ID3\x03\x00\x00", 6);
+    tag[6] = (uint8_t)((body >> 21) & 0x7F); // Syncsafe size
+    tag[7] = (uint8_t)((body >> 14) & 0x7F);
+    tag[8] = (uint8_t)((body >> 7) & 0x7F);
+    tag[9] = (uint8_t)(body & 0x7F);
+    if (bytes < len) return false;
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(tag, 1, len, f) == len;
+    static const uint8_t frameHeader[4] = { 0xFF, 0xFB, 0x90, 0x00 }; // MPEG-1 layer III, 128 kb/s, 44.1 kHz
+    for (uint32_t at = len; ok && at < bytes; ++at) {
+        uint32_t pos = (at - len) % 417; // One 417-byte frame after another
+        ok = fputc(pos < 4 ? frameHeader[pos] : 0x55, f) != EOF;
+    }
+    return fclose(f) == 0 && ok;
+}
+
+bool synthAlbumPath(char *out, const char *musicDir, uint32_t artist, uint32_t album) {
+    int n = snprintf(out, PATH_MAX, "%s/Artist %02u/Album %02u", musicDir, artist, album);
+    return n >= 0 && n < PATH_MAX;
+}
+
+bool synthWriteTrack(const char *musicDir, uint32_t artist, uint32_t album, uint32_t track, int take, uint32_t bytes) {
+    char dir[PATH_MAX], name[16], path[PATH_MAX], title[64], artistName[32], albumName[32];
+    snprintf(name, sizeof(name), "%02u.mp3", track);
+    snprintf(title, sizeof(title), "Take %d of %02u-%02u-%02u", take, artist, album, track);
+    snprintf(artistName, sizeof(artistName), "Artist %02u", artist);
+    snprintf(albumName, sizeof(albumName), "Album %02u", album);
+    return synthAlbumPath(dir, musicDir, artist, album) && fsJoinPath(path, dir, name) &&
+           synthWriteMp3(path, title, artistName, albumName, track, bytes);
+}
+
+bool synthWriteTree(const char *musicDir, uint32_t artists, uint32_t albums, uint32_t tracks, uint32_t bytes) {
+    for (uint32_t ar = 0; ar < artists; ++ar) {
+        for (uint32_t al = 0; al < albums; ++al) {
+            char dir[PATH_MAX], probe[PATH_MAX];
+            if (!synthAlbumPath(dir, musicDir, ar, al) || !fsJoinPath(probe, dir, "x")) return false;
+            fsMakeParents(probe);
+            for (uint32_t t = 1; t <= tracks; ++t) {
+                if (!synthWriteTrack(musicDir, ar, al, t, 1, bytes)) return false;
+            }
+        }
+    }
+    return true;
+}
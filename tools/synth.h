@@ -0,0 +1,51 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "catalog.h"
+
+// --- Synthetic Test Data ---
+// Libraries and signals made up on the spot, shared by pearscan's benchmarks
+// and the host checks (tools/check), so both run without a music folder.
+
+#define SYNTH_TRACKS_PER_ALBUM   11
+#define SYNTH_ALBUMS_PER_ARTIST  6
+
+// A linear congruential step; the same seed gives the same data everywhere.
+uint32_t synthRandom(uint32_t *state);
+
+// Fills `catalog` with a synthetic library: albums of ~11 tracks by artists
+// of ~6 albums, laid out folder by folder in a shuffled order as a scan
+// would find them. Some artists are also tagged in lower case on one album,
+// some albums are shared titles ("Greatest Hits"), and 1 in 50 tracks has
+// no tags. A third of the albums number their tracks in filename order, a
+// third in scan order with each number given twice, and the rest not at all.
+void synthCatalog(Catalog *catalog, uint32_t tracks);
+
+// Compares two catalog strings in the order the sort and group indexes use.
+int synthCompareNames(const Catalog *catalog, uint32_t a, uint32_t b);
+
+// Noise bursts of random length (0.2-3 s) and level (-60 to -5 dBFS), some
+// of them silent: a programme whose blocks land all over the loudness
+// histogram. Interleaved stereo; `seed`, `left` and `level` carry on from
+// one call to the next.
+void synthProgramme(float *pcm, uint32_t frames, uint32_t *seed, uint32_t *left, float *level);
+
+// Writes a tagged MP3 of `bytes` bytes: an ID3v2.3 tag with the three text
+// frames and, unless `track` is 0, a TRCK, then MPEG frame headers and
+// filler. Equal-length tags give equal sizes, so a file can be re-tagged
+// without its size changing.
+bool synthWriteMp3(const char *path, const char *title, const char *artist, const char *album, uint32_t track,
+                   uint32_t bytes);
+
+// A tree of such files under `musicDir`: "Artist AA/Album BB/TT.mp3", titled
+// "Take N of AA-BB-TT" and numbered TT. Writing another take re-tags a file
+// at the same size.
+bool synthAlbumPath(char *out, const char *musicDir, uint32_t artist, uint32_t album);
+bool synthWriteTrack(const char *musicDir, uint32_t artist, uint32_t album, uint32_t track, int take, uint32_t bytes);
+// `artists` x `albums` folders of `tracks` files numbered from 1, take 1 of each.
+bool synthWriteTree(const char *musicDir, uint32_t artists, uint32_t albums, uint32_t tracks, uint32_t bytes);
+
+#endif
@@ -0,0 +1,153 @@
+#include <string.h>
+
+#include "textsamples.h"
+#include "strarena.h"
+
+// Sample tag text, as UTF-8, and whether the system font can draw all of it.
+typedef struct {
+    const char *text;
+    bool noGlyphs;
+} TextSample;
+
+static const TextSample s_textSamples[] = {
+    { "Bohemian Rhapsody", false },
+    { "Queen", false },
+    { "A Night at the Opera", false },
+    { "Live at the Royal Albert Hall, London, 12 October 1997 (Remastered Deluxe Edition)", false },
+    { "Track 07   ", false },
+    { "Bj\xc3\xb6rk", false },
+    { "Sigur R\xc3\xb3s", false },
+    { "Mot\xc3\xb6rhead - No Sleep 'til Hammersmith", false },
+    { "Caf\xc3\xa9 del Mar, Vol. 3", false },
+    { "\xce\x95\xce\xbb\xce\xbb\xce\xb7\xce\xbd\xce\xb9\xce\xba\xce\xac", false },               // Greek
+    { "\xd0\x9a\xd0\xb8\xd0\xbd\xd0\xbe - \xd0\x93\xd1\x80\xd1\x83\xd0\xbf\xd0\xbf\xd0\xb0", false }, // Cyrillic
+    { "\xe5\xae\x87\xe5\xa4\x9a\xe7\x94\xb0\xe3\x83\x92\xe3\x82\xab\xe3\x83\xab", false },     // Kanji, katakana
+    { "\xe5\x88\x9d\xe9\x9f\xb3\xe3\x83\x9f\xe3\x82\xaf", false },
+    { "\xeb\xb0\xa9\xed\x83\x84\xec\x86\x8c\xeb\x85\x84\xeb\x8b\xa8", true },                 // Hangul
+    { "\xd7\xa2\xd7\x91\xd7\xa8\xd7\x99\xd7\xaa", true },                                     // Hebrew
+    { "Night Drive \xf0\x9f\x8e\xb5", true },                                                 // Emoji: a surrogate pair
+};
+#define TEXT_SAMPLE_COUNT (sizeof(s_textSamples) / sizeof(s_textSamples[0]))
+
+typedef enum {
+    TEXT_CASE_LATIN1,
+    TEXT_CASE_UTF16_LE, // With BOM
+    TEXT_CASE_UTF16_BE, // With BOM
+    TEXT_CASE_UTF16BE,  // No BOM
+    TEXT_CASE_UTF8,
+    TEXT_CASE_LATIN1_AS_UTF8, // Latin-1 bytes in a frame marked UTF-8
+    TEXT_CASE_COUNT
+} TextCase;
+
+// Decodes the (valid) UTF-8 sample at `*p`.
+static uint32_t nextCodePoint(const uint8_t **p) {
+    const uint8_t *s = *p;
+    uint32_t cp;
+    int extra;
+    if (s[0] < 0x80) { cp = s[0]; extra = 0; }
+    else if (s[0] < 0xE0) { cp = s[0] & 0x1F; extra = 1; }
+    else if (s[0] < 0xF0) { cp = s[0] & 0x0F; extra = 2; }
+    else { cp = s[0] & 0x07; extra = 3; }
+    for (int i = 1; i <= extra; ++i) cp = (cp << 6) | (s[i] & 0x3F);
+    *p = s + 1 + extra;
+    return cp;
+}
+
+static void putUnit(TextInput *in, uint32_t unit, bool bigEndian) {
+    in->data[in->len++] = (uint8_t)(bigEndian ? unit >> 8 : unit);
+    in->data[in->len++] = (uint8_t)(bigEndian ? unit : unit >> 8);
+}
+
+// Encodes `text` for `textCase`. Returns false if it can't be (Latin-1 with
+// characters past U+00FF, or mislabelled text that is plain ASCII anyway).
+static bool encodeSample(const char *text, TextCase textCase, TextInput *in) {
+    static const MetaTextEncoding encodings[TEXT_CASE_COUNT] = {
+        META_TEXT_LATIN1, META_TEXT_UTF16, META_TEXT_UTF16, META_TEXT_UTF16BE, META_TEXT_UTF8, META_TEXT_UTF8
+    };
+    in->encoding = encodings[textCase];
+    in->len = 0;
+    bool bigEndian = textCase == TEXT_CASE_UTF16_BE || textCase == TEXT_CASE_UTF16BE;
+    if (textCase == TEXT_CASE_UTF16_LE) putUnit(in, 0xFEFF, false);
+    if (textCase == TEXT_CASE_UTF16_BE) putUnit(in, 0xFEFF, true);
+    bool wide = false;
+    const uint8_t *p = (const uint8_t*)text;
+    while (*p) {
+        uint32_t cp = nextCodePoint(&p);
+        if (cp >= 0x80) wide = true;
+        switch (textCase) {
+            case TEXT_CASE_LATIN1:
+            case TEXT_CASE_LATIN1_AS_UTF8:
+                if (cp > 0xFF) return false;
+                in->data[in->len++] = (uint8_t)cp;
+                break;
+            case TEXT_CASE_UTF8:
+                break;
+            default:
+                if (cp >= 0x10000) {
+                    putUnit(in, 0xD800 + ((cp - 0x10000) >> 10), bigEndian);
+                    putUnit(in, 0xDC00 + ((cp - 0x10000) & 0x3FF), bigEndian);
+                } else {
+                    putUnit(in, cp, bigEndian);
+                }
+                break;
+        }
+    }
+    if (textCase == TEXT_CASE_UTF8) {
+        in->len = (uint32_t)strlen(text);
+        memcpy(in->data, text, in->len);
+    }
+    if (textCase == TEXT_CASE_LATIN1_AS_UTF8 && !wide) return false;
+    // Tags are often stored with their terminator
+    in->data[in->len++] = 0;
+    if (in->encoding == META_TEXT_UTF16 || in->encoding == META_TEXT_UTF16BE) in->data[in->len++] = 0;
+
+    in->expectedLen = strlen(text);
+    while (in->expectedLen > 0 && text[in->expectedLen - 1] == ' ') in->expectedLen--;
+    in->expected = text;
+    in->ascii = !wide && textCase != TEXT_CASE_LATIN1_AS_UTF8;
+    return true;
+}
+
+// Hand-made inputs for the edges: cut-off and malformed text, clipping.
+static uint32_t edgeInputs(TextInput *inputs) {
+    uint32_t n = 0;
+    TextInput *in;
+
+    in = &inputs[n++]; // A UTF-8 character cut off by the end of the field is dropped
+    *in = (TextInput){ META_TEXT_UTF8, "Caf\xc3", 4, "Caf", 3, false, false };
+    in = &inputs[n++]; // An overlong form is not UTF-8: each byte is taken as Latin-1
+    *in = (TextInput){ META_TEXT_UTF8, "A\xc0\xafZ", 4, "A\xc3\x80\xc2\xafZ", 6, false, false };
+    in = &inputs[n++]; // An unpaired surrogate becomes U+FFFD, which the font lacks
+    *in = (TextInput){ META_TEXT_UTF16BE, { 0, 'O', 0xD8, 0x3C, 0, 'K' }, 6, "O\xef\xbf\xbdK", 5, true, false };
+    in = &inputs[n++]; // Stops at the terminator, even inside a word
+    *in = (TextInput){ META_TEXT_UTF16, { 0xFF, 0xFE, 'A', 0, 'B', 0, 'C', 0, 'D', 0, 0, 0, 'E', 0 }, 14,
+                       "ABCD", 4, false, true };
+    in = &inputs[n++]; // Only spaces: nothing
+    *in = (TextInput){ META_TEXT_LATIN1, "        ", 8, NULL, 0, false, true };
+
+    // Clipped at STRARENA_MAX_LEN on a character boundary: 511 of 512 "é"
+    static char clipped[STRARENA_MAX_LEN];
+    in = &inputs[n++];
+    memset(in, 0, sizeof(*in));
+    in->encoding = META_TEXT_LATIN1;
+    memset(in->data, 0xE9, 512);
+    in->len = 512;
+    for (int i = 0; i < 511; ++i) memcpy(clipped + i * 2, "\xc3\xa9", 2);
+    in->expected = clipped;
+    in->expectedLen = 1022;
+    return n;
+}
+
+uint32_t textSampleInputs(TextInput *inputs, uint32_t *edges) {
+    uint32_t count = 0;
+    for (uint32_t s = 0; s < TEXT_SAMPLE_COUNT; ++s) {
+        for (int c = 0; c < TEXT_CASE_COUNT; ++c) {
+            TextInput *in = &inputs[count];
+            if (!encodeSample(s_textSamples[s].text, (TextCase)c, in)) continue;
+            in->noGlyphs = s_textSamples[s].noGlyphs;
+            count++;
+        }
+    }
+    *edges = edgeInputs(inputs + count);
+    return count;
+}
@@ -0,0 +1,32 @@
+#ifndef TEXTSAMPLES_H
+#define TEXTSAMPLES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "textconv.h"
+
+// --- Tag Text Samples ---
+// Titles and names in the scripts a library holds, encoded every way a tag
+// can carry them, plus hand-made edge cases, each with the UTF-8 that
+// textConvert() must give. The text conversion check holds textConvert() to
+// them; pearscan -e times it on them.
+
+typedef struct {
+    MetaTextEncoding encoding;
+    uint8_t data[512];
+    uint32_t len;
+    const char *expected; // UTF-8, trailing spaces trimmed; NULL for STRARENA_NONE
+    size_t expectedLen;
+    bool noGlyphs;
+    bool ascii;
+} TextInput;
+
+#define TEXT_SAMPLE_INPUTS_MAX 128
+
+// Fills `inputs` with every sample in every encoding it fits, then the edge
+// cases. Returns the number of samples; `*edges` edge cases follow them.
+uint32_t textSampleInputs(TextInput *inputs, uint32_t *edges);
+
+#endif